@@ -0,0 +1,168 @@
+#include "BatchInserter.h"
+#include <algorithm>
+
+namespace
+{
+    // Значений на один запрос по умолчанию: дальше выигрыш от пачки почти не растет, а текст запроса и его программа - растут
+    const int kTargetValues = 1000;
+}
+
+BatchInserter::BatchInserter(sqlite3* dbHandle, const std::string& insertHead, int columnCount, const std::string& tail, int rowsPerBatch)
+    : dbHandle_(dbHandle), insertHead_(insertHead), tail_(tail), columnCount_(std::max(1, columnCount))
+{
+    const int maxRows = std::max(1, sqlite3_limit(dbHandle_, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / columnCount_);
+    rowsPerBatch_ = rowsPerBatch > 0 ? std::min(rowsPerBatch, maxRows) : DefaultRowsPerBatch(dbHandle_, columnCount_);
+    values_.reserve(static_cast<size_t>(rowsPerBatch_) * columnCount_);
+}
+
+BatchInserter::~BatchInserter()
+{
+    Flush();
+    sqlite3_finalize(batchStmt_);
+    sqlite3_finalize(tailStmt_);
+    sqlite3_finalize(rowStmt_);
+}
+
+int BatchInserter::DefaultRowsPerBatch(sqlite3* dbHandle, int columnCount)
+{
+    columnCount = std::max(1, columnCount);
+    const int maxRows = std::max(1, sqlite3_limit(dbHandle, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / columnCount);
+    return std::max(1, std::min(kTargetValues / columnCount, maxRows));
+}
+
+BatchInserter::Value& BatchInserter::NextValue()
+{
+    values_.emplace_back();
+    ++rowValues_;
+    return values_.back();
+}
+
+void BatchInserter::BindInt64(long long value)
+{
+    Value& v = NextValue();
+    v.kind = Value::Integer;
+    v.integer = value;
+}
+
+void BatchInserter::BindDouble(double value)
+{
+    Value& v = NextValue();
+    v.kind = Value::Real;
+    v.real = value;
+}
+
+void BatchInserter::BindText(const char* value)
+{
+    if (!value)
+    {
+        BindNull();
+        return;
+    }
+    Value& v = NextValue();
+    v.kind = Value::Text;
+    v.textOffset = textBuffer_.size();
+    textBuffer_.append(value);
+    textBuffer_.push_back('\0');
+}
+
+void BatchInserter::BindBlob(const void* data, size_t size)
+{
+    Value& v = NextValue();
+    v.kind = Value::Blob;
+    v.integer = static_cast<long long>(size);
+    v.textOffset = textBuffer_.size();
+    textBuffer_.append(static_cast<const char*>(data), size);
+}
+
+void BatchInserter::BindNull()
+{
+    NextValue();
+}
+
+void BatchInserter::EndRow()
+{
+    // Строка всегда занимает columnCount_ значений: лишние отбрасываются, недостающие - NULL
+    if (rowValues_ > columnCount_) values_.resize(values_.size() - (rowValues_ - columnCount_));
+    while (rowValues_ < columnCount_) BindNull();
+    rowValues_ = 0;
+    if (static_cast<int>(values_.size()) >= rowsPerBatch_ * columnCount_) WriteRows(rowsPerBatch_);
+}
+
+void BatchInserter::Flush()
+{
+    if (rowValues_ > 0) EndRow();
+    if (!values_.empty()) WriteRows(static_cast<int>(values_.size()) / columnCount_);
+}
+
+sqlite3_stmt* BatchInserter::PrepareStatement(int rowCount)
+{
+    std::string row = "(?";
+    for (int i = 1; i < columnCount_; ++i) row += ",?";
+    row += ")";
+
+    std::string sql = insertHead_ + " VALUES " + row;
+    sql.reserve(sql.size() + static_cast<size_t>(rowCount) * (row.size() + 1) + tail_.size() + 2);
+    for (int i = 1; i < rowCount; ++i) sql += "," + row;
+    if (!tail_.empty()) sql += " " + tail_;
+    sql += ";";
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        if (error_.empty()) error_ = sqlite3_errmsg(dbHandle_);
+        sqlite3_finalize(stmt);
+        return nullptr;
+    }
+    return stmt;
+}
+
+void BatchInserter::WriteRows(int rowCount)
+{
+    sqlite3_stmt* stmt;
+    if (rowCount == rowsPerBatch_)
+    {
+        if (!batchStmt_) batchStmt_ = PrepareStatement(rowCount);
+        stmt = batchStmt_;
+    }
+    else
+    {
+        if (!tailStmt_ || tailRows_ != rowCount)
+        {
+            sqlite3_finalize(tailStmt_);
+            tailStmt_ = PrepareStatement(rowCount);
+            tailRows_ = rowCount;
+        }
+        stmt = tailStmt_;
+    }
+
+    if (stmt && !Execute(stmt, 0, rowCount) && rowCount > 1)
+    {
+        // Запрос с ошибкой не вставляет ни одной строки: повторяем по одной, чтобы потерять только ошибочные (как без пачек)
+        if (!rowStmt_) rowStmt_ = PrepareStatement(1);
+        for (int row = 0; rowStmt_ && row < rowCount; ++row) Execute(rowStmt_, row, 1);
+    }
+    values_.clear();
+    textBuffer_.clear();
+}
+
+bool BatchInserter::Execute(sqlite3_stmt* stmt, int firstRow, int rowCount)
+{
+    // Все параметры запроса переписываются, поэтому sqlite3_clear_bindings не нужен
+    const int first = firstRow * columnCount_;
+    for (int i = 0; i < rowCount * columnCount_; ++i)
+    {
+        const Value& v = values_[first + i];
+        switch (v.kind)
+        {
+        case Value::Integer: sqlite3_bind_int64(stmt, i + 1, v.integer); break;
+        case Value::Real: sqlite3_bind_double(stmt, i + 1, v.real); break;
+        case Value::Text: sqlite3_bind_text(stmt, i + 1, textBuffer_.c_str() + v.textOffset, -1, SQLITE_STATIC); break;
+        case Value::Blob: sqlite3_bind_blob(stmt, i + 1, textBuffer_.data() + v.textOffset, static_cast<int>(v.integer), SQLITE_STATIC); break;
+        default: sqlite3_bind_null(stmt, i + 1); break;
+        }
+    }
+    const bool done = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!done && error_.empty()) error_ = sqlite3_errmsg(dbHandle_);
+    sqlite3_reset(stmt);
+    return done;
+}
@@ -0,0 +1,91 @@
+#pragma once // Защита от двойного включения
+
+#include <string>
+#include <vector>
+#include "sqlite3.h"
+
+/// <summary>
+/// Вставка строк пачками: N строк копятся в памяти и пишутся одним запросом INSERT ... VALUES (...), (...), ...
+/// Один sqlite3_step на пачку вместо одного на строку.
+///
+///   BatchInserter inserter(db, "INSERT INTO \"T\" (\"a\", \"b\")", 2);
+///   inserter.BindInt64(1); inserter.BindText(name); inserter.EndRow();
+///   ...
+///   inserter.Flush(); // до COMMIT
+///
+/// Значения строки задаются по порядку колонок. Текст и Blob копируются, поэтому указатель может
+/// стать недействительным сразу после вызова. Порядок вставки строк сохраняется
+/// (важно для ON CONFLICT с условием "строго больше"). Если пачка не записалась (например, повтор ключа),
+/// ее строки записываются по одной, и теряются только ошибочные строки.
+/// </summary>
+class BatchInserter
+{
+public:
+    /// <summary>
+    /// insertHead - запрос до VALUES; tail - то, что идет после списка строк (например, ON CONFLICT ...).
+    /// rowsPerBatch = 0 - размер пачки подбирается по ширине таблицы (DefaultRowsPerBatch).
+    /// </summary>
+    BatchInserter(sqlite3* dbHandle, const std::string& insertHead, int columnCount, const std::string& tail = "", int rowsPerBatch = 0);
+    ~BatchInserter();
+
+    BatchInserter(const BatchInserter&) = delete;
+    BatchInserter& operator=(const BatchInserter&) = delete;
+
+    void BindInt64(long long value);
+    void BindDouble(double value);
+    void BindText(const char* value);
+    void BindText(const std::string& value) { BindText(value.c_str()); }
+    void BindBlob(const void* data, size_t size);
+    void BindNull();
+
+    /// <summary>
+    /// Завершает строку; полная пачка сразу записывается. Недостающие значения строки - NULL.
+    /// </summary>
+    void EndRow();
+
+    /// <summary>
+    /// Записывает накопленные строки. Вызывается перед COMMIT (деструктор тоже вызывает Flush).
+    /// </summary>
+    void Flush();
+
+    /// <summary>
+    /// Текст первой ошибки SQLite (пусто, если ошибок не было).
+    /// </summary>
+    const std::string& Error() const { return error_; }
+
+    int RowsPerBatch() const { return rowsPerBatch_; }
+
+    /// <summary>
+    /// Размер пачки для таблицы из columnCount колонок: около kTargetValues значений на запрос,
+    /// но не больше лимита переменных SQLite (SQLITE_LIMIT_VARIABLE_NUMBER).
+    /// </summary>
+    static int DefaultRowsPerBatch(sqlite3* dbHandle, int columnCount);
+
+private:
+    struct Value
+    {
+        enum Kind : unsigned char { Null, Integer, Real, Text, Blob } kind = Null;
+        long long integer = 0; // Для Blob - размер в байтах
+        double real = 0.0;
+        size_t textOffset = 0; // Смещение в textBuffer_ (текст и Blob)
+    };
+
+    sqlite3_stmt* PrepareStatement(int rowCount);
+    Value& NextValue();
+    void WriteRows(int rowCount);
+    bool Execute(sqlite3_stmt* stmt, int firstRow, int rowCount);
+
+    sqlite3* dbHandle_;
+    std::string insertHead_;
+    std::string tail_;
+    int columnCount_;
+    int rowsPerBatch_;
+    sqlite3_stmt* batchStmt_ = nullptr; // Запрос на полную пачку
+    sqlite3_stmt* tailStmt_ = nullptr;  // Запрос на остаток (последний использованный размер)
+    sqlite3_stmt* rowStmt_ = nullptr;   // Запрос на одну строку (после ошибки в пачке)
+    int tailRows_ = 0;
+    std::vector<Value> values_;
+    std::string textBuffer_;
+    int rowValues_ = 0; // Значений в текущей строке
+    std::string error_;
+};
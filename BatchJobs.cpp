@@ -0,0 +1,56 @@
+#include "BatchJobs.h"
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+int RunJobs(const std::vector<CommandLine>& jobs, ThreadPool& pool, const JobFunction& runJob)
+{
+    std::atomic<int> failedJobs{ 0 };
+    std::mutex outputMutex;
+    const bool bufferOutput = pool.Size() > 1;
+
+    std::vector<std::future<void>> results;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        results.push_back(pool.Submit([&, i]()
+        {
+            std::ostringstream buffer;
+            std::ostream& log = bufferOutput ? static_cast<std::ostream&>(buffer) : std::cout;
+            log << "\n=== Job " << (i + 1) << " of " << jobs.size() << " ===\n";
+
+            bool success = false;
+            try
+            {
+                success = runJob(jobs[i], i, log);
+            }
+            catch (const std::exception& e)
+            {
+                log << "CRITICAL ERROR: " << e.what() << "\n";
+            }
+            if (!success)
+            {
+                ++failedJobs;
+                log << "Job " << (i + 1) << " FAILED.\n";
+            }
+
+            if (bufferOutput)
+            {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cout << buffer.str() << std::flush;
+            }
+        }));
+    }
+    for (auto& result : results) result.get();
+
+    std::cout << "\nJobs finished: " << jobs.size() - failedJobs << " succeeded, " << failedJobs << " failed." << std::endl;
+    return failedJobs;
+}
+
+fs::path JobReportPath(const fs::path& reportPath, size_t jobIndex)
+{
+    if (reportPath.empty()) return reportPath;
+    fs::path jobPath = reportPath;
+    jobPath.replace_filename(reportPath.stem().string() + ".job" + std::to_string(jobIndex + 1) + reportPath.extension().string());
+    return jobPath;
+}
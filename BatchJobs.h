@@ -0,0 +1,26 @@
+#pragma once // Защита от двойного включения
+
+#include <functional>
+#include <ostream>
+#include <vector>
+#include "CommandLine.h"
+#include "ThreadPool.h"
+
+/// <summary>
+/// Выполняет одно задание: аргументы задания, его номер (с нуля) и поток для вывода. Возвращает true при успехе.
+/// </summary>
+using JobFunction = std::function<bool(const CommandLine& job, size_t jobIndex, std::ostream& log)>;
+
+/// <summary>
+/// Выполняет задания job-файла на общем пуле потоков в одном процессе.
+/// Если в пуле один поток, вывод идет прямо в std::cout; иначе вывод каждого задания
+/// буферизуется и печатается целиком после его завершения, чтобы строки разных заданий не перемешивались.
+/// Возвращает количество неудачных заданий.
+/// </summary>
+int RunJobs(const std::vector<CommandLine>& jobs, ThreadPool& pool, const JobFunction& runJob);
+
+/// <summary>
+/// Путь к JSON-отчету задания: общий --report превращается в report.job1.json, report.job2.json, ...
+/// чтобы задания не перезаписывали отчеты друг друга.
+/// </summary>
+fs::path JobReportPath(const fs::path& reportPath, size_t jobIndex);
@@ -0,0 +1,841 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "EnvelopeBuilder.h"
+#include "EnvelopeAnalyzer.h"
+#include "DbUtils.h"
+#include "csv_to_db.h"
+#include "RunStats.h"
+#include "QuantileSketch.h"
+#include "SqliteAccess.h"
+#include "SyntheticDbGenerator.h"
+#include "TableDigest.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+/// <summary>
+/// Точка масштаба бенчмарка: имя и параметры синтетического набора.
+/// </summary>
+struct ScalePoint
+{
+    std::string name;
+    SyntheticDatasetSpec spec;
+};
+
+/// <summary>
+/// Замеряемый вариант: действие и его выходные базы в папке набора. Если задан sameAs, выходные базы после замера
+/// должны совпасть с результатом варианта sameAs (например, оба способа огибания дают одну огибающую),
+/// иначе бенчмарк завершается с ошибкой: ускорение не должно менять результат.
+/// </summary>
+struct BenchCase
+{
+    std::string name;
+    std::function<void()> action;
+    std::vector<std::string> outputs;
+    std::string sameAs;
+};
+
+/// <summary>
+/// Буфер, который отбрасывает весь вывод (для подавления консольного вывода утилит во время замеров).
+/// </summary>
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+};
+
+/// <summary>
+/// Стандартные точки масштаба.
+/// </summary>
+static std::vector<ScalePoint> DefaultScalePoints()
+{
+    std::vector<ScalePoint> points(3);
+    points[0].name = "small";
+    points[0].spec.fileCount = 4;  points[0].spec.tablesPerFile = 2; points[0].spec.elementCount = 2000;   points[0].spec.setsPerTable = 4;
+    points[1].name = "medium";
+    points[1].spec.fileCount = 8;  points[1].spec.tablesPerFile = 4; points[1].spec.elementCount = 20000;  points[1].spec.setsPerTable = 4;
+    points[2].name = "large";
+    points[2].spec.fileCount = 16; points[2].spec.tablesPerFile = 4; points[2].spec.elementCount = 100000; points[2].spec.setsPerTable = 8;
+    return points;
+}
+
+static std::string DescribeSpec(const SyntheticDatasetSpec& spec)
+{
+    std::stringstream ss;
+    ss << "files=" << spec.fileCount << " tables=" << spec.tablesPerFile << " elements=" << spec.elementCount
+       << " sets=" << spec.setsPerTable << " shells=" << spec.shellFraction << " seed=" << spec.seed;
+    return ss.str();
+}
+
+/// <summary>
+/// Удаляет результаты всех утилит, чтобы каждый замер начинался с одинакового состояния папки.
+/// </summary>
+static void CleanOutputs(const fs::path& dataDir)
+{
+    for (const char* name : { "Envelope.db", "Envelope_Summed.db", "Enveloped_Reinforcement_Analysis.db", "Enveloped_Reinforcement_Analysis.csv", "__temp_envelope.db" })
+    {
+        fs::remove(dataDir / name);
+    }
+    fs::remove_all(dataDir / "csv_extracted");
+}
+
+/// <summary>
+/// Вытесняет исходные .db файлы папки из файлового кэша ОС, чтобы следующий замер читал их с диска ("холодный" кэш).
+/// В Windows не поддерживается (main отключает --cold).
+/// </summary>
+static void EvictFromPageCache(const fs::path& dataDir)
+{
+#ifdef _WIN32
+    (void)dataDir;
+#else
+    for (const auto& entry : fs::directory_iterator(dataDir))
+    {
+        if (entry.path().extension() != ".db") continue;
+        int fd = open(entry.path().c_str(), O_RDONLY);
+        if (fd < 0) continue;
+        fdatasync(fd); // Грязные страницы не вытесняются
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+/// <summary>
+/// Генерирует набор, если он еще не создан с теми же параметрами (параметры хранятся в spec.txt).
+/// </summary>
+static void PrepareDataset(const fs::path& dataDir, const SyntheticDatasetSpec& spec)
+{
+    const std::string description = DescribeSpec(spec);
+    std::ifstream stampIn(dataDir / "spec.txt");
+    std::string existing;
+    if (stampIn.is_open() && std::getline(stampIn, existing) && existing == description) return;
+    stampIn.close();
+
+    std::cout << "  Generating dataset (" << description << ")..." << std::endl;
+    fs::remove_all(dataDir);
+    Stopwatch timer;
+    long long rows = GenerateSyntheticDataset(dataDir, spec);
+    std::ofstream(dataDir / "spec.txt") << description << "\n";
+    std::cout << "  Generated " << rows << " result rows in " << timer.Seconds() << " s" << std::endl;
+}
+
+/// <summary>
+/// Текст значения колонки текущей строки для сообщения о расхождении.
+/// </summary>
+static std::string DescribeValue(sqlite3_stmt* stmt, int column)
+{
+    if (sqlite3_column_type(stmt, column) == SQLITE_NULL) return "NULL";
+    return "'" + std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, column))) + "'";
+}
+
+/// <summary>
+/// Запрос строк таблицы для сравнения, отсортированных по всем колонкам. Номера файлов и таблиц в Envelope Provenance
+/// зависят от порядка чтения (например, у частей --shard и у огибания всей папки), поэтому вместо них сравниваются имена.
+/// </summary>
+static std::string ComparisonSql(const std::string& table, size_t columnCount)
+{
+    if (table == "Envelope Provenance")
+    {
+        return "SELECT p.elemId, p.\"column\", f.name, t.name, p.setN FROM \"Envelope Provenance\" p"
+               " LEFT JOIN \"Envelope Provenance Files\" f ON f.fileId = p.fileId"
+               " LEFT JOIN \"Envelope Provenance Tables\" t ON t.tableId = p.tableId ORDER BY 1, 2";
+    }
+    if (table == "Envelope Provenance Files" || table == "Envelope Provenance Tables") return "SELECT name FROM \"" + table + "\" ORDER BY 1";
+
+    std::string sql = SqliteConnection::SelectAllSql(table);
+    if (!sql.empty() && sql.back() == ';') sql.pop_back();
+    for (size_t c = 0; c < columnCount; ++c) sql += (c == 0 ? " ORDER BY " : ", ") + std::to_string(c + 1);
+    return sql;
+}
+
+/// <summary>
+/// Сравнивает содержимое двух баз: те же таблицы, колонки и строки (в порядке сортировки по всем колонкам,
+/// поэтому порядок записи строк не важен), значения - вместе с типом и точно, без допуска.
+/// Возвращает описание первого расхождения или пустую строку, если базы одинаковы.
+/// </summary>
+static std::string FirstDifference(const fs::path& expectedPath, const fs::path& actualPath)
+{
+    SqliteConnection expected(expectedPath, ReadProfile());
+    SqliteConnection actual(actualPath, ReadProfile());
+    if (!expected.IsOpen()) return "cannot open " + expectedPath.string() + ": " + expected.OpenError();
+    if (!actual.IsOpen()) return "cannot open " + actualPath.string() + ": " + actual.OpenError();
+
+    std::vector<std::string> tables = expected.TableNames();
+    std::vector<std::string> actualTables = actual.TableNames();
+    std::sort(tables.begin(), tables.end());
+    std::sort(actualTables.begin(), actualTables.end());
+    if (tables != actualTables) return "different tables";
+
+    for (const auto& table : tables)
+    {
+        const std::vector<std::string>& columns = expected.ColumnNames(table);
+        if (columns != actual.ColumnNames(table)) return "table '" + table + "': different columns";
+        const std::string sql = ComparisonSql(table, columns.size());
+
+        StatementLease expectedRows = expected.Prepare(sql);
+        StatementLease actualRows = actual.Prepare(sql);
+        if (!expectedRows || !actualRows) return "table '" + table + "': cannot read";
+        for (long long row = 1;; ++row)
+        {
+            const bool expectedHasRow = sqlite3_step(expectedRows.Get()) == SQLITE_ROW;
+            const bool actualHasRow = sqlite3_step(actualRows.Get()) == SQLITE_ROW;
+            if (expectedHasRow != actualHasRow) return "table '" + table + "': different row counts";
+            if (!expectedHasRow) break;
+            for (int c = 0; c < sqlite3_column_count(expectedRows.Get()); ++c)
+            {
+                const int type = sqlite3_column_type(expectedRows.Get(), c);
+                bool same = type == sqlite3_column_type(actualRows.Get(), c);
+                if (same && type == SQLITE_INTEGER) same = sqlite3_column_int64(expectedRows.Get(), c) == sqlite3_column_int64(actualRows.Get(), c);
+                else if (same && type == SQLITE_FLOAT) same = sqlite3_column_double(expectedRows.Get(), c) == sqlite3_column_double(actualRows.Get(), c);
+                else if (same && type != SQLITE_NULL)
+                {
+                    const int bytes = sqlite3_column_bytes(expectedRows.Get(), c);
+                    same = bytes == sqlite3_column_bytes(actualRows.Get(), c)
+                        && std::memcmp(sqlite3_column_blob(expectedRows.Get(), c), sqlite3_column_blob(actualRows.Get(), c), bytes) == 0;
+                }
+                if (!same)
+                {
+                    return "table '" + table + "', sorted row " + std::to_string(row) + ", column " + sqlite3_column_name(expectedRows.Get(), c) + ": "
+                        + DescribeValue(expectedRows.Get(), c) + " vs " + DescribeValue(actualRows.Get(), c);
+                }
+            }
+        }
+    }
+    return "";
+}
+
+/// <summary>
+/// Печатает строку результата замера. Скорость в строках в секунду не печатается, если время не измерилось (0 с).
+/// </summary>
+static void PrintMeasurement(const std::string& name, double seconds, long long rows)
+{
+    std::cout << "  " << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << seconds << " s";
+    if (seconds > 0.0) std::cout << std::setw(14) << std::setprecision(0) << rows / seconds << " rows/s";
+    std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+/// <summary>
+/// Выполняет действие с подавленным консольным выводом.
+/// </summary>
+static void RunQuietly(const std::function<void()>& action)
+{
+    NullBuffer nullBuffer;
+    std::streambuf* savedOut = std::cout.rdbuf(&nullBuffer);
+    try
+    {
+        action();
+    }
+    catch (...)
+    {
+        std::cout.rdbuf(savedOut);
+        throw;
+    }
+    std::cout.rdbuf(savedOut);
+}
+
+/// <summary>
+/// Запускает действие repeat раз с подавленным выводом и возвращает лучшее время.
+/// </summary>
+static double TimeBest(int repeat, const std::function<void()>& prepare, const std::function<void()>& action)
+{
+    double best = 0.0;
+    for (int i = 0; i < repeat; ++i)
+    {
+        prepare();
+        Stopwatch timer;
+        RunQuietly(action);
+        double seconds = timer.Seconds();
+        if (i == 0 || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+// --- Проверки (--check) ---
+
+static void Require(bool condition, const std::string& message)
+{
+    if (!condition) throw std::runtime_error("Check failed: " + message);
+}
+
+static void RequireSameDatabase(const fs::path& expected, const fs::path& actual, const std::string& what)
+{
+    std::string difference = FirstDifference(expected, actual);
+    Require(difference.empty(), what + " (" + difference + ")");
+}
+
+/// <summary>
+/// Части огибающей (--shard) для частей папки, собранные Merge, должны дать те же Envelope.db и Envelope_Summed.db,
+/// что и огибание всей папки за один запуск. Проверяется с настройками по умолчанию и с --bounds absmax --provenance
+/// (ничьи по модулю и источник значения при равных значениях разных частей).
+/// </summary>
+static void CheckShardMerge(const fs::path& dataDir, const SyntheticDatasetSpec& spec, const fs::path& checkDir)
+{
+    const int parts = std::min(3, spec.fileCount);
+    for (int variant = 0; variant < 2; ++variant)
+    {
+        Builder::BuildOptions options;
+        if (variant == 1)
+        {
+            options.bounds = Builder::EnvelopeBounds::MinMaxAbs;
+            options.trackProvenance = true;
+        }
+        fs::remove_all(checkDir);
+        const fs::path wholeDir = checkDir / "whole";
+        fs::create_directories(wholeDir);
+        std::vector<fs::path> shards;
+        for (int part = 0; part < parts; ++part)
+        {
+            // Часть - подряд идущие файлы, части по порядку файлов
+            const fs::path partDir = checkDir / ("part" + std::to_string(part + 1));
+            fs::create_directories(partDir);
+            for (int f = part * spec.fileCount / parts; f < (part + 1) * spec.fileCount / parts; ++f)
+            {
+                fs::copy_file(dataDir / SyntheticDbFileName(f), partDir / SyntheticDbFileName(f));
+                fs::copy_file(dataDir / SyntheticDbFileName(f), wholeDir / SyntheticDbFileName(f));
+            }
+            Builder::BuildOptions shardOptions = options;
+            shardOptions.shardPath = checkDir / ("part" + std::to_string(part + 1) + ".shard");
+            bool built = false;
+            RunQuietly([&]() { built = Builder::EnvelopeBuilder(shardOptions).Run(partDir); });
+            Require(built, "shard " + shardOptions.shardPath.filename().string() + " was not written");
+            shards.push_back(shardOptions.shardPath);
+        }
+
+        bool built = false;
+        RunQuietly([&]() { built = Builder::EnvelopeBuilder(options).Run(wholeDir); });
+        Require(built, "the envelope of the whole folder was not built");
+
+        Builder::BuildOptions mergeOptions;
+        mergeOptions.outputPath = checkDir / "merged";
+        fs::create_directories(mergeOptions.outputPath);
+        RunQuietly([&]() { built = Builder::EnvelopeBuilder(mergeOptions).Merge(shards); });
+        Require(built, "the shards were not merged");
+
+        for (const char* output : { "Envelope.db", "Envelope_Summed.db" })
+        {
+            RequireSameDatabase(wholeDir / output, mergeOptions.outputPath / output,
+                                std::string("merged ") + output + " differs from the single run" + (variant == 1 ? " (--bounds absmax --provenance)" : ""));
+        }
+    }
+    fs::remove_all(checkDir);
+}
+
+/// <summary>
+/// Набор для процентилей (QuantileSketch), который части передают через файл: Serialize и Deserialize восстанавливают
+/// его без изменений, слияние восстановленных наборов равно слиянию исходных, пока все центроиды точные (значений
+/// не больше kCapacity разных) процентили слитых частей равны процентилям всех значений, в остальных случаях
+/// ошибка по рангу невелика. Байты чужого формата отклоняются.
+/// </summary>
+static void CheckQuantileSketch()
+{
+    using Builder::QuantileSketch;
+    auto roundTrip = [](const QuantileSketch& sketch)
+    {
+        unsigned char bytes[QuantileSketch::kMaxSerializedSize];
+        unsigned char again[QuantileSketch::kMaxSerializedSize];
+        const size_t size = sketch.Serialize(bytes);
+        QuantileSketch copy;
+        Require(copy.Deserialize(bytes, size), "a serialized sketch was not read back");
+        Require(copy.Serialize(again) == size && std::memcmp(bytes, again, size) == 0, "the sketch changed in a Serialize/Deserialize round trip");
+        return copy;
+    };
+    auto sameBytes = [](const QuantileSketch& a, const QuantileSketch& b)
+    {
+        unsigned char first[QuantileSketch::kMaxSerializedSize];
+        unsigned char second[QuantileSketch::kMaxSerializedSize];
+        const size_t size = a.Serialize(first);
+        return b.Serialize(second) == size && std::memcmp(first, second, size) == 0;
+    };
+    const double levels[] = { 0.0, 0.05, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99, 1.0 };
+
+    // Мало разных значений (как нули и несколько типовых площадей): все центроиды точные
+    {
+        QuantileSketch first, second, all;
+        for (int i = 0; i < 1000; ++i)
+        {
+            const double value = (i * 7) % 11 == 0 ? 0.0 : 1e-4 * ((i * 13) % 9);
+            (i % 3 == 0 ? first : second).Add(value);
+            all.Add(value);
+        }
+        QuantileSketch merged = roundTrip(first);
+        merged.MergeFrom(roundTrip(second));
+        Require(merged.Count() == all.Count(), "merged sketch has a wrong count");
+        for (double q : levels) Require(merged.Quantile(q) == all.Quantile(q), "exact percentile " + std::to_string(q) + " changed by the merge");
+    }
+
+    // Много разных значений: оценка по рангу близка к точному процентилю
+    {
+        std::vector<double> values;
+        QuantileSketch parts[4];
+        for (int i = 0; i < 20000; ++i)
+        {
+            const double value = i % 4 == 0 ? 0.0 : 1e-6 * ((i * 7919) % 10007);
+            values.push_back(static_cast<float>(value));
+            parts[i % 4].Add(value);
+        }
+        std::sort(values.begin(), values.end());
+        QuantileSketch merged, mergedOriginals;
+        for (const auto& part : parts)
+        {
+            merged.MergeFrom(roundTrip(part));
+            mergedOriginals.MergeFrom(part);
+        }
+        Require(sameBytes(merged, mergedOriginals), "merging deserialized sketches differs from merging the originals");
+        Require(merged.Count() == static_cast<double>(values.size()), "merged sketch has a wrong count");
+        for (double q : levels)
+        {
+            const double estimate = merged.Quantile(q);
+            const double rank = static_cast<double>(std::lower_bound(values.begin(), values.end(), static_cast<float>(estimate)) - values.begin()) / values.size();
+            const double upperRank = static_cast<double>(std::upper_bound(values.begin(), values.end(), static_cast<float>(estimate)) - values.begin()) / values.size();
+            Require(q >= rank - 0.05 && q <= upperRank + 0.05, "percentile " + std::to_string(q) + " of the merged sketch is far off (" + std::to_string(estimate) + ")");
+        }
+    }
+
+    unsigned char bytes[QuantileSketch::kMaxSerializedSize];
+    QuantileSketch sketch;
+    sketch.Add(1.0);
+    const size_t size = sketch.Serialize(bytes);
+    bytes[0] = QuantileSketch::kFormatVersion + 1;
+    Require(!QuantileSketch().Deserialize(bytes, size), "a sketch of another format version was accepted");
+    Require(!QuantileSketch().Deserialize(bytes, size - 1), "a truncated sketch was accepted");
+}
+
+/// <summary>
+/// Выполняет SQL в базе, открытой для записи; ошибка SQL - ошибка проверки.
+/// </summary>
+static void ExecuteOrFail(SqliteConnection& connection, const std::string& sql)
+{
+    char* errorMessage = nullptr;
+    const bool executed = sqlite3_exec(connection.Handle(), sql.c_str(), nullptr, nullptr, &errorMessage) == SQLITE_OK;
+    const std::string error = errorMessage ? errorMessage : "";
+    sqlite3_free(errorMessage);
+    Require(executed, "could not prepare " + connection.Path().filename().string() + ": " + error);
+}
+
+/// <summary>
+/// Хэш строк таблицы через SELECT: rowid, тип и байты каждого значения в порядке rowid (FNV-1a).
+/// Равенство таких хэшей - равенство того, что вернет SELECT *.
+/// </summary>
+static std::pair<uint64_t, long long> SelectTableHash(SqliteConnection& connection, const std::string& tableName)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void* data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= static_cast<const unsigned char*>(data)[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    long long rows = 0;
+    StatementLease statement = connection.Prepare("SELECT rowid, * FROM \"" + tableName + "\" ORDER BY rowid;");
+    Require(static_cast<bool>(statement), "could not read " + tableName);
+    sqlite3_stmt* stmt = statement.Get();
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        ++rows;
+        for (int c = 0; c < sqlite3_column_count(stmt); ++c)
+        {
+            const unsigned char type = static_cast<unsigned char>(sqlite3_column_type(stmt, c));
+            add(&type, 1);
+            if (type == SQLITE_INTEGER)
+            {
+                const sqlite3_int64 value = sqlite3_column_int64(stmt, c);
+                add(&value, sizeof(value));
+            }
+            else if (type == SQLITE_FLOAT)
+            {
+                const double value = sqlite3_column_double(stmt, c);
+                add(&value, sizeof(value));
+            }
+            else if (type != SQLITE_NULL)
+            {
+                const int size = sqlite3_column_bytes(stmt, c);
+                add(&size, sizeof(size));
+                add(sqlite3_column_blob(stmt, c), static_cast<size_t>(size));
+            }
+        }
+    }
+    return { hash, rows };
+}
+
+/// <summary>
+/// Отпечаток таблицы по страницам B-дерева (ContentTableDigest) сравнивается с хэшем строк через SELECT на небольшой
+/// базе: строки с длинными значениями (на страницах переполнения), NULL, копии таблицы с другой раскладкой по
+/// страницам (INSERT ... SELECT, удаленные строки, другой page_size) и таблицы, отличающиеся одним байтом в конце
+/// длинного значения или только типом значения (3 и 3.0). Для каждой пары таблиц отпечатки должны совпадать
+/// тогда и только тогда, когда совпадают хэши SELECT, а у равных таблиц должны совпадать и выборочные отпечатки.
+/// </summary>
+static void CheckTableDigest(const fs::path& checkDir)
+{
+    fs::remove_all(checkDir);
+    fs::create_directories(checkDir);
+    const fs::path mainPath = checkDir / "digest.db";
+    const fs::path smallPagesPath = checkDir / "digest_1k_pages.db";
+    {
+        SqliteConnection db(mainPath, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+        Require(db.IsOpen(), "could not create " + mainPath.string());
+        // Значение из 6000 и более байт не помещается на страницу 4096 байт и уходит на страницы переполнения
+        ExecuteOrFail(db,
+            "PRAGMA page_size = 4096;"
+            "CREATE TABLE a (n, label TEXT, payload BLOB);"
+            "WITH RECURSIVE i(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM i WHERE x < 300)"
+            " INSERT INTO a SELECT x, 'row ' || x, CASE WHEN x % 7 = 0 THEN NULL WHEN x % 5 = 0 THEN x || ':' || hex(zeroblob(3000 + x)) ELSE hex(zeroblob(x)) END FROM i;"
+            "CREATE TABLE copied (n, label TEXT, payload BLOB);"
+            "INSERT INTO copied (rowid, n, label, payload) SELECT rowid, * FROM a;"
+            "CREATE TABLE rewritten (n, label TEXT, payload BLOB);"
+            "INSERT INTO rewritten (rowid, n, label, payload) SELECT rowid + 1000, * FROM a;"
+            "INSERT INTO rewritten (rowid, n, label, payload) SELECT rowid, * FROM a;"
+            "DELETE FROM rewritten WHERE rowid > 1000;"
+            "CREATE TABLE edited (n, label TEXT, payload BLOB);"
+            "INSERT INTO edited (rowid, n, label, payload) SELECT rowid, * FROM a;"
+            "UPDATE edited SET payload = substr(payload, 1, length(payload) - 1) || '1' WHERE rowid = 10;"
+            "CREATE TABLE retyped (n, label TEXT, payload BLOB);"
+            "INSERT INTO retyped (rowid, n, label, payload) SELECT rowid, * FROM a;"
+            "UPDATE retyped SET n = n + 0.0 WHERE rowid = 3;"
+            "CREATE TABLE empty (n, label TEXT, payload BLOB);");
+    }
+    {
+        SqliteConnection db(smallPagesPath, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+        Require(db.IsOpen(), "could not create " + smallPagesPath.string());
+        ExecuteOrFail(db,
+            "PRAGMA page_size = 1024;"
+            "ATTACH DATABASE '" + mainPath.generic_string() + "' AS source;"
+            "CREATE TABLE a (n, label TEXT, payload BLOB);"
+            "INSERT INTO a (rowid, n, label, payload) SELECT rowid, * FROM source.a;"
+            "DETACH DATABASE source;");
+    }
+
+    struct DigestedTable
+    {
+        std::string name;
+        TableDigest content;
+        TableDigest sample;
+        std::pair<uint64_t, long long> selected;
+    };
+    std::vector<DigestedTable> tables;
+    for (const fs::path& path : { mainPath, smallPagesPath })
+    {
+        SqliteConnection db(path, ReadProfile());
+        Require(db.IsOpen(), "could not open " + path.string());
+        for (const auto& tableName : db.TableNames())
+        {
+            DigestedTable table;
+            table.name = path.filename().string() + "/" + tableName;
+            Require(ContentTableDigest(path, db.Handle(), tableName, table.content), "no page digest for " + table.name);
+            Require(SampleTableDigest(db, tableName, 16, table.sample), "no sample digest for " + table.name);
+            table.selected = SelectTableHash(db, tableName);
+            Require(table.content.rows == table.selected.second, "page digest of " + table.name + " counts a wrong number of rows");
+            tables.push_back(std::move(table));
+        }
+    }
+    Require(tables.size() == 7, "unexpected tables in the digest test databases");
+
+    int equalPairs = 0;
+    for (size_t i = 0; i < tables.size(); ++i)
+    {
+        for (size_t j = i + 1; j < tables.size(); ++j)
+        {
+            const bool sameRows = tables[i].selected == tables[j].selected;
+            Require((tables[i].content == tables[j].content) == sameRows,
+                    "page digests of " + tables[i].name + " and " + tables[j].name + (sameRows ? " differ for the same rows" : " match for different rows"));
+            if (sameRows) Require(tables[i].sample == tables[j].sample, "sample digests of the equal tables " + tables[i].name + " and " + tables[j].name + " differ");
+            if (sameRows) ++equalPairs;
+        }
+    }
+    // a, copied, rewritten и a из базы со страницами 1 КБ - одна таблица
+    Require(equalPairs == 6, "the test tables do not have the expected copies");
+    fs::remove_all(checkDir);
+}
+
+/// <summary>
+/// Пропуск копий таблиц (BuildOptions::deduplicateTables) не меняет результат: к набору добавляются точная копия
+/// файла и копия с одним увеличенным значением в одной таблице (ее нельзя пропускать: она меняет огибающую), и
+/// огибающие с пропуском и без него (--no-dedup) должны совпасть, с --provenance тоже. Пропущены должны быть
+/// все таблицы точной копии и все неизмененные таблицы второй копии.
+/// </summary>
+static void CheckDeduplication(const fs::path& dataDir, const SyntheticDatasetSpec& spec, const fs::path& checkDir)
+{
+    fs::remove_all(checkDir);
+    const fs::path sourceDir = checkDir / "sources";
+    fs::create_directories(sourceDir);
+    for (int f = 0; f < spec.fileCount; ++f) fs::copy_file(dataDir / SyntheticDbFileName(f), sourceDir / SyntheticDbFileName(f));
+    const fs::path copyPath = sourceDir / "SYNTH_000_copy.db";
+    const fs::path editedPath = sourceDir / "SYNTH_000_edited.db";
+    fs::copy_file(dataDir / SyntheticDbFileName(0), copyPath);
+    fs::copy_file(dataDir / SyntheticDbFileName(0), editedPath);
+    {
+        SqliteConnection edited(editedPath, SQLITE_OPEN_READWRITE);
+        Require(edited.IsOpen(), "could not open " + editedPath.string());
+        std::string tableName;
+        for (const auto& name : edited.TableNames())
+        {
+            if (name != "Elements") tableName = name;
+        }
+        const std::string column = SyntheticReinforcementColumns().front();
+        ExecuteOrFail(edited, "UPDATE \"" + tableName + "\" SET \"" + column + "\" = \"" + column + "\" + 1"
+                              " WHERE rowid = (SELECT MAX(rowid) / 2 + 1 FROM \"" + tableName + "\");");
+    }
+
+    for (int variant = 0; variant < 2; ++variant)
+    {
+        std::string skippedLog;
+        for (bool deduplicate : { true, false })
+        {
+            Builder::BuildOptions options;
+            options.trackProvenance = variant == 1;
+            options.deduplicateTables = deduplicate;
+            options.outputPath = checkDir / (deduplicate ? "dedup" : "no-dedup");
+            fs::create_directories(options.outputPath);
+            std::ostringstream log;
+            options.log = &log;
+            bool built = false;
+            RunQuietly([&]() { built = Builder::EnvelopeBuilder(options).Run(sourceDir); });
+            Require(built, std::string("the envelope was not built") + (deduplicate ? "" : " with --no-dedup"));
+            if (deduplicate) skippedLog = log.str();
+        }
+
+        int skipped = 0;
+        for (size_t position = skippedLog.find("    Skipped '"); position != std::string::npos; position = skippedLog.find("    Skipped '", position + 1)) ++skipped;
+        Require(skipped == 2 * spec.tablesPerFile - 1, "expected " + std::to_string(2 * spec.tablesPerFile - 1) + " skipped copies, the builder skipped " + std::to_string(skipped));
+        for (const char* output : { "Envelope.db", "Envelope_Summed.db" })
+        {
+            RequireSameDatabase(checkDir / "no-dedup" / output, checkDir / "dedup" / output,
+                                std::string(output) + " with skipped copies differs from --no-dedup" + (variant == 1 ? " (--provenance)" : ""));
+        }
+    }
+    fs::remove_all(checkDir);
+}
+
+/// <summary>
+/// Запускает проверки результатов на наборе точки масштаба. Ошибка проверки - исключение.
+/// </summary>
+static void RunChecks(const fs::path& dataDir, const SyntheticDatasetSpec& spec, const fs::path& checkDir)
+{
+    const std::vector<std::pair<std::string, std::function<void()>>> checks = {
+        { "shard-merge", [&]() { CheckShardMerge(dataDir, spec, checkDir); } },
+        { "quantile-sketch", []() { CheckQuantileSketch(); } },
+        { "table-digest", [&]() { CheckTableDigest(checkDir); } },
+        { "dedup", [&]() { CheckDeduplication(dataDir, spec, checkDir); } },
+    };
+    for (const auto& check : checks)
+    {
+        check.second();
+        std::cout << "  " << std::left << std::setw(18) << check.first << std::right << "OK" << std::endl;
+    }
+}
+
+static void PrintUsage()
+{
+    std::cout << "Usage: FEDOR_Benchmark [options]\n"
+              << "  --dir <path>       Working directory for datasets (default: ./fedor_bench)\n"
+              << "  --scale <name>     small | medium | large | all (default: small)\n"
+              << "  --files N --tables N --elements N --sets N --shells F --seed N\n"
+              << "                     Custom scale point instead of the predefined ones\n"
+              << "  --repeat N         Repetitions per measurement, best time is reported (default: 3)\n"
+              << "  --cold             Evict the source files from the OS file cache before every repetition\n"
+              << "  --report <file>    Write results as JSON\n"
+              << "  --check            Check results on the datasets instead of timing (shard merge, quantile sketches, table digests, dedup)\n";
+}
+
+int main(int argc, char* argv[])
+{
+    fs::path workDir = "fedor_bench";
+    std::string scaleName = "small";
+    int repeat = 3;
+    fs::path reportPath;
+    bool customScale = false;
+    bool coldCache = false;
+    bool checkOnly = false;
+    ScalePoint custom{ "custom", {} };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto nextValue = [&]() -> std::string
+        {
+            if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+            return argv[++i];
+        };
+        try
+        {
+            if (arg == "--dir") workDir = nextValue();
+            else if (arg == "--scale") scaleName = nextValue();
+            else if (arg == "--repeat") repeat = std::max(1, std::stoi(nextValue()));
+            else if (arg == "--report") reportPath = nextValue();
+            else if (arg == "--cold") coldCache = true;
+            else if (arg == "--check") checkOnly = true;
+            else if (arg == "--files") { custom.spec.fileCount = std::stoi(nextValue()); customScale = true; }
+            else if (arg == "--tables") { custom.spec.tablesPerFile = std::stoi(nextValue()); customScale = true; }
+            else if (arg == "--elements") { custom.spec.elementCount = std::stoi(nextValue()); customScale = true; }
+            else if (arg == "--sets") { custom.spec.setsPerTable = std::stoi(nextValue()); customScale = true; }
+            else if (arg == "--shells") { custom.spec.shellFraction = std::stod(nextValue()); customScale = true; }
+            else if (arg == "--seed") { custom.spec.seed = std::stoull(nextValue()); customScale = true; }
+            else if (arg == "--help" || arg == "-h") { PrintUsage(); return 0; }
+            else throw std::invalid_argument("Unknown option " + arg);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    std::vector<ScalePoint> points;
+    if (customScale)
+    {
+        points.push_back(custom);
+    }
+    else
+    {
+        for (const auto& point : DefaultScalePoints())
+        {
+            if (scaleName == "all" || scaleName == point.name) points.push_back(point);
+        }
+        if (points.empty())
+        {
+            std::cerr << "ERROR: Unknown scale '" << scaleName << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "--- FEDOR Benchmark ---" << std::endl;
+#ifdef _WIN32
+    if (coldCache)
+    {
+        std::cout << "Cold-cache runs are not supported on this platform; measuring with a warm cache." << std::endl;
+        coldCache = false;
+    }
+#endif
+    const std::string passSuffix = coldCache ? "-cold" : "";
+    RunStats results("FEDOR_Benchmark");
+    results.SetReportPath(reportPath);
+
+    try
+    {
+        for (const auto& point : points)
+        {
+            std::cout << "\nScale '" << point.name << "': " << DescribeSpec(point.spec) << std::endl;
+            fs::path dataDir = workDir / point.name;
+            PrepareDataset(dataDir, point.spec);
+            if (checkOnly)
+            {
+                RunChecks(dataDir, point.spec, workDir / (point.name + "-check"));
+                continue;
+            }
+            const long long rows = static_cast<long long>(point.spec.fileCount) * point.spec.tablesPerFile * point.spec.setsPerTable * point.spec.elementCount;
+            const fs::path csvDir = dataDir / "csv_extracted";
+
+            const std::vector<std::string> builderOutputs = { "Envelope.db", "Envelope_Summed.db" };
+            const std::vector<std::string> analyzerOutputs = { "Enveloped_Reinforcement_Analysis.db" };
+            std::vector<BenchCase> cases;
+            cases.push_back({ "builder", [&]() { Builder::EnvelopeBuilder builder; builder.Run(dataDir); }, builderOutputs, "" });
+            for (auto engine : { Builder::EnvelopeEngine::Loop, Builder::EnvelopeEngine::Sql })
+            {
+                cases.push_back({ engine == Builder::EnvelopeEngine::Loop ? "builder-loop" : "builder-sql", [&dataDir, engine]()
+                {
+                    Builder::BuildOptions options;
+                    options.engine = engine;
+                    Builder::EnvelopeBuilder builder(options);
+                    builder.Run(dataDir);
+                }, builderOutputs, "builder" });
+            }
+            cases.push_back({ "analyzer-memory", [&]()
+            {
+                EnvelopeAnalyzer::Options options;
+                options.mode = EnvelopeAnalyzer::Mode::InMemory;
+                EnvelopeAnalyzer analyzer(options);
+                analyzer.Run(dataDir);
+            }, analyzerOutputs, "" });
+            cases.push_back({ "analyzer-disk", [&]()
+            {
+                EnvelopeAnalyzer::Options options;
+                options.mode = EnvelopeAnalyzer::Mode::OnDisk;
+                EnvelopeAnalyzer analyzer(options);
+                analyzer.Run(dataDir);
+            }, analyzerOutputs, "analyzer-memory" });
+            cases.push_back({ "db-to-csv", [&]()
+            {
+                fs::create_directory(csvDir);
+                for (int f = 0; f < point.spec.fileCount; ++f) ProcessDatabaseFile(dataDir / SyntheticDbFileName(f), csvDir);
+            }, {}, "" });
+
+            // Результаты эталонных вариантов хранятся вне папки набора, чтобы не попасть в исходные файлы
+            const fs::path referenceDir = workDir / (point.name + "-reference");
+            fs::remove_all(referenceDir);
+
+            for (const auto& benchCase : cases)
+            {
+                double seconds = TimeBest(repeat,
+                    [&]()
+                    {
+                        CleanOutputs(dataDir);
+                        if (coldCache) EvictFromPageCache(dataDir);
+                    },
+                    benchCase.action);
+                results.AddPass(point.name + "/" + benchCase.name + passSuffix, seconds);
+                PrintMeasurement(benchCase.name, seconds, rows);
+
+                // Результат последнего повтора: эталон сохраняется, остальные варианты сравниваются с ним
+                for (const auto& output : benchCase.outputs)
+                {
+                    if (benchCase.sameAs.empty())
+                    {
+                        fs::create_directories(referenceDir / benchCase.name);
+                        fs::copy_file(dataDir / output, referenceDir / benchCase.name / output, fs::copy_options::overwrite_existing);
+                        continue;
+                    }
+                    std::string difference = FirstDifference(referenceDir / benchCase.sameAs / output, dataDir / output);
+                    if (!difference.empty())
+                    {
+                        throw std::runtime_error("Result mismatch: " + output + " of " + benchCase.name + " differs from " + benchCase.sameAs + " (" + difference + ")");
+                    }
+                }
+            }
+            fs::remove_all(referenceDir);
+
+            // CSV -> DB измеряется на файлах, выгруженных предыдущим шагом
+            double csvSeconds = TimeBest(repeat,
+                [&]()
+                {
+                    for (int f = 0; f < point.spec.fileCount; ++f) fs::remove(csvDir / SyntheticDbFileName(f));
+                },
+                [&]()
+                {
+                    for (const auto& group : GroupCsvFilesByPrefix(csvDir)) CreateDatabaseFromGroup(csvDir, group.first, group.second);
+                });
+            results.AddPass(point.name + "/csv-to-db" + passSuffix, csvSeconds);
+            PrintMeasurement("csv-to-db", csvSeconds, rows);
+
+            CleanOutputs(dataDir);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "\nCRITICAL ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (!results.WriteJsonReport())
+    {
+        std::cerr << "ERROR: Could not write report: " << reportPath.string() << std::endl;
+        return 1;
+    }
+    std::cout << (checkOnly ? "\nAll checks passed." : "\nBenchmark complete!") << std::endl;
+    return 0;
+}
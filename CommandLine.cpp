@@ -0,0 +1,144 @@
+#include "CommandLine.h"
+#include <fstream>
+#include <stdexcept>
+
+CommandLine::CommandLine(const std::vector<std::string>& tokens, const std::set<std::string>& valueOptions, const std::set<std::string>& flagOptions)
+{
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        const std::string& token = tokens[i];
+        if (token.size() > 2 && token.compare(0, 2, "--") == 0)
+        {
+            if (flagOptions.count(token))
+            {
+                options_[token] = "1";
+            }
+            else if (valueOptions.count(token))
+            {
+                if (i + 1 >= tokens.size()) throw std::invalid_argument("Missing value for option " + token);
+                options_[token] = tokens[++i];
+            }
+            else
+            {
+                throw std::invalid_argument("Unknown option " + token);
+            }
+        }
+        else
+        {
+            positional_.push_back(token);
+        }
+    }
+}
+
+CommandLine::CommandLine(int argc, char* argv[], const std::set<std::string>& valueOptions, const std::set<std::string>& flagOptions)
+    : CommandLine(std::vector<std::string>(argv + (argc > 0 ? 1 : 0), argv + argc), valueOptions, flagOptions)
+{
+}
+
+std::string CommandLine::Get(const std::string& name, const std::string& defaultValue) const
+{
+    auto it = options_.find(name);
+    return it != options_.end() ? it->second : defaultValue;
+}
+
+int CommandLine::GetInt(const std::string& name, int defaultValue) const
+{
+    auto it = options_.find(name);
+    if (it == options_.end()) return defaultValue;
+    try
+    {
+        return std::stoi(it->second);
+    }
+    catch (const std::exception&)
+    {
+        throw std::invalid_argument("Option " + name + " expects a number, got '" + it->second + "'");
+    }
+}
+
+double CommandLine::GetDouble(const std::string& name, double defaultValue) const
+{
+    auto it = options_.find(name);
+    if (it == options_.end()) return defaultValue;
+    try
+    {
+        return std::stod(it->second);
+    }
+    catch (const std::exception&)
+    {
+        throw std::invalid_argument("Option " + name + " expects a number, got '" + it->second + "'");
+    }
+}
+
+CommandLine CommandLine::MergedWith(const CommandLine& overrides) const
+{
+    CommandLine merged = *this;
+    for (const auto& option : overrides.options_) merged.options_[option.first] = option.second;
+    merged.positional_ = overrides.positional_;
+    return merged;
+}
+
+std::vector<std::string> TokenizeCommandLine(const std::string& line)
+{
+    std::vector<std::string> tokens;
+    std::string current;
+    bool inQuotes = false;
+    bool hasToken = false;
+    for (char c : line)
+    {
+        if (c == '"')
+        {
+            inQuotes = !inQuotes;
+            hasToken = true;
+        }
+        else if ((c == ' ' || c == '\t' || c == '\r') && !inQuotes)
+        {
+            if (hasToken) tokens.push_back(current);
+            current.clear();
+            hasToken = false;
+        }
+        else
+        {
+            current += c;
+            hasToken = true;
+        }
+    }
+    if (inQuotes) throw std::invalid_argument("Unterminated quote in: " + line);
+    if (hasToken) tokens.push_back(current);
+    return tokens;
+}
+
+std::vector<CommandLine> ReadJobFile(const fs::path& jobFilePath, const std::set<std::string>& valueOptions, const std::set<std::string>& flagOptions)
+{
+    std::ifstream jobFile(jobFilePath);
+    if (!jobFile.is_open()) throw std::runtime_error("Could not open job file: " + jobFilePath.string());
+
+    std::vector<CommandLine> jobs;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(jobFile, line))
+    {
+        ++lineNumber;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+        try
+        {
+            jobs.emplace_back(TokenizeCommandLine(line), valueOptions, flagOptions);
+        }
+        catch (const std::invalid_argument& e)
+        {
+            throw std::invalid_argument(jobFilePath.filename().string() + ":" + std::to_string(lineNumber) + ": " + e.what());
+        }
+    }
+    return jobs;
+}
+
+fs::path FolderArgument(const CommandLine& args)
+{
+    if (args.Positional().size() > 1) throw std::invalid_argument("Expected one directory, got " + std::to_string(args.Positional().size()) + " arguments");
+    fs::path folder = args.Positional().empty() ? fs::path(".") : fs::path(args.Positional().front());
+    if (!fs::exists(folder) || !fs::is_directory(folder))
+    {
+        throw std::invalid_argument("Path does not exist or is not a directory: " + folder.string());
+    }
+    return folder;
+}
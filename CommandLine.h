@@ -0,0 +1,64 @@
+#pragma once // Защита от двойного включения
+
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/// <summary>
+/// Разобранные аргументы командной строки: позиционные аргументы и опции вида "--name value" или "--flag".
+/// Неизвестная опция или опция без значения приводят к std::invalid_argument.
+/// </summary>
+class CommandLine
+{
+public:
+    CommandLine() = default;
+
+    /// <summary>
+    /// valueOptions - опции со значением, flagOptions - опции-переключатели без значения.
+    /// </summary>
+    CommandLine(const std::vector<std::string>& tokens, const std::set<std::string>& valueOptions, const std::set<std::string>& flagOptions);
+
+    CommandLine(int argc, char* argv[], const std::set<std::string>& valueOptions, const std::set<std::string>& flagOptions);
+
+    /// <summary>
+    /// True, если не передано ни одного аргумента (утилита запущена двойным щелчком).
+    /// </summary>
+    bool Empty() const { return options_.empty() && positional_.empty(); }
+
+    bool Has(const std::string& name) const { return options_.count(name) != 0; }
+    std::string Get(const std::string& name, const std::string& defaultValue = "") const;
+    int GetInt(const std::string& name, int defaultValue) const;
+    double GetDouble(const std::string& name, double defaultValue) const;
+    const std::vector<std::string>& Positional() const { return positional_; }
+
+    /// <summary>
+    /// Возвращает копию, в которой опции из overrides заменяют текущие, а позиционные аргументы берутся из overrides.
+    /// Используется для строк job-файла поверх общих опций запуска.
+    /// </summary>
+    CommandLine MergedWith(const CommandLine& overrides) const;
+
+private:
+    std::map<std::string, std::string> options_;
+    std::vector<std::string> positional_;
+};
+
+/// <summary>
+/// Разбивает строку на аргументы по пробелам с учетом кавычек ("C:\My Data" - один аргумент).
+/// </summary>
+std::vector<std::string> TokenizeCommandLine(const std::string& line);
+
+/// <summary>
+/// Читает job-файл: одно задание на строку (папка и опции в том же формате, что и в командной строке).
+/// Пустые строки и строки, начинающиеся с '#', пропускаются.
+/// </summary>
+std::vector<CommandLine> ReadJobFile(const fs::path& jobFilePath, const std::set<std::string>& valueOptions, const std::set<std::string>& flagOptions);
+
+/// <summary>
+/// Папка из позиционного аргумента ("." если не задана). Бросает std::invalid_argument, если это не папка
+/// или передано больше одного позиционного аргумента.
+/// </summary>
+fs::path FolderArgument(const CommandLine& args);
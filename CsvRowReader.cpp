@@ -0,0 +1,120 @@
+#include "CsvRowReader.h"
+#include <cctype>
+#include <charconv>
+#include <cstring>
+
+namespace Builder
+{
+    namespace
+    {
+        const size_t kBlockSize = 1 << 20;
+
+        /**
+         * @brief Parses a whole field as a number: optional spaces, sign, digits with an optional point and exponent.
+         * "inf", "nan" and hexadecimal forms are not numbers here (SQLite keeps them as text).
+         */
+        bool ParseNumber(const char* begin, const char* end, double& value)
+        {
+            while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+            while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) --end;
+            if (begin < end && *begin == '+') ++begin;
+            const char* digits = begin < end && *begin == '-' ? begin + 1 : begin;
+            if (digits == end || !(std::isdigit(static_cast<unsigned char>(*digits)) || *digits == '.')) return false;
+            const std::from_chars_result result = std::from_chars(begin, end, value);
+            return result.ec == std::errc() && result.ptr == end;
+        }
+    }
+
+    CsvRowReader::CsvRowReader(char separator)
+        : separator_(separator)
+    {
+    }
+
+    bool CsvRowReader::Open(const fs::path& path)
+    {
+        file_.open(path, std::ios::binary);
+        if (!file_.is_open()) return false;
+        buffer_.resize(kBlockSize);
+
+        char* begin = nullptr;
+        char* end = nullptr;
+        if (!ReadLine(begin, end)) return false;
+        if (end - begin >= 3 && std::memcmp(begin, "\xEF\xBB\xBF", 3) == 0) begin += 3;
+        const size_t count = SplitLine(begin, end);
+        for (size_t i = 0; i < count; ++i) columnNames_.emplace_back(fields_[i].first, fields_[i].second);
+        values_.assign(columnNames_.size(), 0.0);
+        return !columnNames_.empty();
+    }
+
+    bool CsvRowReader::Next()
+    {
+        char* begin = nullptr;
+        char* end = nullptr;
+        while (ReadLine(begin, end))
+        {
+            if (begin == end) continue;
+            if (SplitLine(begin, end) == columnNames_.size()) return true;
+            ++skippedRows_;
+        }
+        return false;
+    }
+
+    bool CsvRowReader::Numeric(int column)
+    {
+        return ParseNumber(fields_[column].first, fields_[column].second, values_[column]);
+    }
+
+    long long CsvRowReader::Int64(int column) const
+    {
+        const char* begin = fields_[column].first;
+        const char* end = fields_[column].second;
+        long long value = 0;
+        const std::from_chars_result result = std::from_chars(begin, end, value);
+        if (result.ec == std::errc() && result.ptr == end) return value;
+        double number = 0.0;
+        return ParseNumber(begin, end, number) ? static_cast<long long>(number) : 0;
+    }
+
+    bool CsvRowReader::ReadLine(char*& begin, char*& end)
+    {
+        for (;;)
+        {
+            char* data = buffer_.data();
+            char* newline = static_cast<char*>(std::memchr(data + position_, '\n', filled_ - position_));
+            if (newline || (endOfFile_ && position_ < filled_))
+            {
+                begin = data + position_;
+                end = newline ? newline : data + filled_;
+                position_ = static_cast<size_t>(end - data) + (newline ? 1 : 0);
+                if (end > begin && end[-1] == '\r') --end;
+                return true;
+            }
+            if (endOfFile_) return false;
+
+            // The unfinished line moves to the front; a line longer than the buffer doubles it
+            const size_t rest = filled_ - position_;
+            if (position_ > 0) std::memmove(data, data + position_, rest);
+            position_ = 0;
+            filled_ = rest;
+            if (filled_ == buffer_.size()) buffer_.resize(buffer_.size() * 2);
+            file_.read(buffer_.data() + filled_, static_cast<std::streamsize>(buffer_.size() - filled_));
+            filled_ += static_cast<size_t>(file_.gcount());
+            endOfFile_ = !file_;
+        }
+    }
+
+    size_t CsvRowReader::SplitLine(char* begin, char* end)
+    {
+        // A separator at the end of the line does not start another field (as with std::getline)
+        fields_.clear();
+        const char* field = begin;
+        while (field < end)
+        {
+            const char* separator = static_cast<const char*>(std::memchr(field, separator_, static_cast<size_t>(end - field)));
+            if (!separator) separator = end;
+            fields_.emplace_back(field, separator);
+            field = separator + 1;
+        }
+        return fields_.size();
+    }
+}
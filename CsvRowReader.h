@@ -0,0 +1,97 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace Builder
+{
+    /**
+     * @class CsvRowReader
+     * @brief Streaming reader of the solver's result exports: separator-delimited text with a header line
+     * (setN;elemId;elemType;As1Ti;... or elemId;elemType;... for Elements), as written next to the .db results.
+     *
+     * The file is read in large blocks and split in place, so a row costs one scan for the line end and the
+     * separators; numbers are only parsed for the fields that are asked for. The reader offers the same row
+     * interface as a SQLite statement (Next, Numeric, Double, Int64, Text), so both feed the same envelope loop.
+     * A field is numeric if it is an integer or a decimal number with a point (spaces around it are ignored);
+     * empty fields and text, including decimal commas, are not numeric, as they would stay TEXT in SQLite.
+     * Fields are not quoted. Rows whose field count differs from the header are skipped, like the CSV import does.
+     */
+    class CsvRowReader
+    {
+    public:
+        explicit CsvRowReader(char separator = ';');
+
+        CsvRowReader(const CsvRowReader&) = delete;
+        CsvRowReader& operator=(const CsvRowReader&) = delete;
+
+        /**
+         * @brief Opens the file and reads the header line (a UTF-8 byte order mark is skipped).
+         * @return False if the file cannot be opened or has no header.
+         */
+        bool Open(const fs::path& path);
+
+        const std::vector<std::string>& ColumnNames() const { return columnNames_; }
+
+        /**
+         * @brief Moves to the next row. Fields of the row stay valid until the next call.
+         * @return False at the end of the file.
+         */
+        bool Next();
+
+        /**
+         * @brief Parses a field of the current row; the value is then returned by Double.
+         * @return True if the field is a number.
+         */
+        bool Numeric(int column);
+
+        /**
+         * @return The value parsed by the last Numeric call for the column.
+         */
+        double Double(int column) const { return values_[column]; }
+
+        /**
+         * @return The field as an integer (a decimal number is truncated), 0 if it is not a number.
+         */
+        long long Int64(int column) const;
+
+        /**
+         * @return The field as it is written (an empty field is empty, like NULL read as text from SQLite).
+         */
+        std::string_view Text(int column) const { return std::string_view(fields_[column].first, static_cast<size_t>(fields_[column].second - fields_[column].first)); }
+
+        /**
+         * @return The number of rows skipped because of a wrong field count.
+         */
+        long long SkippedRows() const { return skippedRows_; }
+
+    private:
+        /**
+         * @brief Finds the next line in the buffer, reading more of the file when needed.
+         * @return False at the end of the file.
+         */
+        bool ReadLine(char*& begin, char*& end);
+
+        /**
+         * @brief Splits a line into fields_; returns the number of fields.
+         */
+        size_t SplitLine(char* begin, char* end);
+
+        std::ifstream file_;
+        char separator_;
+        std::vector<char> buffer_;
+        size_t position_ = 0; // Start of the unread data in buffer_
+        size_t filled_ = 0;   // End of the data in buffer_
+        bool endOfFile_ = false;
+        std::vector<std::string> columnNames_;
+        std::vector<std::pair<const char*, const char*>> fields_;
+        std::vector<double> values_;
+        long long skippedRows_ = 0;
+    };
+}
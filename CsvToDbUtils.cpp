@@ -1,5 +1,6 @@
-#include "DbUtils.h"
+#include "csv_to_db.h"
 #include "sqlite3.h"
+#include "BatchInserter.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -83,10 +84,10 @@ std::map<std::string, std::vector<fs::path>> GroupCsvFilesByPrefix(const fs::pat
     return fileGroups;
 }
 
-void CreateDatabaseFromGroup(const fs::path& targetDir, const std::string& dbName, const std::vector<fs::path>& csvFiles)
+void CreateDatabaseFromGroup(const fs::path& targetDir, const std::string& dbName, const std::vector<fs::path>& csvFiles, RunStats* stats)
 {
     fs::path dbPath = targetDir / (dbName + ".db");
-    std::cout << "\nCreating database: " << dbPath.filename().string() << std::endl;
+    std::cout << "\nCreating database: " << dbPath.filename().string() << "\n";
 
     sqlite3* dbHandle;
     if (sqlite3_open(dbPath.string().c_str(), &dbHandle) != SQLITE_OK)
@@ -105,28 +106,34 @@ void CreateDatabaseFromGroup(const fs::path& targetDir, const std::string& dbNam
         size_t lastUnderscorePos = filename.find_last_of('_');
         std::string tableName = filename.substr(lastUnderscorePos + 1);
 
-        std::cout << "  - Processing file: " << csvPath.filename().string() << " -> table: '" << tableName << "'" << std::endl;
+        std::cout << "  - Processing file: " << csvPath.filename().string() << " -> table: '" << tableName << "'\n";
 
         std::ifstream csvFile(csvPath);
         if (!csvFile.is_open()) continue;
 
         std::string headerLine;
         if (!std::getline(csvFile, headerLine)) continue;
+
+        // Статистика файла - после чтения заголовка, чтобы пропущенные файлы не попадали в отчет
+        RunStats::FileStats* fileStats = stats ? &stats->BeginFile("convert", csvPath) : nullptr;
         
         std::vector<std::string> csvHeaders = SplitString(headerLine, ';');
         
         std::string createTableSql;
-        std::string insertSql;
+        std::string insertSql; // Запрос до VALUES: строки вставляются пачками
+        int insertColumns = static_cast<int>(csvHeaders.size());
         
         if (tableName == "Elements")
         {
             createTableSql = R"(CREATE TABLE "Elements" ("elemId" INT, "elemType" INT, "CGrade" TEXT, "SLGrade" TEXT, "STGrade" TEXT, "CSType" INT, "b1" REAL, "h1" REAL, "a1" REAL, "a2" REAL, "t1" REAL, "t2" REAL, "reinfStep1" REAL, "reinfStep2" REAL, "a3" REAL, "a4" REAL, PRIMARY KEY("elemId"));)";
-            insertSql = R"(INSERT INTO "Elements" ("elemId", "elemType", "CGrade", "SLGrade", "STGrade", "CSType", "b1", "h1", "a1", "a2", "t1", "t2", "reinfStep1", "reinfStep2", "a3", "a4") VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);)";
+            insertSql = R"(INSERT INTO "Elements" ("elemId", "elemType", "CGrade", "SLGrade", "STGrade", "CSType", "b1", "h1", "a1", "a2", "t1", "t2", "reinfStep1", "reinfStep2", "a3", "a4"))";
+            insertColumns = 16;
         }
         else if (tableName == "Enveloped Reinforcement")
         {
             createTableSql = R"(CREATE TABLE "Enveloped Reinforcement" ("setN" INT, "elemId" INT, "elemType" INT, "As1Ti" REAL, "As1Tj" REAL, "As1Bi" REAL, "As1Bj" REAL, "As2Ti" REAL, "As2Tj" REAL, "As2Bi" REAL, "As2Bj" REAL, "Asw1i" REAL, "Asw1j" REAL, "Asw2i" REAL, "Asw2j" REAL, "Reinf1" REAL, "Reinf2" REAL, "Crack1i" REAL, "Crack1j" REAL, "Crack2i" REAL, "Crack2j" REAL, "Sw1i" REAL, "Sw1j" REAL, "Sw2i" REAL, "Sw2j" REAL, "ls1i" REAL, "ls1j" REAL, "ls2i" REAL, "ls2j" REAL, CONSTRAINT "fk_elements" FOREIGN KEY("elemId") REFERENCES "Elements"("elemId"), PRIMARY KEY("elemId"));)";
-            insertSql = R"(INSERT INTO "Enveloped Reinforcement" ("setN", "elemId", "elemType", "As1Ti", "As1Tj", "As1Bi", "As1Bj", "As2Ti", "As2Tj", "As2Bi", "As2Bj", "Asw1i", "Asw1j", "Asw2i", "Asw2j", "Reinf1", "Reinf2", "Crack1i", "Crack1j", "Crack2i", "Crack2j", "Sw1i", "Sw1j", "Sw2i", "Sw2j", "ls1i", "ls1j", "ls2i", "ls2j") VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);)";
+            insertSql = R"(INSERT INTO "Enveloped Reinforcement" ("setN", "elemId", "elemType", "As1Ti", "As1Tj", "As1Bi", "As1Bj", "As2Ti", "As2Tj", "As2Bi", "As2Bj", "Asw1i", "Asw1j", "Asw2i", "Asw2j", "Reinf1", "Reinf2", "Crack1i", "Crack1j", "Crack2i", "Crack2j", "Sw1i", "Sw1j", "Sw2i", "Sw2j", "ls1i", "ls1j", "ls2i", "ls2j"))";
+            insertColumns = 29;
         }
         else // Блок для всех остальных, обычных таблиц
         {
@@ -139,7 +146,7 @@ void CreateDatabaseFromGroup(const fs::path& targetDir, const std::string& dbNam
 
             std::stringstream createSqlStream, insertSqlStream;
             createSqlStream << "CREATE TABLE IF NOT EXISTS \"" << tableName << "\" (";
-            insertSqlStream << "INSERT INTO \"" << tableName << "\" VALUES (";
+            insertSqlStream << "INSERT INTO \"" << tableName << "\"";
             for (size_t i = 0; i < csvHeaders.size(); ++i)
             {
                 std::string colType = "TEXT";
@@ -147,10 +154,8 @@ void CreateDatabaseFromGroup(const fs::path& targetDir, const std::string& dbNam
                     colType = InferDataType(firstDataValues[i]);
                 }
                 createSqlStream << "\"" << csvHeaders[i] << "\" " << colType << (i == csvHeaders.size() - 1 ? "" : ", ");
-                insertSqlStream << "?" << (i == csvHeaders.size() - 1 ? "" : ",");
             }
             createSqlStream << ");";
-            insertSqlStream << ");";
             createTableSql = createSqlStream.str();
             insertSql = insertSqlStream.str();
             
@@ -162,28 +167,27 @@ void CreateDatabaseFromGroup(const fs::path& targetDir, const std::string& dbNam
         sqlite3_exec(dbHandle, createTableSql.c_str(), 0, 0, &errMsg);
         if (errMsg) { LogSqliteError("Failed to create table", dbHandle); sqlite3_free(errMsg); errMsg = nullptr; }
 
-        sqlite3_stmt* insertStmt;
-        if (sqlite3_prepare_v2(dbHandle, insertSql.c_str(), -1, &insertStmt, nullptr) != SQLITE_OK)
-        {
-            LogSqliteError("Failed to prepare insert statement", dbHandle);
-            continue;
-        }
+        BatchInserter inserter(dbHandle, insertSql, insertColumns);
 
         std::string dataLine;
+        long long rowCount = 0;
         while (std::getline(csvFile, dataLine))
         {
             if (dataLine.empty()) continue;
             std::vector<std::string> values = SplitString(dataLine, ';');
             if (values.size() != csvHeaders.size()) continue;
+            ++rowCount;
 
-            for (size_t i = 0; i < values.size(); ++i)
-            {
-                sqlite3_bind_text(insertStmt, i + 1, values[i].c_str(), -1, SQLITE_TRANSIENT);
-            }
-            if (sqlite3_step(insertStmt) != SQLITE_DONE) LogSqliteError("Failed to execute insert step", dbHandle);
-            sqlite3_reset(insertStmt);
+            for (const auto& value : values) inserter.BindText(value);
+            inserter.EndRow();
+        }
+        inserter.Flush();
+        if (!inserter.Error().empty()) std::cerr << "  ERROR: Failed to insert rows: " << inserter.Error() << std::endl;
+        if (fileStats)
+        {
+            fileStats->AddTable(tableName, rowCount, fileStats->timer.Seconds());
+            stats->EndFile(*fileStats, nullptr);
         }
-        sqlite3_finalize(insertStmt);
     }
 
     sqlite3_exec(dbHandle, "COMMIT;", 0, 0, &errMsg);
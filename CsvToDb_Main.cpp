@@ -1,28 +1,39 @@
 #include <iostream>
 #include <string>
 #include <filesystem>
-#include "DbUtils.h" // Подключаем наши утилиты
+#include "csv_to_db.h" // Подключаем наши утилиты
+#include "CommandLine.h"
+#include "BatchJobs.h"
 
 namespace fs = std::filesystem;
 
-int main()
-{
-    std::cout << "--- CSV to DB Converter ---" << std::endl;
-
-    std::cout << "Enter path to directory with .csv files (or '.' for current directory): ";
-    std::string inputPathStr;
-    std::getline(std::cin, inputPathStr);
-
-    fs::path targetPath = inputPathStr.empty() || inputPathStr == "." ? "." : inputPathStr;
+// Опции командной строки конвертера
+static const std::set<std::string> kValueOptions = { "--output", "--report", "--jobs" };
+static const std::set<std::string> kFlagOptions = { "--help" };
 
-    if (!fs::exists(targetPath) || !fs::is_directory(targetPath))
-    {
-        std::cerr << "ERROR: Path does not exist or is not a directory: " << inputPathStr << std::endl;
-        return 1;
-    }
+static void PrintUsage()
+{
+    std::cout << "Usage: FEDOR_CSV_To_DB [<folder>] [options]\n"
+              << "       FEDOR_CSV_To_DB --jobs <job file> [options]\n"
+              << "  <folder>           Directory with .csv files (default: current directory)\n"
+              << "  --output <dir>     Directory for the created .db files (default: <folder>)\n"
+              << "  --report <file>    Write a JSON timing report\n"
+              << "  --jobs <file>      Convert one folder per line of the job file (folder and options per line)\n"
+              << "Without arguments the converter asks for the folder interactively and waits for Enter at exit.\n";
+}
 
+/// <summary>
+/// Собирает базы данных из всех групп CSV файлов папки. Возвращает true при успехе.
+/// </summary>
+static bool ConvertFolder(const fs::path& targetPath, const fs::path& outputDir, const fs::path& reportPath)
+{
+    RunStats stats("FEDOR_CSV_To_DB");
+    stats.SetReportPath(reportPath.empty() ? RunStats::ReportPathFromEnvironment() : reportPath);
     try
     {
+        RunStats::ScopedTimer timer(stats, "convert");
+        fs::create_directories(outputDir);
+
         // 1. Группируем все CSV файлы по префиксам
         auto fileGroups = GroupCsvFilesByPrefix(targetPath);
 
@@ -35,18 +46,82 @@ int main()
             // 2. Для каждой группы создаем свою базу данных
             for (const auto& group : fileGroups)
             {
-                CreateDatabaseFromGroup(targetPath, group.first, group.second);
+                CreateDatabaseFromGroup(outputDir, group.first, group.second, &stats);
             }
         }
     }
     catch (const std::exception& e)
     {
         std::cerr << "An unexpected error occurred: " << e.what() << std::endl;
-        return 1;
+        return false;
     }
 
     std::cout << "\nConversion complete!" << std::endl;
+    stats.PrintSummary(std::cout);
+    if (!stats.WriteJsonReport())
+    {
+        std::cerr << "ERROR: Could not write timing report: " << stats.GetReportPath().string() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    std::cout << "--- CSV to DB Converter ---" << std::endl;
+
+    try
+    {
+        CommandLine args(argc, argv, kValueOptions, kFlagOptions);
+        if (args.Has("--help"))
+        {
+            PrintUsage();
+            return 0;
+        }
+
+        if (args.Has("--jobs"))
+        {
+            // Задания выполняются последовательно: конвертер пишет прямо в консоль
+            std::vector<CommandLine> jobs = ReadJobFile(args.Get("--jobs"), kValueOptions, kFlagOptions);
+            ThreadPool pool(1);
+            int failed = RunJobs(jobs, pool, [&](const CommandLine& job, size_t jobIndex, std::ostream&)
+            {
+                CommandLine jobArgs = args.MergedWith(job);
+                fs::path targetPath = FolderArgument(jobArgs);
+                fs::path reportPath = job.Has("--report") ? fs::path(job.Get("--report")) : JobReportPath(args.Get("--report"), jobIndex);
+                return ConvertFolder(targetPath, jobArgs.Get("--output", targetPath.string()), reportPath);
+            });
+            return failed == 0 ? 0 : 1;
+        }
+
+        if (!args.Empty())
+        {
+            fs::path targetPath = FolderArgument(args);
+            return ConvertFolder(targetPath, args.Get("--output", targetPath.string()), args.Get("--report")) ? 0 : 1;
+        }
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        PrintUsage();
+        return 2;
+    }
+
+    // Без аргументов - прежний интерактивный режим
+    std::cout << "Enter path to directory with .csv files (or '.' for current directory): ";
+    std::string inputPathStr;
+    std::getline(std::cin, inputPathStr);
+
+    fs::path targetPath = inputPathStr.empty() || inputPathStr == "." ? fs::path(".") : fs::path(inputPathStr);
+
+    if (!fs::exists(targetPath) || !fs::is_directory(targetPath))
+    {
+        std::cerr << "ERROR: Path does not exist or is not a directory: " << inputPathStr << std::endl;
+        return 1;
+    }
+
+    bool success = ConvertFolder(targetPath, targetPath, {});
     std::cout << "Press Enter to exit...";
     std::cin.get();
-    return 0;
+    return success ? 0 : 1;
 }
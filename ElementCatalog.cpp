@@ -0,0 +1,185 @@
+#include "ElementCatalog.h"
+#include <stdexcept>
+#include "BatchInserter.h"
+
+namespace Builder
+{
+    ElementCatalog::ElementCatalog(size_t memoryBudgetBytes) : memoryBudget_(memoryBudgetBytes)
+    {
+    }
+
+    ElementCatalog::~ElementCatalog()
+    {
+        Clear();
+    }
+
+    void ElementCatalog::Clear()
+    {
+        sqlite3_finalize(selectStmt_);
+        sqlite3_finalize(insertStmt_);
+        if (spillDb_) sqlite3_close(spillDb_); // The temporary file is deleted by SQLite
+        selectStmt_ = nullptr;
+        insertStmt_ = nullptr;
+        spillDb_ = nullptr;
+
+        std::unordered_map<long long, Record>().swap(records_);
+        std::unordered_map<long long, Record>().swap(staged_);
+        files_.clear();
+        ownedCounts_.clear();
+        committedCount_ = 0;
+        stagedCount_ = 0;
+        inFile_ = false;
+    }
+
+    void ElementCatalog::BeginFile(const fs::path& path)
+    {
+        files_.push_back(path);
+        ownedCounts_.push_back(0);
+        stagedCount_ = 0;
+        inFile_ = true;
+        if (spillDb_) Execute("BEGIN;");
+    }
+
+    ElementCatalog::Match ElementCatalog::Check(long long elemId, uint64_t hash)
+    {
+        if (spillDb_)
+        {
+            // Staged rows are in the open transaction and visible to this connection
+            sqlite3_bind_int64(selectStmt_, 1, elemId);
+            Match match = Match::New;
+            if (sqlite3_step(selectStmt_) == SQLITE_ROW)
+            {
+                match = static_cast<uint64_t>(sqlite3_column_int64(selectStmt_, 0)) == hash ? Match::Same : Match::Different;
+            }
+            sqlite3_reset(selectStmt_);
+            return match;
+        }
+
+        auto known = records_.find(elemId);
+        if (known == records_.end())
+        {
+            known = staged_.find(elemId);
+            if (known == staged_.end()) return Match::New;
+        }
+        return known->second.hash == hash ? Match::Same : Match::Different;
+    }
+
+    void ElementCatalog::Add(long long elemId, uint64_t hash)
+    {
+        ++stagedCount_;
+        if (!spillDb_)
+        {
+            Record& record = staged_[elemId];
+            record.hash = hash;
+            record.file = static_cast<uint32_t>(files_.size() - 1);
+            if ((records_.size() + staged_.size()) * kBytesPerRecord > memoryBudget_) Spill();
+            return;
+        }
+
+        sqlite3_bind_int64(insertStmt_, 1, elemId);
+        sqlite3_bind_int64(insertStmt_, 2, static_cast<sqlite3_int64>(hash));
+        sqlite3_bind_int64(insertStmt_, 3, static_cast<sqlite3_int64>(files_.size() - 1));
+        int rc = sqlite3_step(insertStmt_);
+        sqlite3_reset(insertStmt_);
+        if (rc != SQLITE_DONE) throw std::runtime_error(std::string("Could not write the element spill file: ") + sqlite3_errmsg(spillDb_));
+    }
+
+    void ElementCatalog::CommitFile()
+    {
+        if (!inFile_) return;
+        if (spillDb_)
+        {
+            Execute("COMMIT;");
+        }
+        else
+        {
+            records_.merge(staged_);
+            staged_.clear();
+        }
+        ownedCounts_.back() += stagedCount_;
+        committedCount_ += stagedCount_;
+        stagedCount_ = 0;
+        inFile_ = false;
+    }
+
+    void ElementCatalog::RollbackFile()
+    {
+        if (!inFile_) return;
+        if (spillDb_) Execute("ROLLBACK;");
+        staged_.clear();
+        stagedCount_ = 0;
+        inFile_ = false;
+    }
+
+    std::vector<fs::path> ElementCatalog::OwnerFiles() const
+    {
+        std::vector<fs::path> owners;
+        for (size_t i = 0; i < files_.size(); ++i)
+        {
+            if (ownedCounts_[i] > 0) owners.push_back(files_[i]);
+        }
+        return owners;
+    }
+
+    uint64_t ElementCatalog::HashBytes(uint64_t hash, const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    void ElementCatalog::Spill()
+    {
+        // An empty name opens a private temporary database that SQLite deletes on close
+        if (sqlite3_open_v2("", &spillDb_, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK)
+        {
+            std::string error = sqlite3_errmsg(spillDb_);
+            sqlite3_close(spillDb_);
+            spillDb_ = nullptr;
+            throw std::runtime_error("Could not create the element spill file: " + error);
+        }
+        Execute("PRAGMA synchronous = OFF; PRAGMA cache_size = -8192;");
+        Execute("CREATE TABLE records (elemId INTEGER PRIMARY KEY, hash INTEGER, file INTEGER);");
+
+        auto copy = [this](const std::unordered_map<long long, Record>& records)
+        {
+            BatchInserter inserter(spillDb_, "INSERT INTO records", 3);
+            for (const auto& record : records)
+            {
+                inserter.BindInt64(record.first);
+                inserter.BindInt64(static_cast<long long>(record.second.hash));
+                inserter.BindInt64(record.second.file);
+                inserter.EndRow();
+            }
+            inserter.Flush();
+            if (!inserter.Error().empty()) throw std::runtime_error("Could not write the element spill file: " + inserter.Error());
+        };
+
+        // Committed records in their own transaction, staged ones in the transaction of the current file
+        Execute("BEGIN;");
+        copy(records_);
+        Execute("COMMIT;");
+        Execute("BEGIN;");
+        copy(staged_);
+        std::unordered_map<long long, Record>().swap(records_);
+        std::unordered_map<long long, Record>().swap(staged_);
+
+        sqlite3_prepare_v2(spillDb_, "SELECT hash FROM records WHERE elemId = ?;", -1, &selectStmt_, nullptr);
+        sqlite3_prepare_v2(spillDb_, "INSERT INTO records VALUES (?, ?, ?);", -1, &insertStmt_, nullptr);
+    }
+
+    void ElementCatalog::Execute(const char* sql)
+    {
+        char* errMsg = nullptr;
+        if (sqlite3_exec(spillDb_, sql, nullptr, nullptr, &errMsg) != SQLITE_OK)
+        {
+            std::string error = errMsg ? errMsg : "unknown error";
+            sqlite3_free(errMsg);
+            throw std::runtime_error("Element spill file: " + error);
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "sqlite3.h"
+
+namespace fs = std::filesystem;
+
+namespace Builder
+{
+    /**
+     * @class ElementCatalog
+     * @brief Verification records of the elements seen in the Elements tables: a hash of the element's properties
+     * and the file in which the element was first seen. Properties themselves are not kept: the output Elements
+     * table is copied from those files.
+     *
+     * Records of a file are staged until the whole file matched (CommitFile) and can be dropped (RollbackFile).
+     * Records are kept in memory up to a budget. Past the budget they move to a temporary SQLite file, which is
+     * deleted when the catalog is cleared.
+     */
+    class ElementCatalog
+    {
+    public:
+        enum class Match { New, Same, Different };
+
+        explicit ElementCatalog(size_t memoryBudgetBytes = 64u << 20);
+        ~ElementCatalog();
+
+        ElementCatalog(const ElementCatalog&) = delete;
+        ElementCatalog& operator=(const ElementCatalog&) = delete;
+
+        /**
+         * @brief Removes all records and files; the budget is kept.
+         */
+        void Clear();
+        void SetMemoryBudget(size_t bytes) { memoryBudget_ = bytes; }
+
+        /**
+         * @brief Starts the records of a file. Must be followed by CommitFile or RollbackFile.
+         */
+        void BeginFile(const fs::path& path);
+
+        /**
+         * @brief Compares an element with its committed or staged record.
+         */
+        Match Check(long long elemId, uint64_t hash);
+
+        /**
+         * @brief Stages a new element of the current file.
+         * @throws std::runtime_error if the temporary file cannot be written.
+         */
+        void Add(long long elemId, uint64_t hash);
+
+        void CommitFile();
+        void RollbackFile();
+
+        /**
+         * @return The number of committed elements.
+         */
+        size_t Size() const { return committedCount_; }
+        bool Spilled() const { return spillDb_ != nullptr; }
+
+        /**
+         * @return The files that were the first source of at least one committed element, in the order they were read.
+         */
+        std::vector<fs::path> OwnerFiles() const;
+
+        /**
+         * @brief FNV-1a over a byte range, continued from hash (start with kHashSeed).
+         */
+        static uint64_t HashBytes(uint64_t hash, const void* data, size_t size);
+        static constexpr uint64_t kHashSeed = 14695981039346656037ull;
+
+    private:
+        struct Record
+        {
+            uint64_t hash = 0;
+            uint32_t file = 0;
+        };
+
+        // Estimated cost of one record in an unordered_map (node, key, bucket and allocator overhead)
+        static constexpr size_t kBytesPerRecord = 64;
+
+        void Spill();
+        void Execute(const char* sql);
+
+        size_t memoryBudget_;
+        std::unordered_map<long long, Record> records_; // Committed records, while in memory
+        std::unordered_map<long long, Record> staged_;  // Records of the current file, while in memory
+        std::vector<fs::path> files_;                   // Files in the order they were read
+        std::vector<size_t> ownedCounts_;               // Committed elements first seen in each file
+        size_t committedCount_ = 0;
+        size_t stagedCount_ = 0;
+        bool inFile_ = false;
+
+        sqlite3* spillDb_ = nullptr;
+        sqlite3_stmt* selectStmt_ = nullptr;
+        sqlite3_stmt* insertStmt_ = nullptr;
+    };
+}
@@ -0,0 +1,282 @@
+#include "ElementFilter.h"
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    std::string Trim(const std::string& text)
+    {
+        size_t first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) return "";
+        size_t last = text.find_last_not_of(" \t\r\n");
+        return text.substr(first, last - first + 1);
+    }
+
+    bool ParseId(const std::string& text, long long& id)
+    {
+        size_t used = 0;
+        try
+        {
+            id = std::stoll(text, &used);
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+        return used > 0 && used == text.size();
+    }
+
+    // Одно значение или диапазон from-to; минус ищется со второго символа, чтобы разбирались отрицательные id
+    bool ParseIdRange(const std::string& text, long long& first, long long& last)
+    {
+        size_t dash = text.find('-', 1);
+        if (!ParseId(Trim(text.substr(0, dash)), first)) return false;
+        if (dash == std::string::npos)
+        {
+            last = first;
+            return true;
+        }
+        return ParseId(Trim(text.substr(dash + 1)), last) && last >= first;
+    }
+
+    size_t CountBits(const std::vector<uint64_t>& bits)
+    {
+        size_t count = 0;
+        for (uint64_t word : bits) count += std::bitset<64>(word).count();
+        return count;
+    }
+}
+
+// =================================================================
+//    ElementIdSet
+// =================================================================
+
+const ElementIdSet::Container* ElementIdSet::Find(long long key) const
+{
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), key, [](const Container& c, long long k) { return c.key < k; });
+    return it != containers_.end() && it->key == key ? &*it : nullptr;
+}
+
+ElementIdSet::Container& ElementIdSet::FindOrAdd(long long key)
+{
+    // Id обычно идут по возрастанию: сначала проверяется последний блок
+    if (!containers_.empty() && containers_.back().key == key) return containers_.back();
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), key, [](const Container& c, long long k) { return c.key < k; });
+    if (it != containers_.end() && it->key == key) return *it;
+    Container container;
+    container.key = key;
+    return *containers_.insert(it, std::move(container));
+}
+
+bool ElementIdSet::ArrayContains(const std::vector<uint16_t>& values, uint16_t low)
+{
+    auto it = std::lower_bound(values.begin(), values.end(), low);
+    return it != values.end() && *it == low;
+}
+
+void ElementIdSet::Add(long long id)
+{
+    Container& container = FindOrAdd(id >> 16);
+    const uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+    if (!container.bits.empty())
+    {
+        uint64_t& word = container.bits[low >> 6];
+        const uint64_t mask = uint64_t(1) << (low & 63);
+        if (word & mask) return;
+        word |= mask;
+        ++size_;
+        return;
+    }
+
+    std::vector<uint16_t>& values = container.values;
+    if (values.empty() || values.back() < low)
+    {
+        values.push_back(low);
+    }
+    else
+    {
+        auto it = std::lower_bound(values.begin(), values.end(), low);
+        if (*it == low) return;
+        values.insert(it, low);
+    }
+    ++size_;
+
+    if (values.size() > kArrayLimit)
+    {
+        container.bits.assign(1024, 0);
+        for (uint16_t value : values) container.bits[value >> 6] |= uint64_t(1) << (value & 63);
+        std::vector<uint16_t>().swap(values);
+    }
+}
+
+void ElementIdSet::AddRange(long long first, long long last)
+{
+    for (long long id = first; id <= last; ++id)
+    {
+        // Целый блок сразу становится заполненной картой
+        if ((id & 0xFFFF) == 0 && last - id >= 0xFFFF)
+        {
+            Container& container = FindOrAdd(id >> 16);
+            const size_t before = container.bits.empty() ? container.values.size() : CountBits(container.bits);
+            std::vector<uint16_t>().swap(container.values);
+            container.bits.assign(1024, ~uint64_t(0));
+            size_ += 65536 - before;
+            id += 0xFFFF;
+        }
+        else
+        {
+            Add(id);
+        }
+        if (id == last) break; // Без переполнения на последнем id типа
+    }
+}
+
+std::vector<std::pair<long long, long long>> ElementIdSet::Ranges(size_t maxRanges) const
+{
+    std::vector<std::pair<long long, long long>> ranges;
+    auto append = [&ranges](long long id)
+    {
+        if (!ranges.empty() && ranges.back().second + 1 == id) ranges.back().second = id;
+        else ranges.emplace_back(id, id);
+    };
+    for (const auto& container : containers_)
+    {
+        const long long base = container.key * 65536;
+        if (container.bits.empty())
+        {
+            for (uint16_t value : container.values) append(base + value);
+            continue;
+        }
+        for (size_t word = 0; word < container.bits.size(); ++word)
+        {
+            if (container.bits[word] == 0) continue;
+            for (int bit = 0; bit < 64; ++bit)
+            {
+                if ((container.bits[word] >> bit) & 1u) append(base + static_cast<long long>(word * 64 + bit));
+            }
+        }
+    }
+
+    maxRanges = std::max<size_t>(1, maxRanges);
+    if (ranges.size() <= maxRanges) return ranges;
+
+    // Закрываются самые узкие промежутки между диапазонами
+    std::vector<size_t> gaps(ranges.size() - 1);
+    for (size_t i = 0; i < gaps.size(); ++i) gaps[i] = i;
+    std::stable_sort(gaps.begin(), gaps.end(), [&ranges](size_t a, size_t b)
+    {
+        return ranges[a + 1].first - ranges[a].second < ranges[b + 1].first - ranges[b].second;
+    });
+    std::vector<char> closed(gaps.size(), 0);
+    for (size_t i = 0; i < ranges.size() - maxRanges; ++i) closed[gaps[i]] = 1;
+
+    std::vector<std::pair<long long, long long>> merged;
+    merged.push_back(ranges[0]);
+    for (size_t i = 1; i < ranges.size(); ++i)
+    {
+        if (closed[i - 1]) merged.back().second = ranges[i].second;
+        else merged.push_back(ranges[i]);
+    }
+    return merged;
+}
+
+// =================================================================
+//    ElementFilter
+// =================================================================
+
+void ElementFilter::AddIds(const std::string& listOrFile)
+{
+    filtersIds_ = true;
+    std::error_code ec;
+    if (!fs::is_regular_file(listOrFile, ec))
+    {
+        std::stringstream list(listOrFile);
+        std::string item;
+        while (std::getline(list, item, ','))
+        {
+            long long first = 0, last = 0;
+            if (Trim(item).empty()) continue;
+            if (!ParseIdRange(Trim(item), first, last)) throw std::invalid_argument("Not an element id or range: '" + item + "' (and not a file)");
+            ids_.AddRange(first, last);
+        }
+        return;
+    }
+
+    std::ifstream file(listOrFile);
+    if (!file.is_open()) throw std::invalid_argument("Could not open element list: " + listOrFile);
+    std::string extension = fs::path(listOrFile).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    const bool csv = extension == ".csv";
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        if (csv)
+        {
+            // Первая колонка; заголовок и прочие строки без числа пропускаются
+            long long first = 0, last = 0;
+            if (ParseIdRange(Trim(line.substr(0, line.find_first_of(";,"))), first, last)) ids_.AddRange(first, last);
+            continue;
+        }
+        for (char& c : line)
+        {
+            if (c == ',' || c == ';' || c == '\t' || c == '\r') c = ' ';
+        }
+        std::stringstream tokens(line);
+        std::string token;
+        while (tokens >> token)
+        {
+            long long first = 0, last = 0;
+            if (!ParseIdRange(token, first, last))
+            {
+                throw std::invalid_argument(fs::path(listOrFile).filename().string() + ":" + std::to_string(lineNumber) + ": not an element id or range: '" + token + "'");
+            }
+            ids_.AddRange(first, last);
+        }
+    }
+}
+
+void ElementFilter::AddTypes(const std::string& typeList)
+{
+    std::stringstream list(typeList);
+    std::string type;
+    while (std::getline(list, type, ','))
+    {
+        if (!Trim(type).empty()) types_.insert(Trim(type));
+    }
+    if (types_.empty()) throw std::invalid_argument("No element types in '" + typeList + "'");
+}
+
+bool ElementFilter::Accept(long long id, const std::string& elemType)
+{
+    if (!MayContain(id)) return false;
+    if (types_.empty()) return true;
+    if (!types_.count(elemType)) return false;
+    accepted_.Add(id);
+    return true;
+}
+
+std::string ElementFilter::SqlRanges(const std::string& column, size_t maxRanges) const
+{
+    const std::vector<std::pair<long long, long long>> ranges = (types_.empty() ? ids_ : accepted_).Ranges(maxRanges);
+    if (ranges.empty()) return "0";
+    std::stringstream sql;
+    sql << "(";
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        if (i > 0) sql << " OR ";
+        if (ranges[i].first == ranges[i].second) sql << "\"" << column << "\" = " << ranges[i].first;
+        else sql << "\"" << column << "\" BETWEEN " << ranges[i].first << " AND " << ranges[i].second;
+    }
+    sql << ")";
+    return sql.str();
+}
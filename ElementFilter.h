@@ -0,0 +1,116 @@
+#pragma once // Защита от двойного включения
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// <summary>
+/// Множество elemId в сжатом виде по образцу Roaring bitmap: id делятся на блоки по 65536 (старшие биты - ключ блока),
+/// в блоке хранятся младшие 16 бит - отсортированным массивом, пока их не больше 4096, дальше битовой картой в 8 КБ.
+/// Проверка - двоичный поиск блока и одно обращение внутри него; тысячи id этажа занимают несколько килобайт.
+/// </summary>
+class ElementIdSet
+{
+public:
+    void Add(long long id);
+
+    /// <summary>
+    /// Добавляет все id от first до last включительно.
+    /// </summary>
+    void AddRange(long long first, long long last);
+
+    bool Contains(long long id) const
+    {
+        const Container* container = Find(id >> 16);
+        if (!container) return false;
+        const uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+        if (!container->bits.empty()) return (container->bits[low >> 6] >> (low & 63)) & 1u;
+        return ArrayContains(container->values, low);
+    }
+
+    size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+
+    /// <summary>
+    /// Непрерывные диапазоны [first, last] по возрастанию. Если их больше maxRanges, ближайшие склеиваются
+    /// через промежутки (результат покрывает множество с запасом, точная проверка остается за Contains).
+    /// </summary>
+    std::vector<std::pair<long long, long long>> Ranges(size_t maxRanges = SIZE_MAX) const;
+
+private:
+    static constexpr size_t kArrayLimit = 4096; // Больше - битовая карта (4096 * 2 байта = 8 КБ = размер карты)
+
+    struct Container
+    {
+        long long key = 0;
+        std::vector<uint16_t> values; // Отсортированные младшие биты (массив)
+        std::vector<uint64_t> bits;   // 1024 слова (битовая карта); непусто - блок хранится картой
+    };
+
+    const Container* Find(long long key) const;
+    Container& FindOrAdd(long long key);
+    static bool ArrayContains(const std::vector<uint16_t>& values, uint16_t low);
+
+    std::vector<Container> containers_; // По возрастанию ключа
+    size_t size_ = 0;
+};
+
+/// <summary>
+/// Выборка элементов для огибающей части модели (этаж, группа стен): список id и диапазонов и/или типы элементов.
+/// Элемент входит в выборку, если подходит под все заданные условия. Тип известен только из таблиц Elements,
+/// поэтому при фильтре по типам строки Elements проходят через Accept, и принятые id запоминаются.
+/// </summary>
+class ElementFilter
+{
+public:
+    /// <summary>
+    /// Добавляет id: список вида "145688-145700,150001" или путь к файлу. В текстовом файле id и диапазоны
+    /// разделены пробелами, запятыми, точками с запятой или переводами строк; из .csv берется первая колонка
+    /// (строки, где там не число, например заголовок, пропускаются).
+    /// Бросает std::invalid_argument, если файл не открывается или значение не число и не диапазон.
+    /// </summary>
+    void AddIds(const std::string& listOrFile);
+
+    /// <summary>
+    /// Добавляет типы элементов (значения elemType через запятую, например "2" или "1,2").
+    /// </summary>
+    void AddTypes(const std::string& typeList);
+
+    bool Active() const { return filtersIds_ || !types_.empty(); }
+    bool FiltersIds() const { return filtersIds_; }
+    bool FiltersTypes() const { return !types_.empty(); }
+
+    /// <summary>
+    /// Проверяет строку Elements; принятый элемент запоминается (для Contains при фильтре по типам).
+    /// </summary>
+    bool Accept(long long id, const std::string& elemType);
+
+    /// <summary>
+    /// Может ли элемент войти в выборку, пока его тип неизвестен (проверяются только id).
+    /// </summary>
+    bool MayContain(long long id) const { return !filtersIds_ || ids_.Contains(id); }
+
+    /// <summary>
+    /// Входит ли элемент в выборку. При фильтре по типам - только элементы, принятые Accept.
+    /// </summary>
+    bool Contains(long long id) const { return types_.empty() ? MayContain(id) : accepted_.Contains(id); }
+
+    /// <summary>
+    /// Число элементов выборки (при фильтре по типам - принятых).
+    /// </summary>
+    size_t Size() const { return types_.empty() ? ids_.Size() : accepted_.Size(); }
+
+    /// <summary>
+    /// Условие SQL на колонку id, покрывающее выборку: ("elemId" BETWEEN a AND b OR ...), не больше maxRanges диапазонов.
+    /// Может пропускать лишние id, но не теряет нужные. Для пустой выборки - условие, ложное для всех строк.
+    /// </summary>
+    std::string SqlRanges(const std::string& column, size_t maxRanges = 64) const;
+
+private:
+    bool filtersIds_ = false;
+    ElementIdSet ids_;
+    std::set<std::string> types_;
+    ElementIdSet accepted_;
+};
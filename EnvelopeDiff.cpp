@@ -0,0 +1,379 @@
+#include "EnvelopeDiff.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "sqlite3.h"
+#include "BatchInserter.h"
+#include "RunStats.h"
+#include "SqliteAccess.h"
+
+namespace Builder
+{
+    namespace
+    {
+        const std::string kIdColumn = "elemId";
+        const std::string kTypeColumn = "elemType";
+        const std::string kSetColumn = "setN";
+        const std::string kDiffTableName = "Envelope Diff";
+        const int kBlockRows = 4096; // Elements compared per block
+        const double kNoValue = std::numeric_limits<double>::quiet_NaN(); // NULL or missing column
+
+        /**
+         * @class TableReader
+         * @brief Reads the envelope table of one database in elemId order.
+         */
+        class TableReader
+        {
+        public:
+            TableReader(const fs::path& path, const std::string& tableName)
+                : connection_(path, ReadProfile()), path_(path), tableName_(tableName)
+            {
+                if (!connection_.IsOpen()) throw std::runtime_error("Could not open " + path.string() + ": " + connection_.OpenError());
+                columns_ = connection_.ColumnNames(tableName);
+                if (columns_.empty()) throw std::runtime_error("Table '" + tableName + "' not found in " + path.filename().string());
+                if (std::find(columns_.begin(), columns_.end(), kIdColumn) == columns_.end())
+                    throw std::runtime_error("Table '" + tableName + "' in " + path.filename().string() + " has no " + kIdColumn + " column");
+            }
+
+            const std::vector<std::string>& Columns() const { return columns_; }
+
+            /**
+             * @brief Starts reading: elemId, elemType and the value columns (NULL for columns this table does not have).
+             */
+            void Start(const std::vector<std::string>& valueColumns)
+            {
+                auto quoted = [this](const std::string& name)
+                {
+                    return std::find(columns_.begin(), columns_.end(), name) != columns_.end() ? "\"" + name + "\"" : std::string("NULL");
+                };
+                std::string sql = "SELECT \"" + kIdColumn + "\", " + quoted(kTypeColumn);
+                for (const auto& column : valueColumns) sql += ", " + quoted(column);
+                sql += " FROM \"" + tableName_ + "\" ORDER BY \"" + kIdColumn + "\";";
+
+                statement_ = connection_.Prepare(sql);
+                if (!statement_) throw std::runtime_error("Could not read " + path_.filename().string() + ": " + sqlite3_errmsg(connection_.Handle()));
+                valueCount_ = static_cast<int>(valueColumns.size());
+                Next();
+            }
+
+            void Next()
+            {
+                hasRow_ = sqlite3_step(statement_.Get()) == SQLITE_ROW;
+                if (hasRow_) elemId_ = sqlite3_column_int64(statement_.Get(), 0);
+            }
+
+            bool HasRow() const { return hasRow_; }
+            long long ElemId() const { return elemId_; }
+            double ElemType() const { return Number(1); }
+
+            /**
+             * @brief Copies the values of the current row to values[column * stride].
+             */
+            void ReadValues(double* values, size_t stride) const
+            {
+                for (int i = 0; i < valueCount_; ++i) values[i * stride] = Number(i + 2);
+            }
+
+        private:
+            double Number(int index) const
+            {
+                return sqlite3_column_type(statement_.Get(), index) == SQLITE_NULL ? kNoValue : sqlite3_column_double(statement_.Get(), index);
+            }
+
+            SqliteConnection connection_;
+            fs::path path_;
+            std::string tableName_;
+            std::vector<std::string> columns_;
+            StatementLease statement_;
+            int valueCount_ = 0;
+            bool hasRow_ = false;
+            long long elemId_ = 0;
+        };
+
+        /**
+         * @struct DiffRow
+         * @brief One changed value (NaN = NULL).
+         */
+        struct DiffRow
+        {
+            long long elemId;
+            double elemType;
+            const char* change;
+            const std::string* column; // nullptr for an added or removed element without values
+            double oldValue;
+            double newValue;
+        };
+
+        /**
+         * @class DiffWriter
+         * @brief Writes diff rows to a CSV file or to the "Envelope Diff" table of a new database.
+         */
+        class DiffWriter
+        {
+        public:
+            explicit DiffWriter(const fs::path& outputPath) : csv_(outputPath.extension() == ".csv")
+            {
+                if (fs::exists(outputPath)) fs::remove(outputPath);
+                if (csv_)
+                {
+                    csvFile_.open(outputPath);
+                    if (!csvFile_.is_open()) throw std::runtime_error("Could not create file " + outputPath.string());
+                    csvFile_ << std::setprecision(15);
+                    csvFile_ << kIdColumn << ";" << kTypeColumn << ";change;column;old;new;delta;relative\n";
+                    return;
+                }
+
+                if (sqlite3_open(outputPath.string().c_str(), &dbHandle_) != SQLITE_OK)
+                {
+                    std::string error = sqlite3_errmsg(dbHandle_);
+                    sqlite3_close(dbHandle_);
+                    dbHandle_ = nullptr;
+                    throw std::runtime_error("Could not create " + outputPath.string() + ": " + error);
+                }
+                std::string createSql = "CREATE TABLE \"" + kDiffTableName + "\" (\"" + kIdColumn + "\" INT, \"" + kTypeColumn
+                    + "\" INT, \"change\" TEXT, \"column\" TEXT, \"old\" REAL, \"new\" REAL, \"delta\" REAL, \"relative\" REAL);";
+                sqlite3_exec(dbHandle_, createSql.c_str(), nullptr, nullptr, nullptr);
+                sqlite3_exec(dbHandle_, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr);
+                inserter_.reset(new BatchInserter(dbHandle_, "INSERT INTO \"" + kDiffTableName + "\"", 8));
+            }
+
+            ~DiffWriter()
+            {
+                inserter_.reset();
+                if (dbHandle_) sqlite3_close(dbHandle_);
+            }
+
+            void Write(const DiffRow& row)
+            {
+                const bool hasDelta = !std::isnan(row.oldValue) && !std::isnan(row.newValue);
+                const double delta = row.newValue - row.oldValue;
+                const bool hasRelative = hasDelta && row.oldValue != 0.0;
+                const double relative = delta / std::fabs(row.oldValue);
+
+                if (csv_)
+                {
+                    csvFile_ << row.elemId << ";";
+                    WriteCsvNumber(row.elemType, true);
+                    csvFile_ << row.change << ";" << (row.column ? *row.column : "") << ";";
+                    WriteCsvNumber(row.oldValue, true);
+                    WriteCsvNumber(row.newValue, true);
+                    WriteCsvNumber(hasDelta ? delta : kNoValue, true);
+                    WriteCsvNumber(hasRelative ? relative : kNoValue, false);
+                    csvFile_ << "\n";
+                    return;
+                }
+
+                inserter_->BindInt64(row.elemId);
+                if (std::isnan(row.elemType)) inserter_->BindNull(); else inserter_->BindInt64(static_cast<long long>(row.elemType));
+                inserter_->BindText(row.change);
+                if (row.column) inserter_->BindText(*row.column); else inserter_->BindNull();
+                BindNumber(row.oldValue);
+                BindNumber(row.newValue);
+                BindNumber(hasDelta ? delta : kNoValue);
+                BindNumber(hasRelative ? relative : kNoValue);
+                inserter_->EndRow();
+            }
+
+            /**
+             * @throws std::runtime_error if the rows could not be written.
+             */
+            void Finish()
+            {
+                if (csv_)
+                {
+                    csvFile_.close();
+                    if (csvFile_.fail()) throw std::runtime_error("Could not write the diff file");
+                    return;
+                }
+                inserter_->Flush();
+                std::string error = inserter_->Error();
+                inserter_.reset();
+                char* errMsg = nullptr;
+                if (sqlite3_exec(dbHandle_, "COMMIT;", nullptr, nullptr, &errMsg) != SQLITE_OK && error.empty()) error = errMsg ? errMsg : "commit failed";
+                sqlite3_free(errMsg);
+                if (!error.empty()) throw std::runtime_error("Could not write the diff database: " + error);
+            }
+
+        private:
+            void WriteCsvNumber(double value, bool separator)
+            {
+                if (!std::isnan(value)) csvFile_ << value;
+                if (separator) csvFile_ << ";";
+            }
+
+            void BindNumber(double value)
+            {
+                if (std::isnan(value)) inserter_->BindNull(); else inserter_->BindDouble(value);
+            }
+
+            bool csv_;
+            std::ofstream csvFile_;
+            sqlite3* dbHandle_ = nullptr;
+            std::unique_ptr<BatchInserter> inserter_;
+        };
+    }
+
+    EnvelopeDiff::EnvelopeDiff(const DiffOptions& options)
+        : options_(options), log_(options.log ? *options.log : std::cout)
+    {
+    }
+
+    DiffSummary EnvelopeDiff::Compare(const fs::path& oldPath, const fs::path& newPath, const fs::path& outputPath)
+    {
+        // The writer replaces an existing file, so a diff path that names an input (e.g. a typo in --diff) must not get that far
+        for (const fs::path* inputPath : { &oldPath, &newPath })
+        {
+            std::error_code ec;
+            if (fs::equivalent(outputPath, *inputPath, ec))
+            {
+                throw std::runtime_error("The diff file " + outputPath.string() + " is one of the compared databases.");
+            }
+        }
+
+        Stopwatch timer;
+        TableReader oldTable(oldPath, options_.tableName);
+        TableReader newTable(newPath, options_.tableName);
+
+        // Value columns: those of the old table, then the ones that only the new table has
+        std::vector<std::string> columns;
+        for (const auto* table : { &oldTable, &newTable })
+        {
+            for (const auto& column : table->Columns())
+            {
+                if (column == kIdColumn || column == kTypeColumn || column == kSetColumn) continue;
+                if (std::find(columns.begin(), columns.end(), column) == columns.end()) columns.push_back(column);
+            }
+        }
+        const size_t columnCount = columns.size();
+
+        log_ << "Comparing '" << options_.tableName << "': " << oldPath.filename().string() << " -> " << newPath.filename().string()
+             << " (" << columnCount << " columns)" << std::endl;
+
+        oldTable.Start(columns);
+        newTable.Start(columns);
+        DiffWriter writer(outputPath);
+        DiffSummary summary;
+
+        // One block of merged rows, column by column: values[column * kBlockRows + row]. A side without the element has NaN.
+        enum RowKind : unsigned char { Both, OnlyOld, OnlyNew };
+        std::vector<long long> ids(kBlockRows);
+        std::vector<RowKind> kinds(kBlockRows);
+        std::vector<double> oldTypes(kBlockRows), newTypes(kBlockRows);
+        std::vector<double> oldValues(columnCount * kBlockRows), newValues(columnCount * kBlockRows);
+        std::vector<unsigned char> changed(columnCount * kBlockRows);
+        const double absoluteThreshold = options_.absoluteThreshold;
+        const double relativeThreshold = options_.relativeThreshold;
+
+        auto flushBlock = [&](int rowCount)
+        {
+            // A value changed if |delta| is above both thresholds or it exists on one side only
+            for (size_t c = 0; c < columnCount; ++c)
+            {
+                const double* o = oldValues.data() + c * kBlockRows;
+                const double* n = newValues.data() + c * kBlockRows;
+                unsigned char* flags = changed.data() + c * kBlockRows;
+                for (int r = 0; r < rowCount; ++r)
+                {
+                    const double limit = std::max(absoluteThreshold, relativeThreshold * std::fabs(o[r]));
+                    flags[r] = static_cast<unsigned char>((std::fabs(n[r] - o[r]) > limit) | ((o[r] != o[r]) != (n[r] != n[r])));
+                }
+            }
+
+            for (int r = 0; r < rowCount; ++r)
+            {
+                static const char* const kChangeNames[] = { "changed", "removed", "added" };
+                DiffRow row{ ids[r], kinds[r] == OnlyOld ? oldTypes[r] : newTypes[r], kChangeNames[kinds[r]], nullptr, kNoValue, kNoValue };
+                long long rowValues = 0;
+                if (kinds[r] == Both && oldTypes[r] != newTypes[r] && !(std::isnan(oldTypes[r]) && std::isnan(newTypes[r])))
+                {
+                    DiffRow typeRow = row;
+                    typeRow.column = &kTypeColumn;
+                    typeRow.oldValue = oldTypes[r];
+                    typeRow.newValue = newTypes[r];
+                    writer.Write(typeRow);
+                    ++rowValues;
+                }
+                for (size_t c = 0; c < columnCount; ++c)
+                {
+                    if (!changed[c * kBlockRows + r]) continue;
+                    row.column = &columns[c];
+                    row.oldValue = oldValues[c * kBlockRows + r];
+                    row.newValue = newValues[c * kBlockRows + r];
+                    writer.Write(row);
+                    ++rowValues;
+                }
+
+                if (kinds[r] == Both)
+                {
+                    if (rowValues > 0) ++summary.changed;
+                }
+                else
+                {
+                    ++(kinds[r] == OnlyOld ? summary.removed : summary.added);
+                    if (rowValues == 0)
+                    {
+                        // Still listed, so that the element does not vanish from the diff
+                        row.column = nullptr;
+                        writer.Write(row);
+                        ++rowValues;
+                    }
+                }
+                summary.changedValues += rowValues;
+            }
+        };
+
+        int rowCount = 0;
+        while (oldTable.HasRow() || newTable.HasRow())
+        {
+            const bool takeOld = oldTable.HasRow() && (!newTable.HasRow() || oldTable.ElemId() <= newTable.ElemId());
+            const bool takeNew = newTable.HasRow() && (!oldTable.HasRow() || newTable.ElemId() <= oldTable.ElemId());
+            ids[rowCount] = takeOld ? oldTable.ElemId() : newTable.ElemId();
+            kinds[rowCount] = takeOld && takeNew ? Both : (takeOld ? OnlyOld : OnlyNew);
+
+            if (takeOld)
+            {
+                oldTypes[rowCount] = oldTable.ElemType();
+                oldTable.ReadValues(oldValues.data() + rowCount, kBlockRows);
+                oldTable.Next();
+            }
+            else
+            {
+                oldTypes[rowCount] = kNoValue;
+                for (size_t c = 0; c < columnCount; ++c) oldValues[c * kBlockRows + rowCount] = kNoValue;
+            }
+            if (takeNew)
+            {
+                newTypes[rowCount] = newTable.ElemType();
+                newTable.ReadValues(newValues.data() + rowCount, kBlockRows);
+                newTable.Next();
+            }
+            else
+            {
+                newTypes[rowCount] = kNoValue;
+                for (size_t c = 0; c < columnCount; ++c) newValues[c * kBlockRows + rowCount] = kNoValue;
+            }
+            if (takeOld && takeNew) ++summary.compared;
+
+            if (++rowCount == kBlockRows)
+            {
+                flushBlock(rowCount);
+                rowCount = 0;
+            }
+        }
+        flushBlock(rowCount);
+        writer.Finish();
+
+        log_ << "Compared " << summary.compared << " elements in " << std::fixed << std::setprecision(3) << timer.Seconds() << std::defaultfloat << " s: "
+             << summary.changed << " changed, " << summary.added << " added, " << summary.removed << " removed ("
+             << summary.changedValues << " rows written to " << outputPath.filename().string() << ")." << std::endl;
+        return summary;
+    }
+}
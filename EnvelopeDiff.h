@@ -0,0 +1,65 @@
+#pragma once
+
+#include <filesystem>
+#include <ostream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace Builder
+{
+    /**
+     * @struct DiffOptions
+     * @brief Settings of an envelope comparison.
+     */
+    struct DiffOptions
+    {
+        std::string tableName = "Enveloped Reinforcement"; // Table compared in both files
+        double absoluteThreshold = 0.0; // A value counts as changed if |new - old| is above this...
+        double relativeThreshold = 0.0; // ...and also above this fraction of |old|
+        std::ostream* log = nullptr;    // Progress output (nullptr = std::cout)
+    };
+
+    /**
+     * @struct DiffSummary
+     * @brief Counters of a comparison.
+     */
+    struct DiffSummary
+    {
+        long long compared = 0;      // Elements in both files
+        long long changed = 0;       // Elements in both files with at least one changed value
+        long long added = 0;         // Elements only in the new file
+        long long removed = 0;       // Elements only in the old file
+        long long changedValues = 0; // Rows written to the diff
+    };
+
+    /**
+     * @class EnvelopeDiff
+     * @brief Compares two versions of an envelope database (Envelope.db or Envelope_Summed.db) element by element.
+     *
+     * Both tables are read in elemId order and merged in one pass; only one block of rows is held in memory.
+     * Values of a block are kept column by column in flat arrays, so the delta and threshold checks run over
+     * contiguous doubles in a loop without branches. Only the values that changed are written, one row per value:
+     * elemId, elemType, change (changed / added / removed), column, old, new, delta and relative change.
+     */
+    class EnvelopeDiff
+    {
+    public:
+        explicit EnvelopeDiff(const DiffOptions& options = DiffOptions());
+
+        /**
+         * @brief Compares the table of two databases and writes the changes.
+         * @param oldPath The earlier envelope database.
+         * @param newPath The revised envelope database.
+         * @param outputPath The diff: a CSV file (separator ';') if the extension is .csv, otherwise a SQLite
+         * database with the table "Envelope Diff". An existing file is replaced; it must not be one of the inputs.
+         * @return The counters of the comparison.
+         * @throws std::runtime_error if a database cannot be read, the diff cannot be written or outputPath is an input.
+         */
+        DiffSummary Compare(const fs::path& oldPath, const fs::path& newPath, const fs::path& outputPath);
+
+    private:
+        DiffOptions options_;
+        std::ostream& log_;
+    };
+}
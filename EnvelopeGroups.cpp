@@ -0,0 +1,182 @@
+#include "EnvelopeGroups.h"
+#include "CommandLine.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace Builder
+{
+    namespace
+    {
+        std::vector<std::string> SplitList(const std::string& list)
+        {
+            std::vector<std::string> items;
+            std::stringstream stream(list);
+            std::string item;
+            while (std::getline(stream, item, ','))
+            {
+                if (!item.empty()) items.push_back(item);
+            }
+            return items;
+        }
+
+        long long ParseSetN(const std::string& text, const std::string& range)
+        {
+            size_t used = 0;
+            long long value = 0;
+            try
+            {
+                value = std::stoll(text, &used);
+            }
+            catch (const std::exception&)
+            {
+                used = 0;
+            }
+            if (used == 0 || used != text.size()) throw std::invalid_argument("Malformed setN range '" + range + "'");
+            return value;
+        }
+
+        bool MatchesAny(const std::vector<std::string>& patterns, const std::string& text)
+        {
+            if (patterns.empty()) return true;
+            for (const auto& pattern : patterns)
+            {
+                if (MatchesWildcard(pattern, text)) return true;
+            }
+            return false;
+        }
+    }
+
+    bool EnvelopeGroup::MatchesFile(const std::string& fileName) const
+    {
+        return MatchesAny(filePatterns, fileName);
+    }
+
+    bool EnvelopeGroup::MatchesTable(const std::string& tableName) const
+    {
+        return MatchesAny(tablePatterns, tableName);
+    }
+
+    bool EnvelopeGroup::MatchesSetN(long long setN) const
+    {
+        if (setNRanges.empty()) return true;
+        for (const auto& range : setNRanges)
+        {
+            if (setN >= range.first && setN <= range.second) return true;
+        }
+        return false;
+    }
+
+    bool MatchesWildcard(const std::string& pattern, const std::string& text)
+    {
+        auto same = [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); };
+
+        // Greedy match with backtracking to the last '*'
+        size_t p = 0, t = 0;
+        size_t starPattern = std::string::npos, starText = 0;
+        while (t < text.size())
+        {
+            if (p < pattern.size() && (pattern[p] == '?' || (pattern[p] != '*' && same(pattern[p], text[t]))))
+            {
+                ++p;
+                ++t;
+            }
+            else if (p < pattern.size() && pattern[p] == '*')
+            {
+                starPattern = p++;
+                starText = t;
+            }
+            else if (starPattern != std::string::npos)
+            {
+                p = starPattern + 1;
+                t = ++starText;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        while (p < pattern.size() && pattern[p] == '*') ++p;
+        return p == pattern.size();
+    }
+
+    EnvelopeGroup ParseEnvelopeGroup(const std::string& line)
+    {
+        std::vector<std::string> tokens = TokenizeCommandLine(line);
+        if (tokens.size() < 2) throw std::invalid_argument("Expected '<name> file=<patterns>|table=<patterns>|setN=<ranges>...'");
+
+        EnvelopeGroup group;
+        group.name = tokens[0];
+        // The name becomes a folder next to Envelope.db
+        if (group.name[0] == '.' || group.name.find_first_of("/\\:*?\"<>|") != std::string::npos)
+        {
+            throw std::invalid_argument("Group name '" + group.name + "' is not a valid folder name");
+        }
+
+        for (size_t i = 1; i < tokens.size(); ++i)
+        {
+            const std::string& condition = tokens[i];
+            size_t equals = condition.find('=');
+            if (equals == std::string::npos) throw std::invalid_argument("Expected <kind>=<values> instead of '" + condition + "'");
+            const std::string kind = condition.substr(0, equals);
+            const std::vector<std::string> values = SplitList(condition.substr(equals + 1));
+            if (values.empty()) throw std::invalid_argument("No values in '" + condition + "'");
+
+            if (kind == "file")
+            {
+                group.filePatterns.insert(group.filePatterns.end(), values.begin(), values.end());
+            }
+            else if (kind == "table")
+            {
+                group.tablePatterns.insert(group.tablePatterns.end(), values.begin(), values.end());
+            }
+            else if (kind == "setN")
+            {
+                // A single setN or from-to; the dash is searched after the first character so that negative numbers parse
+                for (const auto& range : values)
+                {
+                    size_t dash = range.find('-', 1);
+                    long long from = ParseSetN(range.substr(0, dash), range);
+                    long long to = dash == std::string::npos ? from : ParseSetN(range.substr(dash + 1), range);
+                    if (to < from) throw std::invalid_argument("Empty setN range '" + range + "'");
+                    group.setNRanges.emplace_back(from, to);
+                }
+            }
+            else
+            {
+                throw std::invalid_argument("Unknown condition '" + kind + "' (expected file, table or setN)");
+            }
+        }
+        return group;
+    }
+
+    std::vector<EnvelopeGroup> LoadEnvelopeGroups(const fs::path& groupsPath)
+    {
+        std::ifstream groupsFile(groupsPath);
+        if (!groupsFile.is_open()) throw std::invalid_argument("Could not open groups file: " + groupsPath.string());
+
+        std::vector<EnvelopeGroup> groups;
+        std::set<std::string> names;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(groupsFile, line))
+        {
+            ++lineNumber;
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') continue;
+            try
+            {
+                groups.push_back(ParseEnvelopeGroup(line));
+                if (!names.insert(groups.back().name).second) throw std::invalid_argument("Group '" + groups.back().name + "' is defined twice");
+            }
+            catch (const std::invalid_argument& e)
+            {
+                throw std::invalid_argument(groupsPath.filename().string() + ":" + std::to_string(lineNumber) + ": " + e.what());
+            }
+        }
+        return groups;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace Builder
+{
+    /**
+     * @struct EnvelopeGroup
+     * @brief A family of load combinations that gets an envelope of its own, e.g. the seismic files or a setN range.
+     * A row belongs to the group if its file, table and setN match all conditions that are given;
+     * a condition without values matches everything.
+     */
+    struct EnvelopeGroup
+    {
+        std::string name;                                    // Output subfolder of the group
+        std::vector<std::string> filePatterns;               // Source file names, wildcards * and ?, case-insensitive
+        std::vector<std::string> tablePatterns;              // Result table names, same matching
+        std::vector<std::pair<long long, long long>> setNRanges; // Inclusive ranges of setN
+
+        bool MatchesFile(const std::string& fileName) const;
+        bool MatchesTable(const std::string& tableName) const;
+        bool FiltersSetN() const { return !setNRanges.empty(); }
+        bool MatchesSetN(long long setN) const;
+    };
+
+    /**
+     * @brief Reads a groups file. One group per line: <name> <condition>..., where a condition is
+     * file=<patterns>, table=<patterns> or setN=<ranges>, with comma-separated alternatives, e.g.
+     *   seismic file=B30_SEISM_*,B35_SEISM_*
+     *   static  file=*STAT* setN=1-100,200
+     * Empty lines and lines starting with '#' are ignored.
+     * @throws std::invalid_argument with the file name and line number on a malformed group, or on a repeated name.
+     */
+    std::vector<EnvelopeGroup> LoadEnvelopeGroups(const fs::path& groupsPath);
+
+    /**
+     * @brief Parses a single group line (the format of LoadEnvelopeGroups).
+     * @throws std::invalid_argument on a malformed group.
+     */
+    EnvelopeGroup ParseEnvelopeGroup(const std::string& line);
+
+    /**
+     * @brief Matches text against a pattern with * (any run of characters) and ? (one character), ignoring ASCII case.
+     */
+    bool MatchesWildcard(const std::string& pattern, const std::string& text);
+}
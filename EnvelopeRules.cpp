@@ -0,0 +1,105 @@
+#include "EnvelopeRules.h"
+#include "CommandLine.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace Builder
+{
+    std::vector<EnvelopeRule> DefaultEnvelopeRules()
+    {
+        return {
+            ParseEnvelopeRule("2 Asw1i max Asw1i+Asw2i Asw2i"),
+            ParseEnvelopeRule("2 Asw1j max Asw1j+Asw2j Asw2j")
+        };
+    }
+
+    EnvelopeRule ParseEnvelopeRule(const std::string& line)
+    {
+        std::vector<std::string> tokens = TokenizeCommandLine(line);
+        if (tokens.size() < 4 || tokens.size() > 5)
+        {
+            throw std::invalid_argument("Expected '<elemType> <target> <max|min|absmax> <expression> [zero columns]'");
+        }
+
+        EnvelopeRule rule;
+        rule.elemType = tokens[0];
+        rule.target = tokens[1];
+
+        if (tokens[2] == "max") rule.mode = EnvelopeMode::Max;
+        else if (tokens[2] == "min") rule.mode = EnvelopeMode::Min;
+        else if (tokens[2] == "absmax") rule.mode = EnvelopeMode::AbsMax;
+        else throw std::invalid_argument("Unknown mode '" + tokens[2] + "' (expected max, min or absmax)");
+
+        // Expression: column names joined by '+' or '-', e.g. Asw1i+Asw2i or -Sw1i
+        const std::string& expression = tokens[3];
+        double sign = 1.0;
+        std::string column;
+        for (size_t i = 0; i <= expression.size(); ++i)
+        {
+            char c = i < expression.size() ? expression[i] : '+';
+            if (c == '+' || c == '-')
+            {
+                if (!column.empty()) rule.terms.push_back({ column, sign });
+                else if (i != 0) throw std::invalid_argument("Malformed expression '" + expression + "'");
+                column.clear();
+                sign = c == '-' ? -1.0 : 1.0;
+            }
+            else
+            {
+                column += c;
+            }
+        }
+        if (rule.terms.empty()) throw std::invalid_argument("Empty expression");
+
+        if (tokens.size() == 5)
+        {
+            std::stringstream zeroList(tokens[4]);
+            std::string zeroColumn;
+            while (std::getline(zeroList, zeroColumn, ','))
+            {
+                if (!zeroColumn.empty()) rule.zeroColumns.push_back(zeroColumn);
+            }
+        }
+        return rule;
+    }
+
+    std::string FormatEnvelopeRule(const EnvelopeRule& rule)
+    {
+        std::string line = rule.elemType + " " + rule.target + " ";
+        line += rule.mode == EnvelopeMode::Min ? "min " : (rule.mode == EnvelopeMode::AbsMax ? "absmax " : "max ");
+        for (size_t i = 0; i < rule.terms.size(); ++i)
+        {
+            if (rule.terms[i].sign < 0) line += "-";
+            else if (i > 0) line += "+";
+            line += rule.terms[i].column;
+        }
+        for (size_t i = 0; i < rule.zeroColumns.size(); ++i) line += (i ? "," : " ") + rule.zeroColumns[i];
+        return line;
+    }
+
+    std::vector<EnvelopeRule> LoadEnvelopeRules(const fs::path& rulesPath)
+    {
+        std::ifstream rulesFile(rulesPath);
+        if (!rulesFile.is_open()) throw std::invalid_argument("Could not open rules file: " + rulesPath.string());
+
+        std::vector<EnvelopeRule> rules;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(rulesFile, line))
+        {
+            ++lineNumber;
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') continue;
+            try
+            {
+                rules.push_back(ParseEnvelopeRule(line));
+            }
+            catch (const std::invalid_argument& e)
+            {
+                throw std::invalid_argument(rulesPath.filename().string() + ":" + std::to_string(lineNumber) + ": " + e.what());
+            }
+        }
+        return rules;
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace Builder
+{
+    /**
+     * @enum EnvelopeMode
+     * @brief How a value replaces the current envelope value. Ties keep the first value, except that of two
+     * values of equal magnitude AbsMax keeps the positive one (see IsLargerMagnitude).
+     */
+    enum class EnvelopeMode
+    {
+        Max,    // Largest value
+        Min,    // Smallest value
+        AbsMax  // Value with the largest magnitude, sign preserved
+    };
+
+    /**
+     * @brief Checks whether value has a larger magnitude than current; of equal magnitudes the positive value wins.
+     * The signed absolute maximum then does not depend on the order of the values, so the loop, which sees rows
+     * one by one, and the SQL engine, which only sees MAX and MIN of a group, give the same result.
+     */
+    template <typename T>
+    inline bool IsLargerMagnitude(T value, T current)
+    {
+        const T magnitude = value < 0 ? -value : value;
+        const T currentMagnitude = current < 0 ? -current : current;
+        return magnitude > currentMagnitude || (magnitude == currentMagnitude && value > current);
+    }
+
+    /**
+     * @brief Checks whether value should replace current under the given mode.
+     */
+    inline bool IsBetterValue(double value, double current, EnvelopeMode mode)
+    {
+        switch (mode)
+        {
+        case EnvelopeMode::Min: return value < current;
+        case EnvelopeMode::AbsMax: return IsLargerMagnitude(value, current);
+        default: return value > current;
+        }
+    }
+
+    /**
+     * @struct EnvelopeRule
+     * @brief One rule of Envelope_Summed.db: for elements of the given type, the envelope of a signed sum of
+     * source columns is written to the target column, and the zero columns are written as 0.
+     * A source that is missing or not numeric in a row counts as 0.
+     */
+    struct EnvelopeRule
+    {
+        struct Term
+        {
+            std::string column;
+            double sign = 1.0;
+        };
+
+        std::string elemType;                 // Value of elemType the rule applies to ("*" = all elements)
+        std::string target;                   // Output column that receives the rule value
+        EnvelopeMode mode = EnvelopeMode::Max;
+        std::vector<Term> terms;              // Source columns, summed with their signs
+        std::vector<std::string> zeroColumns; // Output columns written as 0 for matching elements
+
+        bool AppliesTo(const std::string& type) const { return elemType == "*" || elemType == type; }
+    };
+
+    /**
+     * @struct CompiledRule
+     * @brief A rule bound to the column layout of one source table: sources are column indices, the result is a store slot.
+     */
+    struct CompiledRule
+    {
+        struct Term
+        {
+            int column;
+            double sign;
+        };
+
+        int slot = -1;
+        EnvelopeMode mode = EnvelopeMode::Max;
+        std::vector<Term> terms; // Only sources present in the table
+    };
+
+    /**
+     * @brief The built-in rules: for shells (elemType 2) Asw1 receives the envelope of Asw1+Asw2 and Asw2 is zeroed, for i and j ends.
+     */
+    std::vector<EnvelopeRule> DefaultEnvelopeRules();
+
+    /**
+     * @brief Reads a rules file. One rule per line: <elemType|*> <target> <max|min|absmax> <expression> [zero columns],
+     * where the expression is a sum like Asw1i+Asw2i (terms may be subtracted) and the zero columns are a comma-separated list.
+     * Empty lines and lines starting with '#' are ignored.
+     * @throws std::invalid_argument with the file name and line number on a malformed rule.
+     */
+    std::vector<EnvelopeRule> LoadEnvelopeRules(const fs::path& rulesPath);
+
+    /**
+     * @brief Parses a single rule line (the format of LoadEnvelopeRules).
+     * @throws std::invalid_argument on a malformed rule.
+     */
+    EnvelopeRule ParseEnvelopeRule(const std::string& line);
+
+    /**
+     * @brief Writes a rule as a line of a rules file (ParseEnvelopeRule reads it back).
+     */
+    std::string FormatEnvelopeRule(const EnvelopeRule& rule);
+}
@@ -0,0 +1,136 @@
+#include "EnvelopeStore.h"
+#include <algorithm>
+
+namespace Builder
+{
+    EnvelopeStore::EnvelopeStore(std::vector<EnvelopeRule> rules) : rules_(std::move(rules))
+    {
+        Clear();
+    }
+
+    void EnvelopeStore::Clear()
+    {
+        elementIndex_.clear();
+        elementIds_.clear();
+        elementTypes_.clear();
+        hasData_.clear();
+        typeNames_.clear();
+        rulesByType_.clear();
+        columnIndex_.clear();
+        columnNames_.clear();
+        values_.clear();
+        floatValues_.clear();
+        rounding_.Reset();
+        sources_.clear();
+        sketches_.clear();
+        sourceFiles_.clear();
+        sourceTables_.clear();
+        ruleSlots_.clear();
+        allRules_.clear();
+
+        // Rule values live in hidden slots ("__" prefix is never written as an output column)
+        for (size_t i = 0; i < rules_.size(); ++i)
+        {
+            ruleSlots_.push_back(ColumnSlot("__rule_" + std::to_string(i)));
+            allRules_.push_back(static_cast<int>(i));
+        }
+    }
+
+    int EnvelopeStore::RegisterElement(long long elemId, const std::string& elemType)
+    {
+        int typeCode = TypeCode(elemType);
+        auto it = elementIndex_.find(elemId);
+        if (it != elementIndex_.end())
+        {
+            elementTypes_[it->second] = typeCode;
+            return it->second;
+        }
+        int element = static_cast<int>(elementIds_.size());
+        elementIndex_.emplace(elemId, element);
+        elementIds_.push_back(elemId);
+        elementTypes_.push_back(typeCode);
+        hasData_.push_back(0);
+        return element;
+    }
+
+    int EnvelopeStore::AddLateElement(long long elemId)
+    {
+        int element = static_cast<int>(elementIds_.size());
+        elementIndex_.emplace(elemId, element);
+        elementIds_.push_back(elemId);
+        elementTypes_.push_back(kUnknownType);
+        hasData_.push_back(0);
+        return element;
+    }
+
+    int EnvelopeStore::ColumnSlot(const std::string& name)
+    {
+        auto it = columnIndex_.find(name);
+        if (it != columnIndex_.end()) return it->second;
+        int slot = static_cast<int>(columnNames_.size());
+        columnIndex_.emplace(name, slot);
+        columnNames_.push_back(name);
+        values_.emplace_back();
+        floatValues_.emplace_back();
+        sources_.emplace_back();
+        sketches_.emplace_back();
+        return slot;
+    }
+
+    int EnvelopeStore::FindColumn(const std::string& name) const
+    {
+        auto it = columnIndex_.find(name);
+        return it != columnIndex_.end() ? it->second : -1;
+    }
+
+    bool EnvelopeStore::ColumnHasData(int slot) const
+    {
+        for (size_t element = 0; element < elementIds_.size(); ++element)
+        {
+            if (HasValue(slot, static_cast<int>(element)) && elementTypes_[element] != kUnknownType) return true;
+        }
+        return false;
+    }
+
+    std::vector<CompiledRule> EnvelopeStore::CompileRules(const std::vector<std::string>& columnNames, const std::vector<bool>& envelopedColumns) const
+    {
+        std::vector<CompiledRule> compiled(rules_.size());
+        for (size_t i = 0; i < rules_.size(); ++i)
+        {
+            compiled[i].slot = ruleSlots_[i];
+            compiled[i].mode = rules_[i].mode;
+            for (const auto& term : rules_[i].terms)
+            {
+                auto it = std::find(columnNames.begin(), columnNames.end(), term.column);
+                if (it == columnNames.end() || !envelopedColumns[it - columnNames.begin()]) continue; // Missing source counts as 0
+                compiled[i].terms.push_back({ static_cast<int>(it - columnNames.begin()), term.sign });
+            }
+        }
+        return compiled;
+    }
+
+    uint32_t EnvelopeStore::InternName(std::vector<std::string>& names, const std::string& name)
+    {
+        // Few files and tables per run: a linear search is enough
+        auto it = std::find(names.begin(), names.end(), name);
+        if (it != names.end()) return static_cast<uint32_t>(it - names.begin());
+        names.push_back(name);
+        return static_cast<uint32_t>(names.size() - 1);
+    }
+
+    int EnvelopeStore::TypeCode(const std::string& elemType)
+    {
+        for (size_t i = 0; i < typeNames_.size(); ++i)
+        {
+            if (typeNames_[i] == elemType) return static_cast<int>(i);
+        }
+        typeNames_.push_back(elemType);
+        std::vector<int> matching;
+        for (size_t i = 0; i < rules_.size(); ++i)
+        {
+            if (rules_[i].AppliesTo(elemType)) matching.push_back(static_cast<int>(i));
+        }
+        rulesByType_.push_back(matching);
+        return static_cast<int>(typeNames_.size() - 1);
+    }
+}
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "EnvelopeRules.h"
+#include "FloatRounding.h"
+#include "QuantileSketch.h"
+
+namespace Builder
+{
+    /**
+     * @struct ValueSource
+     * @brief Where an enveloped value came from: ids of the source file and table (see EnvelopeStore::SourceFileId)
+     * and the setN of the row.
+     */
+    struct ValueSource
+    {
+        uint32_t file = 0;
+        uint32_t table = 0;
+        long long setN = 0;
+    };
+
+    /**
+     * @enum EnvelopeBounds
+     * @brief Bounds kept next to the envelope value of every column and written as paired columns.
+     */
+    enum class EnvelopeBounds
+    {
+        Max,       // The envelope value only
+        MinMax,    // Also the smallest value (<column>_min)
+        MinMaxAbs  // Also the smallest value and the value with the largest magnitude, sign kept (<column>_min, <column>_absmax)
+    };
+
+    /**
+     * @class EnvelopeStore
+     * @brief Dense in-memory envelope: every element gets an index, every column a slot, and values are kept
+     * column by column in flat arrays. Rules get hidden slots of their own. The pass-2 loop works on indices
+     * only; names are resolved once per table.
+     * With bounds, the cell of an element holds the envelope value, the minimum and the signed absolute maximum
+     * next to each other, so one row updates them in the same cache line.
+     * In single precision the cells are floats: every value is rounded to float before it is compared, so the
+     * envelope is exact for the rounded values, and the largest relative rounding error is kept for the report.
+     */
+    class EnvelopeStore
+    {
+    public:
+        static constexpr int kUnknownType = -1; // Element seen in results before its Elements row (watch mode)
+
+        explicit EnvelopeStore(std::vector<EnvelopeRule> rules = DefaultEnvelopeRules());
+
+        /**
+         * @brief Sets the bounds kept for every column. Call before the first value is folded; Clear keeps the setting.
+         */
+        void SetBounds(EnvelopeBounds bounds)
+        {
+            bounds_ = bounds;
+            stride_ = bounds == EnvelopeBounds::Max ? 1 : 3;
+        }
+        EnvelopeBounds Bounds() const { return bounds_; }
+
+        /**
+         * @brief Also keeps a quantile sketch of all folded values of every column and element (about 180 bytes each).
+         * Call before the first value is folded; Clear keeps the setting.
+         */
+        void SetSketching(bool enabled) { sketching_ = enabled; }
+        bool Sketching() const { return sketching_; }
+
+        /**
+         * @brief Keeps the values as float instead of double (half the memory of the cells).
+         * Call before the first value is folded; Clear keeps the setting.
+         */
+        void SetSinglePrecision(bool enabled) { singlePrecision_ = enabled; }
+        bool SinglePrecision() const { return singlePrecision_; }
+
+        /**
+         * @return The largest |float(value) - value| / |value| of the values folded in single precision (0 in double precision).
+         */
+        double MaxRoundingError() const { return rounding_.MaxError(); }
+
+        /**
+         * @brief Removes all elements and values; columns of the rules are kept.
+         */
+        void Clear();
+
+        // --- Elements ---
+
+        /**
+         * @brief Adds a verified element or sets the type of an element that was added before its Elements row.
+         * @return The element index.
+         */
+        int RegisterElement(long long elemId, const std::string& elemType);
+
+        /**
+         * @brief Adds an element whose type is not known yet.
+         * @return The element index.
+         */
+        int AddLateElement(long long elemId);
+
+        /**
+         * @return The element index, or -1 if the element is unknown.
+         */
+        int FindElement(long long elemId) const
+        {
+            auto it = elementIndex_.find(elemId);
+            return it != elementIndex_.end() ? it->second : -1;
+        }
+
+        size_t ElementCount() const { return elementIds_.size(); }
+        long long ElementId(int element) const { return elementIds_[element]; }
+        const std::vector<long long>& ElementIds() const { return elementIds_; }
+        int ElementType(int element) const { return elementTypes_[element]; }
+        bool IsVerified(int element) const { return elementTypes_[element] != kUnknownType; }
+        bool HasData(int element) const { return hasData_[element] != 0; }
+        const std::string& TypeName(int typeCode) const { return typeNames_[typeCode]; }
+        size_t TypeCount() const { return typeNames_.size(); }
+
+        // --- Columns ---
+
+        /**
+         * @brief Returns the slot of a column, adding it on first use.
+         */
+        int ColumnSlot(const std::string& name);
+
+        /**
+         * @return The slot of a column, or -1 if no value of it was stored.
+         */
+        int FindColumn(const std::string& name) const;
+
+        size_t ColumnCount() const { return columnNames_.size(); }
+        const std::string& ColumnName(int slot) const { return columnNames_[slot]; }
+
+        /**
+         * @brief Checks whether a visible column has a value for at least one verified element.
+         */
+        bool ColumnHasData(int slot) const;
+
+        // --- Values ---
+
+        /**
+         * @brief Folds a value into the envelope of a column for an element.
+         * @return True if the value became the new envelope value (ties keep the earlier value).
+         */
+        bool Fold(int slot, int element, double value, EnvelopeMode mode)
+        {
+            hasData_[element] = 1;
+            if (sketching_) SketchCell(slot, element).Add(value);
+            if (!singlePrecision_) return FoldInto(Cell(values_, slot, element), value, mode);
+            return FoldInto(Cell(floatValues_, slot, element), Round(value), mode);
+        }
+
+        /**
+         * @brief Folds a value into the bounds only (the SQL engine passes the MIN of a group after its MAX).
+         */
+        void FoldBounds(int slot, int element, double value)
+        {
+            if (stride_ == 1) return;
+            if (!singlePrecision_) FoldBoundsInto(Cell(values_, slot, element), value);
+            else FoldBoundsInto(Cell(floatValues_, slot, element), Round(value));
+        }
+
+        /**
+         * @brief Folds the envelope of another run of the same cell (a shard): its value under the mode and its bounds.
+         * @return True if the value became the new envelope value (ties keep the earlier value).
+         */
+        bool FoldEnvelope(int slot, int element, double value, double minValue, double absMaxValue, EnvelopeMode mode)
+        {
+            hasData_[element] = 1;
+            if (!singlePrecision_) return FoldEnvelopeInto(Cell(values_, slot, element), value, minValue, absMaxValue, mode);
+            return FoldEnvelopeInto(Cell(floatValues_, slot, element), Round(value), Round(minValue), Round(absMaxValue), mode);
+        }
+
+        bool HasValue(int slot, int element) const
+        {
+            const size_t cell = static_cast<size_t>(element) * stride_;
+            if (singlePrecision_) return cell < floatValues_[slot].size() && !std::isnan(floatValues_[slot][cell]);
+            return cell < values_[slot].size() && !std::isnan(values_[slot][cell]);
+        }
+
+        double Value(int slot, int element) const { return CellValue(slot, static_cast<size_t>(element) * stride_); }
+        double MinValue(int slot, int element) const { return CellValue(slot, static_cast<size_t>(element) * stride_ + 1); }
+        double AbsMaxValue(int slot, int element) const { return CellValue(slot, static_cast<size_t>(element) * stride_ + 2); }
+
+        // --- Distribution ---
+
+        bool HasSketch(int slot, int element) const
+        {
+            const std::vector<QuantileSketch>& column = sketches_[slot];
+            return static_cast<size_t>(element) < column.size() && !column[element].Empty();
+        }
+
+        const QuantileSketch& Sketch(int slot, int element) const { return sketches_[slot][element]; }
+
+        /**
+         * @brief Adds the values of a sketch of another run (a shard) to the sketch of a cell.
+         */
+        void MergeSketch(int slot, int element, const QuantileSketch& sketch)
+        {
+            if (sketching_) SketchCell(slot, element).MergeFrom(sketch);
+        }
+
+        // --- Provenance ---
+
+        /**
+         * @brief Records the source of the current envelope value (call after Fold returned true).
+         */
+        void SetSource(int slot, int element, const ValueSource& source)
+        {
+            std::vector<ValueSource>& column = sources_[slot];
+            if (column.size() <= static_cast<size_t>(element)) column.resize(elementIds_.size());
+            column[element] = source;
+        }
+
+        const ValueSource& Source(int slot, int element) const { return sources_[slot][element]; }
+
+        /**
+         * @brief Returns the id of a source file name, adding it on first use.
+         */
+        uint32_t SourceFileId(const std::string& name) { return InternName(sourceFiles_, name); }
+
+        /**
+         * @brief Returns the id of a source table name, adding it on first use.
+         */
+        uint32_t SourceTableId(const std::string& name) { return InternName(sourceTables_, name); }
+
+        const std::vector<std::string>& SourceFiles() const { return sourceFiles_; }
+        const std::vector<std::string>& SourceTables() const { return sourceTables_; }
+
+        // --- Rules ---
+
+        const std::vector<EnvelopeRule>& Rules() const { return rules_; }
+        int RuleSlot(size_t rule) const { return ruleSlots_[rule]; }
+
+        /**
+         * @brief Indices of the rules that apply to a type; all rules for kUnknownType, since a late element
+         * may turn out to be of any type.
+         */
+        const std::vector<int>& RulesForType(int typeCode) const
+        {
+            return typeCode == kUnknownType ? allRules_ : rulesByType_[typeCode];
+        }
+
+        /**
+         * @brief Binds the rules to the columns of a source table.
+         * @param columnNames The columns of the table.
+         * @param envelopedColumns For every table column: true if it holds result values (not elemId, setN, elemType).
+         */
+        std::vector<CompiledRule> CompileRules(const std::vector<std::string>& columnNames, const std::vector<bool>& envelopedColumns) const;
+
+    private:
+        // Unset values are NaN: SQLite never returns NaN for INTEGER or FLOAT values
+        template <typename T>
+        T* Cell(std::vector<std::vector<T>>& columns, int slot, int element)
+        {
+            std::vector<T>& column = columns[slot];
+            const size_t cell = static_cast<size_t>(element) * stride_;
+            if (column.size() <= cell) GrowColumn(column);
+            return &column[cell];
+        }
+
+        double CellValue(int slot, size_t cell) const
+        {
+            return singlePrecision_ ? static_cast<double>(floatValues_[slot][cell]) : values_[slot][cell];
+        }
+
+        float Round(double value) { return rounding_.Round(value); }
+
+        template <typename T>
+        bool FoldInto(T* cell, T value, EnvelopeMode mode)
+        {
+            if (stride_ > 1) FoldBoundsInto(cell, value);
+            T& current = cell[0];
+            if (!std::isnan(current) && !IsBetterValue(value, current, mode)) return false;
+            current = value;
+            return true;
+        }
+
+        template <typename T>
+        bool FoldEnvelopeInto(T* cell, T value, T minValue, T absMaxValue, EnvelopeMode mode)
+        {
+            if (stride_ > 1)
+            {
+                cell[1] = minValue < cell[1] ? minValue : cell[1];
+                cell[2] = IsLargerMagnitude(absMaxValue, cell[2]) ? absMaxValue : cell[2];
+            }
+            T& current = cell[0];
+            if (!std::isnan(current) && !IsBetterValue(value, current, mode)) return false;
+            current = value;
+            return true;
+        }
+
+        /**
+         * @brief Minimum and signed absolute maximum as selects without branches. An unset cell starts at
+         * (+inf, 0), so the first value always replaces the minimum; of equal magnitudes the positive value is
+         * kept, as in the SQL engine, so the bounds do not depend on the row order.
+         */
+        template <typename T>
+        static void FoldBoundsInto(T* cell, T value)
+        {
+            cell[1] = value < cell[1] ? value : cell[1];
+            cell[2] = IsLargerMagnitude(value, cell[2]) ? value : cell[2];
+        }
+
+        QuantileSketch& SketchCell(int slot, int element)
+        {
+            std::vector<QuantileSketch>& column = sketches_[slot];
+            if (column.size() <= static_cast<size_t>(element)) column.resize(elementIds_.size());
+            return column[element];
+        }
+
+        template <typename T>
+        void GrowColumn(std::vector<T>& column) const
+        {
+            const size_t oldSize = column.size();
+            column.resize(elementIds_.size() * stride_, std::numeric_limits<T>::quiet_NaN());
+            if (stride_ == 1) return;
+            for (size_t cell = oldSize; cell < column.size(); cell += stride_)
+            {
+                column[cell + 1] = std::numeric_limits<T>::infinity();
+                column[cell + 2] = 0;
+            }
+        }
+
+        int TypeCode(const std::string& elemType);
+        static uint32_t InternName(std::vector<std::string>& names, const std::string& name);
+
+        std::vector<EnvelopeRule> rules_;
+        std::vector<int> ruleSlots_;
+        std::vector<int> allRules_;
+        std::vector<std::vector<int>> rulesByType_;
+
+        std::unordered_map<long long, int> elementIndex_;
+        std::vector<long long> elementIds_;
+        std::vector<int> elementTypes_;
+        std::vector<char> hasData_;
+        std::vector<std::string> typeNames_;
+
+        std::unordered_map<std::string, int> columnIndex_;
+        std::vector<std::string> columnNames_;
+        EnvelopeBounds bounds_ = EnvelopeBounds::Max;
+        size_t stride_ = 1;                       // Values per element cell: envelope, then min and absmax with bounds
+        std::vector<std::vector<double>> values_; // [slot][element * stride_ + value]
+        bool singlePrecision_ = false;
+        std::vector<std::vector<float>> floatValues_; // Instead of values_ in single precision
+        FloatRounding rounding_;                      // Largest rounding error of floatValues_
+        std::vector<std::vector<ValueSource>> sources_; // [slot][element], filled only when provenance is tracked
+        bool sketching_ = false;
+        std::vector<std::vector<QuantileSketch>> sketches_; // [slot][element], filled only when sketching
+
+        std::vector<std::string> sourceFiles_;
+        std::vector<std::string> sourceTables_;
+    };
+}
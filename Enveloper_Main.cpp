@@ -0,0 +1,251 @@
+#include "EnvelopeBuilder.h"
+#include "CommandLine.h"
+#include "BatchJobs.h"
+#include "EnvelopeDiff.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+// Command line options of the enveloper
+static const std::set<std::string> kValueOptions = { "--output", "--report", "--rules", "--groups", "--engine", "--bounds", "--quantiles", "--elements", "--elem-types", "--prefetch", "--elements-memory", "--shard", "--jobs", "--threads", "--settle", "--refresh", "--idle-exit", "--expect",
+                                                       "--compare", "--diff", "--threshold", "--relative", "--table" };
+static const std::set<std::string> kFlagOptions = { "--help", "--watch", "--provenance", "--immutable", "--merge", "--float32", "--no-dedup" };
+
+static void PrintUsage()
+{
+    std::cout << "Usage: FEDOR_Enveloper [<folder>] [options]\n"
+              << "       FEDOR_Enveloper --jobs <job file> [options]\n"
+              << "  <folder>           Directory with source .db files and .csv result exports (default: current directory)\n"
+              << "  --output <dir>     Directory for Envelope.db and Envelope_Summed.db (default: <folder>)\n"
+              << "  --report <file>    Write a JSON timing report\n"
+              << "  --rules <file>     Envelope rules for Envelope_Summed.db (default: shell Asw1+Asw2 sums)\n"
+              << "  --groups <file>    Also build the envelope of every group of files, tables or setN ranges into <output>/<group>\n"
+              << "  --engine <engine>  loop | sql | auto: how source tables are read (default: auto, the faster on the first files)\n"
+              << "  --bounds <bounds>  max | minmax | absmax: also write <column>_min (and <column>_absmax, signed) next to every column (default: max)\n"
+              << "  --quantiles <list> Also write these percentiles of every column over all combinations, e.g. 50,90,95 (Envelope Quantiles table)\n"
+              << "  --provenance       Also write the source file, table and setN of every value (Envelope Provenance table)\n"
+              << "  --float32          Keep the envelope in single precision (half the memory); reports the largest rounding error\n"
+              << "  --immutable        Source files are final and not written by anyone: read them without locks\n"
+              << "  --no-dedup         Read every table, also verbatim copies of tables already enveloped (skipped by default)\n"
+              << "  --elements <ids>   Only these elements: ids and ranges (e.g. 1-500,731) or a file of ids (.txt, or .csv: first column)\n"
+              << "  --elem-types <list> Only elements of these elemType values, e.g. 2 or 1,2 (with --elements: both must match)\n"
+              << "  --prefetch N       Load N files ahead of the one being enveloped into the OS file cache (default: 1, 0 = off)\n"
+              << "  --elements-memory MB  Memory for checking the Elements tables; past it the check uses a temporary file (default: 64)\n"
+              << "  --shard <file>     Write a partial-envelope shard (e.g. part1.shard) instead of the output databases\n"
+              << "  --jobs <file>      Run one envelope job per line of the job file (folder and options per line)\n"
+              << "  --threads N        Number of jobs run at the same time (default: 1)\n"
+              << "  --watch            Keep running and envelope new .db files as the solver writes them\n"
+              << "  --settle S         Watch: seconds a closed file must stay unchanged before it is read (default: 2)\n"
+              << "  --refresh S        Watch: minimum seconds between refreshes of the output databases (default: 10)\n"
+              << "  --idle-exit S      Watch: finish after S seconds without new files (default: run until Ctrl+C)\n"
+              << "  --expect N         Watch: finish once N source files were enveloped\n"
+              << "Merge of shards built from parts of one folder (the settings come from the shards):\n"
+              << "       FEDOR_Enveloper --merge <shard or folder of .shard files>... [--output <dir>] [--elements <ids>]\n"
+              << "Comparison of two envelope databases:\n"
+              << "       FEDOR_Enveloper --compare <old Envelope.db> <new Envelope.db> [options]\n"
+              << "  --diff <file>      Output: .csv or a SQLite database (default: Envelope_Diff.db next to the new file)\n"
+              << "  --threshold A      Report a value only if |new - old| > A (default: 0)\n"
+              << "  --relative R       ...and |new - old| > R * |old| (default: 0, e.g. 0.05 for 5%)\n"
+              << "  --table <name>     Compared table (default: Enveloped Reinforcement)\n"
+              << "Without arguments the enveloper asks for the folder interactively.\n";
+}
+
+/**
+ * @brief Converts command line arguments into builder options.
+ */
+static Builder::BuildOptions OptionsFromArgs(const CommandLine& args)
+{
+    Builder::BuildOptions options;
+    options.outputPath = args.Get("--output");
+    options.reportPath = args.Get("--report");
+    options.rulesPath = args.Get("--rules");
+    options.groupsPath = args.Get("--groups");
+    options.trackProvenance = args.Has("--provenance");
+    options.singlePrecision = args.Has("--float32");
+    options.deduplicateTables = !args.Has("--no-dedup");
+    options.immutableSources = args.Has("--immutable");
+    options.prefetchDepth = args.GetInt("--prefetch", 1);
+    if (options.prefetchDepth < 0) throw std::invalid_argument("--prefetch must not be negative");
+    options.shardPath = args.Get("--shard");
+    options.elementsMemoryMiB = args.GetInt("--elements-memory", 64);
+    if (options.elementsMemoryMiB < 1) throw std::invalid_argument("--elements-memory must be at least 1");
+    if (args.Has("--elements")) options.elementFilter.AddIds(args.Get("--elements"));
+    if (args.Has("--elem-types")) options.elementFilter.AddTypes(args.Get("--elem-types"));
+    std::string bounds = args.Get("--bounds");
+    if (bounds == "minmax") options.bounds = Builder::EnvelopeBounds::MinMax;
+    else if (bounds == "absmax") options.bounds = Builder::EnvelopeBounds::MinMaxAbs;
+    else if (bounds != "max" && !bounds.empty()) throw std::invalid_argument("Unknown bounds '" + bounds + "' (expected max, minmax or absmax)");
+    std::stringstream quantiles(args.Get("--quantiles"));
+    std::string percent;
+    while (std::getline(quantiles, percent, ','))
+    {
+        size_t used = 0;
+        try
+        {
+            options.quantiles.push_back(std::stod(percent, &used));
+        }
+        catch (const std::exception&)
+        {
+            used = 0;
+        }
+        if (used == 0 || used != percent.size()) throw std::invalid_argument("Malformed percentile '" + percent + "' in --quantiles");
+    }
+    std::string engine = args.Get("--engine");
+    if (engine == "loop") options.engine = Builder::EnvelopeEngine::Loop;
+    else if (engine == "sql") options.engine = Builder::EnvelopeEngine::Sql;
+    else if (engine == "auto" || engine.empty()) options.engine = Builder::EnvelopeEngine::Auto;
+    else throw std::invalid_argument("Unknown engine '" + engine + "' (expected loop, sql or auto)");
+    return options;
+}
+
+/**
+ * @brief Compares two envelope databases (--compare mode).
+ * @param log Progress output (nullptr = std::cout).
+ * @return True when the comparison is written; errors are thrown.
+ */
+static bool RunComparison(const CommandLine& args, std::ostream* log = nullptr)
+{
+    if (args.Positional().size() != 1) throw std::invalid_argument("--compare needs exactly one new database after the options");
+    fs::path oldPath = args.Get("--compare");
+    fs::path newPath = args.Positional().front();
+    for (const auto& path : { oldPath, newPath })
+    {
+        if (!fs::is_regular_file(path)) throw std::invalid_argument("Not a file: " + path.string());
+    }
+
+    Builder::DiffOptions options;
+    options.tableName = args.Get("--table", options.tableName);
+    options.absoluteThreshold = args.GetDouble("--threshold", 0.0);
+    options.relativeThreshold = args.GetDouble("--relative", 0.0);
+    if (options.absoluteThreshold < 0 || options.relativeThreshold < 0) throw std::invalid_argument("--threshold and --relative must not be negative");
+    fs::path diffPath = args.Get("--diff");
+    if (diffPath.empty()) diffPath = newPath.parent_path() / "Envelope_Diff.db";
+    options.log = log;
+
+    Builder::EnvelopeDiff diff(options);
+    diff.Compare(oldPath, newPath, diffPath);
+    return true;
+}
+
+/**
+ * @brief Combines shard files into Envelope.db and Envelope_Summed.db (--merge mode).
+ * @param options The options of args (output, element filter, report and log).
+ */
+static bool RunMerge(const CommandLine& args, const Builder::BuildOptions& options)
+{
+    for (const char* option : { "--rules", "--groups", "--bounds", "--quantiles", "--provenance", "--float32", "--shard", "--watch" })
+    {
+        if (args.Has(option)) throw std::invalid_argument(std::string(option) + " cannot be used with --merge (the settings come from the shards)");
+    }
+    std::vector<fs::path> shards;
+    for (const auto& argument : args.Positional())
+    {
+        // A folder stands for its .shard files in name order
+        if (fs::is_directory(argument))
+        {
+            std::vector<fs::path> folderShards;
+            for (const auto& entry : fs::directory_iterator(argument))
+            {
+                if (entry.is_regular_file() && entry.path().extension() == ".shard") folderShards.push_back(entry.path());
+            }
+            std::sort(folderShards.begin(), folderShards.end());
+            shards.insert(shards.end(), folderShards.begin(), folderShards.end());
+        }
+        else if (fs::is_regular_file(argument))
+        {
+            shards.push_back(argument);
+        }
+        else
+        {
+            throw std::invalid_argument("Not a shard file or folder: " + argument);
+        }
+    }
+    if (shards.empty()) throw std::invalid_argument("--merge needs shard files or folders with .shard files");
+
+    Builder::EnvelopeBuilder builder(options);
+    return builder.Merge(shards);
+}
+
+/**
+ * @brief Runs a normal build, or the watch-folder mode if --watch is given.
+ */
+static bool RunBuilder(const CommandLine& args, const Builder::BuildOptions& options)
+{
+    Builder::EnvelopeBuilder builder(options);
+    if (!args.Has("--watch")) return builder.Run(FolderArgument(args));
+    if (!options.shardPath.empty()) throw std::invalid_argument("--shard cannot be used with --watch");
+
+    Builder::WatchOptions watchOptions;
+    watchOptions.settleSeconds = args.GetDouble("--settle", watchOptions.settleSeconds);
+    watchOptions.refreshSeconds = args.GetDouble("--refresh", watchOptions.refreshSeconds);
+    watchOptions.idleExitSeconds = args.GetDouble("--idle-exit", watchOptions.idleExitSeconds);
+    watchOptions.expectedFiles = args.GetInt("--expect", watchOptions.expectedFiles);
+    return builder.Watch(FolderArgument(args), watchOptions);
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef _WIN32
+    std::system("chcp 65001 > nul");
+#endif
+
+    try
+    {
+        CommandLine args(argc, argv, kValueOptions, kFlagOptions);
+
+        // No arguments: the original interactive mode
+        if (args.Empty())
+        {
+            Builder::EnvelopeBuilder builder;
+            builder.Run();
+            return 0;
+        }
+        if (args.Has("--help"))
+        {
+            PrintUsage();
+            return 0;
+        }
+
+        if (args.Has("--compare"))
+        {
+            RunComparison(args);
+            return 0;
+        }
+
+        if (args.Has("--merge"))
+        {
+            return RunMerge(args, OptionsFromArgs(args)) ? 0 : 1;
+        }
+
+        if (args.Has("--jobs"))
+        {
+            std::vector<CommandLine> jobs = ReadJobFile(args.Get("--jobs"), kValueOptions, kFlagOptions);
+            ThreadPool pool(static_cast<unsigned>(std::max(1, args.GetInt("--threads", 1))));
+            int failed = RunJobs(jobs, pool, [&](const CommandLine& job, size_t jobIndex, std::ostream& log)
+            {
+                // A job line may use every mode of the command line
+                CommandLine jobArgs = args.MergedWith(job);
+                if (jobArgs.Has("--compare")) return RunComparison(jobArgs, &log);
+                Builder::BuildOptions options = OptionsFromArgs(jobArgs);
+                if (!job.Has("--report")) options.reportPath = JobReportPath(options.reportPath, jobIndex);
+                options.log = &log;
+                if (jobArgs.Has("--merge")) return RunMerge(jobArgs, options);
+                return RunBuilder(jobArgs, options);
+            });
+            return failed == 0 ? 0 : 1;
+        }
+
+        return RunBuilder(args, OptionsFromArgs(args)) ? 0 : 1;
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        PrintUsage();
+        return 2;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "An unexpected critical error occurred: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,580 @@
+// Сборка как загружаемого расширения SQLite (fedor_dir.dll / fedor_dir.so): определить FEDOR_DIR_EXTENSION.
+// Без него модуль линкуется в программу и регистрируется через RegisterFedorDirModule.
+#ifdef FEDOR_DIR_EXTENSION
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT1
+#else
+#include "sqlite3.h"
+#endif
+
+#include "FedorDirModule.h"
+#include "ThreadPool.h"
+#include "OutputFiles.h"
+#include "SqliteAccess.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const char* const kElementIdColumn = "elemId";
+    const char* const kSetNColumn = "setN";
+    const char* const kSourceDbColumn = "source_db";
+    const char* const kSourceTableColumn = "source_table";
+    const size_t kBatchRows = 256;      // Строк в одной порции от потока чтения
+    const size_t kQueuedBatches = 16;   // Порций, которые поток может прочитать вперед на файл
+
+    /// <summary>
+    /// Значение ячейки, скопированное из исходного файла (оно переживает свой запрос).
+    /// </summary>
+    struct Cell
+    {
+        int type = SQLITE_NULL;
+        sqlite3_int64 integer = 0;
+        double real = 0.0;
+        std::string bytes; // TEXT и BLOB
+    };
+
+    struct SourceTable
+    {
+        size_t file = 0;
+        std::string name;
+        int width = 0;                   // Число колонок исходной таблицы
+        std::vector<int> sourceColumnOf; // Колонка виртуальной таблицы -> колонка исходной (-1 = нет)
+    };
+
+    struct DirVtab : sqlite3_vtab
+    {
+        std::vector<fs::path> paths;
+        std::vector<std::string> fileNames;
+        std::vector<SourceTable> tables;
+        std::vector<std::string> columns; // Видимые колонки; за ними source_db и source_table
+        int sourceDbColumn = 0;
+        int sourceTableColumn = 0;
+        unsigned threads = 0;
+    };
+
+    struct RowBatch
+    {
+        size_t table = 0;
+        size_t rows = 0;
+        std::vector<Cell> cells; // rows * width, по строкам
+    };
+
+    /// <summary>
+    /// Очередь порций одного файла: поток чтения кладет, курсор забирает по порядку.
+    /// </summary>
+    struct FileQueue
+    {
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<RowBatch> batches;
+        bool done = false;
+        std::string error;
+    };
+
+    // Условие, переданное в исходные запросы: колонка, оператор SQL и значение
+    struct PushedConstraint
+    {
+        std::string column;
+        const char* op;
+        Cell value;
+    };
+
+    struct DirCursor : sqlite3_vtab_cursor
+    {
+        std::vector<size_t> files;                       // Выбранные файлы по порядку
+        std::vector<std::vector<size_t>> tablesOfFile;   // Выбранные таблицы каждого файла
+        std::vector<std::unique_ptr<FileQueue>> queues;
+        std::vector<PushedConstraint> constraints;
+        std::unique_ptr<ThreadPool> pool;
+        std::atomic<bool> stopRequested{ false };
+
+        size_t fileIndex = 0;
+        RowBatch current;
+        size_t row = 0;
+        sqlite3_int64 rowid = 0;
+        bool eof = true;
+    };
+
+    std::string Unquote(const char* argument)
+    {
+        std::string text = argument;
+        while (!text.empty() && (text.front() == ' ')) text.erase(text.begin());
+        while (!text.empty() && (text.back() == ' ')) text.pop_back();
+        if (text.size() >= 2 && (text.front() == '\'' || text.front() == '"') && text.back() == text.front())
+        {
+            text = text.substr(1, text.size() - 2);
+        }
+        return text;
+    }
+
+    std::string QuoteIdentifier(const std::string& name)
+    {
+        std::string quoted = "\"";
+        for (char c : name) quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+        return quoted + "\"";
+    }
+
+    Cell CopyCell(sqlite3_value* value)
+    {
+        Cell cell;
+        cell.type = sqlite3_value_type(value);
+        if (cell.type == SQLITE_INTEGER) cell.integer = sqlite3_value_int64(value);
+        else if (cell.type == SQLITE_FLOAT) cell.real = sqlite3_value_double(value);
+        else if (cell.type == SQLITE_TEXT || cell.type == SQLITE_BLOB)
+        {
+            const void* data = cell.type == SQLITE_TEXT ? static_cast<const void*>(sqlite3_value_text(value)) : sqlite3_value_blob(value);
+            cell.bytes.assign(static_cast<const char*>(data), static_cast<size_t>(sqlite3_value_bytes(value)));
+        }
+        return cell;
+    }
+
+    void BindCell(sqlite3_stmt* stmt, int index, const Cell& cell)
+    {
+        switch (cell.type)
+        {
+        case SQLITE_INTEGER: sqlite3_bind_int64(stmt, index, cell.integer); break;
+        case SQLITE_FLOAT: sqlite3_bind_double(stmt, index, cell.real); break;
+        case SQLITE_TEXT: sqlite3_bind_text(stmt, index, cell.bytes.data(), static_cast<int>(cell.bytes.size()), SQLITE_TRANSIENT); break;
+        case SQLITE_BLOB: sqlite3_bind_blob(stmt, index, cell.bytes.data(), static_cast<int>(cell.bytes.size()), SQLITE_TRANSIENT); break;
+        default: sqlite3_bind_null(stmt, index); break;
+        }
+    }
+
+    int SetError(sqlite3_vtab* vtab, const std::string& message)
+    {
+        sqlite3_free(vtab->zErrMsg);
+        vtab->zErrMsg = sqlite3_mprintf("%s", message.c_str());
+        return SQLITE_ERROR;
+    }
+
+    // --- Чтение исходных файлов (потоки пула) ---
+
+    void ReadFile(const DirVtab& vtab, DirCursor& cursor, size_t selected)
+    {
+        FileQueue& queue = *cursor.queues[selected];
+        auto finish = [&queue](const std::string& error)
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.done = true;
+            queue.error = error;
+            queue.changed.notify_all();
+        };
+        if (cursor.stopRequested) return finish("");
+
+        const size_t file = cursor.files[selected];
+        SqliteConnection source(vtab.paths[file], ReadProfile());
+        if (!source.IsOpen()) return finish("fedor_dir: could not open " + vtab.fileNames[file] + ": " + source.OpenError());
+        sqlite3* dbHandle = source.Handle();
+
+        std::string error;
+        for (size_t tableIndex : cursor.tablesOfFile[selected])
+        {
+            const SourceTable& table = vtab.tables[tableIndex];
+            std::string query = "SELECT * FROM " + QuoteIdentifier(table.name);
+            for (size_t c = 0; c < cursor.constraints.size(); ++c)
+            {
+                query += (c == 0 ? " WHERE " : " AND ") + QuoteIdentifier(cursor.constraints[c].column) + " " + cursor.constraints[c].op + " ?";
+            }
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(dbHandle, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            {
+                error = "fedor_dir: " + vtab.fileNames[file] + "/" + table.name + ": " + sqlite3_errmsg(dbHandle);
+                break;
+            }
+            for (size_t c = 0; c < cursor.constraints.size(); ++c) BindCell(stmt, static_cast<int>(c) + 1, cursor.constraints[c].value);
+
+            RowBatch batch;
+            batch.table = tableIndex;
+            auto push = [&]()
+            {
+                std::unique_lock<std::mutex> lock(queue.mutex);
+                queue.changed.wait(lock, [&]() { return queue.batches.size() < kQueuedBatches || cursor.stopRequested; });
+                queue.batches.push_back(std::move(batch));
+                queue.changed.notify_all();
+                batch = RowBatch();
+                batch.table = tableIndex;
+            };
+            while (!cursor.stopRequested && sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                for (int c = 0; c < table.width; ++c) batch.cells.push_back(CopyCell(sqlite3_column_value(stmt, c)));
+                if (++batch.rows == kBatchRows) push();
+            }
+            if (batch.rows > 0) push();
+            sqlite3_finalize(stmt);
+            if (cursor.stopRequested) break;
+        }
+        finish(error);
+    }
+
+    void StopReading(DirCursor& cursor)
+    {
+        cursor.stopRequested = true;
+        for (auto& queue : cursor.queues)
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->changed.notify_all();
+        }
+        cursor.pool.reset(); // Дожидается потоков чтения
+        cursor.queues.clear();
+        cursor.stopRequested = false;
+    }
+
+    // --- Методы модуля ---
+
+    int DirConnect(sqlite3* dbHandle, void*, int argc, const char* const* argv, sqlite3_vtab** outVtab, char** errMsg)
+    {
+        if (argc < 4)
+        {
+            *errMsg = sqlite3_mprintf("fedor_dir: expected a folder argument: USING fedor_dir('path' [, threads])");
+            return SQLITE_ERROR;
+        }
+        std::unique_ptr<DirVtab> vtab(new DirVtab());
+        std::memset(static_cast<sqlite3_vtab*>(vtab.get()), 0, sizeof(sqlite3_vtab));
+        fs::path folder = fs::u8path(Unquote(argv[3]));
+        if (argc > 4) vtab->threads = static_cast<unsigned>(std::max(0, std::atoi(Unquote(argv[4]).c_str())));
+
+        std::error_code ec;
+        if (!fs::is_directory(folder, ec))
+        {
+            *errMsg = sqlite3_mprintf("fedor_dir: not a directory: %s", folder.u8string().c_str());
+            return SQLITE_ERROR;
+        }
+        for (const auto& entry : fs::directory_iterator(folder, ec))
+        {
+            if (!entry.is_regular_file() || entry.path().extension() != ".db" || IsToolOutputFile(entry.path().filename().string())) continue;
+            vtab->paths.push_back(entry.path());
+        }
+        std::sort(vtab->paths.begin(), vtab->paths.end());
+
+        // Схема: объединение колонок всех таблиц, elemId и setN первыми
+        vtab->columns = { kElementIdColumn, kSetNColumn };
+        for (size_t file = 0; file < vtab->paths.size(); ++file)
+        {
+            vtab->fileNames.push_back(vtab->paths[file].filename().string());
+            SqliteConnection source(vtab->paths[file], ReadProfile());
+            if (!source.IsOpen())
+            {
+                *errMsg = sqlite3_mprintf("fedor_dir: could not open %s: %s", vtab->fileNames[file].c_str(), source.OpenError().c_str());
+                return SQLITE_ERROR;
+            }
+            sqlite3* sourceHandle = source.Handle();
+            for (const auto& tableName : ReadTableNames(sourceHandle))
+            {
+                sqlite3_stmt* stmt;
+                std::string query = "SELECT * FROM " + QuoteIdentifier(tableName) + ";";
+                if (sqlite3_prepare_v2(sourceHandle, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) continue;
+                SourceTable table;
+                table.file = file;
+                table.name = tableName;
+                table.width = sqlite3_column_count(stmt);
+                std::vector<std::pair<int, int>> mapping; // (колонка виртуальной таблицы, колонка исходной)
+                for (int c = 0; c < table.width; ++c)
+                {
+                    // Имена колонок в SQLite не зависят от регистра: ElemId и elemId - одна колонка.
+                    // Колонка исходной таблицы с именем скрытой колонки видна как source_db_1 (source_table_1)
+                    std::string columnName = sqlite3_column_name(stmt, c);
+                    if (sqlite3_stricmp(columnName.c_str(), kSourceDbColumn) == 0 || sqlite3_stricmp(columnName.c_str(), kSourceTableColumn) == 0) columnName += "_1";
+                    auto it = std::find_if(vtab->columns.begin(), vtab->columns.end(),
+                                           [&columnName](const std::string& column) { return sqlite3_stricmp(column.c_str(), columnName.c_str()) == 0; });
+                    if (it == vtab->columns.end()) it = vtab->columns.insert(vtab->columns.end(), columnName);
+                    mapping.push_back({ static_cast<int>(it - vtab->columns.begin()), c });
+                }
+                sqlite3_finalize(stmt);
+                for (const auto& pair : mapping)
+                {
+                    if (table.sourceColumnOf.size() <= static_cast<size_t>(pair.first)) table.sourceColumnOf.resize(pair.first + 1, -1);
+                    table.sourceColumnOf[pair.first] = pair.second;
+                }
+                vtab->tables.push_back(std::move(table));
+            }
+        }
+        for (auto& table : vtab->tables) table.sourceColumnOf.resize(vtab->columns.size(), -1);
+        vtab->sourceDbColumn = static_cast<int>(vtab->columns.size());
+        vtab->sourceTableColumn = vtab->sourceDbColumn + 1;
+
+        std::string schema = "CREATE TABLE x(";
+        for (const auto& column : vtab->columns) schema += QuoteIdentifier(column) + ", ";
+        schema += std::string(kSourceDbColumn) + " TEXT HIDDEN, " + kSourceTableColumn + " TEXT HIDDEN)";
+        int rc = sqlite3_declare_vtab(dbHandle, schema.c_str());
+        if (rc != SQLITE_OK)
+        {
+            *errMsg = sqlite3_mprintf("fedor_dir: %s", sqlite3_errmsg(dbHandle));
+            return rc;
+        }
+        *outVtab = vtab.release();
+        return SQLITE_OK;
+    }
+
+    int DirDisconnect(sqlite3_vtab* vtab)
+    {
+        delete static_cast<DirVtab*>(vtab);
+        return SQLITE_OK;
+    }
+
+    // idxStr: по два символа на переданное условие - колонка (e = elemId, s = setN, d = source_db, t = source_table)
+    // и оператор (= < { > }, где { это <=, а } это >=)
+    int DirBestIndex(sqlite3_vtab* vtabBase, sqlite3_index_info* info)
+    {
+        const DirVtab& vtab = *static_cast<DirVtab*>(vtabBase);
+        std::string plan;
+        double cost = 1e6;
+        int argument = 0;
+        for (int i = 0; i < info->nConstraint; ++i)
+        {
+            const auto& constraint = info->aConstraint[i];
+            if (!constraint.usable) continue;
+            char column = 0;
+            if (constraint.iColumn == 0) column = 'e';
+            else if (constraint.iColumn == 1) column = 's';
+            else if (constraint.iColumn == vtab.sourceDbColumn) column = 'd';
+            else if (constraint.iColumn == vtab.sourceTableColumn) column = 't';
+            if (!column) continue;
+
+            char op = 0;
+            switch (constraint.op)
+            {
+            case SQLITE_INDEX_CONSTRAINT_EQ: op = '='; break;
+            case SQLITE_INDEX_CONSTRAINT_LT: op = '<'; break;
+            case SQLITE_INDEX_CONSTRAINT_LE: op = '{'; break;
+            case SQLITE_INDEX_CONSTRAINT_GT: op = '>'; break;
+            case SQLITE_INDEX_CONSTRAINT_GE: op = '}'; break;
+            default: break;
+            }
+            if (!op || ((column == 'd' || column == 't') && op != '=')) continue;
+
+            plan += column;
+            plan += op;
+            info->aConstraintUsage[i].argvIndex = ++argument;
+            // Имена файлов и таблиц сравниваются точно; условия на elemId и setN SQLite перепроверяет сам
+            info->aConstraintUsage[i].omit = column == 'd' || column == 't';
+            cost /= op == '=' ? 10.0 : 2.0;
+        }
+        info->estimatedCost = cost;
+        info->estimatedRows = static_cast<sqlite3_int64>(cost);
+        if (!plan.empty())
+        {
+            info->idxStr = sqlite3_mprintf("%s", plan.c_str());
+            info->needToFreeIdxStr = 1;
+        }
+        return SQLITE_OK;
+    }
+
+    int DirOpen(sqlite3_vtab*, sqlite3_vtab_cursor** outCursor)
+    {
+        DirCursor* cursor = new DirCursor();
+        *outCursor = cursor;
+        return SQLITE_OK;
+    }
+
+    int DirClose(sqlite3_vtab_cursor* cursorBase)
+    {
+        DirCursor* cursor = static_cast<DirCursor*>(cursorBase);
+        StopReading(*cursor);
+        delete cursor;
+        return SQLITE_OK;
+    }
+
+    int DirNext(sqlite3_vtab_cursor* cursorBase)
+    {
+        DirCursor& cursor = *static_cast<DirCursor*>(cursorBase);
+        ++cursor.rowid;
+        if (++cursor.row < cursor.current.rows) return SQLITE_OK;
+
+        // Следующая порция: из очереди текущего файла, затем следующих файлов
+        while (cursor.fileIndex < cursor.queues.size())
+        {
+            FileQueue& queue = *cursor.queues[cursor.fileIndex];
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.changed.wait(lock, [&]() { return !queue.batches.empty() || queue.done; });
+            if (!queue.batches.empty())
+            {
+                cursor.current = std::move(queue.batches.front());
+                queue.batches.pop_front();
+                queue.changed.notify_all();
+                cursor.row = 0;
+                return SQLITE_OK;
+            }
+            if (!queue.error.empty())
+            {
+                cursor.eof = true;
+                return SetError(cursor.pVtab, queue.error);
+            }
+            ++cursor.fileIndex;
+        }
+        cursor.eof = true;
+        return SQLITE_OK;
+    }
+
+    int DirFilter(sqlite3_vtab_cursor* cursorBase, int, const char* idxStr, int argc, sqlite3_value** argv)
+    {
+        DirCursor& cursor = *static_cast<DirCursor*>(cursorBase);
+        const DirVtab& vtab = *static_cast<DirVtab*>(cursor.pVtab);
+        StopReading(cursor);
+
+        std::vector<std::string> sourceDbs, sourceTables;
+        bool hasSourceDb = false, hasSourceTable = false;
+        cursor.constraints.clear();
+        const std::string plan = idxStr ? idxStr : "";
+        for (int i = 0; i < argc && 2 * static_cast<size_t>(i) + 1 < plan.size(); ++i)
+        {
+            const char column = plan[2 * i];
+            const char op = plan[2 * i + 1];
+            if (column == 'd' || column == 't')
+            {
+                const unsigned char* text = sqlite3_value_text(argv[i]);
+                std::string name = text ? reinterpret_cast<const char*>(text) : "";
+                if (column == 'd') { hasSourceDb = true; sourceDbs.push_back(name); }
+                else { hasSourceTable = true; sourceTables.push_back(name); }
+                continue;
+            }
+            const char* sqlOp = op == '=' ? "=" : op == '<' ? "<" : op == '{' ? "<=" : op == '>' ? ">" : ">=";
+            cursor.constraints.push_back({ column == 'e' ? kElementIdColumn : kSetNColumn, sqlOp, CopyCell(argv[i]) });
+        }
+        auto matches = [](const std::vector<std::string>& wanted, const std::string& name)
+        {
+            // Несколько условий = на одну колонку должны выполняться все
+            return std::all_of(wanted.begin(), wanted.end(), [&](const std::string& w) { return w == name; });
+        };
+
+        // Выбор файлов и таблиц; таблица без колонки из условия не может дать строк
+        cursor.files.clear();
+        cursor.tablesOfFile.clear();
+        for (size_t t = 0; t < vtab.tables.size(); ++t)
+        {
+            const SourceTable& table = vtab.tables[t];
+            if (hasSourceDb && !matches(sourceDbs, vtab.fileNames[table.file])) continue;
+            if (hasSourceTable && !matches(sourceTables, table.name)) continue;
+            bool hasColumns = true;
+            for (const auto& constraint : cursor.constraints)
+            {
+                int column = constraint.column == kElementIdColumn ? 0 : 1;
+                if (table.sourceColumnOf[column] < 0) hasColumns = false;
+            }
+            if (!hasColumns) continue;
+            if (cursor.files.empty() || cursor.files.back() != table.file)
+            {
+                cursor.files.push_back(table.file);
+                cursor.tablesOfFile.emplace_back();
+            }
+            cursor.tablesOfFile.back().push_back(t);
+        }
+
+        for (size_t i = 0; i < cursor.files.size(); ++i) cursor.queues.emplace_back(new FileQueue());
+        cursor.fileIndex = 0;
+        cursor.current = RowBatch();
+        cursor.row = 0;
+        cursor.rowid = 0;
+        cursor.eof = false;
+        if (!cursor.files.empty())
+        {
+            unsigned threads = vtab.threads > 0 ? vtab.threads : ThreadPool::HardwareThreads();
+            cursor.pool.reset(new ThreadPool(std::min<unsigned>(threads, static_cast<unsigned>(cursor.files.size()))));
+            // Файлы ставятся в очередь по порядку, поэтому файл, который ждет курсор, всегда уже читается
+            for (size_t i = 0; i < cursor.files.size(); ++i)
+            {
+                cursor.pool->Submit([&vtab, &cursor, i]() { ReadFile(vtab, cursor, i); });
+            }
+        }
+        cursor.rowid = -1;
+        return DirNext(cursorBase);
+    }
+
+    int DirEof(sqlite3_vtab_cursor* cursorBase)
+    {
+        return static_cast<DirCursor*>(cursorBase)->eof ? 1 : 0;
+    }
+
+    int DirColumn(sqlite3_vtab_cursor* cursorBase, sqlite3_context* context, int column)
+    {
+        const DirCursor& cursor = *static_cast<DirCursor*>(cursorBase);
+        const DirVtab& vtab = *static_cast<DirVtab*>(cursor.pVtab);
+        const SourceTable& table = vtab.tables[cursor.current.table];
+        if (column == vtab.sourceDbColumn)
+        {
+            sqlite3_result_text(context, vtab.fileNames[table.file].c_str(), -1, SQLITE_TRANSIENT);
+            return SQLITE_OK;
+        }
+        if (column == vtab.sourceTableColumn)
+        {
+            sqlite3_result_text(context, table.name.c_str(), -1, SQLITE_TRANSIENT);
+            return SQLITE_OK;
+        }
+        int sourceColumn = table.sourceColumnOf[column];
+        if (sourceColumn < 0)
+        {
+            sqlite3_result_null(context);
+            return SQLITE_OK;
+        }
+        const Cell& cell = cursor.current.cells[cursor.row * table.width + sourceColumn];
+        switch (cell.type)
+        {
+        case SQLITE_INTEGER: sqlite3_result_int64(context, cell.integer); break;
+        case SQLITE_FLOAT: sqlite3_result_double(context, cell.real); break;
+        case SQLITE_TEXT: sqlite3_result_text(context, cell.bytes.data(), static_cast<int>(cell.bytes.size()), SQLITE_TRANSIENT); break;
+        case SQLITE_BLOB: sqlite3_result_blob(context, cell.bytes.data(), static_cast<int>(cell.bytes.size()), SQLITE_TRANSIENT); break;
+        default: sqlite3_result_null(context); break;
+        }
+        return SQLITE_OK;
+    }
+
+    int DirRowid(sqlite3_vtab_cursor* cursorBase, sqlite3_int64* rowid)
+    {
+        *rowid = static_cast<DirCursor*>(cursorBase)->rowid;
+        return SQLITE_OK;
+    }
+
+    sqlite3_module MakeModule()
+    {
+        sqlite3_module module;
+        std::memset(&module, 0, sizeof(module));
+        module.iVersion = 0;
+        module.xCreate = DirConnect;
+        module.xConnect = DirConnect;
+        module.xBestIndex = DirBestIndex;
+        module.xDisconnect = DirDisconnect;
+        module.xDestroy = DirDisconnect;
+        module.xOpen = DirOpen;
+        module.xClose = DirClose;
+        module.xFilter = DirFilter;
+        module.xNext = DirNext;
+        module.xEof = DirEof;
+        module.xColumn = DirColumn;
+        module.xRowid = DirRowid;
+        return module;
+    }
+
+    const sqlite3_module kFedorDirModule = MakeModule();
+}
+
+int RegisterFedorDirModule(sqlite3* dbHandle)
+{
+    return sqlite3_create_module(dbHandle, "fedor_dir", &kFedorDirModule, nullptr);
+}
+
+#ifdef FEDOR_DIR_EXTENSION
+#ifdef _WIN32
+#define FEDOR_DIR_EXPORT extern "C" __declspec(dllexport)
+#else
+#define FEDOR_DIR_EXPORT extern "C"
+#endif
+
+/// <summary>
+/// Точка входа загружаемого расширения: .load fedor_dir в sqlite3, load_extension в Python.
+/// </summary>
+FEDOR_DIR_EXPORT int sqlite3_fedordir_init(sqlite3* dbHandle, char**, const sqlite3_api_routines* api)
+{
+    SQLITE_EXTENSION_INIT2(api);
+    return RegisterFedorDirModule(dbHandle);
+}
+#endif
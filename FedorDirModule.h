@@ -0,0 +1,22 @@
+#pragma once // Защита от двойного включения
+
+#include "sqlite3.h"
+
+/// <summary>
+/// Виртуальная таблица SQLite "fedor_dir": все таблицы всех .db файлов папки как одно отношение.
+///
+///   CREATE VIRTUAL TABLE all_results USING fedor_dir('D:\Results' [, потоки]);
+///   SELECT elemId, MAX(Asw1i) FROM all_results WHERE setN = 3 GROUP BY elemId;
+///
+/// Колонки: объединение колонок всех таблиц (elemId и setN первыми; в таблице без колонки - NULL)
+/// и скрытые source_db, source_table. Условия =, <, <=, >, >= на elemId и setN передаются в запросы
+/// к исходным файлам, условия = на source_db и source_table отбрасывают лишние файлы и таблицы.
+/// Файлы читаются параллельно (по умолчанию - по числу ядер) с ограниченным буфером на файл;
+/// порядок строк - по файлам в порядке имен. Список файлов и колонок фиксируется при создании таблицы.
+/// Выходные файлы утилит (Envelope.db и т.д.) не читаются.
+/// </summary>
+
+/// <summary>
+/// Регистрирует модуль fedor_dir в соединении (для использования внутри программ).
+/// </summary>
+int RegisterFedorDirModule(sqlite3* dbHandle);
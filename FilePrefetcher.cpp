@@ -0,0 +1,74 @@
+#include "FilePrefetcher.h"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+FilePrefetcher::FilePrefetcher(const std::vector<fs::path>& files, size_t depth) : files_(files), depth_(depth)
+{
+    if (depth_ > 0 && files_.size() > 1) worker_ = std::thread(&FilePrefetcher::WorkerLoop, this);
+}
+
+FilePrefetcher::~FilePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    if (worker_.joinable()) worker_.join();
+}
+
+void FilePrefetcher::Advance(size_t index)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_ = index;
+    }
+    condition_.notify_all();
+}
+
+void FilePrefetcher::WorkerLoop()
+{
+    size_t next = 1; // Файл 0 читает сам обработчик
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        condition_.wait(lock, [&]() { return stopping_ || (next < files_.size() && next <= current_ + depth_); });
+        if (stopping_) return;
+        if (next <= current_)
+        {
+            next = current_ + 1; // Обработка обогнала предзагрузку
+            continue;
+        }
+        const size_t index = next++;
+        lock.unlock();
+        Warm(index);
+        lock.lock();
+    }
+}
+
+void FilePrefetcher::Warm(size_t index)
+{
+#ifdef _WIN32
+    // Прямого аналога WILLNEED для обычного файла нет: последовательное чтение оставляет страницы в кэше
+    const size_t kChunk = 1 << 20;
+    std::vector<char> buffer(kChunk);
+    std::ifstream file(files_[index], std::ios::binary);
+    while (file && !Cancelled(index)) file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+#else
+    // Запрос частями, чтобы не держать диск файлом, обработка которого уже началась
+    const off_t kChunk = 8 << 20;
+    int fd = open(files_[index].c_str(), O_RDONLY);
+    if (fd < 0) return;
+    const off_t size = lseek(fd, 0, SEEK_END);
+    for (off_t offset = 0; offset < size && !Cancelled(index); offset += kChunk)
+    {
+        posix_fadvise(fd, offset, kChunk, POSIX_FADV_WILLNEED);
+    }
+    close(fd);
+#endif
+}
@@ -0,0 +1,48 @@
+#pragma once // Защита от двойного включения
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/// <summary>
+/// Фоновая предзагрузка файлов, которые будут читаться по очереди: пока обрабатывается файл N,
+/// файлы N+1 .. N+depth подтягиваются в файловый кэш ОС, и диск работает одновременно с процессором.
+/// В Linux и других POSIX-системах ядру отдается posix_fadvise(WILLNEED) (чтение идет без копирования в программу),
+/// в Windows файл последовательно читается отдельным потоком.
+/// Предзагрузка файла прерывается, если его обработка уже началась.
+/// </summary>
+class FilePrefetcher
+{
+public:
+    /// <summary>
+    /// files - порядок обработки; depth - сколько файлов впереди текущего загружать (0 - поток не создается).
+    /// </summary>
+    FilePrefetcher(const std::vector<fs::path>& files, size_t depth);
+    ~FilePrefetcher();
+
+    FilePrefetcher(const FilePrefetcher&) = delete;
+    FilePrefetcher& operator=(const FilePrefetcher&) = delete;
+
+    /// <summary>
+    /// Сообщает, что началась обработка файла с номером index.
+    /// </summary>
+    void Advance(size_t index);
+
+private:
+    void WorkerLoop();
+    void Warm(size_t index);
+    bool Cancelled(size_t index) const { return stopping_ || current_ >= index; }
+
+    std::vector<fs::path> files_;
+    size_t depth_;
+    std::atomic<size_t> current_{ 0 };
+    std::atomic<bool> stopping_{ false };
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::thread worker_;
+};
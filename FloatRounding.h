@@ -0,0 +1,43 @@
+#pragma once // Защита от двойного включения
+
+#include <cmath>
+#include <ostream>
+
+/// <summary>
+/// Округление значений до float в режиме одинарной точности (--float32) с учетом наибольшей относительной
+/// ошибки |float(значение) - значение| / |значение|. Общее для огибающей (EnvelopeStore) и анализатора (TopKTable):
+/// одно правило округления и одна итоговая строка в логе обеих программ.
+/// </summary>
+class FloatRounding
+{
+public:
+    /// <summary>
+    /// Округляет значение до float и запоминает ошибку. Сравнение идет умножением, а деление выполняется
+    /// только когда ошибка растет, то есть почти никогда: округление стоит в цикле по всем значениям.
+    /// </summary>
+    float Round(double value)
+    {
+        const float rounded = static_cast<float>(value);
+        const double error = std::fabs(static_cast<double>(rounded) - value);
+        if (error > maxError_ * std::fabs(value)) maxError_ = error / std::fabs(value);
+        return rounded;
+    }
+
+    /// <summary>
+    /// Наибольшая относительная ошибка округленных значений (0, если округлений не было).
+    /// </summary>
+    double MaxError() const { return maxError_; }
+
+    void Reset() { maxError_ = 0.0; }
+
+    /// <summary>
+    /// Печатает наибольшую относительную ошибку округления в конце работы.
+    /// </summary>
+    static void LogMaxError(std::ostream& log, double maxError)
+    {
+        log << "Single precision: largest relative rounding error " << maxError << " (float keeps about 7 digits)." << std::endl;
+    }
+
+private:
+    double maxError_ = 0.0;
+};
@@ -0,0 +1,67 @@
+#include "FolderWatcher.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FolderWatcher::FolderWatcher(const fs::path& folder, double pollSeconds)
+    : folder_(folder), pollSeconds_(pollSeconds)
+{
+#ifdef __linux__
+    notifyHandle_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyHandle_ >= 0 && inotify_add_watch(notifyHandle_, folder_.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY) < 0)
+    {
+        // Например, папка на сетевом диске: переходим на опрос
+        close(notifyHandle_);
+        notifyHandle_ = -1;
+    }
+#endif
+}
+
+FolderWatcher::~FolderWatcher()
+{
+#ifdef __linux__
+    if (notifyHandle_ >= 0) close(notifyHandle_);
+#endif
+}
+
+std::vector<FolderWatcher::Event> FolderWatcher::Wait(double timeoutSeconds)
+{
+    std::vector<Event> events;
+#ifdef __linux__
+    if (notifyHandle_ >= 0)
+    {
+        pollfd descriptor{ notifyHandle_, POLLIN, 0 };
+        if (poll(&descriptor, 1, static_cast<int>(std::max(0.0, timeoutSeconds) * 1000)) <= 0) return events;
+
+        alignas(inotify_event) char buffer[16 * 1024];
+        ssize_t length;
+        while ((length = read(notifyHandle_, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* p = buffer; p < buffer + length;)
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                if (event->len > 0 && !(event->mask & IN_ISDIR))
+                {
+                    events.push_back({ folder_ / event->name, (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0 });
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        return events;
+    }
+#endif
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(std::max(0.0, std::min(timeoutSeconds, pollSeconds_))));
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(folder_, ec))
+    {
+        if (entry.is_regular_file(ec)) events.push_back({ entry.path(), false });
+    }
+    return events;
+}
@@ -0,0 +1,47 @@
+#pragma once // Защита от двойного включения
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/// <summary>
+/// Наблюдение за папкой, в которую другой процесс записывает файлы.
+/// В Linux используется inotify: событие приходит, когда файл закрыт после записи (IN_CLOSE_WRITE)
+/// или перемещен в папку (IN_MOVED_TO). На других системах папка опрашивается с заданным интервалом.
+/// </summary>
+class FolderWatcher
+{
+public:
+    struct Event
+    {
+        fs::path path;
+        bool closed = false; // Файл закрыт писателем (только inotify; при опросе всегда false)
+    };
+
+    /// <summary>
+    /// pollSeconds - интервал опроса, если уведомления недоступны.
+    /// </summary>
+    FolderWatcher(const fs::path& folder, double pollSeconds);
+    ~FolderWatcher();
+
+    FolderWatcher(const FolderWatcher&) = delete;
+    FolderWatcher& operator=(const FolderWatcher&) = delete;
+
+    /// <summary>
+    /// Ждет изменений не дольше timeoutSeconds. Возвращает файлы, которые могли измениться
+    /// (пустой список при таймауте). При опросе возвращает все файлы папки.
+    /// </summary>
+    std::vector<Event> Wait(double timeoutSeconds);
+
+    /// <summary>
+    /// True, если работают уведомления системы, а не опрос.
+    /// </summary>
+    bool UsesNotifications() const { return notifyHandle_ >= 0; }
+
+private:
+    fs::path folder_;
+    double pollSeconds_;
+    int notifyHandle_ = -1;
+};
@@ -0,0 +1,23 @@
+#pragma once // Защита от двойного включения
+
+#include <string>
+
+/// <summary>
+/// Базы, которые программы пакета пишут в папку с исходными .db файлами: результаты FEDOR_Enveloper и анализатора
+/// и временная база анализатора. При следующем запуске они не являются исходными данными, поэтому все, кто ищет
+/// исходные файлы в папке (FEDOR_Enveloper, анализатор, виртуальная таблица fedor_dir), пропускают их по этому списку.
+/// Новое имя выходного файла добавляется сюда.
+/// </summary>
+inline bool IsToolOutputFile(const std::string& fileName)
+{
+    static const char* const kOutputFiles[] = {
+        "Envelope.db", "Envelope_Summed.db",                  // FEDOR_Enveloper
+        "Envelope_Diff.db",                                   // FEDOR_Enveloper --compare без --diff
+        "Enveloped_Reinforcement_Analysis.db", "__temp_envelope.db" // Анализатор: результат и временная база
+    };
+    for (const char* output : kOutputFiles)
+    {
+        if (fileName == output) return true;
+    }
+    return false;
+}
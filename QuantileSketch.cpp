@@ -0,0 +1,206 @@
+#include "QuantileSketch.h"
+#include <cstring>
+#include <limits>
+
+namespace Builder
+{
+    namespace
+    {
+        void WriteFloat(unsigned char*& bytes, float value)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            for (int i = 0; i < 4; ++i) *bytes++ = static_cast<unsigned char>(bits >> (8 * i));
+        }
+
+        float ReadFloat(const unsigned char*& bytes)
+        {
+            uint32_t bits = 0;
+            for (int i = 0; i < 4; ++i) bits |= static_cast<uint32_t>(*bytes++) << (8 * i);
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    }
+
+    void QuantileSketch::Flush()
+    {
+        if (buffered_ == 0) return;
+        // Insertion sort: the buffer is small
+        for (int i = 1; i < buffered_; ++i)
+        {
+            const float value = buffer_[i];
+            int j = i;
+            for (; j > 0 && buffer_[j - 1] > value; --j) buffer_[j] = buffer_[j - 1];
+            buffer_[j] = value;
+        }
+        float weights[kBuffer];
+        for (int i = 0; i < buffered_; ++i) weights[i] = 1.0f;
+        const int count = buffered_;
+        buffered_ = 0;
+        MergeSorted(buffer_, weights, (1u << count) - 1, count);
+    }
+
+    void QuantileSketch::MergeSorted(const float* means, const float* weights, uint32_t exact, int count)
+    {
+        // Merge of the two sorted lists; equal exact values join one centroid (typically the zeros of a column)
+        const int kMaxMerged = 2 * kCapacity;
+        float mergedMeans[kMaxMerged];
+        float mergedWeights[kMaxMerged];
+        uint32_t mergedExact = 0;
+        int size = 0;
+        int own = 0, added = 0;
+        while (own < size_ || added < count)
+        {
+            const bool takeOwn = added == count || (own < size_ && means_[own] <= means[added]);
+            const float mean = takeOwn ? means_[own] : means[added];
+            const float weight = takeOwn ? weights_[own] : weights[added];
+            const bool isExact = takeOwn ? IsExact(own++) : ((exact >> added++) & 1u) != 0;
+            if (isExact && size > 0 && mergedMeans[size - 1] == mean && ((mergedExact >> (size - 1)) & 1u))
+            {
+                mergedWeights[size - 1] += weight;
+                continue;
+            }
+            mergedMeans[size] = mean;
+            mergedWeights[size] = weight;
+            mergedExact |= static_cast<uint32_t>(isExact) << size;
+            ++size;
+        }
+
+        if (size > kCapacity)
+        {
+            // Cost of merging centroids i and i + 1: their weight relative to q(1-q) at their common center,
+            // so centroids stay small near the tails. Only the neighbours of a merged pair change their cost.
+            double before[kMaxMerged];
+            double total = 0.0;
+            for (int i = 0; i < size; ++i)
+            {
+                before[i] = total;
+                total += mergedWeights[i];
+            }
+            auto pairCost = [&](int i)
+            {
+                const double weight = static_cast<double>(mergedWeights[i]) + mergedWeights[i + 1];
+                const double center = before[i] + weight / 2;
+                return weight / (center * (total - center));
+            };
+            double costs[kMaxMerged];
+            for (int i = 0; i + 1 < size; ++i) costs[i] = pairCost(i);
+
+            while (size > kCapacity)
+            {
+                int best = 0;
+                double bestCost = costs[0];
+                for (int i = 1; i + 1 < size; ++i)
+                {
+                    best = costs[i] < bestCost ? i : best;
+                    bestCost = costs[i] < bestCost ? costs[i] : bestCost;
+                }
+
+                // Two different values or an inexact centroid take part, so the result is never exact
+                const double weight = static_cast<double>(mergedWeights[best]) + mergedWeights[best + 1];
+                mergedMeans[best] = static_cast<float>((static_cast<double>(mergedMeans[best]) * mergedWeights[best] +
+                                                        static_cast<double>(mergedMeans[best + 1]) * mergedWeights[best + 1]) / weight);
+                mergedWeights[best] = static_cast<float>(weight);
+                for (int i = best + 1; i + 1 < size; ++i)
+                {
+                    mergedMeans[i] = mergedMeans[i + 1];
+                    mergedWeights[i] = mergedWeights[i + 1];
+                    before[i] = before[i + 1];
+                }
+                for (int i = best + 1; i + 2 < size; ++i) costs[i] = costs[i + 1];
+                const uint32_t below = (1u << best) - 1;
+                mergedExact = (mergedExact & below) | ((mergedExact >> 1) & ~below & ~(1u << best));
+                --size;
+                if (best + 1 < size) costs[best] = pairCost(best);
+                if (best > 0) costs[best - 1] = pairCost(best - 1);
+            }
+        }
+
+        for (int i = 0; i < size; ++i)
+        {
+            means_[i] = mergedMeans[i];
+            weights_[i] = mergedWeights[i];
+        }
+        exact_ = static_cast<uint16_t>(mergedExact);
+        size_ = static_cast<uint8_t>(size);
+    }
+
+    void QuantileSketch::MergeFrom(const QuantileSketch& other)
+    {
+        if (other.Empty()) return;
+        QuantileSketch flushed = other;
+        flushed.Flush();
+        Flush();
+        min_ = Empty() || other.min_ < min_ ? other.min_ : min_;
+        max_ = Empty() || other.max_ > max_ ? other.max_ : max_;
+        total_ += other.total_;
+        MergeSorted(flushed.means_, flushed.weights_, flushed.exact_, flushed.size_);
+    }
+
+    double QuantileSketch::Quantile(double q) const
+    {
+        if (Empty()) return std::numeric_limits<double>::quiet_NaN();
+        QuantileSketch sketch = *this;
+        sketch.Flush();
+        q = q < 0.0 ? 0.0 : (q > 1.0 ? 1.0 : q);
+        const double rank = q * total_;
+
+        // Every value stands at the middle of its rank (k + 0.5): an exact centroid spans the ranks of its first
+        // and last value, any other centroid stands at the middle of its weight. Between them the value is
+        // interpolated; the extremes are at rank 0 and rank total.
+        double before = 0.0;
+        double previousRank = 0.0;
+        double previousValue = min_;
+        for (int i = 0; i < sketch.size_; ++i)
+        {
+            const double weight = sketch.weights_[i];
+            const double first = sketch.IsExact(i) ? before + 0.5 : before + weight / 2.0;
+            const double last = sketch.IsExact(i) ? before + weight - 0.5 : first;
+            if (rank < first)
+            {
+                return previousValue + (rank - previousRank) / (first - previousRank) * (static_cast<double>(sketch.means_[i]) - previousValue);
+            }
+            if (rank <= last) return sketch.means_[i];
+            previousRank = last;
+            previousValue = sketch.means_[i];
+            before += weight;
+        }
+        const double span = total_ - previousRank;
+        return span > 0.0 ? previousValue + (rank - previousRank) / span * (static_cast<double>(max_) - previousValue) : max_;
+    }
+
+    size_t QuantileSketch::Serialize(unsigned char* bytes) const
+    {
+        QuantileSketch sketch = *this;
+        sketch.Flush();
+        unsigned char* position = bytes;
+        *position++ = kFormatVersion;
+        *position++ = sketch.size_;
+        *position++ = static_cast<unsigned char>(sketch.exact_);
+        *position++ = static_cast<unsigned char>(sketch.exact_ >> 8);
+        WriteFloat(position, sketch.total_);
+        WriteFloat(position, sketch.min_);
+        WriteFloat(position, sketch.max_);
+        for (int i = 0; i < sketch.size_; ++i) WriteFloat(position, sketch.means_[i]);
+        for (int i = 0; i < sketch.size_; ++i) WriteFloat(position, sketch.weights_[i]);
+        return static_cast<size_t>(position - bytes);
+    }
+
+    bool QuantileSketch::Deserialize(const unsigned char* bytes, size_t size)
+    {
+        if (size < 16 || bytes[0] != kFormatVersion || bytes[1] > kCapacity || size != 16 + 8 * static_cast<size_t>(bytes[1])) return false;
+        QuantileSketch sketch;
+        sketch.size_ = bytes[1];
+        sketch.exact_ = static_cast<uint16_t>(bytes[2] | (bytes[3] << 8));
+        if (sketch.size_ < kCapacity && (sketch.exact_ >> sketch.size_) != 0) return false;
+        const unsigned char* position = bytes + 4;
+        sketch.total_ = ReadFloat(position);
+        sketch.min_ = ReadFloat(position);
+        sketch.max_ = ReadFloat(position);
+        for (int i = 0; i < sketch.size_; ++i) sketch.means_[i] = ReadFloat(position);
+        for (int i = 0; i < sketch.size_; ++i) sketch.weights_[i] = ReadFloat(position);
+        *this = sketch;
+        return true;
+    }
+}
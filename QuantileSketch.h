@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Builder
+{
+    /**
+     * @class QuantileSketch
+     * @brief Fixed-size mergeable sketch of a value distribution, for percentiles of one element column across
+     * all combinations: a small t-digest of at most kCapacity weighted centroids, sorted by mean.
+     *
+     * New values wait in a buffer of kBuffer values; a full buffer is sorted, merged into the centroids and
+     * compressed back to kCapacity at once, so adding a value is usually a store and two compares.
+     * Up to kCapacity distinct values are kept exactly. Past that, the two neighbouring centroids whose merge costs
+     * the least are combined; the cost grows towards the tails (weight / q(1-q)), so the upper percentiles stay sharp.
+     * Equal values share one centroid that is marked exact and covers its whole rank range, so the many zeros of
+     * a column (no crack, no reinforcement) do not blur the percentiles. The smallest and largest values are kept
+     * exactly. Two sketches merge into one (MergeFrom), so partial results, e.g. of different files, can be combined.
+     * The size does not depend on the number of values (about 180 bytes).
+     */
+    class QuantileSketch
+    {
+    public:
+        static constexpr int kCapacity = 16;
+        static constexpr int kBuffer = 8;
+        static constexpr uint8_t kFormatVersion = 1;
+        static constexpr size_t kMaxSerializedSize = 16 + 8 * kCapacity;
+
+        void Add(double value)
+        {
+            const float v = static_cast<float>(value);
+            min_ = total_ == 0.0f || v < min_ ? v : min_;
+            max_ = total_ == 0.0f || v > max_ ? v : max_;
+            total_ += 1.0f;
+            buffer_[buffered_++] = v;
+            if (buffered_ == kBuffer) Flush();
+        }
+
+        /**
+         * @brief Adds all values of another sketch.
+         */
+        void MergeFrom(const QuantileSketch& other);
+
+        /**
+         * @return The estimated value at quantile q (0..1), interpolated between centroids; NaN for an empty sketch.
+         * While all centroids are exact this is the percentile of the values themselves (position q * count - 0.5
+         * in the sorted values, interpolated).
+         */
+        double Quantile(double q) const;
+
+        /**
+         * @return The number of values added.
+         */
+        double Count() const { return total_; }
+
+        bool Empty() const { return total_ == 0.0f; }
+
+        /**
+         * @brief Writes the sketch in a portable form: a version byte, the centroid count, the exact bits, count, min
+         * and max, then only the used centroids (buffered values are merged first). Little-endian, independent of the
+         * compiler's layout, so equal sketches give equal bytes.
+         * @param bytes At least kMaxSerializedSize bytes.
+         * @return The number of bytes written.
+         */
+        size_t Serialize(unsigned char* bytes) const;
+
+        /**
+         * @brief Reads a sketch written by Serialize.
+         * @return False if the bytes are not a sketch of kFormatVersion (the sketch is then unchanged).
+         */
+        bool Deserialize(const unsigned char* bytes, size_t size);
+
+    private:
+        /**
+         * @brief Moves the buffered values into the centroids.
+         */
+        void Flush();
+
+        /**
+         * @brief Merges a sorted list of centroids into this sketch and compresses the result to kCapacity.
+         * @param exact Bit i: centroid i of the list holds equal values only.
+         */
+        void MergeSorted(const float* means, const float* weights, uint32_t exact, int count);
+
+        bool IsExact(int i) const { return (exact_ >> i) & 1u; }
+
+        float means_[kCapacity] = {};   // Sorted by mean
+        float weights_[kCapacity] = {};
+        float buffer_[kBuffer] = {};    // Values not merged into the centroids yet
+        float min_ = 0.0f;
+        float max_ = 0.0f;
+        float total_ = 0.0f;       // Number of values, buffered ones included (exact up to 2^24)
+        uint16_t exact_ = 0;       // Bit i: centroid i holds equal values only
+        uint8_t size_ = 0;
+        uint8_t buffered_ = 0;
+    };
+}
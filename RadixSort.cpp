@@ -0,0 +1,37 @@
+#include "RadixSort.h"
+#include <algorithm>
+#include <cstdint>
+
+std::vector<int> RadixSortedOrder(const std::vector<long long>& keys)
+{
+    const size_t count = keys.size();
+    std::vector<int> order(count);
+    for (size_t i = 0; i < count; ++i) order[i] = static_cast<int>(i);
+    if (count < 2) return order;
+
+    // Знаковые ключи сравниваются как беззнаковые с инвертированным старшим битом
+    std::vector<uint64_t> biased(count);
+    for (size_t i = 0; i < count; ++i) biased[i] = static_cast<uint64_t>(keys[i]) ^ (uint64_t(1) << 63);
+
+    const int kDigitBits = 11;
+    const uint64_t kDigitMask = (uint64_t(1) << kDigitBits) - 1;
+    std::vector<size_t> starts(size_t(1) << kDigitBits);
+    std::vector<int> sorted(count);
+    for (int shift = 0; shift < 64; shift += kDigitBits)
+    {
+        std::fill(starts.begin(), starts.end(), 0);
+        for (uint64_t key : biased) ++starts[(key >> shift) & kDigitMask];
+        if (starts[(biased[0] >> shift) & kDigitMask] == count) continue; // Разряд у всех одинаков: порядок не меняется
+
+        size_t position = 0;
+        for (size_t& start : starts)
+        {
+            const size_t digitCount = start;
+            start = position;
+            position += digitCount;
+        }
+        for (int index : order) sorted[starts[(biased[index] >> shift) & kDigitMask]++] = index;
+        order.swap(sorted);
+    }
+    return order;
+}
@@ -0,0 +1,11 @@
+#pragma once // Защита от двойного включения
+
+#include <vector>
+
+/// <summary>
+/// Порядок индексов, при котором ключи идут по возрастанию: order[0] - индекс наименьшего ключа.
+/// Поразрядная (LSD radix) сортировка по 11 бит за проход, без сравнений; проход пропускается, если разряд у всех
+/// ключей одинаков (у id одной модели обычно заняты только младшие разряды), поэтому миллион id сортируется
+/// за два-три прохода по массиву. Равные ключи остаются в исходном порядке. Отрицательные ключи допустимы.
+/// </summary>
+std::vector<int> RadixSortedOrder(const std::vector<long long>& keys);
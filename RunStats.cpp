@@ -0,0 +1,201 @@
+#include "RunStats.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/// <summary>
+/// Экранирует строку для записи в JSON.
+/// </summary>
+static std::string JsonEscape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (char c : s)
+    {
+        switch (c)
+        {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+    }
+    return out;
+}
+
+static double RowsPerSecond(long long rows, double seconds)
+{
+    return seconds > 0.0 ? static_cast<double>(rows) / seconds : 0.0;
+}
+
+void RunStats::FileStats::AddTable(const std::string& tableName, long long rowCount, double tableSeconds)
+{
+    tables.push_back({ tableName, rowCount, tableSeconds });
+    rows += rowCount;
+}
+
+RunStats::ScopedTimer::ScopedTimer(RunStats& stats, std::string passName)
+    : stats_(stats), passName_(std::move(passName))
+{
+}
+
+RunStats::ScopedTimer::~ScopedTimer()
+{
+    stats_.AddPass(passName_, timer_.Seconds());
+}
+
+RunStats::RunStats(std::string toolName) : toolName_(std::move(toolName))
+{
+}
+
+RunStats::FileStats& RunStats::BeginFile(const std::string& passName, const fs::path& filePath)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    FileStats& file = files_.emplace_back();
+    file.pass = passName;
+    file.name = filePath.filename().string();
+    std::error_code ec;
+    std::uintmax_t size = fs::file_size(filePath, ec);
+    file.bytes = ec ? 0 : size;
+    return file;
+}
+
+void RunStats::EndFile(FileStats& file, sqlite3* dbHandle)
+{
+    file.seconds = file.timer.Seconds();
+    if (dbHandle)
+    {
+        int current = 0, highwater = 0;
+        // Счетчики сбрасываются: соединение может использоваться в нескольких проходах (ConnectionCache)
+        if (sqlite3_db_status(dbHandle, SQLITE_DBSTATUS_CACHE_HIT, &current, &highwater, 1) == SQLITE_OK) file.cacheHits = current;
+        if (sqlite3_db_status(dbHandle, SQLITE_DBSTATUS_CACHE_MISS, &current, &highwater, 1) == SQLITE_OK) file.cacheMisses = current;
+    }
+}
+
+void RunStats::AddPass(const std::string& passName, double seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& pass : passes_)
+    {
+        if (pass.name == passName)
+        {
+            pass.seconds += seconds;
+            return;
+        }
+    }
+    passes_.push_back({ passName, seconds });
+}
+
+void RunStats::PrintSummary(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, long long> rowsByPass;
+    for (const auto& file : files_) rowsByPass[file.pass] += file.rows;
+
+    out << "\n--- Timing summary (" << toolName_ << ") ---\n";
+    for (const auto& pass : passes_)
+    {
+        long long rows = rowsByPass.count(pass.name) ? rowsByPass.at(pass.name) : 0;
+        out << "  " << std::left << std::setw(12) << pass.name << std::right
+            << std::fixed << std::setprecision(3) << std::setw(10) << pass.seconds << " s";
+        if (rows > 0) out << "  " << rows << " rows (" << std::setprecision(0) << RowsPerSecond(rows, pass.seconds) << " rows/s)";
+        out << "\n";
+    }
+    out << "  Total       " << std::setprecision(3) << std::setw(10) << totalTimer_.Seconds() << " s";
+    std::uintmax_t peakRss = PeakRssBytes();
+    if (peakRss > 0) out << ", peak RSS " << peakRss / (1024 * 1024) << " MB";
+    out << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+bool RunStats::WriteJsonReport() const
+{
+    if (reportPath_.empty()) return true;
+
+    std::ofstream json(reportPath_);
+    if (!json.is_open()) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    json << std::setprecision(6);
+    json << "{\n";
+    json << "  \"tool\": \"" << JsonEscape(toolName_) << "\",\n";
+    json << "  \"totalSeconds\": " << totalTimer_.Seconds() << ",\n";
+    json << "  \"peakRssBytes\": " << PeakRssBytes() << ",\n";
+
+    json << "  \"passes\": [";
+    for (size_t i = 0; i < passes_.size(); ++i)
+    {
+        json << (i ? ",\n" : "\n") << "    { \"name\": \"" << JsonEscape(passes_[i].name) << "\", \"seconds\": " << passes_[i].seconds << " }";
+    }
+    json << (passes_.empty() ? "],\n" : "\n  ],\n");
+
+    json << "  \"files\": [";
+    bool firstFile = true;
+    for (const auto& file : files_)
+    {
+        json << (firstFile ? "\n" : ",\n");
+        firstFile = false;
+        json << "    { \"pass\": \"" << JsonEscape(file.pass) << "\", \"name\": \"" << JsonEscape(file.name) << "\""
+             << ", \"bytes\": " << file.bytes << ", \"rows\": " << file.rows << ", \"seconds\": " << file.seconds
+             << ", \"rowsPerSecond\": " << RowsPerSecond(file.rows, file.seconds)
+             << ", \"cacheHits\": " << file.cacheHits << ", \"cacheMisses\": " << file.cacheMisses
+             << ", \"tables\": [";
+        for (size_t i = 0; i < file.tables.size(); ++i)
+        {
+            const TableStats& table = file.tables[i];
+            json << (i ? ", " : "") << "{ \"name\": \"" << JsonEscape(table.name) << "\", \"rows\": " << table.rows
+                 << ", \"seconds\": " << table.seconds << ", \"rowsPerSecond\": " << RowsPerSecond(table.rows, table.seconds) << " }";
+        }
+        json << "] }";
+    }
+    json << (files_.empty() ? "]\n" : "\n  ]\n");
+    json << "}\n";
+    return static_cast<bool>(json);
+}
+
+std::uintmax_t RunStats::PeakRssBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<std::uintmax_t>(usage.ru_maxrss);
+#else
+    return static_cast<std::uintmax_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+fs::path RunStats::ReportPathFromEnvironment()
+{
+    const char* value = std::getenv("FEDOR_REPORT_JSON");
+    return value && *value ? fs::path(value) : fs::path();
+}
@@ -0,0 +1,138 @@
+#pragma once // Защита от двойного включения
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "sqlite3.h"
+
+namespace fs = std::filesystem;
+
+/// <summary>
+/// Простой секундомер на монотонных часах.
+/// </summary>
+class Stopwatch
+{
+public:
+    Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+
+    void Restart() { start_ = std::chrono::steady_clock::now(); }
+
+    double Seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+/// <summary>
+/// Статистика одного запуска утилиты: время проходов (verify, envelope, assemble и т.д.),
+/// счетчики по файлам и таблицам, пиковое потребление памяти и попадания в кэш страниц SQLite.
+/// Общая для всех утилит, чтобы отчеты разных запусков можно было сравнивать между собой.
+/// </summary>
+class RunStats
+{
+public:
+    struct TableStats
+    {
+        std::string name;
+        long long rows = 0;
+        double seconds = 0.0;
+    };
+
+    struct FileStats
+    {
+        std::string pass;
+        std::string name;
+        std::uintmax_t bytes = 0;
+        long long rows = 0;
+        double seconds = 0.0;
+        long long cacheHits = 0;
+        long long cacheMisses = 0;
+        std::vector<TableStats> tables;
+        Stopwatch timer;
+
+        /// <summary>
+        /// Добавляет счетчики обработанной таблицы к файлу.
+        /// </summary>
+        void AddTable(const std::string& tableName, long long rowCount, double tableSeconds);
+    };
+
+    struct PassStats
+    {
+        std::string name;
+        double seconds = 0.0;
+    };
+
+    /// <summary>
+    /// RAII-таймер прохода: при выходе из области видимости записывает время в статистику.
+    /// </summary>
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(RunStats& stats, std::string passName);
+        ~ScopedTimer();
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        RunStats& stats_;
+        std::string passName_;
+        Stopwatch timer_;
+    };
+
+    explicit RunStats(std::string toolName);
+
+    /// <summary>
+    /// Начинает учет файла в рамках прохода. Ссылка остается валидной до конца жизни объекта.
+    /// </summary>
+    FileStats& BeginFile(const std::string& passName, const fs::path& filePath);
+
+    /// <summary>
+    /// Завершает учет файла. Если передан dbHandle, снимает с него статистику кэша страниц и сбрасывает ее
+    /// (вызывать до sqlite3_close).
+    /// </summary>
+    void EndFile(FileStats& file, sqlite3* dbHandle);
+
+    /// <summary>
+    /// Добавляет время прохода. Повторные проходы с тем же именем суммируются (режим наблюдения за папкой).
+    /// </summary>
+    void AddPass(const std::string& passName, double seconds);
+
+    void SetReportPath(const fs::path& reportPath) { reportPath_ = reportPath; }
+    const fs::path& GetReportPath() const { return reportPath_; }
+
+    /// <summary>
+    /// Печатает краткую сводку по проходам в консоль.
+    /// </summary>
+    void PrintSummary(std::ostream& out) const;
+
+    /// <summary>
+    /// Сохраняет JSON-отчет, если задан путь. Возвращает false при ошибке записи.
+    /// </summary>
+    bool WriteJsonReport() const;
+
+    /// <summary>
+    /// Пиковый объем резидентной памяти процесса в байтах (0, если недоступно).
+    /// </summary>
+    static std::uintmax_t PeakRssBytes();
+
+    /// <summary>
+    /// Путь к JSON-отчету из переменной окружения FEDOR_REPORT_JSON (пустой, если не задана).
+    /// </summary>
+    static fs::path ReportPathFromEnvironment();
+
+private:
+    std::string toolName_;
+    fs::path reportPath_;
+    Stopwatch totalTimer_;
+    std::deque<FileStats> files_;
+    std::vector<PassStats> passes_;
+    mutable std::mutex mutex_;
+};
@@ -0,0 +1,209 @@
+// В расширении fedor_dir вызовы SQLite идут через таблицу функций, переданную при загрузке (sqlite3_api)
+#ifdef FEDOR_DIR_EXTENSION
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+#endif
+
+#include "SqliteAccess.h"
+#include <cstdio>
+
+std::string SourceUri(const fs::path& path, const ReadProfile& profile)
+{
+    // Символы, которые в URI имеют особый смысл, кодируются; разделители пути - всегда '/'
+    std::string uri = "file:";
+    if (path.has_root_name()) uri += "///";
+    else if (path.has_root_directory()) uri += "//";
+    for (char c : path.generic_string())
+    {
+        if (c == '%' || c == '?' || c == '#')
+        {
+            char escaped[4];
+            std::snprintf(escaped, sizeof(escaped), "%%%02X", static_cast<unsigned char>(c));
+            uri += escaped;
+        }
+        else
+        {
+            uri += c;
+        }
+    }
+    uri += "?mode=ro";
+
+    std::error_code ec;
+    if (profile.immutable && !fs::exists(path.string() + "-journal", ec) && !fs::exists(path.string() + "-wal", ec)) uri += "&immutable=1";
+    return uri;
+}
+
+void ApplyReadProfile(sqlite3* dbHandle, const std::string& schema, const fs::path& path, const ReadProfile& profile)
+{
+    const std::string prefix = "PRAGMA \"" + schema + "\".";
+    std::string sql = prefix + "cache_size = -" + std::to_string(profile.cacheKib) + ";";
+    if (profile.memoryMap)
+    {
+        // SQLite ограничивает значение своим максимумом (SQLITE_MAX_MMAP_SIZE); остаток файла читается обычным образом
+        std::error_code ec;
+        std::uintmax_t size = fs::file_size(path, ec);
+        if (!ec) sql += " " + prefix + "mmap_size = " + std::to_string(size) + ";";
+    }
+    sqlite3_exec(dbHandle, sql.c_str(), nullptr, nullptr, nullptr);
+}
+
+std::vector<std::string> ReadTableNames(sqlite3* dbHandle)
+{
+    std::vector<std::string> tableNames;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT name FROM sqlite_master WHERE type='table';", -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            tableNames.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        }
+    }
+    sqlite3_finalize(stmt);
+    return tableNames;
+}
+
+bool HasIndexOn(sqlite3* dbHandle, const std::string& tableName, const std::string& columnName)
+{
+    bool indexed = false;
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT 1 FROM pragma_index_list(?1) AS list, pragma_index_info(list.name) AS info WHERE info.seqno = 0 AND info.name = ?2;";
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, tableName.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, columnName.c_str(), -1, SQLITE_TRANSIENT);
+        indexed = sqlite3_step(stmt) == SQLITE_ROW;
+    }
+    sqlite3_finalize(stmt);
+    return indexed;
+}
+
+// =================================================================
+//                        SqliteConnection
+// =================================================================
+
+SqliteConnection::SqliteConnection(const fs::path& path, int flags) : path_(path)
+{
+    if (sqlite3_open_v2(path.string().c_str(), &handle_, flags, nullptr) != SQLITE_OK)
+    {
+        openError_ = sqlite3_errmsg(handle_);
+        sqlite3_close(handle_);
+        handle_ = nullptr;
+    }
+}
+
+SqliteConnection::SqliteConnection(const fs::path& path, const ReadProfile& profile)
+    : SqliteConnection(fs::path(SourceUri(path, profile)), SQLITE_OPEN_READONLY | SQLITE_OPEN_URI)
+{
+    path_ = path;
+    if (!handle_) return;
+    sqlite3_exec(handle_, "PRAGMA query_only = 1; PRAGMA temp_store = MEMORY;", nullptr, nullptr, nullptr);
+    ApplyReadProfile(handle_, "main", path, profile);
+}
+
+SqliteConnection::~SqliteConnection()
+{
+    for (auto& statement : statements_) sqlite3_finalize(statement.second);
+    if (handle_) sqlite3_close(handle_);
+}
+
+StatementLease SqliteConnection::Prepare(const std::string& sql)
+{
+    auto it = statements_.find(sql);
+    if (it != statements_.end()) return StatementLease(it->second);
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(handle_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        sqlite3_finalize(stmt);
+        return StatementLease();
+    }
+    statements_.emplace(sql, stmt);
+    return StatementLease(stmt);
+}
+
+const std::vector<std::string>& SqliteConnection::TableNames()
+{
+    if (!tableNames_) tableNames_.reset(new std::vector<std::string>(ReadTableNames(handle_)));
+    return *tableNames_;
+}
+
+const std::vector<std::string>& SqliteConnection::ColumnNames(const std::string& tableName)
+{
+    auto it = columnNames_.find(tableName);
+    if (it != columnNames_.end()) return it->second;
+
+    // Отдельный запрос, а не из кэша: вызывающий обычно уже держит StatementLease на SelectAllSql этой таблицы
+    std::vector<std::string> names;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(handle_, SelectAllSql(tableName).c_str(), -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        for (int i = 0; i < sqlite3_column_count(stmt); ++i) names.push_back(sqlite3_column_name(stmt, i));
+    }
+    sqlite3_finalize(stmt);
+    return columnNames_.emplace(tableName, std::move(names)).first->second;
+}
+
+std::string SqliteConnection::SelectAllSql(const std::string& tableName)
+{
+    return "SELECT * FROM \"" + tableName + "\";";
+}
+
+// =================================================================
+//                        ConnectionCache
+// =================================================================
+
+ConnectionCache::ConnectionCache(size_t capacity) : capacity_(capacity > 0 ? capacity : 1)
+{
+}
+
+SqliteConnection* ConnectionCache::OpenReadOnly(const fs::path& path)
+{
+    std::error_code ec;
+    std::uintmax_t size = fs::file_size(path, ec);
+    fs::file_time_type writeTime = ec ? fs::file_time_type() : fs::last_write_time(path, ec);
+
+    const std::string key = path.string();
+    auto it = entries_.find(key);
+    if (it != entries_.end())
+    {
+        if (!ec && it->second.size == size && it->second.writeTime == writeTime)
+        {
+            ++hits_;
+            it->second.lastUse = ++useCounter_;
+            return it->second.connection.get();
+        }
+        entries_.erase(it); // Файл изменился: схема и запросы могли устареть
+    }
+
+    ++misses_;
+    std::unique_ptr<SqliteConnection> connection(new SqliteConnection(path, profile_));
+    if (!connection->IsOpen())
+    {
+        lastError_ = connection->OpenError();
+        return nullptr;
+    }
+
+    if (entries_.size() >= capacity_)
+    {
+        // Вытесняется последнее использованное соединение: проходы читают файлы по кругу в одном порядке,
+        // и при вытеснении самого старого каждый следующий проход промахивался бы по всем файлам
+        auto victim = entries_.begin();
+        for (auto candidate = entries_.begin(); candidate != entries_.end(); ++candidate)
+        {
+            if (candidate->second.lastUse > victim->second.lastUse) victim = candidate;
+        }
+        entries_.erase(victim);
+    }
+
+    Entry& entry = entries_[key];
+    entry.connection = std::move(connection);
+    entry.size = size;
+    entry.writeTime = writeTime;
+    entry.lastUse = ++useCounter_;
+    return entry.connection.get();
+}
+
+void ConnectionCache::Close(const fs::path& path)
+{
+    entries_.erase(path.string());
+}
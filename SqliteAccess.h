@@ -0,0 +1,194 @@
+#pragma once // Защита от двойного включения
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "sqlite3.h"
+
+namespace fs = std::filesystem;
+
+/// <summary>
+/// Настройки открытия исходных файлов только для чтения (все читатели исходных .db используют один профиль).
+/// </summary>
+struct ReadProfile
+{
+    bool immutable = false;   // URI immutable=1: без блокировок и проверок изменений; только для окончательно записанных файлов
+    bool memoryMap = true;    // PRAGMA mmap_size = размер файла: страницы читаются из отображения без копирования в кэш
+    int cacheKib = 32768;     // PRAGMA cache_size в КиБ (по умолчанию у SQLite около 2 МиБ)
+};
+
+/// <summary>
+/// URI исходного файла для sqlite3_open_v2 с SQLITE_OPEN_URI и для ATTACH: mode=ro и, если задано в профиле, immutable=1.
+/// immutable не ставится, если рядом с файлом есть -journal или -wal (файл еще не записан до конца).
+/// </summary>
+std::string SourceUri(const fs::path& path, const ReadProfile& profile);
+
+/// <summary>
+/// Применяет PRAGMA профиля для одной схемы соединения ("main" или имя ATTACH): cache_size и mmap_size.
+/// </summary>
+void ApplyReadProfile(sqlite3* dbHandle, const std::string& schema, const fs::path& path, const ReadProfile& profile);
+
+/// <summary>
+/// Имена всех таблиц открытой базы данных (в порядке sqlite_master).
+/// </summary>
+std::vector<std::string> ReadTableNames(sqlite3* dbHandle);
+
+/// <summary>
+/// Есть ли у таблицы индекс, который начинается с колонки columnName (в том числе индекс PRIMARY KEY или UNIQUE):
+/// тогда условие на эту колонку читает только нужные строки.
+/// </summary>
+bool HasIndexOn(sqlite3* dbHandle, const std::string& tableName, const std::string& columnName);
+
+/// <summary>
+/// Подготовленный запрос из кэша соединения, выданный на время использования.
+/// При уничтожении запрос сбрасывается (sqlite3_reset), и файл не остается заблокированным на чтение.
+/// </summary>
+class StatementLease
+{
+public:
+    StatementLease() = default;
+    explicit StatementLease(sqlite3_stmt* stmt) : stmt_(stmt) {}
+    ~StatementLease() { Release(); }
+
+    StatementLease(const StatementLease&) = delete;
+    StatementLease& operator=(const StatementLease&) = delete;
+    StatementLease(StatementLease&& other) noexcept : stmt_(other.stmt_) { other.stmt_ = nullptr; }
+    StatementLease& operator=(StatementLease&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            stmt_ = other.stmt_;
+            other.stmt_ = nullptr;
+        }
+        return *this;
+    }
+
+    sqlite3_stmt* Get() const { return stmt_; }
+    explicit operator bool() const { return stmt_ != nullptr; }
+
+private:
+    void Release()
+    {
+        if (!stmt_) return;
+        sqlite3_reset(stmt_);
+        sqlite3_clear_bindings(stmt_);
+        stmt_ = nullptr;
+    }
+
+    sqlite3_stmt* stmt_ = nullptr;
+};
+
+/// <summary>
+/// Соединение SQLite (RAII) с кэшем подготовленных запросов по тексту SQL и кэшем схемы:
+/// список таблиц и колонки таблиц читаются из файла один раз.
+/// Один и тот же запрос нельзя использовать двумя StatementLease одновременно.
+/// </summary>
+class SqliteConnection
+{
+public:
+    /// <summary>
+    /// Открывает файл с флагами sqlite3_open_v2. Если открыть не удалось, IsOpen() == false, текст ошибки - OpenError().
+    /// </summary>
+    SqliteConnection(const fs::path& path, int flags);
+
+    /// <summary>
+    /// Открывает исходный файл только для чтения по профилю (URI из SourceUri, query_only, temp_store = MEMORY).
+    /// </summary>
+    SqliteConnection(const fs::path& path, const ReadProfile& profile);
+    ~SqliteConnection();
+
+    SqliteConnection(const SqliteConnection&) = delete;
+    SqliteConnection& operator=(const SqliteConnection&) = delete;
+
+    bool IsOpen() const { return handle_ != nullptr; }
+    const std::string& OpenError() const { return openError_; }
+    sqlite3* Handle() const { return handle_; }
+    const fs::path& Path() const { return path_; }
+
+    /// <summary>
+    /// Запрос из кэша (подготавливается при первом обращении). Пустой, если SQL не подготовился
+    /// (текст ошибки - sqlite3_errmsg(Handle())).
+    /// </summary>
+    StatementLease Prepare(const std::string& sql);
+
+    /// <summary>
+    /// Список таблиц файла (читается один раз).
+    /// </summary>
+    const std::vector<std::string>& TableNames();
+
+    /// <summary>
+    /// Колонки таблицы в порядке SELECT * (читаются один раз отдельным запросом, кэш запросов не затрагивается,
+    /// поэтому вызов допустим, пока открыт StatementLease на SelectAllSql). Пусто, если таблицы нет.
+    /// </summary>
+    const std::vector<std::string>& ColumnNames(const std::string& tableName);
+
+    /// <summary>
+    /// Текст запроса SELECT * для таблицы - один и тот же для всех проходов, чтобы попадать в кэш запросов.
+    /// </summary>
+    static std::string SelectAllSql(const std::string& tableName);
+
+private:
+    fs::path path_;
+    sqlite3* handle_ = nullptr;
+    std::string openError_;
+    std::unordered_map<std::string, sqlite3_stmt*> statements_;
+    std::unique_ptr<std::vector<std::string>> tableNames_;
+    std::unordered_map<std::string, std::vector<std::string>> columnNames_;
+};
+
+/// <summary>
+/// Кэш соединений только для чтения по пути файла: повторные проходы по тем же файлам не открывают их заново
+/// и не перечитывают схему. Файл, у которого изменились размер или время записи, открывается заново.
+/// Указатель на соединение действителен до следующего вызова OpenReadOnly, Close или Clear.
+/// </summary>
+class ConnectionCache
+{
+public:
+    explicit ConnectionCache(size_t capacity = 64);
+
+    /// <summary>
+    /// Профиль для соединений, открываемых после вызова.
+    /// </summary>
+    void SetProfile(const ReadProfile& profile) { profile_ = profile; }
+    const ReadProfile& Profile() const { return profile_; }
+
+    /// <summary>
+    /// Соединение с файлом; nullptr, если файл не открылся (текст ошибки - LastError()).
+    /// </summary>
+    SqliteConnection* OpenReadOnly(const fs::path& path);
+
+    /// <summary>
+    /// Закрывает соединение с файлом, если оно есть в кэше.
+    /// </summary>
+    void Close(const fs::path& path);
+
+    /// <summary>
+    /// Закрывает все соединения.
+    /// </summary>
+    void Clear() { entries_.clear(); }
+
+    const std::string& LastError() const { return lastError_; }
+    long long Hits() const { return hits_; }
+    long long Misses() const { return misses_; }
+
+private:
+    struct Entry
+    {
+        std::unique_ptr<SqliteConnection> connection;
+        std::uintmax_t size = 0;
+        fs::file_time_type writeTime;
+        unsigned long long lastUse = 0;
+    };
+
+    size_t capacity_;
+    ReadProfile profile_;
+    std::unordered_map<std::string, Entry> entries_;
+    unsigned long long useCounter_ = 0;
+    long long hits_ = 0;
+    long long misses_ = 0;
+    std::string lastError_;
+};
@@ -0,0 +1,180 @@
+#include "SyntheticDbGenerator.h"
+#include "sqlite3.h"
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+/// <summary>
+/// Детерминированный генератор псевдослучайных чисел (SplitMix64).
+/// Используется вместо std::uniform_real_distribution, чтобы наборы совпадали на всех компиляторах.
+/// </summary>
+class SplitMix64
+{
+public:
+    explicit SplitMix64(std::uint64_t seed) : state_(seed) {}
+
+    std::uint64_t Next()
+    {
+        std::uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Равномерное число в [0, 1)
+    double NextUnit() { return static_cast<double>(Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+    std::uint64_t state_;
+};
+
+/// <summary>
+/// Выполняет SQL и бросает исключение при ошибке.
+/// </summary>
+static void ExecOrThrow(sqlite3* dbHandle, const std::string& sql)
+{
+    char* errMsg = nullptr;
+    if (sqlite3_exec(dbHandle, sql.c_str(), 0, 0, &errMsg) != SQLITE_OK)
+    {
+        std::string message = errMsg ? errMsg : "unknown error";
+        sqlite3_free(errMsg);
+        throw std::runtime_error("SQL error: " + message);
+    }
+}
+
+/// <summary>
+/// Правдоподобное значение для колонки: площади армирования ~1e-5 м2, ширина трещин, шаги.
+/// </summary>
+static double SyntheticValue(const std::string& column, bool isShell, SplitMix64& rng)
+{
+    double u = rng.NextUnit();
+    if (column.rfind("Asw", 0) == 0) return (isShell ? 4e-5 : 6e-5) * u;
+    if (column.rfind("As", 0) == 0) return 1e-6 + (isShell ? 1.5e-5 : 2.5e-5) * u;
+    if (column.rfind("Reinf", 0) == 0) return 6e-5 * u;
+    if (column.rfind("Crack", 0) == 0) return u < 0.7 ? 0.0 : 0.3 * u;
+    if (column.rfind("Sw", 0) == 0) return 0.1 + 0.2 * u;
+    return u < 0.9 ? 0.0 : u; // ls*
+}
+
+const std::vector<std::string>& SyntheticReinforcementColumns()
+{
+    static const std::vector<std::string> columns = {
+        "As1Ti", "As1Tj", "As1Bi", "As1Bj", "As2Ti", "As2Tj", "As2Bi", "As2Bj",
+        "Asw1i", "Asw1j", "Asw2i", "Asw2j", "Reinf1", "Reinf2", "Crack1i", "Crack1j",
+        "Crack2i", "Crack2j", "Sw1i", "Sw1j", "Sw2i", "Sw2j", "ls1i", "ls1j", "ls2i", "ls2j"
+    };
+    return columns;
+}
+
+std::string SyntheticDbFileName(int fileIndex)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "SYNTH_%03d.db", fileIndex);
+    return name;
+}
+
+long long GenerateSyntheticDataset(const fs::path& directory, const SyntheticDatasetSpec& spec)
+{
+    fs::create_directories(directory);
+    const auto& columns = SyntheticReinforcementColumns();
+
+    // Тип элемента определяется детерминированно по его номеру
+    std::vector<int> elemTypes(spec.elementCount);
+    SplitMix64 typeRng(spec.seed);
+    for (int e = 0; e < spec.elementCount; ++e) elemTypes[e] = typeRng.NextUnit() < spec.shellFraction ? 2 : 1;
+
+    long long totalRows = 0;
+    for (int f = 0; f < spec.fileCount; ++f)
+    {
+        fs::path dbPath = directory / SyntheticDbFileName(f);
+        if (fs::exists(dbPath)) fs::remove(dbPath);
+
+        sqlite3* dbHandle;
+        if (sqlite3_open(dbPath.string().c_str(), &dbHandle) != SQLITE_OK)
+        {
+            sqlite3_close(dbHandle);
+            throw std::runtime_error("Could not create synthetic database " + dbPath.string());
+        }
+
+        try
+        {
+            ExecOrThrow(dbHandle, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF; BEGIN TRANSACTION;");
+            ExecOrThrow(dbHandle, R"(CREATE TABLE "Elements" ("elemId" INT, "elemType" INT, "CGrade" TEXT, "SLGrade" TEXT, "STGrade" TEXT, "CSType" INT, "b1" REAL, "h1" REAL, "a1" REAL, "a2" REAL, "t1" REAL, "t2" REAL, "reinfStep1" REAL, "reinfStep2" REAL, "a3" REAL, "a4" REAL, PRIMARY KEY("elemId"));)");
+
+            sqlite3_stmt* elementStmt;
+            sqlite3_prepare_v2(dbHandle, "INSERT INTO \"Elements\" VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);", -1, &elementStmt, nullptr);
+            for (int e = 0; e < spec.elementCount; ++e)
+            {
+                bool isShell = elemTypes[e] == 2;
+                sqlite3_bind_int64(elementStmt, 1, spec.firstElementId + e);
+                sqlite3_bind_int(elementStmt, 2, elemTypes[e]);
+                sqlite3_bind_text(elementStmt, 3, "B30", -1, SQLITE_STATIC);
+                sqlite3_bind_text(elementStmt, 4, "A500", -1, SQLITE_STATIC);
+                sqlite3_bind_text(elementStmt, 5, "A240", -1, SQLITE_STATIC);
+                sqlite3_bind_int(elementStmt, 6, isShell ? 0 : 1);
+                sqlite3_bind_double(elementStmt, 7, isShell ? 1.0 : 0.3);
+                sqlite3_bind_double(elementStmt, 8, isShell ? 0.2 : 0.6);
+                sqlite3_bind_double(elementStmt, 9, 0.04);
+                sqlite3_bind_double(elementStmt, 10, 0.04);
+                sqlite3_bind_double(elementStmt, 11, isShell ? 0.2 : 0.0);
+                sqlite3_bind_double(elementStmt, 12, isShell ? 0.2 : 0.0);
+                sqlite3_bind_double(elementStmt, 13, 0.2);
+                sqlite3_bind_double(elementStmt, 14, 0.2);
+                sqlite3_bind_double(elementStmt, 15, 0.04);
+                sqlite3_bind_double(elementStmt, 16, 0.04);
+                sqlite3_step(elementStmt);
+                sqlite3_reset(elementStmt);
+            }
+            sqlite3_finalize(elementStmt);
+
+            for (int t = 0; t < spec.tablesPerFile; ++t)
+            {
+                std::string tableName = "Reinforcement " + std::to_string(t + 1);
+                std::stringstream createSql, insertSql;
+                createSql << "CREATE TABLE \"" << tableName << "\" (\"setN\" INT, \"elemId\" INT, \"elemType\" INT";
+                insertSql << "INSERT INTO \"" << tableName << "\" VALUES (?,?,?";
+                for (const auto& column : columns)
+                {
+                    createSql << ", \"" << column << "\" REAL";
+                    insertSql << ",?";
+                }
+                createSql << ");";
+                insertSql << ");";
+                ExecOrThrow(dbHandle, createSql.str());
+
+                sqlite3_stmt* insertStmt;
+                sqlite3_prepare_v2(dbHandle, insertSql.str().c_str(), -1, &insertStmt, nullptr);
+
+                // Отдельный поток чисел для каждой таблицы: содержимое файла не зависит от порядка генерации
+                SplitMix64 rng(spec.seed * 0x100000001B3ULL + static_cast<std::uint64_t>(f) * 1000003ULL + static_cast<std::uint64_t>(t));
+                for (int s = 0; s < spec.setsPerTable; ++s)
+                {
+                    long long setN = static_cast<long long>(f) * spec.tablesPerFile * spec.setsPerTable + static_cast<long long>(t) * spec.setsPerTable + s + 1;
+                    for (int e = 0; e < spec.elementCount; ++e)
+                    {
+                        bool isShell = elemTypes[e] == 2;
+                        sqlite3_bind_int64(insertStmt, 1, setN);
+                        sqlite3_bind_int64(insertStmt, 2, spec.firstElementId + e);
+                        sqlite3_bind_int(insertStmt, 3, elemTypes[e]);
+                        for (size_t c = 0; c < columns.size(); ++c)
+                        {
+                            sqlite3_bind_double(insertStmt, static_cast<int>(c) + 4, SyntheticValue(columns[c], isShell, rng));
+                        }
+                        sqlite3_step(insertStmt);
+                        sqlite3_reset(insertStmt);
+                        ++totalRows;
+                    }
+                }
+                sqlite3_finalize(insertStmt);
+            }
+            ExecOrThrow(dbHandle, "COMMIT;");
+        }
+        catch (...)
+        {
+            sqlite3_close(dbHandle);
+            throw;
+        }
+        sqlite3_close(dbHandle);
+    }
+    return totalRows;
+}
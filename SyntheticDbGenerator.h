@@ -0,0 +1,40 @@
+#pragma once // Защита от двойного включения
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/// <summary>
+/// Параметры синтетического набора баз данных в формате FEDOR.
+/// Один и тот же набор параметров (включая seed) всегда дает побайтно одинаковые значения.
+/// </summary>
+struct SyntheticDatasetSpec
+{
+    int fileCount = 4;              // Количество .db файлов
+    int tablesPerFile = 2;          // Количество таблиц результатов в каждом файле (кроме Elements)
+    int elementCount = 10000;       // Количество элементов (одинаково во всех файлах)
+    int setsPerTable = 4;           // Количество комбинаций (setN) в каждой таблице
+    double shellFraction = 0.5;     // Доля оболочек (elemType = 2), остальные - балки (elemType = 1)
+    long long firstElementId = 100000;
+    std::uint64_t seed = 1;
+};
+
+/// <summary>
+/// Колонки армирования в порядке файла B30_SEISM_617005_617010.csv (без setN, elemId, elemType).
+/// </summary>
+const std::vector<std::string>& SyntheticReinforcementColumns();
+
+/// <summary>
+/// Создает в папке набор .db файлов: в каждом таблица Elements (схема как у Envelope.db)
+/// и таблицы результатов с 29 колонками (setN;elemId;elemType;As1Ti;...;ls2j).
+/// Существующие файлы с теми же именами перезаписываются. Возвращает общее число строк результатов.
+/// </summary>
+long long GenerateSyntheticDataset(const fs::path& directory, const SyntheticDatasetSpec& spec);
+
+/// <summary>
+/// Имя i-го файла набора (SYNTH_000.db, SYNTH_001.db, ...).
+/// </summary>
+std::string SyntheticDbFileName(int fileIndex);
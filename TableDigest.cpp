@@ -0,0 +1,279 @@
+#include "TableDigest.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+    // Финальное перемешивание MurmurHash3 (fmix64): каждый бит входа влияет на все биты результата
+    uint64_t Mix(uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdULL;
+        value ^= value >> 33;
+        value *= 0xc4ceb9fe1a85ec53ULL;
+        value ^= value >> 33;
+        return value;
+    }
+
+    // Хэш последовательности строк: на слово - одно умножение в каждой из двух независимых половин,
+    // полное перемешивание - один раз в конце строки. Порядок слов и строк важен.
+    class DigestBuilder
+    {
+    public:
+        void AddWord(uint64_t word)
+        {
+            low_ = (low_ ^ word) * 0x9e3779b97f4a7c15ULL;
+            high_ = (high_ + word) * 0xbf58476d1ce4e5b9ULL;
+        }
+
+        void AddBytes(const void* data, size_t size)
+        {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            AddWord(size);
+            for (; size >= 8; bytes += 8, size -= 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, bytes, 8);
+                AddWord(word);
+            }
+            if (size > 0)
+            {
+                uint64_t word = 0;
+                std::memcpy(&word, bytes, size);
+                AddWord(word);
+            }
+        }
+
+        void EndRow()
+        {
+            low_ = Mix(low_);
+            high_ = Mix(high_ + low_);
+            ++rows_;
+        }
+
+        TableDigest Result() const
+        {
+            TableDigest digest;
+            digest.low = low_;
+            digest.high = high_;
+            digest.rows = rows_;
+            return digest;
+        }
+
+    private:
+        uint64_t low_ = 0x243f6a8885a308d3ULL;
+        uint64_t high_ = 0x13198a2e03707344ULL;
+        long long rows_ = 0;
+    };
+
+    uint32_t ReadBigEndian(const unsigned char* bytes, int size)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < size; ++i) value = (value << 8) | bytes[i];
+        return value;
+    }
+
+    // Varint формата SQLite: до 9 байт, по 7 бит в байте, старший бит - продолжение; 9-й байт - все 8 бит
+    bool ReadVarint(const unsigned char*& position, const unsigned char* end, uint64_t& value)
+    {
+        value = 0;
+        for (int i = 0; i < 9; ++i)
+        {
+            if (position >= end) return false;
+            const unsigned char byte = *position++;
+            if (i == 8)
+            {
+                value = (value << 8) | byte;
+                return true;
+            }
+            value = (value << 7) | (byte & 0x7f);
+            if (!(byte & 0x80)) return true;
+        }
+        return true;
+    }
+
+    /// <summary>
+    /// Обход B-дерева таблицы (rowid) прямо по страницам файла: листья слева направо, то есть в порядке rowid.
+    /// Любое несоответствие формату прерывает обход (результат - false).
+    /// </summary>
+    class TableTreeReader
+    {
+    public:
+        bool Open(const fs::path& dbPath)
+        {
+            file_.open(dbPath, std::ios::binary);
+            if (!file_.is_open()) return false;
+            unsigned char header[100];
+            if (!file_.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+            if (std::memcmp(header, "SQLite format 3", 16) != 0) return false;
+            pageSize_ = ReadBigEndian(header + 16, 2);
+            if (pageSize_ == 1) pageSize_ = 65536;
+            if (pageSize_ < 512 || (pageSize_ & (pageSize_ - 1)) != 0) return false;
+            usableSize_ = pageSize_ - header[20];
+            std::error_code ec;
+            const std::uintmax_t fileSize = fs::file_size(dbPath, ec);
+            if (ec) return false;
+            pageCount_ = static_cast<uint32_t>(fileSize / pageSize_);
+            return true;
+        }
+
+        bool HashTree(uint32_t rootPage, DigestBuilder& digest)
+        {
+            return HashPage(rootPage, digest, 0);
+        }
+
+    private:
+        bool ReadPage(uint32_t page, std::vector<unsigned char>& buffer)
+        {
+            // Страница 1 - схема с заголовком файла; деревья таблиц пользователя на ней не лежат
+            if (page < 2 || page > pageCount_) return false;
+            buffer.resize(pageSize_);
+            file_.seekg(static_cast<std::streamoff>(page - 1) * pageSize_);
+            return static_cast<bool>(file_.read(reinterpret_cast<char*>(buffer.data()), pageSize_));
+        }
+
+        bool HashPage(uint32_t page, DigestBuilder& digest, int depth)
+        {
+            if (depth > 40) return false; // Глубже не бывает; защита от зацикленных ссылок
+            std::vector<unsigned char> buffer;
+            if (!ReadPage(page, buffer)) return false;
+            const unsigned char* data = buffer.data();
+            const unsigned char* end = data + usableSize_;
+            const unsigned char type = data[0];
+            const uint32_t cellCount = ReadBigEndian(data + 3, 2);
+
+            if (type == 0x05) // Внутренняя страница: левые потомки ячеек по порядку, затем правый
+            {
+                if (12 + 2 * cellCount > usableSize_) return false;
+                for (uint32_t cell = 0; cell < cellCount; ++cell)
+                {
+                    const uint32_t offset = ReadBigEndian(data + 12 + 2 * cell, 2);
+                    if (offset + 4 > usableSize_) return false;
+                    if (!HashPage(ReadBigEndian(data + offset, 4), digest, depth + 1)) return false;
+                }
+                return HashPage(ReadBigEndian(data + 8, 4), digest, depth + 1);
+            }
+            if (type != 0x0D) return false; // Не лист таблицы (например, WITHOUT ROWID - это B-дерево индекса)
+
+            if (8 + 2 * cellCount > usableSize_) return false;
+            for (uint32_t cell = 0; cell < cellCount; ++cell)
+            {
+                const uint32_t offset = ReadBigEndian(data + 8 + 2 * cell, 2);
+                if (offset >= usableSize_) return false;
+                const unsigned char* position = data + offset;
+                uint64_t payloadSize = 0, rowid = 0;
+                if (!ReadVarint(position, end, payloadSize) || !ReadVarint(position, end, rowid)) return false;
+                if (!ReadPayload(position, end, payloadSize)) return false;
+                digest.AddWord(rowid);
+                digest.AddBytes(payload_.data(), payload_.size());
+                digest.EndRow();
+            }
+            return true;
+        }
+
+        // Запись ячейки в payload_: локальная часть и, если не поместилась, цепочка страниц переполнения
+        bool ReadPayload(const unsigned char* position, const unsigned char* end, uint64_t payloadSize)
+        {
+            const uint64_t maxLocal = usableSize_ - 35;
+            uint64_t localSize = payloadSize;
+            if (payloadSize > maxLocal)
+            {
+                const uint64_t minLocal = (usableSize_ - 12) * 32 / 255 - 23;
+                const uint64_t size = minLocal + (payloadSize - minLocal) % (usableSize_ - 4);
+                localSize = size <= maxLocal ? size : minLocal;
+            }
+            if (localSize > static_cast<uint64_t>(end - position)) return false;
+            payload_.assign(position, position + localSize);
+            if (localSize == payloadSize) return true;
+
+            if (localSize + 4 > static_cast<uint64_t>(end - position)) return false;
+            uint32_t overflowPage = ReadBigEndian(position + localSize, 4);
+            std::vector<unsigned char> buffer;
+            for (uint32_t chain = 0; payload_.size() < payloadSize; ++chain)
+            {
+                if (chain > pageCount_ || !ReadPage(overflowPage, buffer)) return false;
+                const size_t take = static_cast<size_t>(std::min<uint64_t>(payloadSize - payload_.size(), usableSize_ - 4));
+                payload_.insert(payload_.end(), buffer.begin() + 4, buffer.begin() + 4 + take);
+                overflowPage = ReadBigEndian(buffer.data(), 4);
+            }
+            return true;
+        }
+
+        std::ifstream file_;
+        uint32_t pageSize_ = 0;
+        uint32_t usableSize_ = 0;
+        uint32_t pageCount_ = 0;
+        std::vector<unsigned char> payload_;
+    };
+}
+
+bool SampleTableDigest(SqliteConnection& connection, const std::string& tableName, int sampleCount, TableDigest& digest)
+{
+    StatementLease maxStatement = connection.Prepare("SELECT max(rowid) FROM \"" + tableName + "\";");
+    if (!maxStatement || sqlite3_step(maxStatement.Get()) != SQLITE_ROW) return false;
+    const long long maxRowid = sqlite3_column_int64(maxStatement.Get(), 0);
+
+    StatementLease rowStatement = connection.Prepare("SELECT * FROM \"" + tableName + "\" WHERE rowid >= ? ORDER BY rowid LIMIT 1;");
+    if (!rowStatement) return false;
+    sqlite3_stmt* stmt = rowStatement.Get();
+
+    DigestBuilder builder;
+    for (const auto& name : connection.ColumnNames(tableName)) builder.AddBytes(name.data(), name.size());
+    builder.AddWord(static_cast<uint64_t>(maxRowid));
+    builder.EndRow();
+    for (int sample = 0; sample < sampleCount; ++sample)
+    {
+        // Точки от 0 до maxRowid включительно; при maxRowid < sampleCount строки повторяются, это не мешает
+        const long long rowid = sampleCount > 1 ? static_cast<long long>(static_cast<double>(maxRowid) * sample / (sampleCount - 1)) : maxRowid;
+        sqlite3_bind_int64(stmt, 1, rowid);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            for (int column = 0; column < sqlite3_column_count(stmt); ++column)
+            {
+                const int type = sqlite3_column_type(stmt, column);
+                builder.AddWord(static_cast<uint64_t>(type));
+                if (type == SQLITE_INTEGER)
+                {
+                    builder.AddWord(static_cast<uint64_t>(sqlite3_column_int64(stmt, column)));
+                }
+                else if (type == SQLITE_FLOAT)
+                {
+                    const double value = sqlite3_column_double(stmt, column);
+                    uint64_t bits;
+                    std::memcpy(&bits, &value, sizeof(bits));
+                    builder.AddWord(bits);
+                }
+                else if (type != SQLITE_NULL)
+                {
+                    // Для TEXT sqlite3_column_blob возвращает байты без преобразования
+                    builder.AddBytes(sqlite3_column_blob(stmt, column), static_cast<size_t>(sqlite3_column_bytes(stmt, column)));
+                }
+            }
+            builder.EndRow();
+        }
+        sqlite3_reset(stmt);
+    }
+    digest = builder.Result();
+    return true;
+}
+
+bool ContentTableDigest(const fs::path& dbPath, sqlite3* dbHandle, const std::string& tableName, TableDigest& digest)
+{
+    std::error_code ec;
+    if (fs::exists(dbPath.string() + "-wal", ec) || fs::exists(dbPath.string() + "-journal", ec)) return false;
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT rootpage FROM sqlite_master WHERE type = 'table' AND name = ?;", -1, &stmt, nullptr) != SQLITE_OK) return false;
+    sqlite3_bind_text(stmt, 1, tableName.c_str(), -1, SQLITE_TRANSIENT);
+    const long long rootPage = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    if (rootPage < 2) return false;
+
+    TableTreeReader reader;
+    DigestBuilder builder;
+    if (!reader.Open(dbPath) || !reader.HashTree(static_cast<uint32_t>(rootPage), builder)) return false;
+    digest = builder.Result();
+    return true;
+}
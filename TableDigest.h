@@ -0,0 +1,41 @@
+#pragma once // Защита от двойного включения
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include "sqlite3.h"
+#include "SqliteAccess.h"
+
+namespace fs = std::filesystem;
+
+/// <summary>
+/// Отпечаток содержимого таблицы: 128-битный хэш и число строк. Таблицы с одинаковым отпечатком одного вида
+/// (SampleTableDigest или ContentTableDigest) считаются одинаковыми.
+/// </summary>
+struct TableDigest
+{
+    uint64_t low = 0;
+    uint64_t high = 0;
+    long long rows = 0;
+
+    bool operator==(const TableDigest& other) const { return low == other.low && high == other.high && rows == other.rows; }
+    bool operator!=(const TableDigest& other) const { return !(*this == other); }
+};
+
+/// <summary>
+/// Быстрый отпечаток для поиска копий таблицы: имена колонок, наибольший rowid и sampleCount строк, равномерно взятых
+/// по диапазону rowid (каждая - один поиск по B-дереву, таблица целиком не читается). Значения хэшируются вместе с типом
+/// (1 и 1.0 различаются). Разные таблицы почти всегда различаются уже здесь; совпадение - только повод сравнить
+/// ContentTableDigest. Возвращает false для таблиц без rowid (WITHOUT ROWID) и при ошибке запроса.
+/// </summary>
+bool SampleTableDigest(SqliteConnection& connection, const std::string& tableName, int sampleCount, TableDigest& digest);
+
+/// <summary>
+/// Полный отпечаток таблицы: rowid и записи всех строк в порядке rowid, прочитанные прямо из страниц B-дерева файла
+/// (формат файла SQLite), без разбора записей на значения. Одинаковые записи - одинаковые значения и типы, поэтому
+/// равенство отпечатков означает, что SELECT * вернет те же строки в том же порядке; раскладка по страницам
+/// (свободное место, номера страниц) не влияет. Чтение идет со скоростью чтения файла, намного быстрее sqlite3_step.
+/// Возвращает false, если рядом с файлом есть -wal или -journal (файл может быть неактуален), таблица без rowid
+/// или страницы не похожи на B-дерево таблицы.
+/// </summary>
+bool ContentTableDigest(const fs::path& dbPath, sqlite3* dbHandle, const std::string& tableName, TableDigest& digest);
@@ -0,0 +1,44 @@
+#pragma once // Защита от двойного включения
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Пул потоков фиксированного размера с общей очередью задач.
+/// Один пул создается на процесс и передается всем заданиям, чтобы не плодить потоки.
+/// </summary>
+class ThreadPool
+{
+public:
+    /// <summary>
+    /// threadCount = 0 означает количество аппаратных потоков.
+    /// </summary>
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// <summary>
+    /// Ставит задачу в очередь. Исключение из задачи передается через future.
+    /// </summary>
+    std::future<void> Submit(std::function<void()> task);
+
+    unsigned Size() const { return static_cast<unsigned>(workers_.size()); }
+
+    static unsigned HardwareThreads();
+
+private:
+    void WorkerLoop();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::packaged_task<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopping_ = false;
+};
@@ -0,0 +1,66 @@
+#include "TopKTable.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+TopKTable::TopKTable(int k, bool singlePrecision) : k_(std::max(1, std::min(k, 255))), singlePrecision_(singlePrecision)
+{
+}
+
+void TopKTable::Clear()
+{
+    elementIndex_.clear();
+    elementIds_.clear();
+    columnIndex_.clear();
+    columnNames_.clear();
+    columns_.clear();
+    rounding_.Reset();
+}
+
+int TopKTable::ColumnIndex(const std::string& name)
+{
+    auto it = columnIndex_.find(name);
+    if (it != columnIndex_.end()) return it->second;
+    int column = static_cast<int>(columnNames_.size());
+    columnIndex_.emplace(name, column);
+    columnNames_.push_back(name);
+    columns_.emplace_back();
+    return column;
+}
+
+void TopKTable::Grow(Column& cells) const
+{
+    // Колонка дорастает до текущего числа элементов (элементы добавляются раньше, чем их значения)
+    size_t elementCount = elementIds_.size();
+    if (singlePrecision_) cells.floatEntries.resize(elementCount * k_);
+    else cells.entries.resize(elementCount * k_);
+    cells.counts.resize(elementCount, 0);
+    cells.offered.resize(elementCount, 0);
+}
+
+int TopKTable::SortedEntries(int column, int element, TopKEntry* out) const
+{
+    const Column& cells = columns_[column];
+    if (static_cast<size_t>(element) >= cells.counts.size()) return 0;
+    int count = cells.counts[element];
+    const size_t first = static_cast<size_t>(element) * k_;
+    if (singlePrecision_)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            const FloatEntry& entry = cells.floatEntries[first + i];
+            out[i] = TopKEntry{ entry.value, entry.setN, entry.source, entry.order };
+        }
+    }
+    else
+    {
+        std::copy(&cells.entries[first], &cells.entries[first] + count, out);
+    }
+    std::sort(out, out + count, [](const TopKEntry& a, const TopKEntry& b) { return IsWorse(b, a); });
+    return count;
+}
+
+void TopKTable::ThrowSetNRange(long long setN)
+{
+    throw std::out_of_range("setN " + std::to_string(setN) + " does not fit the single-precision mode (32 bits); run without --float32");
+}
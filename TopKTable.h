@@ -0,0 +1,183 @@
+#pragma once // Защита от двойного включения
+
+#include <cstdint>
+#include <utility>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "FloatRounding.h"
+
+/// <summary>
+/// Один кандидат в ячейке top-K: значение и его источник.
+/// source - номер пары (файл, таблица) в словаре источников анализатора,
+/// order - порядковый номер поступления в ячейку (при равных значениях выигрывает более ранний).
+/// </summary>
+struct TopKEntry
+{
+    double value = 0.0;
+    long long setN = 0;
+    uint32_t source = 0;
+    uint32_t order = 0;
+};
+
+/// <summary>
+/// K наибольших значений для каждой пары (элемент, колонка).
+/// Каждая ячейка - min-куча фиксированной емкости K, лежащая прямо в плоском массиве колонки
+/// (K записей подряд на элемент), поэтому на ячейку не выделяется память.
+/// Элементы и колонки нумеруются при первом появлении; в цикле по строкам используются только индексы.
+/// В режиме одинарной точности значение хранится во float, а setN - в 32 битах (16 байт на запись вместо 24):
+/// значение округляется до сравнения, поэтому порядок точен для округленных значений; наибольшая относительная
+/// ошибка округления запоминается для отчета.
+/// </summary>
+class TopKTable
+{
+public:
+    explicit TopKTable(int k = 1, bool singlePrecision = false);
+
+    int K() const { return k_; }
+    bool SinglePrecision() const { return singlePrecision_; }
+
+    /// <summary>
+    /// Наибольшая |float(значение) - значение| / |значение| среди предложенных значений (0 при двойной точности).
+    /// </summary>
+    double MaxRoundingError() const { return rounding_.MaxError(); }
+
+    /// <summary>
+    /// Удаляет все элементы, колонки и значения.
+    /// </summary>
+    void Clear();
+
+    /// <summary>
+    /// Индекс элемента; добавляет элемент при первом обращении.
+    /// </summary>
+    int ElementIndex(long long elemId)
+    {
+        auto it = elementIndex_.find(elemId);
+        if (it != elementIndex_.end()) return it->second;
+        int element = static_cast<int>(elementIds_.size());
+        elementIndex_.emplace(elemId, element);
+        elementIds_.push_back(elemId);
+        return element;
+    }
+
+    /// <summary>
+    /// Индекс колонки; добавляет колонку при первом обращении.
+    /// </summary>
+    int ColumnIndex(const std::string& name);
+
+    size_t ElementCount() const { return elementIds_.size(); }
+    long long ElementId(int element) const { return elementIds_[element]; }
+    const std::vector<long long>& ElementIds() const { return elementIds_; }
+    size_t ColumnCount() const { return columnNames_.size(); }
+    const std::string& ColumnName(int column) const { return columnNames_[column]; }
+
+    /// <summary>
+    /// Предлагает значение ячейке. Если в ячейке уже K значений, новое вытесняет наименьшее,
+    /// только если строго больше него (при K = 1 это прежнее правило "первый максимум выигрывает").
+    /// В режиме одинарной точности бросает std::out_of_range, если setN не помещается в 32 бита.
+    /// </summary>
+    void Offer(int column, int element, double value, long long setN, uint32_t source)
+    {
+        Column& cells = columns_[column];
+        if (cells.counts.size() <= static_cast<size_t>(element)) Grow(cells);
+        const size_t first = static_cast<size_t>(element) * k_;
+        const uint32_t order = cells.offered[element]++;
+        if (!singlePrecision_)
+        {
+            Insert(&cells.entries[first], cells.counts[element], TopKEntry{ value, setN, source, order });
+            return;
+        }
+        if (setN != static_cast<int32_t>(setN)) ThrowSetNRange(setN);
+        Insert(&cells.floatEntries[first], cells.counts[element], FloatEntry{ Round(value), static_cast<int32_t>(setN), source, order });
+    }
+
+    /// <summary>
+    /// Значения ячейки от лучшего к худшему (ранг 1 - первый). Возвращает их количество (0, если значений нет).
+    /// </summary>
+    int SortedEntries(int column, int element, TopKEntry* out) const;
+
+private:
+    // Запись в режиме одинарной точности
+    struct FloatEntry
+    {
+        float value = 0.0f;
+        int32_t setN = 0;
+        uint32_t source = 0;
+        uint32_t order = 0;
+    };
+
+    struct Column
+    {
+        std::vector<TopKEntry> entries;       // K записей на элемент
+        std::vector<FloatEntry> floatEntries; // Вместо entries в режиме одинарной точности
+        std::vector<uint8_t> counts;          // Заполненность кучи элемента
+        std::vector<uint32_t> offered;        // Сколько значений предлагалось ячейке (для порядка поступления)
+    };
+
+    float Round(double value) { return rounding_.Round(value); }
+
+    [[noreturn]] static void ThrowSetNRange(long long setN);
+
+    template <typename Entry>
+    void Insert(Entry* heap, uint8_t& count, const Entry& candidate)
+    {
+        if (count < k_)
+        {
+            heap[count] = candidate;
+            SiftUp(heap, count);
+            ++count;
+        }
+        else if (candidate.value > heap[0].value)
+        {
+            heap[0] = candidate;
+            SiftDown(heap, k_);
+        }
+    }
+
+    // Худшее значение в корне кучи: меньшее, а при равенстве - поступившее позже
+    template <typename Entry>
+    static bool IsWorse(const Entry& a, const Entry& b)
+    {
+        return a.value < b.value || (a.value == b.value && a.order > b.order);
+    }
+
+    template <typename Entry>
+    static void SiftUp(Entry* heap, int index)
+    {
+        while (index > 0)
+        {
+            int parent = (index - 1) / 2;
+            if (!IsWorse(heap[index], heap[parent])) break;
+            std::swap(heap[index], heap[parent]);
+            index = parent;
+        }
+    }
+
+    template <typename Entry>
+    static void SiftDown(Entry* heap, int size)
+    {
+        int index = 0;
+        while (true)
+        {
+            int worst = index;
+            int left = 2 * index + 1, right = left + 1;
+            if (left < size && IsWorse(heap[left], heap[worst])) worst = left;
+            if (right < size && IsWorse(heap[right], heap[worst])) worst = right;
+            if (worst == index) break;
+            std::swap(heap[index], heap[worst]);
+            index = worst;
+        }
+    }
+
+    void Grow(Column& cells) const;
+
+    int k_;
+    bool singlePrecision_;
+    FloatRounding rounding_; // Наибольшая ошибка округления floatEntries
+    std::unordered_map<long long, int> elementIndex_;
+    std::vector<long long> elementIds_;
+    std::unordered_map<std::string, int> columnIndex_;
+    std::vector<std::string> columnNames_;
+    std::vector<Column> columns_;
+};
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include "RunStats.h"
 
 namespace fs = std::filesystem;
 
@@ -15,5 +16,6 @@ std::map<std::string, std::vector<fs::path>> GroupCsvFilesByPrefix(const fs::pat
 
 /// <summary>
 /// Создает одну базу данных из группы CSV файлов.
+/// Если передан stats, учитывает в нем каждый CSV файл.
 /// </summary>
-void CreateDatabaseFromGroup(const fs::path& targetDir, const std::string& dbName, const std::vector<fs::path>& csvFiles);
+void CreateDatabaseFromGroup(const fs::path& targetDir, const std::string& dbName, const std::vector<fs::path>& csvFiles, RunStats* stats = nullptr);
@@ -1,4 +1,5 @@
 #include "DbUtils.h" // Подключаем наш заголовочный файл
+#include "SqliteAccess.h"
 #include <iostream>
 #include <fstream>
 
@@ -10,30 +11,15 @@ static void LogSqliteError(const std::string& message, sqlite3* dbHandle)
     std::cerr << "  ERROR: " << message << ": " << sqlite3_errmsg(dbHandle) << std::endl;
 }
 
-std::vector<std::string> GetTableNames(sqlite3* dbHandle)
+long long ConvertTableToCsv(sqlite3* dbHandle, const std::string& tableName, const fs::path& outputFilePath)
 {
-    std::vector<std::string> tableNames;
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(dbHandle, "SELECT name FROM sqlite_master WHERE type='table';", -1, &stmt, nullptr) == SQLITE_OK)
-    {
-        while (sqlite3_step(stmt) == SQLITE_ROW)
-        {
-            tableNames.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
-        }
-    }
-    sqlite3_finalize(stmt);
-    return tableNames;
-}
-
-void ConvertTableToCsv(sqlite3* dbHandle, const std::string& tableName, const fs::path& outputFilePath)
-{
-    std::cout << "  - Converting table '" << tableName << "' to " << outputFilePath.filename().string() << std::endl;
+    std::cout << "  - Converting table '" << tableName << "' to " << outputFilePath.filename().string() << "\n";
 
     std::ofstream csvFile(outputFilePath);
     if (!csvFile.is_open())
     {
         std::cerr << "  ERROR: Could not create file " << outputFilePath.string() << std::endl;
-        return;
+        return 0;
     }
 
     std::string query = "SELECT * FROM \"" + tableName + "\";";
@@ -41,7 +27,7 @@ void ConvertTableToCsv(sqlite3* dbHandle, const std::string& tableName, const fs
     if (sqlite3_prepare_v2(dbHandle, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
     {
         LogSqliteError("Failed to prepare select query", dbHandle);
-        return;
+        return 0;
     }
 
     int colCount = sqlite3_column_count(stmt);
@@ -54,8 +40,10 @@ void ConvertTableToCsv(sqlite3* dbHandle, const std::string& tableName, const fs
     csvFile << "\n";
 
     // Записываем строки
+    long long rowCount = 0;
     while (sqlite3_step(stmt) == SQLITE_ROW)
     {
+        ++rowCount;
         for (int i = 0; i < colCount; ++i)
         {
             const char* data = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
@@ -65,26 +53,29 @@ void ConvertTableToCsv(sqlite3* dbHandle, const std::string& tableName, const fs
     }
 
     sqlite3_finalize(stmt);
+    return rowCount;
 }
 
-void ProcessDatabaseFile(const fs::path& dbPath, const fs::path& outputDir)
+void ProcessDatabaseFile(const fs::path& dbPath, const fs::path& outputDir, RunStats* stats)
 {
-    std::cout << "\nProcessing file: " << dbPath.filename().string() << std::endl;
-    sqlite3* dbHandle;
-    if (sqlite3_open_v2(dbPath.string().c_str(), &dbHandle, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    std::cout << "\nProcessing file: " << dbPath.filename().string() << "\n";
+    SqliteConnection connection(dbPath, ReadProfile());
+    if (!connection.IsOpen())
     {
-        LogSqliteError("Could not open file", dbHandle);
-        sqlite3_close(dbHandle);
+        std::cerr << "  ERROR: Could not open file: " << connection.OpenError() << std::endl;
         return;
     }
+    sqlite3* dbHandle = connection.Handle();
 
+    RunStats::FileStats* fileStats = stats ? &stats->BeginFile("convert", dbPath) : nullptr;
     std::string dbNameWithoutExt = dbPath.stem().string();
-    for (const auto& tableName : GetTableNames(dbHandle))
+    for (const auto& tableName : connection.TableNames())
     {
         fs::path outputFilePath = outputDir / (dbNameWithoutExt + "_" + tableName + ".csv");
-        ConvertTableToCsv(dbHandle, tableName, outputFilePath);
+        Stopwatch tableTimer;
+        long long rowCount = ConvertTableToCsv(dbHandle, tableName, outputFilePath);
+        if (fileStats) fileStats->AddTable(tableName, rowCount, tableTimer.Seconds());
     }
-
-    sqlite3_close(dbHandle);
+    if (fileStats) stats->EndFile(*fileStats, dbHandle);
 }
 
@@ -4,21 +4,19 @@
 #include <string>
 #include <vector>
 #include "sqlite3.h"
+#include "RunStats.h"
 
 namespace fs = std::filesystem;
 
-/// <summary>
-/// Получает список имен всех таблиц из открытой базы данных.
-/// </summary>
-std::vector<std::string> GetTableNames(sqlite3* dbHandle);
-
 /// <summary>
 /// Конвертирует одну таблицу из базы данных в CSV файл.
+/// Возвращает количество записанных строк.
 /// </summary>
-void ConvertTableToCsv(sqlite3* dbHandle, const std::string& tableName, const fs::path& outputFilePath);
+long long ConvertTableToCsv(sqlite3* dbHandle, const std::string& tableName, const fs::path& outputFilePath);
 
 /// <summary>
 /// Обрабатывает один DB файл: находит все таблицы и запускает их конвертацию.
+/// Если передан stats, учитывает в нем файл и его таблицы.
 /// </summary>
-void ProcessDatabaseFile(const fs::path& dbPath, const fs::path& outputDir);
+void ProcessDatabaseFile(const fs::path& dbPath, const fs::path& outputDir, RunStats* stats = nullptr);
 
@@ -2,49 +2,129 @@
 #include <string>
 #include <filesystem>
 #include "DbUtils.h" // Подключаем наши утилиты
+#include "CommandLine.h"
+#include "BatchJobs.h"
 
 namespace fs = std::filesystem;
 
-int main()
-{
-    std::cout << "--- DB to CSV Converter ---" << std::endl;
-
-    std::cout << "Enter path to directory with .db files (or '.' for current directory): ";
-    std::string inputPathStr;
-    std::getline(std::cin, inputPathStr);
-
-    fs::path targetPath = inputPathStr.empty() || inputPathStr == "." ? "." : inputPathStr;
+// Опции командной строки конвертера
+static const std::set<std::string> kValueOptions = { "--output", "--report", "--jobs" };
+static const std::set<std::string> kFlagOptions = { "--help" };
 
-    if (!fs::exists(targetPath) || !fs::is_directory(targetPath))
-    {
-        std::cerr << "ERROR: Path does not exist or is not a directory: " << inputPathStr << std::endl;
-        return 1;
-    }
+static void PrintUsage()
+{
+    std::cout << "Usage: FEDOR_DB_TO_CSV [<folder>] [options]\n"
+              << "       FEDOR_DB_TO_CSV --jobs <job file> [options]\n"
+              << "  <folder>           Directory with .db files (default: current directory)\n"
+              << "  --output <dir>     Directory for .csv files (default: <folder>/csv_extracted)\n"
+              << "  --report <file>    Write a JSON timing report\n"
+              << "  --jobs <file>      Convert one folder per line of the job file (folder and options per line)\n"
+              << "Without arguments the converter asks for the folder interactively.\n";
+}
 
-    fs::path outputDir = targetPath / "csv_extracted";
+/// <summary>
+/// Конвертирует все .db файлы папки. Возвращает true при успехе.
+/// </summary>
+static bool ConvertFolder(const fs::path& targetPath, const fs::path& outputDir, const fs::path& reportPath)
+{
     try
     {
         if (!fs::exists(outputDir))
         {
-            fs::create_directory(outputDir);
+            fs::create_directories(outputDir);
             std::cout << "Created output directory: " << outputDir.string() << std::endl;
         }
     }
     catch (const std::exception& e)
     {
         std::cerr << "ERROR: Could not create output directory. " << e.what() << std::endl;
-        return 1;
+        return false;
     }
 
-    for (const auto& entry : fs::directory_iterator(targetPath))
+    RunStats stats("FEDOR_DB_TO_CSV");
+    stats.SetReportPath(reportPath.empty() ? RunStats::ReportPathFromEnvironment() : reportPath);
     {
-        if (entry.is_regular_file() && entry.path().extension() == ".db")
+        RunStats::ScopedTimer timer(stats, "convert");
+        for (const auto& entry : fs::directory_iterator(targetPath))
         {
-            ProcessDatabaseFile(entry.path(), outputDir);
+            if (entry.is_regular_file() && entry.path().extension() == ".db")
+            {
+                ProcessDatabaseFile(entry.path(), outputDir, &stats);
+            }
         }
     }
 
     std::cout << "\nConversion complete!" << std::endl;
-    return 0;
+    stats.PrintSummary(std::cout);
+    if (!stats.WriteJsonReport())
+    {
+        std::cerr << "ERROR: Could not write timing report: " << stats.GetReportPath().string() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// Папка для CSV: --output или подпапка csv_extracted.
+/// </summary>
+static fs::path OutputDirFromArgs(const CommandLine& args, const fs::path& targetPath)
+{
+    return args.Has("--output") ? fs::path(args.Get("--output")) : targetPath / "csv_extracted";
 }
 
+int main(int argc, char* argv[])
+{
+    std::cout << "--- DB to CSV Converter ---" << std::endl;
+
+    try
+    {
+        CommandLine args(argc, argv, kValueOptions, kFlagOptions);
+        if (args.Has("--help"))
+        {
+            PrintUsage();
+            return 0;
+        }
+
+        if (args.Has("--jobs"))
+        {
+            // Задания выполняются последовательно: конвертер пишет прямо в консоль
+            std::vector<CommandLine> jobs = ReadJobFile(args.Get("--jobs"), kValueOptions, kFlagOptions);
+            ThreadPool pool(1);
+            int failed = RunJobs(jobs, pool, [&](const CommandLine& job, size_t jobIndex, std::ostream&)
+            {
+                CommandLine jobArgs = args.MergedWith(job);
+                fs::path targetPath = FolderArgument(jobArgs);
+                fs::path reportPath = job.Has("--report") ? fs::path(job.Get("--report")) : JobReportPath(args.Get("--report"), jobIndex);
+                return ConvertFolder(targetPath, OutputDirFromArgs(jobArgs, targetPath), reportPath);
+            });
+            return failed == 0 ? 0 : 1;
+        }
+
+        if (!args.Empty())
+        {
+            fs::path targetPath = FolderArgument(args);
+            return ConvertFolder(targetPath, OutputDirFromArgs(args, targetPath), args.Get("--report")) ? 0 : 1;
+        }
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        PrintUsage();
+        return 2;
+    }
+
+    // Без аргументов - прежний интерактивный режим
+    std::cout << "Enter path to directory with .db files (or '.' for current directory): ";
+    std::string inputPathStr;
+    std::getline(std::cin, inputPathStr);
+
+    fs::path targetPath = inputPathStr.empty() || inputPathStr == "." ? fs::path(".") : fs::path(inputPathStr);
+
+    if (!fs::exists(targetPath) || !fs::is_directory(targetPath))
+    {
+        std::cerr << "ERROR: Path does not exist or is not a directory: " << inputPathStr << std::endl;
+        return 1;
+    }
+
+    return ConvertFolder(targetPath, targetPath / "csv_extracted", {}) ? 0 : 1;
+}
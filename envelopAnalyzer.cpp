@@ -2,10 +2,22 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include "FilePrefetcher.h"
+#include "BatchInserter.h"
+#include "RadixSort.h"
+#include "FloatRounding.h"
+#include "OutputFiles.h"
 
 // --- РЕАЛИЗАЦИЯ МЕТОДОВ КЛАССА ---
 
-EnvelopeAnalyzer::EnvelopeAnalyzer()
+EnvelopeAnalyzer::EnvelopeAnalyzer() : EnvelopeAnalyzer(Options{})
+{
+}
+
+EnvelopeAnalyzer::EnvelopeAnalyzer(const Options& options)
+    : options_(options), log_(options.log ? *options.log : std::cout), stats_("FEDOR_Analyzer"), allResults_(options.topK, options.singlePrecision)
 {
     // Конструктор может быть использован для начальной инициализации, если потребуется
 }
@@ -20,13 +32,49 @@ void EnvelopeAnalyzer::Run()
         return; // Выход, если путь некорректен
     }
 
+    Run(targetPath);
+}
+
+bool EnvelopeAnalyzer::Run(const fs::path& targetPath)
+{
+    stats_.SetReportPath(options_.reportPath.empty() ? RunStats::ReportPathFromEnvironment() : options_.reportPath);
+    const fs::path outputPath = options_.outputPath.empty() ? targetPath : options_.outputPath;
+    fs::create_directories(outputPath);
+
+    elementFilter_ = options_.elementFilter;
+    if (elementFilter_.FiltersTypes())
+    {
+        RunStats::ScopedTimer timer(stats_, "elements");
+        SelectElementsByType(CollectSourceFiles(targetPath));
+    }
+    if (elementFilter_.Active()) log_ << "Element filter: " << elementFilter_.Size() << " elements selected." << std::endl;
+
+    if (options_.mode == Mode::OnDisk)
+    {
+        RunOnDisk(targetPath, outputPath);
+    }
+    else
+    {
+        RunInMemory(targetPath, outputPath);
+    }
+
+    log_ << "\nAnalysis complete!" << std::endl;
+    stats_.PrintSummary(log_);
+    if (!stats_.WriteJsonReport())
+    {
+        ErrorLog() << "ERROR: Could not write timing report: " << stats_.GetReportPath().string() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+EnvelopeAnalyzer::Mode EnvelopeAnalyzer::DefaultMode()
+{
 #ifdef MEMORY_OPTIMIZED
-    RunOnDisk(targetPath);
+    return Mode::OnDisk;
 #else
-    RunInMemory(targetPath);
+    return Mode::InMemory;
 #endif
-
-    std::cout << "\nAnalysis complete!" << std::endl;
 }
 
 fs::path EnvelopeAnalyzer::GetTargetPathFromUser()
@@ -53,72 +101,204 @@ fs::path EnvelopeAnalyzer::GetTargetPathFromUser()
     return targetPath;
 }
 
+std::ostream& EnvelopeAnalyzer::ErrorLog()
+{
+    return &log_ == &std::cout ? std::cerr : log_;
+}
+
 void EnvelopeAnalyzer::LogSqliteError(const std::string& message, sqlite3* dbHandle)
 {
-    std::cerr << "  ERROR: " << message << ": " << sqlite3_errmsg(dbHandle) << std::endl;
+    ErrorLog() << "  ERROR: " << message << ": " << sqlite3_errmsg(dbHandle) << std::endl;
+}
+
+void EnvelopeAnalyzer::LogRoundingError(double maxError)
+{
+    if (!options_.singlePrecision) return;
+    FloatRounding::LogMaxError(log_, maxError);
+}
+
+bool EnvelopeAnalyzer::IsProcessableDbFile(const fs::directory_entry& entry)
+{
+    if (!entry.is_regular_file() || entry.path().extension() != ".db")
+    {
+        return false;
+    }
+    return !IsToolOutputFile(entry.path().filename().string());
 }
 
-std::vector<std::string> EnvelopeAnalyzer::GetTableNames(sqlite3* dbHandle)
+std::vector<fs::path> EnvelopeAnalyzer::CollectSourceFiles(const fs::path& targetPath)
 {
-    std::vector<std::string> tableNames;
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(dbHandle, "SELECT name FROM sqlite_master WHERE type='table';", -1, &stmt, nullptr) == SQLITE_OK)
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(targetPath))
     {
+        if (IsProcessableDbFile(entry)) files.push_back(entry.path());
+    }
+    return files;
+}
+
+uint32_t EnvelopeAnalyzer::SourceId(const std::string& sourceDb, const std::string& sourceTable)
+{
+    auto key = std::make_pair(sourceDb, sourceTable);
+    auto it = sourceIndex_.find(key);
+    if (it != sourceIndex_.end()) return it->second;
+    uint32_t source = static_cast<uint32_t>(sources_.size());
+    sources_.push_back({ sourceDb, sourceTable });
+    sourceIndex_.emplace(key, source);
+    return source;
+}
+
+void EnvelopeAnalyzer::SelectElementsByType(const std::vector<fs::path>& files)
+{
+    ReadProfile profile;
+    profile.immutable = options_.immutableSources;
+    const std::string sql = "SELECT \"" + config_.ELEMENT_ID_COLUMN + "\", \"" + config_.ELEM_TYPE_COLUMN + "\" FROM \"" + config_.ELEMENTS_TABLE_NAME + "\";";
+    for (const auto& file : files)
+    {
+        SqliteConnection connection(file, profile);
+        if (!connection.IsOpen()) continue; // Ошибка открытия будет выведена при разборе файла
+        StatementLease statement = connection.Prepare(sql);
+        if (!statement) continue;
+        sqlite3_stmt* stmt = statement.Get();
         while (sqlite3_step(stmt) == SQLITE_ROW)
         {
-            tableNames.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+            const char* type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            elementFilter_.Accept(sqlite3_column_int64(stmt, 0), type ? type : "");
         }
     }
-    sqlite3_finalize(stmt);
-    return tableNames;
 }
 
-bool EnvelopeAnalyzer::IsProcessableDbFile(const fs::directory_entry& entry)
+// =================================================================
+//    РАЗБОР ИСХОДНЫХ ФАЙЛОВ (ОБЩИЙ ДЛЯ ОБОИХ РЕЖИМОВ)
+// =================================================================
+
+void EnvelopeAnalyzer::ProcessDatabase(const fs::path& dbPath, TopKTable& results)
 {
-    if (!entry.is_regular_file() || entry.path().extension() != ".db")
+    log_ << "\nProcessing file: " << dbPath.filename().string() << "\n";
+    ReadProfile profile;
+    profile.immutable = options_.immutableSources;
+    SqliteConnection connection(dbPath, profile);
+    if (!connection.IsOpen())
     {
-        return false;
+        ErrorLog() << "  ERROR: Could not open file: " << connection.OpenError() << std::endl;
+        return;
+    }
+
+    RunStats::FileStats& fileStats = stats_.BeginFile("analyze", dbPath);
+    for (const auto& tableName : connection.TableNames())
+    {
+        Stopwatch tableTimer;
+        long long rowCount = ProcessTable(tableName, connection, SourceId(dbPath.filename().string(), tableName), results);
+        fileStats.AddTable(tableName, rowCount, tableTimer.Seconds());
     }
-    const std::string filename = entry.path().filename().string();
-    return filename != config_.OUTPUT_DB_FILENAME && filename != config_.TEMP_DB_FILENAME;
+    stats_.EndFile(fileStats, connection.Handle());
 }
 
+long long EnvelopeAnalyzer::ProcessTable(const std::string& tableName, SqliteConnection& connection, uint32_t source, TopKTable& results)
+{
+    log_ << "  - Reading table: '" << tableName << "'\n";
+    // Выборка элементов: таблица с индексом по elemId читается только в диапазонах выборки (в порядке полного чтения)
+    const bool filterElements = elementFilter_.Active();
+    StatementLease statement;
+    if (filterElements && HasIndexOn(connection.Handle(), tableName, config_.ELEMENT_ID_COLUMN))
+    {
+        statement = connection.Prepare("SELECT * FROM \"" + tableName + "\" WHERE " + elementFilter_.SqlRanges(config_.ELEMENT_ID_COLUMN) + " ORDER BY rowid;");
+    }
+    if (!statement) statement = connection.Prepare(SqliteConnection::SelectAllSql(tableName));
+    if (!statement)
+    {
+        LogSqliteError("Failed to prepare query", connection.Handle());
+        return 0;
+    }
+    sqlite3_stmt* stmt = statement.Get();
+
+    const std::vector<std::string>& colNames = connection.ColumnNames(tableName);
+    int colCount = static_cast<int>(colNames.size());
+    int elemIdIdx = -1, setNIdx = -1;
+    std::vector<std::string> reinfNames;
+    std::vector<int> reinfIndices;
+    for (int i = 0; i < colCount; ++i)
+    {
+        const std::string& colName = colNames[i];
+        if (colName == config_.ELEMENT_ID_COLUMN) elemIdIdx = i;
+        else if (colName == config_.SET_N_COLUMN) setNIdx = i;
+        else if (colName.rfind("As", 0) == 0)
+        {
+            reinfNames.push_back(colName);
+            reinfIndices.push_back(i);
+        }
+    }
+
+    if (elemIdIdx == -1 || setNIdx == -1)
+    {
+        log_ << "    WARNING: Skipping table. Missing '" << config_.ELEMENT_ID_COLUMN << "' or '" << config_.SET_N_COLUMN << "' columns.\n";
+        return 0;
+    }
+
+    // Колонки таблицы переводятся в индексы колонок результата один раз
+    std::vector<int> reinfColumns;
+    for (const auto& name : reinfNames) reinfColumns.push_back(results.ColumnIndex(name));
+
+    long long rowCount = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        ++rowCount;
+        const long long elementId = sqlite3_column_int64(stmt, elemIdIdx);
+        if (filterElements && !elementFilter_.Contains(elementId)) continue;
+        int element = results.ElementIndex(elementId);
+        long long setN = sqlite3_column_int64(stmt, setNIdx);
+        for (size_t c = 0; c < reinfColumns.size(); ++c)
+        {
+            results.Offer(reinfColumns[c], element, sqlite3_column_double(stmt, reinfIndices[c]), setN, source);
+        }
+    }
+    return rowCount;
+}
 
-#ifdef MEMORY_OPTIMIZED
 // =================================================================
 //    РЕАЛИЗАЦИЯ ДЛЯ РЕЖИМА С НИЗКОЙ ПАМЯТЬЮ (НА ДИСКЕ)
 // =================================================================
 
-void EnvelopeAnalyzer::RunOnDisk(const fs::path& targetPath)
+void EnvelopeAnalyzer::RunOnDisk(const fs::path& targetPath, const fs::path& outputPath)
 {
-    std::cout << "\n>> Running in MEMORY OPTIMIZED (On-Disk) mode." << std::endl;
+    log_ << "\n>> Running in MEMORY OPTIMIZED (On-Disk) mode." << std::endl;
     
-    fs::path tempDbPath = targetPath / config_.TEMP_DB_FILENAME;
+    fs::path tempDbPath = outputPath / config_.TEMP_DB_FILENAME;
     sqlite3* tempDbHandle = InitializeTempDatabase(tempDbPath);
     if (!tempDbHandle) return;
 
     char* errMsg = nullptr;
     sqlite3_exec(tempDbHandle, "BEGIN TRANSACTION;", 0, 0, &errMsg);
 
+    // В памяти держится top-K только текущего файла; между файлами результаты копятся во временной БД
+    TopKTable fileResults(options_.topK, options_.singlePrecision);
+    double maxRoundingError = 0.0;
     int fileCount = 0;
-    for (const auto& entry : fs::directory_iterator(targetPath))
     {
-        if (IsProcessableDbFile(entry))
+        RunStats::ScopedTimer timer(stats_, "analyze");
+        const std::vector<fs::path> files = CollectSourceFiles(targetPath);
+        FilePrefetcher prefetcher(files, static_cast<size_t>(std::max(0, options_.prefetchDepth)));
+        for (const auto& file : files)
         {
-            ProcessDatabaseOnDisk(entry.path(), tempDbHandle);
+            prefetcher.Advance(static_cast<size_t>(fileCount));
+            fileResults.Clear();
+            ProcessDatabase(file, fileResults);
+            MergeIntoTempDatabase(fileResults, tempDbHandle);
+            maxRoundingError = std::max(maxRoundingError, fileResults.MaxRoundingError());
             fileCount++;
         }
+
+        sqlite3_exec(tempDbHandle, "COMMIT;", 0, 0, &errMsg);
     }
-    
-    sqlite3_exec(tempDbHandle, "COMMIT;", 0, 0, &errMsg);
+    LogRoundingError(maxRoundingError);
 
     if (fileCount > 0)
     {
-        SaveFinalResultsOnDisk(tempDbHandle, targetPath);
+        RunStats::ScopedTimer timer(stats_, "write");
+        SaveFinalResultsOnDisk(tempDbHandle, outputPath);
     }
     else
     {
-        std::cout << "\nNo .db files found to process in the specified directory." << std::endl;
+        log_ << "\nNo .db files found to process in the specified directory." << std::endl;
     }
 
     sqlite3_close(tempDbHandle);
@@ -136,12 +316,20 @@ sqlite3* EnvelopeAnalyzer::InitializeTempDatabase(const fs::path& tempDbPath)
         return nullptr;
     }
     
-    const char* createTempTableSql = R"(
+    // При K > 1 на ячейку приходится до K строк с рангом.
+    // WITHOUT ROWID: строки лежат прямо в B-дереве первичного ключа, без второго индекса по rowid
+    const char* createTempTableSql = options_.topK > 1 ? R"(
+        CREATE TABLE IntermediateResults (
+            Element_ID INTEGER, Reinforcement_Type TEXT, Rank INTEGER, Max_Value REAL,
+            Source_DB TEXT, Source_Table TEXT, Source_SetN INTEGER,
+            PRIMARY KEY (Element_ID, Reinforcement_Type, Rank)
+        ) WITHOUT ROWID;
+    )" : R"(
         CREATE TABLE IntermediateResults (
             Element_ID INTEGER, Reinforcement_Type TEXT, Max_Value REAL,
             Source_DB TEXT, Source_Table TEXT, Source_SetN INTEGER,
             PRIMARY KEY (Element_ID, Reinforcement_Type)
-        );
+        ) WITHOUT ROWID;
     )";
     char* errMsg = nullptr;
     sqlite3_exec(tempDbHandle, createTempTableSql, 0, 0, &errMsg);
@@ -153,102 +341,162 @@ sqlite3* EnvelopeAnalyzer::InitializeTempDatabase(const fs::path& tempDbPath)
     return tempDbHandle;
 }
 
-void EnvelopeAnalyzer::ProcessDatabaseOnDisk(const fs::path& dbPath, sqlite3* tempDbHandle)
+void EnvelopeAnalyzer::MergeIntoTempDatabase(const TopKTable& fileResults, sqlite3* tempDbHandle)
 {
-    std::cout << "\nProcessing file: " << dbPath.filename().string() << std::endl;
-    sqlite3* sourceDbHandle;
-    if (sqlite3_open_v2(dbPath.string().c_str(), &sourceDbHandle, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
-    {
-        LogSqliteError("Could not open source file", sourceDbHandle);
-        sqlite3_close(sourceDbHandle);
-        return;
-    }
+    const int k = fileResults.K();
+    std::vector<TopKEntry> entries(k);
 
-    const char* upsertSql = R"(
-        INSERT INTO IntermediateResults VALUES (?, ?, ?, ?, ?, ?)
-        ON CONFLICT(Element_ID, Reinforcement_Type) DO UPDATE SET
-            Max_Value = excluded.Max_Value, Source_DB = excluded.Source_DB,
-            Source_Table = excluded.Source_Table, Source_SetN = excluded.Source_SetN
-        WHERE excluded.Max_Value > Max_Value;
-    )";
-    sqlite3_stmt* upsertStmt;
-    if (sqlite3_prepare_v2(tempDbHandle, upsertSql, -1, &upsertStmt, nullptr) != SQLITE_OK)
+    // Ячейки файла обходятся в порядке ключа временной таблицы (elemId, затем имя колонки), чтобы записи шли по соседним страницам
+    const std::vector<int> sortedElements = RadixSortedOrder(fileResults.ElementIds());
+    std::vector<int> sortedColumns(fileResults.ColumnCount());
+    for (size_t i = 0; i < sortedColumns.size(); ++i) sortedColumns[i] = static_cast<int>(i);
+    std::sort(sortedColumns.begin(), sortedColumns.end(), [&fileResults](int a, int b) { return fileResults.ColumnName(a) < fileResults.ColumnName(b); });
+
+    if (k == 1)
     {
-        LogSqliteError("Failed to prepare UPSERT statement", tempDbHandle);
-        sqlite3_close(sourceDbHandle);
+        // Одно значение на ячейку: UPSERT с прежним правилом "строго больше"
+        const char* upsertTail = R"(
+            ON CONFLICT(Element_ID, Reinforcement_Type) DO UPDATE SET
+                Max_Value = excluded.Max_Value, Source_DB = excluded.Source_DB,
+                Source_Table = excluded.Source_Table, Source_SetN = excluded.Source_SetN
+            WHERE excluded.Max_Value > Max_Value)";
+        BatchInserter upserter(tempDbHandle, "INSERT INTO IntermediateResults", 6, upsertTail);
+        for (int element : sortedElements)
+        {
+            for (int column : sortedColumns)
+            {
+                if (fileResults.SortedEntries(column, element, entries.data()) == 0) continue;
+                const SourceInfo& source = sources_[entries[0].source];
+                upserter.BindInt64(fileResults.ElementId(element));
+                upserter.BindText(fileResults.ColumnName(column));
+                upserter.BindDouble(entries[0].value);
+                upserter.BindText(source.sourceDb);
+                upserter.BindText(source.sourceTable);
+                upserter.BindInt64(entries[0].setN);
+                upserter.EndRow();
+            }
+        }
+        upserter.Flush();
+        if (!upserter.Error().empty()) ErrorLog() << "  ERROR: UPSERT into the temporary database failed: " << upserter.Error() << std::endl;
         return;
     }
 
-    for (const auto& tableName : GetTableNames(sourceDbHandle))
-    {
-        ProcessTableOnDisk(tableName, sourceDbHandle, upsertStmt, dbPath.filename().string());
-    }
-    
-    sqlite3_finalize(upsertStmt);
-    sqlite3_close(sourceDbHandle);
-}
+    // K > 1: накопленные значения (они поступили раньше) объединяются со значениями файла пачками элементов.
+    // На пачку - одно чтение диапазона elemId по порядку ключа, слияние в памяти и UPSERT только изменившихся рангов:
+    // после слияния рангов не меньше, чем было, поэтому DELETE не нужен. Пачки не пересекаются по elemId,
+    // поэтому чтению пачки не мешают еще не записанные строки предыдущих
+    const size_t kMergeBatchEntries = 1 << 18; // Записей top-K в памяти на пачку (несколько МБ)
+    const int columnCount = static_cast<int>(fileResults.ColumnCount());
+    std::unordered_map<std::string, int> columnIndex;
+    for (int column = 0; column < columnCount; ++column) columnIndex[fileResults.ColumnName(column)] = column;
+    const size_t cellEntries = static_cast<size_t>(std::max(1, columnCount)) * k;
+    const size_t batchElements = std::max<size_t>(1, kMergeBatchEntries / cellEntries);
 
-void EnvelopeAnalyzer::ProcessTableOnDisk(const std::string& tableName, sqlite3* sourceDbHandle, sqlite3_stmt* upsertStmt, const std::string& sourceDbName)
-{
-    std::cout << "  - Reading table: '" << tableName << "'" << std::endl;
-    
-    std::string query = "SELECT * FROM \"" + tableName + "\";";
     sqlite3_stmt* selectStmt;
-    if (sqlite3_prepare_v2(sourceDbHandle, query.c_str(), -1, &selectStmt, nullptr) != SQLITE_OK) return;
-
-    int colCount = sqlite3_column_count(selectStmt);
-    int elemIdIdx = -1, setNIdx = -1;
-    std::vector<std::pair<std::string, int>> reinfCols;
-    for (int i = 0; i < colCount; ++i)
-    {
-        std::string colName = sqlite3_column_name(selectStmt, i);
-        if (colName == config_.ELEMENT_ID_COLUMN) elemIdIdx = i;
-        else if (colName == config_.SET_N_COLUMN) setNIdx = i;
-        else if (colName.rfind("As", 0) == 0) reinfCols.push_back({colName, i});
-    }
+    sqlite3_prepare_v2(tempDbHandle, "SELECT Element_ID, Reinforcement_Type, Max_Value, Source_DB, Source_Table, Source_SetN FROM IntermediateResults "
+                                     "WHERE Element_ID BETWEEN ? AND ? ORDER BY Element_ID, Reinforcement_Type, Rank;", -1, &selectStmt, nullptr);
+    const char* upsertTail = R"(
+        ON CONFLICT(Element_ID, Reinforcement_Type, Rank) DO UPDATE SET
+            Max_Value = excluded.Max_Value, Source_DB = excluded.Source_DB,
+            Source_Table = excluded.Source_Table, Source_SetN = excluded.Source_SetN)";
+    BatchInserter upserter(tempDbHandle, "INSERT INTO IntermediateResults", 7, upsertTail);
 
-    if (elemIdIdx == -1 || setNIdx == -1)
+    std::vector<TopKEntry> stored(batchElements * cellEntries); // [элемент пачки][колонка][ранг]
+    std::vector<int> storedCounts(batchElements * columnCount);
+    std::vector<TopKEntry> merged(2 * static_cast<size_t>(k));
+    for (size_t batchStart = 0; batchStart < sortedElements.size(); batchStart += batchElements)
     {
-        sqlite3_finalize(selectStmt);
-        return;
-    }
+        const size_t batchEnd = std::min(sortedElements.size(), batchStart + batchElements);
+        std::fill(storedCounts.begin(), storedCounts.end(), 0);
+
+        // Шаг 1: накопленные строки диапазона; элементы диапазона, которых нет в файле, пропускаются
+        sqlite3_bind_int64(selectStmt, 1, fileResults.ElementId(sortedElements[batchStart]));
+        sqlite3_bind_int64(selectStmt, 2, fileResults.ElementId(sortedElements[batchEnd - 1]));
+        size_t cursor = batchStart;
+        while (sqlite3_step(selectStmt) == SQLITE_ROW)
+        {
+            const long long elementId = sqlite3_column_int64(selectStmt, 0);
+            while (cursor < batchEnd && fileResults.ElementId(sortedElements[cursor]) < elementId) ++cursor;
+            if (cursor == batchEnd) break;
+            if (fileResults.ElementId(sortedElements[cursor]) != elementId) continue;
+            auto column = columnIndex.find(reinterpret_cast<const char*>(sqlite3_column_text(selectStmt, 1)));
+            if (column == columnIndex.end()) continue; // Колонка, которой нет в файле, не меняется
+            const size_t cell = (cursor - batchStart) * columnCount + column->second;
+            if (storedCounts[cell] == k) continue;
+            TopKEntry& entry = stored[cell * k + storedCounts[cell]++];
+            entry.value = sqlite3_column_double(selectStmt, 2);
+            entry.source = SourceId(reinterpret_cast<const char*>(sqlite3_column_text(selectStmt, 3)),
+                                    reinterpret_cast<const char*>(sqlite3_column_text(selectStmt, 4)));
+            entry.setN = sqlite3_column_int64(selectStmt, 5);
+        }
+        sqlite3_reset(selectStmt);
 
-    while (sqlite3_step(selectStmt) == SQLITE_ROW)
-    {
-        long long elementId = sqlite3_column_int64(selectStmt, elemIdIdx);
-        long long setN = sqlite3_column_int64(selectStmt, setNIdx);
-        for (const auto& reinfCol : reinfCols)
+        // Шаг 2: слияние двух убывающих списков; при равных значениях выше остается накопленное (оно поступило раньше)
+        for (size_t position = batchStart; position < batchEnd; ++position)
         {
-            sqlite3_bind_int64(upsertStmt, 1, elementId);
-            sqlite3_bind_text(upsertStmt, 2, reinfCol.first.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_double(upsertStmt, 3, sqlite3_column_double(selectStmt, reinfCol.second));
-            sqlite3_bind_text(upsertStmt, 4, sourceDbName.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(upsertStmt, 5, tableName.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int64(upsertStmt, 6, setN);
-            sqlite3_step(upsertStmt);
-            sqlite3_reset(upsertStmt);
+            const int element = sortedElements[position];
+            const long long elementId = fileResults.ElementId(element);
+            for (int column : sortedColumns)
+            {
+                const int fileCount = fileResults.SortedEntries(column, element, entries.data());
+                if (fileCount == 0) continue;
+                const size_t cell = (position - batchStart) * columnCount + column;
+                const TopKEntry* storedEntries = &stored[cell * k];
+                const int storedCount = storedCounts[cell];
+                auto mergedEnd = std::merge(storedEntries, storedEntries + storedCount, entries.begin(), entries.begin() + fileCount, merged.begin(),
+                                            [](const TopKEntry& a, const TopKEntry& b) { return a.value > b.value; });
+                const int mergedCount = std::min(k, static_cast<int>(mergedEnd - merged.begin()));
+
+                for (int rank = 0; rank < mergedCount; ++rank)
+                {
+                    const TopKEntry& entry = merged[rank];
+                    if (rank < storedCount && entry.value == storedEntries[rank].value && entry.source == storedEntries[rank].source &&
+                        entry.setN == storedEntries[rank].setN) continue;
+                    const SourceInfo& source = sources_[entry.source];
+                    upserter.BindInt64(elementId);
+                    upserter.BindText(fileResults.ColumnName(column));
+                    upserter.BindInt64(static_cast<long long>(rank) + 1);
+                    upserter.BindDouble(entry.value);
+                    upserter.BindText(source.sourceDb);
+                    upserter.BindText(source.sourceTable);
+                    upserter.BindInt64(entry.setN);
+                    upserter.EndRow();
+                }
+            }
         }
     }
+    upserter.Flush();
+    if (!upserter.Error().empty()) ErrorLog() << "  ERROR: UPSERT into the temporary database failed: " << upserter.Error() << std::endl;
     sqlite3_finalize(selectStmt);
 }
 
 void EnvelopeAnalyzer::SaveFinalResultsOnDisk(sqlite3* tempDbHandle, const fs::path& targetPath)
 {
-    std::cout << "\nWriting final results..." << std::endl;
+    if (options_.wideOutput && SaveWideFinalResultsOnDisk(tempDbHandle, targetPath)) return;
+
+    log_ << "\nWriting final results..." << std::endl;
+    const bool withRank = options_.topK > 1;
     
     std::ofstream csvFile(targetPath / config_.OUTPUT_CSV_FILENAME);
-    csvFile << "Element_ID;Reinforcement_Type;Max_Value;Source_DB;Source_Table;Source_SetN\n";
+    csvFile << "Element_ID;Reinforcement_Type;Max_Value;Source_DB;Source_Table;Source_SetN" << (withRank ? ";Rank" : "") << "\n";
+
+    // Результат предыдущего запуска заменяется, а не дополняется
+    fs::path finalDbPath = targetPath / config_.OUTPUT_DB_FILENAME;
+    if (fs::exists(finalDbPath)) fs::remove(finalDbPath);
 
     sqlite3* finalDbHandle;
-    sqlite3_open((targetPath / config_.OUTPUT_DB_FILENAME).string().c_str(), &finalDbHandle);
+    sqlite3_open(finalDbPath.string().c_str(), &finalDbHandle);
     char* errMsg = nullptr;
-    sqlite3_exec(finalDbHandle, "CREATE TABLE IF NOT EXISTS EnvelopedReinforcement (Element_ID INTEGER, Reinforcement_Type TEXT, Max_Value REAL, Source_DB TEXT, Source_Table TEXT, Source_SetN INTEGER);", 0, 0, &errMsg);
+    sqlite3_exec(finalDbHandle, withRank
+        ? "CREATE TABLE IF NOT EXISTS EnvelopedReinforcement (Element_ID INTEGER, Reinforcement_Type TEXT, Max_Value REAL, Source_DB TEXT, Source_Table TEXT, Source_SetN INTEGER, Rank INTEGER, PRIMARY KEY (Element_ID, Reinforcement_Type, Rank)) WITHOUT ROWID;"
+        : "CREATE TABLE IF NOT EXISTS EnvelopedReinforcement (Element_ID INTEGER, Reinforcement_Type TEXT, Max_Value REAL, Source_DB TEXT, Source_Table TEXT, Source_SetN INTEGER, PRIMARY KEY (Element_ID, Reinforcement_Type)) WITHOUT ROWID;", 0, 0, &errMsg);
     sqlite3_exec(finalDbHandle, "BEGIN TRANSACTION;", 0, 0, &errMsg);
-    sqlite3_stmt* insertStmt;
-    sqlite3_prepare_v2(finalDbHandle, "INSERT INTO EnvelopedReinforcement VALUES (?, ?, ?, ?, ?, ?);", -1, &insertStmt, nullptr);
+    BatchInserter inserter(finalDbHandle, "INSERT INTO EnvelopedReinforcement", withRank ? 7 : 6);
 
     sqlite3_stmt* selectStmt;
-    sqlite3_prepare_v2(tempDbHandle, "SELECT * FROM IntermediateResults ORDER BY Element_ID, Reinforcement_Type;", -1, &selectStmt, nullptr);
+    sqlite3_prepare_v2(tempDbHandle, withRank
+        ? "SELECT Element_ID, Reinforcement_Type, Max_Value, Source_DB, Source_Table, Source_SetN, Rank FROM IntermediateResults ORDER BY Element_ID, Reinforcement_Type, Rank;"
+        : "SELECT * FROM IntermediateResults ORDER BY Element_ID, Reinforcement_Type;", -1, &selectStmt, nullptr);
 
     while (sqlite3_step(selectStmt) == SQLITE_ROW)
     {
@@ -259,174 +507,367 @@ void EnvelopeAnalyzer::SaveFinalResultsOnDisk(sqlite3* tempDbHandle, const fs::p
         const char* sourceTable = reinterpret_cast<const char*>(sqlite3_column_text(selectStmt, 4));
         long long sourceSetN = sqlite3_column_int64(selectStmt, 5);
 
-        csvFile << elementId << ";" << reinfType << ";" << maxValue << ";" << sourceDb << ";" << sourceTable << ";" << sourceSetN << "\n";
+        csvFile << elementId << ";" << reinfType << ";" << maxValue << ";" << sourceDb << ";" << sourceTable << ";" << sourceSetN;
+        if (withRank) csvFile << ";" << sqlite3_column_int64(selectStmt, 6);
+        csvFile << "\n";
         
-        sqlite3_bind_int64(insertStmt, 1, elementId);
-        sqlite3_bind_text(insertStmt, 2, reinfType, -1, SQLITE_STATIC);
-        sqlite3_bind_double(insertStmt, 3, maxValue);
-        sqlite3_bind_text(insertStmt, 4, sourceDb, -1, SQLITE_STATIC);
-        sqlite3_bind_text(insertStmt, 5, sourceTable, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(insertStmt, 6, sourceSetN);
-        sqlite3_step(insertStmt);
-        sqlite3_reset(insertStmt);
+        inserter.BindInt64(elementId);
+        inserter.BindText(reinfType);
+        inserter.BindDouble(maxValue);
+        inserter.BindText(sourceDb);
+        inserter.BindText(sourceTable);
+        inserter.BindInt64(sourceSetN);
+        if (withRank) inserter.BindInt64(sqlite3_column_int64(selectStmt, 6));
+        inserter.EndRow();
     }
 
     sqlite3_finalize(selectStmt);
-    sqlite3_finalize(insertStmt);
+    inserter.Flush();
+    if (!inserter.Error().empty()) ErrorLog() << "  ERROR: Could not write results: " << inserter.Error() << std::endl;
     sqlite3_exec(finalDbHandle, "COMMIT;", 0, 0, &errMsg);
     if (errMsg) sqlite3_free(errMsg);
     sqlite3_close(finalDbHandle);
 
-    std::cout << "OK: Results successfully saved." << std::endl;
+    log_ << "OK: Results successfully saved." << std::endl;
 }
 
-#else
 // =================================================================
 //      РЕАЛИЗАЦИЯ ДЛЯ РЕЖИМА В ОПЕРАТИВНОЙ ПАМЯТИ (БЫСТРЫЙ)
 // =================================================================
 
-void EnvelopeAnalyzer::RunInMemory(const fs::path& targetPath)
+void EnvelopeAnalyzer::RunInMemory(const fs::path& targetPath, const fs::path& outputPath)
 {
-    std::cout << "\n>> Running in HIGH PERFORMANCE (In-Memory) mode." << std::endl;
+    log_ << "\n>> Running in HIGH PERFORMANCE (In-Memory) mode." << std::endl;
+    allResults_ = TopKTable(options_.topK, options_.singlePrecision);
     
     int fileCount = 0;
-    for (const auto& entry : fs::directory_iterator(targetPath))
     {
-        if (IsProcessableDbFile(entry))
+        RunStats::ScopedTimer timer(stats_, "analyze");
+        const std::vector<fs::path> files = CollectSourceFiles(targetPath);
+        FilePrefetcher prefetcher(files, static_cast<size_t>(std::max(0, options_.prefetchDepth)));
+        for (const auto& file : files)
         {
-            ProcessDatabaseInMemory(entry.path());
+            prefetcher.Advance(static_cast<size_t>(fileCount));
+            ProcessDatabase(file, allResults_);
             fileCount++;
         }
     }
+    LogRoundingError(allResults_.MaxRoundingError());
 
-    if (allMaxResults_.empty())
+    if (allResults_.ElementCount() == 0)
     {
-        std::cout << "\nERROR: No data was collected. Check .db files in the specified directory." << std::endl;
+        log_ << "\nERROR: No data was collected. Check .db files in the specified directory." << std::endl;
     }
     else
     {
-        SaveResultsInMemory(targetPath);
+        RunStats::ScopedTimer timer(stats_, "write");
+        SaveResultsInMemory(outputPath);
     }
 }
 
-void EnvelopeAnalyzer::ProcessDatabaseInMemory(const fs::path& dbPath)
+void EnvelopeAnalyzer::SaveResultsInMemory(const fs::path& targetPath)
 {
-    std::cout << "\nProcessing file: " << dbPath.filename().string() << std::endl;
+    if (options_.wideOutput && SaveWideResultsInMemory(targetPath)) return;
+
+    log_ << "\nWriting results..." << std::endl;
+    const bool withRank = options_.topK > 1;
+    std::ofstream csvFile(targetPath / config_.OUTPUT_CSV_FILENAME);
+    csvFile << "Element_ID;Reinforcement_Type;Max_Value;Source_DB;Source_Table;Source_SetN" << (withRank ? ";Rank" : "") << "\n";
+
+    // Результат предыдущего запуска заменяется, а не дополняется
+    fs::path outputDbPath = targetPath / config_.OUTPUT_DB_FILENAME;
+    if (fs::exists(outputDbPath)) fs::remove(outputDbPath);
+
     sqlite3* dbHandle;
-    if (sqlite3_open_v2(dbPath.string().c_str(), &dbHandle, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    if (sqlite3_open(outputDbPath.string().c_str(), &dbHandle) != SQLITE_OK)
     {
-        LogSqliteError("Could not open file", dbHandle);
+        LogSqliteError("Could not create output database", dbHandle);
         sqlite3_close(dbHandle);
         return;
     }
 
-    for (const auto& tableName : GetTableNames(dbHandle))
+    char* errMsg = nullptr;
+    sqlite3_exec(dbHandle, withRank
+        ? "CREATE TABLE IF NOT EXISTS EnvelopedReinforcement (Element_ID INTEGER, Reinforcement_Type TEXT, Max_Value REAL, Source_DB TEXT, Source_Table TEXT, Source_SetN INTEGER, Rank INTEGER, PRIMARY KEY (Element_ID, Reinforcement_Type, Rank)) WITHOUT ROWID;"
+        : "CREATE TABLE IF NOT EXISTS EnvelopedReinforcement (Element_ID INTEGER, Reinforcement_Type TEXT, Max_Value REAL, Source_DB TEXT, Source_Table TEXT, Source_SetN INTEGER, PRIMARY KEY (Element_ID, Reinforcement_Type)) WITHOUT ROWID;", 0, 0, &errMsg);
+    sqlite3_exec(dbHandle, "BEGIN TRANSACTION;", 0, 0, &errMsg);
+
+    BatchInserter inserter(dbHandle, "INSERT INTO EnvelopedReinforcement", withRank ? 7 : 6);
+
+    // Элементы по возрастанию elemId, колонки по имени (как в режиме On-Disk)
+    // Строки идут в порядке ключа таблицы: B-дерево заполняется дописыванием в конец, без разбиения страниц
+    const std::vector<int> sortedElements = RadixSortedOrder(allResults_.ElementIds());
+    std::vector<int> sortedColumns(allResults_.ColumnCount());
+    for (size_t i = 0; i < sortedColumns.size(); ++i) sortedColumns[i] = static_cast<int>(i);
+    std::sort(sortedColumns.begin(), sortedColumns.end(), [this](int a, int b) { return allResults_.ColumnName(a) < allResults_.ColumnName(b); });
+
+    std::vector<TopKEntry> entries(allResults_.K());
+    for (int element : sortedElements)
     {
-        ProcessTableInMemory(tableName, dbHandle, dbPath.filename().string());
+        const long long elementId = allResults_.ElementId(element);
+        for (int column : sortedColumns)
+        {
+            const std::string& reinfType = allResults_.ColumnName(column);
+            int count = allResults_.SortedEntries(column, element, entries.data());
+            for (int rank = 0; rank < count; ++rank)
+            {
+                const TopKEntry& info = entries[rank];
+                const SourceInfo& source = sources_[info.source];
+                csvFile << elementId << ";" << reinfType << ";" << info.value << ";" << source.sourceDb << ";" << source.sourceTable << ";" << info.setN;
+                if (withRank) csvFile << ";" << rank + 1;
+                csvFile << "\n";
+                inserter.BindInt64(elementId);
+                inserter.BindText(reinfType);
+                inserter.BindDouble(info.value);
+                inserter.BindText(source.sourceDb);
+                inserter.BindText(source.sourceTable);
+                inserter.BindInt64(info.setN);
+                if (withRank) inserter.BindInt64(rank + 1);
+                inserter.EndRow();
+            }
+        }
     }
+
+    inserter.Flush();
+    if (!inserter.Error().empty()) ErrorLog() << "  ERROR: Could not write results: " << inserter.Error() << std::endl;
+    sqlite3_exec(dbHandle, "COMMIT;", 0, 0, &errMsg);
+    if (errMsg) sqlite3_free(errMsg);
     sqlite3_close(dbHandle);
+
+    log_ << "OK: Results successfully saved." << std::endl;
 }
 
-void EnvelopeAnalyzer::ProcessTableInMemory(const std::string& tableName, sqlite3* dbHandle, const std::string& sourceDbName)
+// =================================================================
+//      ШИРОКИЙ ФОРМАТ РЕЗУЛЬТАТОВ (ОБА РЕЖИМА)
+// =================================================================
+
+namespace
 {
-    std::cout << "  - Reading table: '" << tableName << "'" << std::endl;
-    std::string query = "SELECT * FROM \"" + tableName + "\";";
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(dbHandle, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    /// <summary>
+    /// Пишет одну строку на элемент: Element_ID и по три колонки на вид армирования и ранг - значение, номер источника
+    /// (Source_ID словаря) и setN. Имена колонок: As1Ti, As1Ti_Source, As1Ti_SetN; для ранга r > 1 - As1Ti_r, As1Ti_r_Source, As1Ti_r_SetN.
+    /// Значения элемента задаются в SetCell и пишутся в EndElement; незаданные ячейки - NULL (в CSV - пусто).
+    /// </summary>
+    class WideResultWriter
     {
-        LogSqliteError("Failed to prepare query", dbHandle);
-        return;
-    }
+    public:
+        WideResultWriter(sqlite3* dbHandle, const std::string& tableName, std::ostream& csv, const std::vector<std::string>& types, int k)
+            : csv_(csv), k_(k), cells_(types.size() * k)
+        {
+            std::vector<std::string> names;
+            for (const auto& type : types)
+            {
+                for (int rank = 1; rank <= k; ++rank)
+                {
+                    const std::string name = rank == 1 ? type : type + "_" + std::to_string(rank);
+                    names.push_back(name);
+                    names.push_back(name + "_Source");
+                    names.push_back(name + "_SetN");
+                }
+            }
+            std::string createSql = "CREATE TABLE \"" + tableName + "\" (Element_ID INTEGER PRIMARY KEY";
+            csv_ << "Element_ID";
+            for (size_t i = 0; i < names.size(); ++i)
+            {
+                createSql += ", \"" + names[i] + "\" " + (i % 3 == 0 ? "REAL" : "INTEGER");
+                csv_ << ";" << names[i];
+            }
+            createSql += ");";
+            csv_ << "\n";
+            sqlite3_exec(dbHandle, createSql.c_str(), 0, 0, nullptr);
+            inserter_.reset(new BatchInserter(dbHandle, "INSERT INTO \"" + tableName + "\"", static_cast<int>(names.size()) + 1));
+        }
 
-    int colCount = sqlite3_column_count(stmt);
-    int elemIdIdx = -1, setNIdx = -1;
-    std::vector<std::pair<std::string, int>> reinfCols;
-    for (int i = 0; i < colCount; ++i)
-    {
-        std::string colName = sqlite3_column_name(stmt, i);
-        if (colName == config_.ELEMENT_ID_COLUMN) elemIdIdx = i;
-        else if (colName == config_.SET_N_COLUMN) setNIdx = i;
-        else if (colName.rfind("As", 0) == 0) reinfCols.push_back({ colName, i });
-    }
+        // Число колонок таблицы для typeCount видов армирования
+        static size_t ColumnCount(size_t typeCount, int k) { return 1 + typeCount * static_cast<size_t>(k) * 3; }
 
-    if (elemIdIdx == -1 || setNIdx == -1)
-    {
-        std::cout << "    WARNING: Skipping table. Missing '" << config_.ELEMENT_ID_COLUMN << "' or '" << config_.SET_N_COLUMN << "' columns." << std::endl;
-        sqlite3_finalize(stmt);
-        return;
-    }
+        void SetCell(int type, int rank, double value, uint32_t source, long long setN)
+        {
+            Cell& cell = cells_[static_cast<size_t>(type) * k_ + rank];
+            cell.set = true;
+            cell.value = value;
+            cell.source = source;
+            cell.setN = setN;
+        }
 
-    while (sqlite3_step(stmt) == SQLITE_ROW)
-    {
-        long long elementId = sqlite3_column_int64(stmt, elemIdIdx);
-        long long setN = sqlite3_column_int64(stmt, setNIdx);
-        for (const auto& reinfCol : reinfCols)
+        void EndElement(long long elementId)
         {
-            const std::string& colName = reinfCol.first;
-            int colIdx = reinfCol.second;
-            double currentValue = sqlite3_column_double(stmt, colIdx);
-            if (allMaxResults_[elementId].find(colName) == allMaxResults_[elementId].end() || currentValue > allMaxResults_[elementId][colName].value)
+            csv_ << elementId;
+            inserter_->BindInt64(elementId);
+            for (Cell& cell : cells_)
             {
-                allMaxResults_[elementId][colName] = { currentValue, sourceDbName, tableName, setN };
+                if (!cell.set)
+                {
+                    csv_ << ";;;";
+                    inserter_->BindNull();
+                    inserter_->BindNull();
+                    inserter_->BindNull();
+                    continue;
+                }
+                csv_ << ";" << cell.value << ";" << cell.source << ";" << cell.setN;
+                inserter_->BindDouble(cell.value);
+                inserter_->BindInt64(cell.source);
+                inserter_->BindInt64(cell.setN);
+                cell.set = false;
             }
+            csv_ << "\n";
+            inserter_->EndRow();
         }
-    }
-    sqlite3_finalize(stmt);
+
+        void Flush() { inserter_->Flush(); }
+        const std::string& Error() const { return inserter_->Error(); }
+
+    private:
+        struct Cell
+        {
+            bool set = false;
+            double value = 0.0;
+            uint32_t source = 0;
+            long long setN = 0;
+        };
+
+        std::ostream& csv_;
+        int k_;
+        std::vector<Cell> cells_; // Вид армирования * K + ранг
+        std::unique_ptr<BatchInserter> inserter_;
+    };
 }
 
-void EnvelopeAnalyzer::SaveResultsInMemory(const fs::path& targetPath)
+sqlite3* EnvelopeAnalyzer::OpenWideOutput(const fs::path& targetPath, size_t typeCount)
 {
-    std::cout << "\nWriting results..." << std::endl;
-    std::ofstream csvFile(targetPath / config_.OUTPUT_CSV_FILENAME);
-    csvFile << "Element_ID;Reinforcement_Type;Max_Value;Source_DB;Source_Table;Source_SetN\n";
+    fs::path outputDbPath = targetPath / config_.OUTPUT_DB_FILENAME;
+    if (fs::exists(outputDbPath)) fs::remove(outputDbPath);
 
     sqlite3* dbHandle;
-    if (sqlite3_open((targetPath / config_.OUTPUT_DB_FILENAME).string().c_str(), &dbHandle) != SQLITE_OK)
+    if (sqlite3_open(outputDbPath.string().c_str(), &dbHandle) != SQLITE_OK)
     {
         LogSqliteError("Could not create output database", dbHandle);
         sqlite3_close(dbHandle);
-        return;
+        return nullptr;
     }
 
-    char* errMsg = nullptr;
-    sqlite3_exec(dbHandle, "CREATE TABLE IF NOT EXISTS EnvelopedReinforcement (Element_ID INTEGER, Reinforcement_Type TEXT, Max_Value REAL, Source_DB TEXT, Source_Table TEXT, Source_SetN INTEGER);", 0, 0, &errMsg);
-    sqlite3_exec(dbHandle, "BEGIN TRANSACTION;", 0, 0, &errMsg);
+    const size_t columnCount = WideResultWriter::ColumnCount(typeCount, options_.topK);
+    const int maxColumns = sqlite3_limit(dbHandle, SQLITE_LIMIT_COLUMN, -1);
+    if (columnCount > static_cast<size_t>(maxColumns))
+    {
+        log_ << "  WARNING: The wide layout needs " << columnCount << " columns, SQLite allows " << maxColumns
+             << ". Writing the long layout instead." << std::endl;
+        sqlite3_close(dbHandle);
+        return nullptr;
+    }
 
-    const char* insertSql = "INSERT INTO EnvelopedReinforcement VALUES (?, ?, ?, ?, ?, ?);";
-    sqlite3_stmt* insertStmt;
-    sqlite3_prepare_v2(dbHandle, insertSql, -1, &insertStmt, nullptr);
+    sqlite3_exec(dbHandle, "BEGIN TRANSACTION;", 0, 0, nullptr);
+    WriteSourceDictionary(dbHandle, targetPath);
+    return dbHandle;
+}
 
-    std::vector<long long> sortedKeys;
-    for (const auto& pair : allMaxResults_) sortedKeys.push_back(pair.first);
-    std::sort(sortedKeys.begin(), sortedKeys.end());
+void EnvelopeAnalyzer::WriteSourceDictionary(sqlite3* dbHandle, const fs::path& targetPath)
+{
+    std::ofstream csvFile(targetPath / config_.OUTPUT_SOURCES_CSV_FILENAME);
+    csvFile << "Source_ID;Source_DB;Source_Table\n";
+    const std::string createSql = "CREATE TABLE \"" + config_.SOURCES_TABLE_NAME + "\" (Source_ID INTEGER PRIMARY KEY, Source_DB TEXT, Source_Table TEXT);";
+    sqlite3_exec(dbHandle, createSql.c_str(), 0, 0, nullptr);
+    BatchInserter inserter(dbHandle, "INSERT INTO \"" + config_.SOURCES_TABLE_NAME + "\"", 3);
+    for (size_t id = 0; id < sources_.size(); ++id)
+    {
+        csvFile << id << ";" << sources_[id].sourceDb << ";" << sources_[id].sourceTable << "\n";
+        inserter.BindInt64(static_cast<long long>(id));
+        inserter.BindText(sources_[id].sourceDb);
+        inserter.BindText(sources_[id].sourceTable);
+        inserter.EndRow();
+    }
+    inserter.Flush();
+}
+
+bool EnvelopeAnalyzer::SaveWideResultsInMemory(const fs::path& targetPath)
+{
+    std::vector<int> sortedColumns(allResults_.ColumnCount());
+    for (size_t i = 0; i < sortedColumns.size(); ++i) sortedColumns[i] = static_cast<int>(i);
+    std::sort(sortedColumns.begin(), sortedColumns.end(), [this](int a, int b) { return allResults_.ColumnName(a) < allResults_.ColumnName(b); });
+    std::vector<std::string> types;
+    for (int column : sortedColumns) types.push_back(allResults_.ColumnName(column));
 
-    for (const auto& elementId : sortedKeys)
+    sqlite3* dbHandle = OpenWideOutput(targetPath, types.size());
+    if (!dbHandle) return false;
+
+    log_ << "\nWriting results (wide layout)..." << std::endl;
+    std::ofstream csvFile(targetPath / config_.OUTPUT_CSV_FILENAME);
     {
-        const auto& reinfMap = allMaxResults_.at(elementId);
-        for (const auto& pair : reinfMap)
+        WideResultWriter writer(dbHandle, config_.WIDE_TABLE_NAME, csvFile, types, allResults_.K());
+        std::vector<TopKEntry> entries(allResults_.K());
+        for (int element : RadixSortedOrder(allResults_.ElementIds()))
         {
-            const std::string& reinfType = pair.first;
-            const ResultInfo& info = pair.second;
-            csvFile << elementId << ";" << reinfType << ";" << info.value << ";" << info.source_db << ";" << info.source_table << ";" << info.source_setN << "\n";
-            sqlite3_bind_int64(insertStmt, 1, elementId);
-            sqlite3_bind_text(insertStmt, 2, reinfType.c_str(), -1, SQLITE_STATIC);
-            sqlite3_bind_double(insertStmt, 3, info.value);
-            sqlite3_bind_text(insertStmt, 4, info.source_db.c_str(), -1, SQLITE_STATIC);
-            sqlite3_bind_text(insertStmt, 5, info.source_table.c_str(), -1, SQLITE_STATIC);
-            sqlite3_bind_int64(insertStmt, 6, info.source_setN);
-            sqlite3_step(insertStmt);
-            sqlite3_clear_bindings(insertStmt);
-            sqlite3_reset(insertStmt);
+            for (size_t type = 0; type < sortedColumns.size(); ++type)
+            {
+                const int count = allResults_.SortedEntries(sortedColumns[type], element, entries.data());
+                for (int rank = 0; rank < count; ++rank)
+                {
+                    writer.SetCell(static_cast<int>(type), rank, entries[rank].value, entries[rank].source, entries[rank].setN);
+                }
+            }
+            writer.EndElement(allResults_.ElementId(element));
         }
+        writer.Flush();
+        if (!writer.Error().empty()) ErrorLog() << "  ERROR: Could not write results: " << writer.Error() << std::endl;
     }
-
-    sqlite3_finalize(insertStmt);
-    sqlite3_exec(dbHandle, "COMMIT;", 0, 0, &errMsg);
-    if (errMsg) sqlite3_free(errMsg);
+    sqlite3_exec(dbHandle, "COMMIT;", 0, 0, nullptr);
     sqlite3_close(dbHandle);
 
-    std::cout << "OK: Results successfully saved." << std::endl;
+    log_ << "OK: Results successfully saved." << std::endl;
+    return true;
 }
 
-#endif
+bool EnvelopeAnalyzer::SaveWideFinalResultsOnDisk(sqlite3* tempDbHandle, const fs::path& targetPath)
+{
+    std::vector<std::string> types;
+    sqlite3_stmt* typesStmt;
+    sqlite3_prepare_v2(tempDbHandle, "SELECT DISTINCT Reinforcement_Type FROM IntermediateResults ORDER BY Reinforcement_Type;", -1, &typesStmt, nullptr);
+    while (sqlite3_step(typesStmt) == SQLITE_ROW) types.push_back(reinterpret_cast<const char*>(sqlite3_column_text(typesStmt, 0)));
+    sqlite3_finalize(typesStmt);
 
+    sqlite3* finalDbHandle = OpenWideOutput(targetPath, types.size());
+    if (!finalDbHandle) return false;
+
+    log_ << "\nWriting final results (wide layout)..." << std::endl;
+    const bool withRank = options_.topK > 1;
+    std::ofstream csvFile(targetPath / config_.OUTPUT_CSV_FILENAME);
+    {
+        WideResultWriter writer(finalDbHandle, config_.WIDE_TABLE_NAME, csvFile, types, options_.topK);
+        sqlite3_stmt* selectStmt;
+        sqlite3_prepare_v2(tempDbHandle, withRank
+            ? "SELECT Element_ID, Reinforcement_Type, Max_Value, Source_DB, Source_Table, Source_SetN, Rank FROM IntermediateResults ORDER BY Element_ID, Reinforcement_Type, Rank;"
+            : "SELECT Element_ID, Reinforcement_Type, Max_Value, Source_DB, Source_Table, Source_SetN FROM IntermediateResults ORDER BY Element_ID, Reinforcement_Type;", -1, &selectStmt, nullptr);
+
+        // Строки приходят по элементам и по имени вида армирования, поэтому номер вида только растет внутри элемента
+        bool hasElement = false;
+        long long currentElement = 0;
+        size_t type = 0;
+        while (sqlite3_step(selectStmt) == SQLITE_ROW)
+        {
+            const long long elementId = sqlite3_column_int64(selectStmt, 0);
+            if (!hasElement || elementId != currentElement)
+            {
+                if (hasElement) writer.EndElement(currentElement);
+                hasElement = true;
+                currentElement = elementId;
+                type = 0;
+            }
+            const char* reinfType = reinterpret_cast<const char*>(sqlite3_column_text(selectStmt, 1));
+            while (types[type] != reinfType) ++type;
+            const uint32_t source = SourceId(reinterpret_cast<const char*>(sqlite3_column_text(selectStmt, 3)),
+                                             reinterpret_cast<const char*>(sqlite3_column_text(selectStmt, 4)));
+            const int rank = withRank ? static_cast<int>(sqlite3_column_int64(selectStmt, 6)) - 1 : 0;
+            writer.SetCell(static_cast<int>(type), rank, sqlite3_column_double(selectStmt, 2), source, sqlite3_column_int64(selectStmt, 5));
+        }
+        if (hasElement) writer.EndElement(currentElement);
+        sqlite3_finalize(selectStmt);
+
+        writer.Flush();
+        if (!writer.Error().empty()) ErrorLog() << "  ERROR: Could not write results: " << writer.Error() << std::endl;
+    }
+    sqlite3_exec(finalDbHandle, "COMMIT;", 0, 0, nullptr);
+    sqlite3_close(finalDbHandle);
+
+    log_ << "OK: Results successfully saved." << std::endl;
+    return true;
+}
@@ -4,13 +4,21 @@
 #include <filesystem>
 #include <vector>
 #include <unordered_map>
+#include <map>
+#include <ostream>
 #include "sqlite3.h"
+#include "RunStats.h"
+#include "TopKTable.h"
+#include "SqliteAccess.h"
+#include "ElementFilter.h"
 
 // =================================================================
 //              ВЫБОР РЕЖИМА РАБОТЫ (ГЛАВНАЯ НАСТРОЙКА)
 // =================================================================
 // - Раскомментируй строку ниже для режима с низкой памятью (на диске).
 // - Закомментируй для режима в оперативной памяти (быстрый).
+// Макрос задает режим по умолчанию; оба режима всегда собираются и
+// доступны через Run(path, mode) (например, для бенчмарков).
 #define MEMORY_OPTIMIZED
 // =================================================================
 
@@ -22,56 +30,116 @@ namespace fs = std::filesystem;
 class EnvelopeAnalyzer
 {
 public:
+    // Режим работы анализатора
+    enum class Mode
+    {
+        InMemory, // Быстрый, все результаты в оперативной памяти
+        OnDisk    // Экономный, промежуточные результаты во временной БД
+    };
+
+    // Режим по умолчанию, выбранный макросом MEMORY_OPTIMIZED.
+    static Mode DefaultMode();
+
+    // Настройки запуска из командной строки или job-файла
+    struct Options
+    {
+        Mode mode = DefaultMode();
+        fs::path outputPath;          // Папка для результатов (пусто = папка с исходными .db)
+        fs::path reportPath;          // JSON-отчет (пусто = FEDOR_REPORT_JSON или без отчета)
+        int topK = 1;                 // Сколько определяющих сочетаний сохранять на элемент и колонку (при K > 1 в результатах есть колонка Rank)
+        bool singlePrecision = false; // Хранить top-K во float и setN в 32 битах (16 байт на запись вместо 24); результаты пишутся как REAL
+        bool wideOutput = false;      // Широкий формат результатов: строка на элемент, источники - номерами из словаря
+        bool immutableSources = false; // Исходные файлы окончательно записаны: открывать с immutable=1 (без блокировок)
+        int prefetchDepth = 1;        // Сколько следующих файлов подгружать в файловый кэш ОС во время обработки текущего (0 - выключено)
+        ElementFilter elementFilter;  // Анализировать только эти элементы: id и/или типы (неактивный фильтр - все элементы)
+        std::ostream* log = nullptr;  // Вывод хода работы (nullptr = std::cout)
+    };
+
     // Конструктор класса
     EnvelopeAnalyzer();
+    explicit EnvelopeAnalyzer(const Options& options);
 
-    // Запускает полный цикл работы анализатора.
+    // Запускает полный цикл работы анализатора (путь запрашивается у пользователя).
     void Run();
 
+    // Запускает анализ указанной папки без диалога с пользователем. Возвращает true при успехе.
+    bool Run(const fs::path& targetPath);
+
 private:
     // --- Конфигурация ---
     struct Config
     {
         const std::string ELEMENT_ID_COLUMN = "elemId";
         const std::string SET_N_COLUMN = "setN";
+        const std::string ELEMENTS_TABLE_NAME = "Elements";
+        const std::string ELEM_TYPE_COLUMN = "elemType";
         const std::string OUTPUT_CSV_FILENAME = "Enveloped_Reinforcement_Analysis.csv";
         const std::string OUTPUT_DB_FILENAME = "Enveloped_Reinforcement_Analysis.db";
         const std::string TEMP_DB_FILENAME = "__temp_envelope.db";
+        // Широкий формат (--wide): таблица результатов и словарь источников (в БД и отдельным CSV)
+        const std::string WIDE_TABLE_NAME = "EnvelopedReinforcementWide";
+        const std::string SOURCES_TABLE_NAME = "ReinforcementSources";
+        const std::string OUTPUT_SOURCES_CSV_FILENAME = "Enveloped_Reinforcement_Sources.csv";
     };
 
     // --- Структуры данных ---
-    struct ResultInfo
+    // Источник значения: файл и таблица. В ячейках TopKTable хранится только номер источника.
+    struct SourceInfo
     {
-        double value = 0.0;
-        std::string source_db;
-        std::string source_table;
-        long long source_setN = 0;
+        std::string sourceDb;
+        std::string sourceTable;
     };
-    using MaxResultsMap = std::unordered_map<long long, std::unordered_map<std::string, ResultInfo>>;
 
     // --- Приватные поля класса ---
     Config config_;
-    MaxResultsMap allMaxResults_; // Используется только в режиме In-Memory
+    Options options_;
+    ElementFilter elementFilter_; // Выборка запуска; при фильтре по типам в ней и принятые элементы
+    std::ostream& log_;           // Вывод хода работы
+    RunStats stats_;              // Статистика времени и счетчики текущего запуска
+    TopKTable allResults_;        // Используется только в режиме In-Memory
+    std::vector<SourceInfo> sources_; // Словарь источников (номер = SourceInfo)
+    std::map<std::pair<std::string, std::string>, uint32_t> sourceIndex_;
 
     // --- Основные методы ---
-    void RunInMemory(const fs::path& targetPath);
-    void RunOnDisk(const fs::path& targetPath);
+    void RunInMemory(const fs::path& targetPath, const fs::path& outputPath);
+    void RunOnDisk(const fs::path& targetPath, const fs::path& outputPath);
     fs::path GetTargetPathFromUser();
 
     // --- Общие вспомогательные методы ---
+    std::ostream& ErrorLog();     // stderr для консоли, лог задания при перенаправленном выводе
     void LogSqliteError(const std::string& message, sqlite3* dbHandle);
-    std::vector<std::string> GetTableNames(sqlite3* dbHandle);
+    // В режиме одинарной точности печатает наибольшую относительную ошибку округления.
+    void LogRoundingError(double maxError);
     bool IsProcessableDbFile(const fs::directory_entry& entry);
+    // Исходные файлы папки в порядке обхода
+    std::vector<fs::path> CollectSourceFiles(const fs::path& targetPath);
+    // Номер источника (файл, таблица) в словаре; добавляет источник при первом обращении.
+    uint32_t SourceId(const std::string& sourceDb, const std::string& sourceTable);
+    // Фильтр по типам: читает таблицы Elements всех файлов и запоминает элементы нужных типов.
+    void SelectElementsByType(const std::vector<fs::path>& files);
+
+    // --- Общий разбор исходных файлов (оба режима) ---
+    // Добавляет значения всех таблиц файла в results.
+    void ProcessDatabase(const fs::path& dbPath, TopKTable& results);
+    // Возвращает количество прочитанных строк таблицы.
+    long long ProcessTable(const std::string& tableName, SqliteConnection& connection, uint32_t source, TopKTable& results);
 
     // --- Методы для режима In-Memory ---
-    void ProcessDatabaseInMemory(const fs::path& dbPath);
-    void ProcessTableInMemory(const std::string& tableName, sqlite3* dbHandle, const std::string& sourceDbName);
     void SaveResultsInMemory(const fs::path& targetPath);
 
     // --- Методы для режима On-Disk ---
     sqlite3* InitializeTempDatabase(const fs::path& tempDbPath);
-    void ProcessDatabaseOnDisk(const fs::path& dbPath, sqlite3* tempDbHandle);
-    void ProcessTableOnDisk(const std::string& tableName, sqlite3* sourceDbHandle, sqlite3_stmt* upsertStmt, const std::string& sourceDbName);
+    // Сливает top-K одного файла с накопленными во временной БД результатами.
+    void MergeIntoTempDatabase(const TopKTable& fileResults, sqlite3* tempDbHandle);
     void SaveFinalResultsOnDisk(sqlite3* tempDbHandle, const fs::path& targetPath);
+
+    // --- Широкий формат (оба режима) ---
+    // Возвращают false, если колонок больше, чем допускает SQLite (тогда результаты пишутся в прежнем формате).
+    bool SaveWideResultsInMemory(const fs::path& targetPath);
+    bool SaveWideFinalResultsOnDisk(sqlite3* tempDbHandle, const fs::path& targetPath);
+    // Создает итоговую БД (прежний результат удаляется) с таблицей на typeCount видов армирования и словарем источников.
+    sqlite3* OpenWideOutput(const fs::path& targetPath, size_t typeCount);
+    // Словарь источников: номер -> файл и таблица, в итоговой БД и в CSV.
+    void WriteSourceDictionary(sqlite3* dbHandle, const fs::path& targetPath);
 };
 
@@ -4,358 +4,1839 @@
 #include <algorithm>
 #include <stdexcept>
 #include <sstream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <csignal>
+#include <limits>
+#include <cctype>
+#include <string_view>
+#include "FolderWatcher.h"
+#include "FilePrefetcher.h"
+#include "BatchInserter.h"
+#include "CsvRowReader.h"
+#include "RadixSort.h"
+#include "TableDigest.h"
+#include "FloatRounding.h"
+#include "OutputFiles.h"
 
 namespace Builder
 {
-    EnvelopeBuilder::EnvelopeBuilder() {}
+    namespace
+    {
+        // Set by Ctrl+C in watch mode: the watch loop finishes and writes the final databases
+        std::atomic<bool> g_watchStopRequested{ false };
+
+        void RequestWatchStop(int)
+        {
+            g_watchStopRequested = true;
+        }
+
+        // SQL function element_in_subset(elemId): whether the element is in the ElementFilter given as user data
+        void ElementInSubset(sqlite3_context* context, int, sqlite3_value** args)
+        {
+            const ElementFilter* filter = static_cast<const ElementFilter*>(sqlite3_user_data(context));
+            sqlite3_result_int(context, filter->Contains(sqlite3_value_int64(args[0])) ? 1 : 0);
+        }
+
+        // Rows of a prepared SELECT for EnvelopeRows (the interface of CsvRowReader)
+        class StatementRows
+        {
+        public:
+            explicit StatementRows(sqlite3_stmt* stmt) : stmt_(stmt) {}
+            bool Next() { return sqlite3_step(stmt_) == SQLITE_ROW; }
+            long long Int64(int column) const { return sqlite3_column_int64(stmt_, column); }
+            double Double(int column) const { return sqlite3_column_double(stmt_, column); }
+            bool Numeric(int column) const
+            {
+                const int type = sqlite3_column_type(stmt_, column);
+                return type == SQLITE_INTEGER || type == SQLITE_FLOAT;
+            }
+            std::string_view Text(int column) const
+            {
+                const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt_, column));
+                return text ? std::string_view(text, static_cast<size_t>(sqlite3_column_bytes(stmt_, column))) : std::string_view();
+            }
+
+        private:
+            sqlite3_stmt* stmt_;
+        };
+
+        // Rows sampled for the fingerprint that finds candidate copies of enveloped tables
+        const int kCopySamples = 16;
+
+        // Table name of a result export: "Prefix_Table.csv" holds table Table of Prefix.db (as in the CSV import)
+        std::string CsvTableName(const fs::path& csvPath)
+        {
+            const std::string stem = csvPath.stem().string();
+            const size_t underscore = stem.find_last_of('_');
+            return underscore == std::string::npos ? stem : stem.substr(underscore + 1);
+        }
+
+        // Database of a result export: "Prefix_Table.csv" comes from Prefix.db; empty without a prefix
+        std::string CsvPrefix(const fs::path& csvPath)
+        {
+            const std::string stem = csvPath.stem().string();
+            const size_t underscore = stem.find_last_of('_');
+            return underscore == std::string::npos ? std::string() : stem.substr(0, underscore);
+        }
+
+        // File extension check regardless of case: on Windows "Results.CSV" is as good as "Results.csv"
+        bool HasExtension(const fs::path& path, const std::string& extension)
+        {
+            const std::string actual = path.extension().string();
+            return actual.size() == extension.size() &&
+                   std::equal(actual.begin(), actual.end(), extension.begin(),
+                              [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); });
+        }
+
+        // First line of a text file without the UTF-8 byte order mark and the line end; empty if it cannot be read
+        std::string ReadHeaderLine(const fs::path& path)
+        {
+            std::ifstream file(path, std::ios::binary);
+            std::string line;
+            if (!std::getline(file, line)) return {};
+            if (line.compare(0, 3, "\xEF\xBB\xBF") == 0) line.erase(0, 3);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            return line;
+        }
+    }
+
+    EnvelopeBuilder::EnvelopeBuilder() : EnvelopeBuilder(BuildOptions{}) {}
+
+    EnvelopeBuilder::EnvelopeBuilder(const BuildOptions& options)
+        : options_(options), log_(options.log ? *options.log : std::cout), stats_("FEDOR_Enveloper"),
+          store_(options.rulesPath.empty() ? DefaultEnvelopeRules() : LoadEnvelopeRules(options.rulesPath))
+    {
+        if (options_.trackProvenance && options_.engine == EnvelopeEngine::Sql)
+        {
+            throw std::invalid_argument("Provenance needs the loop engine (the SQL engine does not see which row gave a value)");
+        }
+        if (!options_.groupsPath.empty())
+        {
+            groups_ = LoadEnvelopeGroups(options_.groupsPath);
+            if (!groups_.empty() && options_.engine == EnvelopeEngine::Sql)
+            {
+                throw std::invalid_argument("Groups need the loop engine (the SQL engine reads a whole batch of files in one query)");
+            }
+            for (size_t g = 0; g < groups_.size(); ++g) groupStores_.emplace_back(store_.Rules());
+        }
+        if (!options_.shardPath.empty() && !groups_.empty())
+        {
+            throw std::invalid_argument("A shard holds the envelope of all elements only; groups are built from the sources");
+        }
+        if (!options_.quantiles.empty() && options_.engine == EnvelopeEngine::Sql)
+        {
+            throw std::invalid_argument("Quantiles need the loop engine (the SQL engine only sees the MAX of every group)");
+        }
+        for (double percent : options_.quantiles)
+        {
+            if (!(percent > 0.0 && percent <= 100.0)) throw std::invalid_argument("Quantiles are percentages in (0, 100]");
+        }
+        store_.SetBounds(options_.bounds);
+        store_.SetSketching(!options_.quantiles.empty());
+        store_.SetSinglePrecision(options_.singlePrecision);
+        for (auto& groupStore : groupStores_)
+        {
+            groupStore.SetBounds(options_.bounds);
+            groupStore.SetSketching(!options_.quantiles.empty());
+            groupStore.SetSinglePrecision(options_.singlePrecision);
+        }
+
+        // Rules can only write columns that exist in the output table
+        auto isOutputColumn = [this](const std::string& name)
+        {
+            return std::find(config_.OUTPUT_COLUMNS.begin(), config_.OUTPUT_COLUMNS.end(), name) != config_.OUTPUT_COLUMNS.end();
+        };
+        for (const auto& rule : store_.Rules())
+        {
+            if (!isOutputColumn(rule.target)) throw std::invalid_argument("Rule target '" + rule.target + "' is not an output column");
+            for (const auto& zeroColumn : rule.zeroColumns)
+            {
+                if (!isOutputColumn(zeroColumn)) throw std::invalid_argument("Rule zero column '" + zeroColumn + "' is not an output column");
+            }
+        }
+    }
+
+    void EnvelopeBuilder::Run()
+    {
+        std::cout << "--- Universal Envelope Builder ---" << std::endl;
+        fs::path targetPath = GetTargetPathFromUser();
+        if (targetPath.empty()) return;
+        Run(targetPath);
+    }
+
+    bool EnvelopeBuilder::Run(const fs::path& targetPath)
+    {
+        elements_.Clear();
+        elementFilter_ = options_.elementFilter;
+        elements_.SetMemoryBudget(static_cast<size_t>(std::max(1, options_.elementsMemoryMiB)) << 20);
+        ClearStores();
+        connections_.Clear();
+        ReadProfile profile;
+        profile.immutable = options_.immutableSources;
+        connections_.SetProfile(profile);
+        stats_.SetReportPath(options_.reportPath.empty() ? RunStats::ReportPathFromEnvironment() : options_.reportPath);
+        const fs::path outputPath = options_.outputPath.empty() ? targetPath : options_.outputPath;
+        bool success = false;
+
+        try
+        {
+            // Passes 1 and 2 are common for both output databases
+            {
+                RunStats::ScopedTimer timer(stats_, "verify");
+                if (!CollectAndVerifyElements(targetPath)) return false;
+            }
+            {
+                RunStats::ScopedTimer timer(stats_, "envelope");
+                EnvelopeDataInMemory(targetPath);
+            }
+            connections_.Clear();
+            LogRoundingError();
+
+            if (!options_.shardPath.empty())
+            {
+                WriteShard(options_.shardPath);
+                log_ << "\nShard written: " << options_.shardPath.string() << std::endl;
+            }
+            else
+            {
+                AssembleOutputs(outputPath);
+                log_ << "\nBuild successful for both databases!" << std::endl;
+            }
+            success = true;
+        }
+        catch (const std::exception& e)
+        {
+            ErrorLog() << "\nCRITICAL ERROR: " << e.what() << std::endl;
+        }
+
+        stats_.PrintSummary(log_);
+        if (!stats_.WriteJsonReport())
+        {
+            ErrorLog() << "ERROR: Could not write timing report: " << stats_.GetReportPath().string() << std::endl;
+        }
+        return success;
+    }
+
+    bool EnvelopeBuilder::Watch(const fs::path& targetPath, const WatchOptions& watchOptions)
+    {
+        using Clock = std::chrono::steady_clock;
+        struct PendingFile
+        {
+            std::uintmax_t size = 0;
+            fs::file_time_type writeTime;
+            Clock::time_point changedAt;
+            bool closed = false;
+        };
+
+        elements_.Clear();
+        elementFilter_ = options_.elementFilter;
+        elements_.SetMemoryBudget(static_cast<size_t>(std::max(1, options_.elementsMemoryMiB)) << 20);
+        ClearStores();
+        allowLateElements_ = true;
+        // A file is read only after it has settled and has no journal, so it is finalized by then
+        ReadProfile profile;
+        profile.immutable = true;
+        connections_.SetProfile(profile);
+        stats_.SetReportPath(options_.reportPath.empty() ? RunStats::ReportPathFromEnvironment() : options_.reportPath);
+        const fs::path outputPath = options_.outputPath.empty() ? targetPath : options_.outputPath;
+        const auto settle = std::chrono::duration<double>(watchOptions.settleSeconds);
+
+        std::map<fs::path, PendingFile> pending;
+        std::set<fs::path> enveloped;
+        std::set<fs::path> rejected;
+        bool dirty = false;
+        bool success = true;
+        Clock::time_point lastRefresh = Clock::now();
+        Clock::time_point lastActivity = Clock::now();
+
+        // Records the current size and time of a file; any change restarts its settle interval
+        auto track = [&](const fs::path& path, bool closed)
+        {
+            std::error_code ec;
+            std::uintmax_t size = fs::file_size(path, ec);
+            if (ec) return;
+            fs::file_time_type writeTime = fs::last_write_time(path, ec);
+            if (ec) return;
+            auto it = pending.find(path);
+            if (it == pending.end())
+            {
+                pending[path] = { size, writeTime, Clock::now(), closed };
+                lastActivity = Clock::now();
+                return;
+            }
+            if (it->second.size != size || it->second.writeTime != writeTime)
+            {
+                it->second.size = size;
+                it->second.writeTime = writeTime;
+                it->second.changedAt = Clock::now();
+                lastActivity = Clock::now();
+            }
+            it->second.closed = it->second.closed || closed;
+        };
+
+        std::signal(SIGINT, RequestWatchStop);
+        g_watchStopRequested = false;
+
+        try
+        {
+            fs::create_directories(outputPath);
+            FolderWatcher watcher(targetPath, std::max(0.2, watchOptions.settleSeconds / 2));
+            log_ << "--- Watching '" << targetPath.string() << "' for new .db files ("
+                 << (watcher.UsesNotifications() ? "inotify" : "polling") << "), press Ctrl+C to finish ---" << std::endl;
+
+            // Files that are already in the folder are treated as closed; they still have to be stable
+            for (const auto& entry : fs::directory_iterator(targetPath))
+            {
+                if (IsSourceDbFile(entry.path())) track(entry.path(), true);
+            }
+
+            while (!g_watchStopRequested)
+            {
+                for (const auto& event : watcher.Wait(pending.empty() ? 1.0 : std::min(1.0, std::max(0.05, watchOptions.settleSeconds / 4))))
+                {
+                    if (!IsSourceDbFile(event.path) || enveloped.count(event.path) || rejected.count(event.path)) continue;
+                    track(event.path, event.closed || !watcher.UsesNotifications());
+                }
+
+                for (auto it = pending.begin(); it != pending.end();)
+                {
+                    const fs::path path = it->first;
+                    std::error_code ec;
+                    if (!fs::exists(path, ec))
+                    {
+                        it = pending.erase(it);
+                        continue;
+                    }
+                    track(path, false);
+                    PendingFile& file = it->second;
+                    if (!file.closed || Clock::now() - file.changedAt < settle) { ++it; continue; }
+                    if (!IsSourceDbReadable(path))
+                    {
+                        // Still being written (or damaged): try again after another settle interval
+                        file.changedAt = Clock::now();
+                        ++it;
+                        continue;
+                    }
+
+                    try
+                    {
+                        {
+                            RunStats::ScopedTimer timer(stats_, "verify");
+                            // A mismatch throws; a file without a readable Elements table is rejected the same way
+                            if (!VerifyElementsFile(path)) throw std::runtime_error("No '" + config_.ELEMENTS_TABLE_NAME + "' table with '" + config_.ELEMENT_ID_COLUMN + "' in '" + path.filename().string() + "'.");
+                        }
+                        RunStats::ScopedTimer timer(stats_, "envelope");
+                        EnvelopeFile(path);
+                        enveloped.insert(path);
+                        dirty = true;
+                    }
+                    catch (const std::exception& e)
+                    {
+                        ErrorLog() << "  ERROR: File rejected: " << e.what() << std::endl;
+                        rejected.insert(path);
+                        success = false;
+                    }
+                    connections_.Close(path); // Every file is read once in watch mode; do not keep it open for the solver
+                    lastActivity = Clock::now();
+                    it = pending.erase(it);
+                }
+
+                if (watchOptions.expectedFiles > 0 && static_cast<int>(enveloped.size()) >= watchOptions.expectedFiles) break;
+                if (watchOptions.idleExitSeconds > 0 && pending.empty() &&
+                    Clock::now() - lastActivity >= std::chrono::duration<double>(watchOptions.idleExitSeconds)) break;
+
+                if (dirty && Clock::now() - lastRefresh >= std::chrono::duration<double>(watchOptions.refreshSeconds))
+                {
+                    // A failed refresh (e.g. Envelope.db open in a viewer on Windows, so it cannot be replaced)
+                    // keeps the previous output; the envelope stays dirty and is written again at the next interval
+                    try
+                    {
+                        AssembleOutputs(outputPath);
+                        log_ << "Envelope refreshed: " << enveloped.size() << " files, " << elements_.Size() << " elements." << std::endl;
+                        dirty = false;
+                    }
+                    catch (const std::exception& e)
+                    {
+                        ErrorLog() << "  ERROR: Envelope not refreshed, retrying in " << watchOptions.refreshSeconds << " s: " << e.what() << std::endl;
+                    }
+                    lastRefresh = Clock::now();
+                }
+            }
+
+            if (dirty || enveloped.empty())
+            {
+                AssembleOutputs(outputPath);
+            }
+            LogRoundingError();
+            log_ << "\nWatch finished: " << enveloped.size() << " files enveloped, " << rejected.size() << " rejected, "
+                 << pending.size() << " still incomplete." << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            ErrorLog() << "\nCRITICAL ERROR: " << e.what() << std::endl;
+            success = false;
+        }
+        std::signal(SIGINT, SIG_DFL);
+        allowLateElements_ = false;
+
+        stats_.PrintSummary(log_);
+        if (!stats_.WriteJsonReport())
+        {
+            ErrorLog() << "ERROR: Could not write timing report: " << stats_.GetReportPath().string() << std::endl;
+        }
+        return success;
+    }
+
+    bool EnvelopeBuilder::Merge(const std::vector<fs::path>& shardPaths)
+    {
+        stats_.SetReportPath(options_.reportPath.empty() ? RunStats::ReportPathFromEnvironment() : options_.reportPath);
+        bool success = false;
+
+        try
+        {
+            if (shardPaths.empty()) throw std::invalid_argument("No shard files to merge");
+            if (!groups_.empty()) throw std::invalid_argument("Groups are built from the sources, not from shards");
+            connections_.Clear();
+            ReadProfile profile;
+            profile.immutable = options_.immutableSources;
+            connections_.SetProfile(profile);
+
+            // The settings of the first shard configure the merge; every shard must have been built with the same
+            const std::map<std::string, std::string> settings = ReadShardSettings(shardPaths.front());
+            auto setting = [&settings](const std::string& key)
+            {
+                auto it = settings.find(key);
+                return it != settings.end() ? it->second : std::string();
+            };
+            std::vector<EnvelopeRule> rules;
+            std::stringstream ruleLines(setting("rules"));
+            std::string line;
+            while (std::getline(ruleLines, line))
+            {
+                if (!line.empty()) rules.push_back(ParseEnvelopeRule(line));
+            }
+            const std::string bounds = setting("bounds");
+            options_.bounds = bounds == "absmax" ? EnvelopeBounds::MinMaxAbs : (bounds == "minmax" ? EnvelopeBounds::MinMax : EnvelopeBounds::Max);
+            options_.quantiles.clear();
+            std::stringstream quantiles(setting("quantiles"));
+            std::string percent;
+            while (std::getline(quantiles, percent, ',')) options_.quantiles.push_back(std::stod(percent));
+            options_.trackProvenance = setting("provenance") == "1";
+            options_.singlePrecision = setting("precision") == "float32";
+            store_ = EnvelopeStore(rules);
+            store_.SetBounds(options_.bounds);
+            store_.SetSketching(!options_.quantiles.empty());
+            store_.SetSinglePrecision(options_.singlePrecision);
+
+            elements_.Clear();
+            elementFilter_ = options_.elementFilter;
+            elements_.SetMemoryBudget(static_cast<size_t>(std::max(1, options_.elementsMemoryMiB)) << 20);
+            ClearStores();
+            fs::path outputPath = options_.outputPath.empty() ? shardPaths.front().parent_path() : options_.outputPath;
+            if (outputPath.empty()) outputPath = ".";
+
+            // Pass 1 over the Elements tables of the shards, so elements shared by two shards must match as in one run
+            log_ << "\nPASS 1: Verifying '" << config_.ELEMENTS_TABLE_NAME << "' tables of " << shardPaths.size() << " shards..." << std::endl;
+            {
+                RunStats::ScopedTimer timer(stats_, "verify");
+                const std::map<std::string, std::string> expected = ShardSettings();
+                for (const auto& shardPath : shardPaths)
+                {
+                    if (ReadShardSettings(shardPath) != expected)
+                    {
+                        throw std::runtime_error("Shard '" + shardPath.filename().string() + "' was built with other rules, bounds, quantiles, provenance or precision than '" +
+                                                 shardPaths.front().filename().string() + "'.");
+                    }
+                    if (!VerifyElementsFile(shardPath)) throw std::runtime_error("Shard '" + shardPath.filename().string() + "' has no Elements table.");
+                }
+            }
+            log_ << "Verification successful. Found " << elements_.Size() << " unique elements"
+                 << (elementFilter_.Active() ? " in the element filter" : "")
+                 << (elements_.Spilled() ? " (records moved to a temporary file)." : ".") << std::endl;
+
+            log_ << "\nPASS 2: Merging shards..." << std::endl;
+            {
+                RunStats::ScopedTimer timer(stats_, "merge");
+                for (const auto& shardPath : shardPaths) MergeShard(shardPath);
+            }
+            connections_.Clear();
+            LogRoundingError();
+
+            AssembleOutputs(outputPath);
+            log_ << "\nMerge successful for both databases!" << std::endl;
+            success = true;
+        }
+        catch (const std::exception& e)
+        {
+            ErrorLog() << "\nCRITICAL ERROR: " << e.what() << std::endl;
+        }
+        connections_.Clear();
+
+        stats_.PrintSummary(log_);
+        if (!stats_.WriteJsonReport())
+        {
+            ErrorLog() << "ERROR: Could not write timing report: " << stats_.GetReportPath().string() << std::endl;
+        }
+        return success;
+    }
+
+    bool EnvelopeBuilder::CollectAndVerifyElements(const fs::path& targetPath)
+    {
+        log_ << "\nPASS 1: Verifying '" << config_.ELEMENTS_TABLE_NAME << "' tables..." << std::endl;
+        size_t elementSources = 0;
+        for (const auto& entry : fs::directory_iterator(targetPath))
+        {
+            const fs::path& path = entry.path();
+            if (IsSourceDbFile(path))
+            {
+                if (VerifyElementsFile(path)) ++elementSources;
+                continue;
+            }
+            std::string skipReason;
+            if (IsSourceCsvFile(path, &skipReason))
+            {
+                if (CsvTableName(path) == config_.ELEMENTS_TABLE_NAME && VerifyElementsCsvFile(path)) ++elementSources;
+            }
+            else if (!skipReason.empty())
+            {
+                log_ << "  - WARNING: " << path.filename().string() << " is skipped: " << skipReason << ".\n";
+            }
+        }
+        // Without elements pass 2 would envelop nothing and write an empty result
+        if (elementSources == 0)
+        {
+            throw std::runtime_error("No '" + config_.ELEMENTS_TABLE_NAME + "' table with '" + config_.ELEMENT_ID_COLUMN + "' in the .db files and no *_" +
+                                     config_.ELEMENTS_TABLE_NAME + ".csv export in " + targetPath.string() + ".");
+        }
+        if (elements_.Size() == 0)
+        {
+            throw std::runtime_error(elementFilter_.Active() ? "None of the elements of the element filter is in the '" + config_.ELEMENTS_TABLE_NAME + "' tables."
+                                                             : "The '" + config_.ELEMENTS_TABLE_NAME + "' tables hold no elements.");
+        }
+        log_ << "Verification successful. Found " << elements_.Size() << " unique elements"
+             << (elementFilter_.Active() ? " in the element filter" : "")
+             << (elements_.Spilled() ? " (records moved to a temporary file)." : ".") << std::endl;
+        return true;
+    }
+
+    bool EnvelopeBuilder::VerifyElementsFile(const fs::path& dbPath)
+    {
+        SqliteConnection* connection = connections_.OpenReadOnly(dbPath);
+        if (!connection) return false;
+
+        StatementLease statement = connection->Prepare(SqliteConnection::SelectAllSql(config_.ELEMENTS_TABLE_NAME));
+        if (!statement) return false;
+
+        log_ << "  - Checking file: " << dbPath.filename().string() << "\n";
+        RunStats::FileStats& fileStats = stats_.BeginFile("verify", dbPath);
+        StatementRows rows(statement.Get());
+        return VerifyElementRows(rows, connection->ColumnNames(config_.ELEMENTS_TABLE_NAME), dbPath, fileStats, connection->Handle());
+    }
+
+    bool EnvelopeBuilder::VerifyElementsCsvFile(const fs::path& csvPath)
+    {
+        CsvRowReader rows;
+        if (!rows.Open(csvPath))
+        {
+            ErrorLog() << "  ERROR: Could not read the header of " << csvPath.string() << std::endl;
+            return false;
+        }
+
+        log_ << "  - Checking file: " << csvPath.filename().string() << "\n";
+        RunStats::FileStats& fileStats = stats_.BeginFile("verify", csvPath);
+        const bool verified = VerifyElementRows(rows, rows.ColumnNames(), csvPath, fileStats, nullptr);
+        if (rows.SkippedRows() > 0) log_ << "    WARNING: " << rows.SkippedRows() << " rows with a different number of fields than the header were skipped.\n";
+        return verified;
+    }
+
+    template <typename RowReader>
+    bool EnvelopeBuilder::VerifyElementRows(RowReader& rows, const std::vector<std::string>& colNames, const fs::path& sourcePath, RunStats::FileStats& fileStats, sqlite3* dbHandle)
+    {
+        Stopwatch tableTimer;
+        long long rowCount = 0;
+
+        const int colCount = static_cast<int>(colNames.size());
+        int elemIdIdx = -1;
+        int elemTypeIdx = -1;
+        for (int i = 0; i < colCount; ++i)
+        {
+            if (colNames[i] == config_.ELEMENT_ID_COLUMN) elemIdIdx = i;
+            else if (colNames[i] == config_.ELEM_TYPE_COLUMN) elemTypeIdx = i;
+        }
+
+        if (elemIdIdx == -1)
+        {
+            stats_.EndFile(fileStats, dbHandle);
+            return false;
+        }
+
+        // Properties are compared as text (NULL = empty), column by column in name order, so files that list
+        // the same columns in another order still match, and a CSV export matches the database it came from.
+        // Only a hash of them is kept.
+        std::vector<int> hashOrder;
+        for (int i = 0; i < colCount; ++i)
+        {
+            if (i != elemIdIdx) hashOrder.push_back(i);
+        }
+        std::sort(hashOrder.begin(), hashOrder.end(), [&colNames](int a, int b) { return colNames[a] < colNames[b]; });
+        const unsigned char kValueEnd = 0xFF; // Never part of UTF-8 text
+
+        // New elements are committed only after the whole file matched, so a rejected file leaves no trace
+        std::vector<std::pair<long long, std::string>> newElements; // elemId and elemType
+        const bool filterElements = elementFilter_.Active();
+        std::string mismatchError;
+        elements_.BeginFile(sourcePath);
+        try
+        {
+            while (rows.Next())
+            {
+                ++rowCount;
+                long long currentElemId = rows.Int64(elemIdIdx);
+                const std::string type = elemTypeIdx >= 0 ? std::string(rows.Text(elemTypeIdx)) : std::string();
+                // Elements outside the subset are neither checked nor registered, so pass 2 skips their rows
+                if (filterElements && !elementFilter_.Accept(currentElemId, type)) continue;
+                uint64_t hash = ElementCatalog::kHashSeed;
+                for (int i : hashOrder)
+                {
+                    hash = ElementCatalog::HashBytes(hash, colNames[i].c_str(), colNames[i].size() + 1);
+                    const std::string_view value = rows.Text(i);
+                    if (!value.empty()) hash = ElementCatalog::HashBytes(hash, value.data(), value.size());
+                    hash = ElementCatalog::HashBytes(hash, &kValueEnd, 1);
+                }
+
+                ElementCatalog::Match match = elements_.Check(currentElemId, hash);
+                if (match == ElementCatalog::Match::Different)
+                {
+                    mismatchError = "Data mismatch for elemId " + std::to_string(currentElemId) + " in file '" + sourcePath.filename().string() + "'.";
+                    break;
+                }
+                if (match == ElementCatalog::Match::New)
+                {
+                    elements_.Add(currentElemId, hash);
+                    newElements.emplace_back(currentElemId, type);
+                }
+            }
+        }
+        catch (...)
+        {
+            elements_.RollbackFile();
+            throw;
+        }
+        fileStats.AddTable(config_.ELEMENTS_TABLE_NAME, rowCount, tableTimer.Seconds());
+        stats_.EndFile(fileStats, dbHandle);
+
+        if (!mismatchError.empty())
+        {
+            elements_.RollbackFile();
+            throw std::runtime_error(mismatchError);
+        }
+        elements_.CommitFile();
+        for (const auto& element : newElements)
+        {
+            store_.RegisterElement(element.first, element.second);
+            for (auto& groupStore : groupStores_) groupStore.RegisterElement(element.first, element.second);
+        }
+        return true;
+    }
+
+    void EnvelopeBuilder::EnvelopeDataInMemory(const fs::path& targetPath)
+    {
+        log_ << "\nPASS 2: Enveloping data (In-Memory mode)..." << std::endl;
+        std::vector<fs::path> files;
+        std::vector<fs::path> csvFiles;
+        for (const auto& entry : fs::directory_iterator(targetPath))
+        {
+            if (IsSourceDbFile(entry.path())) files.push_back(entry.path());
+            // The Elements exports were read in pass 1
+            else if (IsSourceCsvFile(entry.path()) && CsvTableName(entry.path()) != config_.ELEMENTS_TABLE_NAME) csvFiles.push_back(entry.path());
+        }
+        // Name order on every file system: ties (and so the provenance) keep the value of the earlier file, as --merge does for shards
+        std::sort(files.begin(), files.end());
+        std::sort(csvFiles.begin(), csvFiles.end());
+
+        // Provenance, groups and quantiles need to see every row
+        EnvelopeEngine engine = options_.trackProvenance || !groups_.empty() || store_.Sketching() ? EnvelopeEngine::Loop : options_.engine;
+        size_t firstFile = 0;
+        // The SQL engine reads a whole ATTACH batch in one statement, so only the loop is paced file by file
+        FilePrefetcher prefetcher(files, engine == EnvelopeEngine::Sql ? 0 : static_cast<size_t>(std::max(0, options_.prefetchDepth)));
+        if (engine == EnvelopeEngine::Auto)
+        {
+            // Calibration: both engines do useful work on one file each, the faster one reads the rest.
+            // The slower engine costs one file extra, so small sets just use the loop.
+            const size_t kCalibrationMinFiles = 16;
+            engine = EnvelopeEngine::Loop;
+            if (files.size() >= kCalibrationMinFiles)
+            {
+                auto bytesPerSecond = [](const fs::path& file, double seconds)
+                {
+                    std::error_code ec;
+                    std::uintmax_t bytes = fs::file_size(file, ec);
+                    return ec || seconds <= 0.0 ? 0.0 : static_cast<double>(bytes) / seconds;
+                };
+                Stopwatch loopTimer;
+                EnvelopeFile(files[0]);
+                connections_.Close(files[0]);
+                double loopRate = bytesPerSecond(files[0], loopTimer.Seconds());
+                Stopwatch sqlTimer;
+                prefetcher.Advance(1);
+                EnvelopeFilesWithSql({ files[1] });
+                double sqlRate = bytesPerSecond(files[1], sqlTimer.Seconds());
+                if (sqlRate > loopRate) engine = EnvelopeEngine::Sql;
+                firstFile = 2;
+                log_ << "  Engine: " << (engine == EnvelopeEngine::Sql ? "SQL" : "loop") << " (loop " << static_cast<long long>(loopRate / 1024)
+                     << " KB/s, SQL " << static_cast<long long>(sqlRate / 1024) << " KB/s)" << std::endl;
+            }
+        }
+
+        if (engine == EnvelopeEngine::Sql)
+        {
+            EnvelopeFilesWithSql(std::vector<fs::path>(files.begin() + firstFile, files.end()));
+        }
+        else
+        {
+            for (size_t i = firstFile; i < files.size(); ++i)
+            {
+                prefetcher.Advance(i);
+                EnvelopeFile(files[i]);
+                connections_.Close(files[i]); // Pass 2 is the last read: release the page cache and the mapping of the file
+            }
+        }
+        // Result exports are streamed through the loop whatever the engine: SQLite cannot attach them
+        for (const auto& csvPath : csvFiles) EnvelopeCsvFile(csvPath);
+        log_.flush();
+    }
+
+    template <typename RowReader>
+    long long EnvelopeBuilder::EnvelopeRows(RowReader& rows, const std::vector<std::string>& colNames, const std::string& fileName, const std::string& tableName)
+    {
+        long long rowCount = 0;
+        const int colCount = static_cast<int>(colNames.size());
+        int elemIdIdx = -1;
+        int setNIdx = -1;
+        for (int i = 0; i < colCount; ++i) 
+        {
+            if (colNames[i] == config_.ELEMENT_ID_COLUMN) elemIdIdx = i;
+            else if (colNames[i] == config_.SET_N_COLUMN) setNIdx = i;
+        }
+
+        if (elemIdIdx == -1) return -1;
+
+        // Resolve names once per table: numeric columns to store slots, rules to column indices
+        struct ColumnPlan
+        {
+            int column;
+            int slot;
+        };
+        std::vector<ColumnPlan> columnPlan;
+        std::vector<bool> envelopedColumns(colCount, false);
+        for (int i = 0; i < colCount; ++i)
+        {
+            const std::string& colName = colNames[i];
+            if (colName == config_.ELEMENT_ID_COLUMN || colName == config_.SET_N_COLUMN || colName == config_.ELEM_TYPE_COLUMN) continue;
+            envelopedColumns[i] = true;
+            columnPlan.push_back({ i, store_.ColumnSlot(colName) });
+            for (auto& groupStore : groupStores_) groupStore.ColumnSlot(colName);
+        }
+        const std::vector<CompiledRule> rulePlan = store_.CompileRules(colNames, envelopedColumns);
+        std::vector<double> rowValues(colCount, 0.0);
+        std::vector<char> rowNumeric(colCount, 0);
+        std::vector<double> ruleValues(rulePlan.size(), 0.0);
+
+        // Provenance: file and table ids are fixed per table, only setN changes per row
+        const bool trackProvenance = options_.trackProvenance;
+        ValueSource rowSource;
+        if (trackProvenance)
+        {
+            AddSourceNames(fileName, tableName);
+            rowSource.file = store_.SourceFileId(fileName);
+            rowSource.table = store_.SourceTableId(tableName);
+        }
+
+        // Groups of the table by file and table name; setN ranges are checked per row
+        const std::vector<int> tableGroups = TableGroups(fileName, tableName);
+        bool groupsNeedSetN = false;
+        for (int g : tableGroups) groupsNeedSetN = groupsNeedSetN || groups_[g].FiltersSetN();
+        const bool readSetN = setNIdx >= 0 && (trackProvenance || groupsNeedSetN);
+        long long setN = 0;
+
+        while (rows.Next())
+        {
+            ++rowCount;
+            long long elementId = rows.Int64(elemIdIdx);
+            int element = store_.FindElement(elementId);
+            if (element < 0)
+            {
+                if (!allowLateElements_ || !elementFilter_.Contains(elementId)) continue;
+                element = AddLateElement(elementId);
+            }
+            if (readSetN)
+            {
+                setN = rows.Int64(setNIdx);
+                rowSource.setN = setN;
+            }
+
+            // Step 1: Perform standard enveloping for all numeric columns and collect current row values
+            for (const ColumnPlan& column : columnPlan)
+            {
+                if (rows.Numeric(column.column))
+                {
+                    double currentValue = rows.Double(column.column);
+                    rowValues[column.column] = currentValue;
+                    rowNumeric[column.column] = 1;
+                    if (store_.Fold(column.slot, element, currentValue, EnvelopeMode::Max) && trackProvenance)
+                    {
+                        store_.SetSource(column.slot, element, rowSource);
+                    }
+                }
+                else
+                {
+                    rowValues[column.column] = 0.0; // Non-numeric sources count as 0 in rules
+                    rowNumeric[column.column] = 0;
+                }
+            }
+
+            // Step 2: Envelope the rules that apply to the element type.
+            // The type of a late element is not known yet, so all rules are kept and chosen at assembly.
+            for (int ruleIndex : store_.RulesForType(store_.ElementType(element)))
+            {
+                const CompiledRule& rule = rulePlan[ruleIndex];
+                double value = 0.0;
+                for (size_t t = 0; t < rule.terms.size(); ++t)
+                {
+                    double term = rule.terms[t].sign * rowValues[rule.terms[t].column];
+                    value = t == 0 ? term : value + term;
+                }
+                ruleValues[ruleIndex] = value;
+                if (store_.Fold(rule.slot, element, value, rule.mode) && trackProvenance) store_.SetSource(rule.slot, element, rowSource);
+            }
+
+            // Step 3: The same values and rules for every group the row belongs to (slots are the same in all stores)
+            for (int g : tableGroups)
+            {
+                const EnvelopeGroup& group = groups_[g];
+                if (group.FiltersSetN() && (setNIdx < 0 || !group.MatchesSetN(setN))) continue;
+                EnvelopeStore& groupStore = groupStores_[g];
+                for (const ColumnPlan& column : columnPlan)
+                {
+                    if (!rowNumeric[column.column]) continue;
+                    if (groupStore.Fold(column.slot, element, rowValues[column.column], EnvelopeMode::Max) && trackProvenance)
+                    {
+                        groupStore.SetSource(column.slot, element, rowSource);
+                    }
+                }
+                for (int ruleIndex : store_.RulesForType(store_.ElementType(element)))
+                {
+                    const CompiledRule& rule = rulePlan[ruleIndex];
+                    if (groupStore.Fold(rule.slot, element, ruleValues[ruleIndex], rule.mode) && trackProvenance) groupStore.SetSource(rule.slot, element, rowSource);
+                }
+            }
+        }
+        return rowCount;
+    }
+
+    void EnvelopeBuilder::EnvelopeFile(const fs::path& dbPath)
+    {
+        log_ << "  - Processing file: " << dbPath.filename().string() << "\n";
+        // Usually still open from pass 1: no re-open and no schema re-read
+        SqliteConnection* connection = connections_.OpenReadOnly(dbPath);
+        if (!connection) return;
+        sqlite3* dbHandle = connection->Handle();
+        RunStats::FileStats& fileStats = stats_.BeginFile("envelope", dbPath);
+        const std::string fileName = dbPath.filename().string();
+        // Element subset: tables indexed by elemId read only the id ranges of the subset (in the order of a full scan)
+        const std::string subsetRanges = elementFilter_.Active() ? elementFilter_.SqlRanges(config_.ELEMENT_ID_COLUMN) : "";
+        // Verbatim copies of tables folded earlier in this run add nothing: every value ties and ties keep the first source.
+        // Quantile sketches count every row, and late elements of watch mode make the same rows fold differently, so both read everything.
+        const bool deduplicate = options_.deduplicateTables && !store_.Sketching() && !allowLateElements_;
+
+        for (const auto& tableName : connection->TableNames())
+        {
+            if (tableName == config_.ELEMENTS_TABLE_NAME) continue;
+
+            Stopwatch tableTimer;
+            StatementLease statement;
+            if (!subsetRanges.empty() && HasIndexOn(dbHandle, tableName, config_.ELEMENT_ID_COLUMN))
+            {
+                statement = connection->Prepare("SELECT * FROM \"" + tableName + "\" WHERE " + subsetRanges + " ORDER BY rowid;");
+            }
+            if (!statement) statement = connection->Prepare(SqliteConnection::SelectAllSql(tableName));
+            if (!statement) continue;
+
+            const std::vector<std::string>& colNames = connection->ColumnNames(tableName);
+            EnvelopedTable table;
+            const bool sampled = deduplicate && SampleTableDigest(*connection, tableName, kCopySamples, table.sample);
+            if (sampled)
+            {
+                table.filePath = dbPath;
+                table.tableName = tableName;
+                table.groups = TableGroups(fileName, tableName);
+                if (const EnvelopedTable* original = FindEnvelopedCopy(*connection, table))
+                {
+                    log_ << "    Skipped '" << tableName << "': same rows as '" << original->tableName << "' of " << original->filePath.filename().string() << ".\n";
+                    if (options_.trackProvenance) AddSourceNames(fileName, tableName);
+                    continue;
+                }
+            }
+
+            StatementRows rows(statement.Get());
+            const long long rowCount = EnvelopeRows(rows, colNames, fileName, tableName);
+            if (rowCount < 0) continue;
+            fileStats.AddTable(tableName, rowCount, tableTimer.Seconds());
+            if (sampled) envelopedTables_.push_back(std::move(table));
+        }
+        stats_.EndFile(fileStats, dbHandle);
+    }
+
+    std::vector<int> EnvelopeBuilder::TableGroups(const std::string& fileName, const std::string& tableName) const
+    {
+        std::vector<int> tableGroups;
+        for (size_t g = 0; g < groups_.size(); ++g)
+        {
+            if (groups_[g].MatchesFile(fileName) && groups_[g].MatchesTable(tableName)) tableGroups.push_back(static_cast<int>(g));
+        }
+        return tableGroups;
+    }
+
+    const EnvelopeBuilder::EnvelopedTable* EnvelopeBuilder::FindEnvelopedCopy(SqliteConnection& connection, const EnvelopedTable& table)
+    {
+        bool hasContent = false;
+        TableDigest content;
+        for (EnvelopedTable& enveloped : envelopedTables_)
+        {
+            if (enveloped.sample != table.sample || enveloped.groups != table.groups) continue;
+            if (!hasContent)
+            {
+                if (!ContentTableDigest(table.filePath, connection.Handle(), table.tableName, content)) return nullptr;
+                hasContent = true;
+            }
+            if (!enveloped.hasContent)
+            {
+                // The pages of the original are read once, when its first candidate copy appears (its pass 2 connection may be closed)
+                SqliteConnection original(enveloped.filePath, connections_.Profile());
+                if (!original.IsOpen() || !ContentTableDigest(enveloped.filePath, original.Handle(), enveloped.tableName, enveloped.content)) continue;
+                enveloped.hasContent = true;
+            }
+            if (enveloped.content == content) return &enveloped;
+        }
+        return nullptr;
+    }
+
+    void EnvelopeBuilder::AddSourceNames(const std::string& fileName, const std::string& tableName)
+    {
+        store_.SourceFileId(fileName);
+        store_.SourceTableId(tableName);
+        for (auto& groupStore : groupStores_)
+        {
+            groupStore.SourceFileId(fileName);
+            groupStore.SourceTableId(tableName);
+        }
+    }
+
+    void EnvelopeBuilder::EnvelopeCsvFile(const fs::path& csvPath)
+    {
+        log_ << "  - Processing file: " << csvPath.filename().string() << "\n";
+        const std::string tableName = CsvTableName(csvPath);
+        CsvRowReader rows;
+        if (!rows.Open(csvPath))
+        {
+            ErrorLog() << "  ERROR: Could not read the header of " << csvPath.string() << std::endl;
+            return;
+        }
+
+        RunStats::FileStats& fileStats = stats_.BeginFile("envelope", csvPath);
+        Stopwatch tableTimer;
+        const long long rowCount = EnvelopeRows(rows, rows.ColumnNames(), csvPath.filename().string(), tableName);
+        if (rowCount < 0) log_ << "    Skipped: no '" << config_.ELEMENT_ID_COLUMN << "' column.\n";
+        else fileStats.AddTable(tableName, rowCount, tableTimer.Seconds());
+        if (rows.SkippedRows() > 0) log_ << "    WARNING: " << rows.SkippedRows() << " rows with a different number of fields than the header were skipped.\n";
+        stats_.EndFile(fileStats, nullptr);
+    }
+
+    void EnvelopeBuilder::EnvelopeFilesWithSql(const std::vector<fs::path>& files)
+    {
+        if (files.empty()) return;
+        sqlite3* dbHandle;
+        if (sqlite3_open_v2(":memory:", &dbHandle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, nullptr) != SQLITE_OK)
+        {
+            sqlite3_close(dbHandle);
+            throw std::runtime_error("Could not open the in-memory database of the SQL engine.");
+        }
+        const size_t attachLimit = static_cast<size_t>(std::max(1, sqlite3_limit(dbHandle, SQLITE_LIMIT_ATTACHED, -1)));
+        const size_t compoundLimit = static_cast<size_t>(std::max(1, sqlite3_limit(dbHandle, SQLITE_LIMIT_COMPOUND_SELECT, -1)));
+
+        // Only numeric values take part, as in the loop; in rules anything else counts as 0.
+        // SQLite orders numbers before any text or blob, so "< ''" is a cheap numeric test (NULL fails it too).
+        auto numeric = [](const std::string& column) { return "CASE WHEN \"" + column + "\" < '' THEN \"" + column + "\" END"; };
+        auto numericOrZero = [](const std::string& column) { return "CASE WHEN \"" + column + "\" < '' THEN \"" + column + "\" ELSE 0 END"; };
+
+        const std::vector<EnvelopeRule>& rules = store_.Rules();
+        const ReadProfile& profile = connections_.Profile();
+        // Element subset: id ranges in every term, so indexed source tables read only the rows of the subset
+        const std::string subsetRanges = elementFilter_.Active() ? elementFilter_.SqlRanges(config_.ELEMENT_ID_COLUMN) : "";
+        sqlite3_exec(dbHandle, "PRAGMA temp_store = MEMORY;", nullptr, nullptr, nullptr);
+        sqlite3_stmt* attachStmt;
+        sqlite3_prepare_v2(dbHandle, "ATTACH DATABASE ? AS ?;", -1, &attachStmt, nullptr);
+
+        for (size_t batchStart = 0; batchStart < files.size(); batchStart += attachLimit)
+        {
+            const size_t batchEnd = std::min(files.size(), batchStart + attachLimit);
+            for (size_t i = batchStart; i < batchEnd; ++i) log_ << "  - Processing file: " << files[i].filename().string() << " (SQL)\n";
+            RunStats::FileStats& fileStats = stats_.BeginFile("envelope", files[batchStart]);
+            if (batchEnd - batchStart > 1) fileStats.name += " (+" + std::to_string(batchEnd - batchStart - 1) + " files)";
+
+            // Step 1: attach the batch and collect its result tables with their columns
+            struct SourceTable
+            {
+                std::string schema;
+                std::string name;
+                std::vector<std::string> columns; // Enveloped columns of the table
+            };
+            std::vector<SourceTable> tables;
+            std::vector<std::string> batchColumns; // Union of the enveloped columns, in order of appearance
+            for (size_t i = batchStart; i < batchEnd; ++i)
+            {
+                const std::string schema = "src" + std::to_string(i - batchStart);
+                sqlite3_bind_text(attachStmt, 1, SourceUri(files[i], profile).c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(attachStmt, 2, schema.c_str(), -1, SQLITE_TRANSIENT);
+                int rc = sqlite3_step(attachStmt);
+                sqlite3_reset(attachStmt);
+                if (rc != SQLITE_DONE)
+                {
+                    LogSqliteError("Could not attach " + files[i].filename().string(), dbHandle);
+                    continue;
+                }
+                ApplyReadProfile(dbHandle, schema, files[i], profile);
+                std::error_code ec;
+                std::uintmax_t bytes = fs::file_size(files[i], ec);
+                if (!ec) fileStats.bytes += bytes;
+
+                sqlite3_stmt* namesStmt;
+                std::string namesSql = "SELECT name FROM " + schema + ".sqlite_master WHERE type='table';";
+                std::vector<std::string> tableNames;
+                if (sqlite3_prepare_v2(dbHandle, namesSql.c_str(), -1, &namesStmt, nullptr) == SQLITE_OK)
+                {
+                    while (sqlite3_step(namesStmt) == SQLITE_ROW) tableNames.push_back(reinterpret_cast<const char*>(sqlite3_column_text(namesStmt, 0)));
+                }
+                sqlite3_finalize(namesStmt);
+
+                for (const auto& tableName : tableNames)
+                {
+                    if (tableName == config_.ELEMENTS_TABLE_NAME) continue;
+                    std::string query = "SELECT * FROM " + schema + ".\"" + tableName + "\";";
+                    sqlite3_stmt* stmt;
+                    if (sqlite3_prepare_v2(dbHandle, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) continue;
+                    SourceTable table{ schema, tableName, {} };
+                    bool hasElemId = false;
+                    for (int c = 0; c < sqlite3_column_count(stmt); ++c)
+                    {
+                        std::string colName = sqlite3_column_name(stmt, c);
+                        if (colName == config_.ELEMENT_ID_COLUMN) hasElemId = true;
+                        else if (colName != config_.SET_N_COLUMN && colName != config_.ELEM_TYPE_COLUMN) table.columns.push_back(colName);
+                    }
+                    sqlite3_finalize(stmt);
+                    if (!hasElemId) continue;
+                    for (const auto& column : table.columns)
+                    {
+                        if (std::find(batchColumns.begin(), batchColumns.end(), column) == batchColumns.end()) batchColumns.push_back(column);
+                    }
+                    tables.push_back(std::move(table));
+                }
+            }
+
+            std::vector<int> columnSlots;
+            for (const auto& column : batchColumns) columnSlots.push_back(store_.ColumnSlot(column));
+
+            // Step 2: one aggregate per chunk of tables (a compound SELECT is limited in the number of its terms).
+            // Result columns: elemId, COUNT(*), the columns (MAX, and MIN too with bounds), then per rule MAX and MIN of its expression.
+            const bool withBounds = store_.Bounds() != EnvelopeBounds::Max;
+            const int columnValues = withBounds ? 2 : 1;
+            long long rowCount = 0;
+            for (size_t chunkStart = 0; chunkStart < tables.size(); chunkStart += compoundLimit)
+            {
+                const size_t chunkEnd = std::min(tables.size(), chunkStart + compoundLimit);
+                std::stringstream sql;
+                sql << "SELECT \"" << config_.ELEMENT_ID_COLUMN << "\", COUNT(*)";
+                for (size_t c = 0; c < batchColumns.size(); ++c)
+                {
+                    sql << ", MAX(c" << c << ")";
+                    if (withBounds) sql << ", MIN(c" << c << ")";
+                }
+                for (size_t r = 0; r < rules.size(); ++r) sql << ", MAX(r" << r << "), MIN(r" << r << ")";
+                sql << " FROM (";
+                for (size_t t = chunkStart; t < chunkEnd; ++t)
+                {
+                    const SourceTable& table = tables[t];
+                    if (t > chunkStart) sql << " UNION ALL ";
+                    sql << "SELECT \"" << config_.ELEMENT_ID_COLUMN << "\"";
+                    for (size_t c = 0; c < batchColumns.size(); ++c)
+                    {
+                        bool present = std::find(table.columns.begin(), table.columns.end(), batchColumns[c]) != table.columns.end();
+                        sql << ", " << (present ? numeric(batchColumns[c]) : "NULL") << " AS c" << c;
+                    }
+                    for (size_t r = 0; r < rules.size(); ++r)
+                    {
+                        // Sources missing in the table count as 0, as in CompileRules
+                        std::string expression;
+                        for (const auto& term : rules[r].terms)
+                        {
+                            if (std::find(table.columns.begin(), table.columns.end(), term.column) == table.columns.end()) continue;
+                            if (expression.empty()) expression = term.sign < 0 ? "-(" + numericOrZero(term.column) + ")" : "(" + numericOrZero(term.column) + ")";
+                            else expression += (term.sign < 0 ? " - (" : " + (") + numericOrZero(term.column) + ")";
+                        }
+                        sql << ", " << (expression.empty() ? "0.0" : expression) << " AS r" << r;
+                    }
+                    sql << " FROM " << table.schema << ".\"" << table.name << "\"";
+                    if (!subsetRanges.empty()) sql << " WHERE " << subsetRanges;
+                }
+                sql << ") GROUP BY \"" << config_.ELEMENT_ID_COLUMN << "\";";
+
+                sqlite3_stmt* stmt;
+                if (sqlite3_prepare_v2(dbHandle, sql.str().c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+                {
+                    LogSqliteError("Failed to prepare the envelope query", dbHandle);
+                    continue;
+                }
+                const int ruleBase = 2 + columnValues * static_cast<int>(batchColumns.size());
+                while (sqlite3_step(stmt) == SQLITE_ROW)
+                {
+                    rowCount += sqlite3_column_int64(stmt, 1);
+                    long long elementId = sqlite3_column_int64(stmt, 0);
+                    int element = store_.FindElement(elementId);
+                    if (element < 0)
+                    {
+                        if (!allowLateElements_ || !elementFilter_.Contains(elementId)) continue;
+                        element = AddLateElement(elementId);
+                    }
+                    for (size_t c = 0; c < batchColumns.size(); ++c)
+                    {
+                        const int maxColumn = 2 + columnValues * static_cast<int>(c);
+                        if (sqlite3_column_type(stmt, maxColumn) == SQLITE_NULL) continue;
+                        store_.Fold(columnSlots[c], element, sqlite3_column_double(stmt, maxColumn), EnvelopeMode::Max);
+                        if (withBounds) store_.FoldBounds(columnSlots[c], element, sqlite3_column_double(stmt, maxColumn + 1));
+                    }
+                    for (int ruleIndex : store_.RulesForType(store_.ElementType(element)))
+                    {
+                        const EnvelopeRule& rule = rules[ruleIndex];
+                        double maxValue = sqlite3_column_double(stmt, ruleBase + 2 * ruleIndex);
+                        double minValue = sqlite3_column_double(stmt, ruleBase + 2 * ruleIndex + 1);
+                        double value = rule.mode == EnvelopeMode::Min ? minValue : maxValue;
+                        // The group gives no row order, so a tie of magnitudes keeps the positive value
+                        if (rule.mode == EnvelopeMode::AbsMax && -minValue > maxValue) value = minValue;
+                        store_.Fold(store_.RuleSlot(ruleIndex), element, value, rule.mode);
+                        if (withBounds)
+                        {
+                            store_.FoldBounds(store_.RuleSlot(ruleIndex), element, maxValue);
+                            store_.FoldBounds(store_.RuleSlot(ruleIndex), element, minValue);
+                        }
+                    }
+                }
+                sqlite3_finalize(stmt);
+            }
 
-    void EnvelopeBuilder::Run()
+            fileStats.AddTable(std::to_string(tables.size()) + " tables", rowCount, fileStats.timer.Seconds());
+            stats_.EndFile(fileStats, dbHandle);
+            for (size_t i = batchStart; i < batchEnd; ++i)
+            {
+                std::string detachSql = "DETACH DATABASE src" + std::to_string(i - batchStart) + ";";
+                sqlite3_exec(dbHandle, detachSql.c_str(), 0, 0, nullptr);
+            }
+        }
+        sqlite3_finalize(attachStmt);
+        sqlite3_close(dbHandle);
+    }
+
+    void EnvelopeBuilder::LogRoundingError()
     {
-        std::cout << "--- Universal Envelope Builder ---" << std::endl;
-        fs::path targetPath = GetTargetPathFromUser();
-        if (targetPath.empty()) return;
+        if (!store_.SinglePrecision()) return;
+        double maxError = store_.MaxRoundingError();
+        for (const auto& groupStore : groupStores_) maxError = std::max(maxError, groupStore.MaxRoundingError());
+        FloatRounding::LogMaxError(log_, maxError);
+    }
 
-        try
-        {
-            // Passes 1 and 2 are common for both output databases
-            if (!CollectAndVerifyElements(targetPath)) return;
-            EnvelopeDataInMemory(targetPath);
+    void EnvelopeBuilder::AssembleOutputs(const fs::path& outputPath)
+    {
+        RunStats::ScopedTimer timer(stats_, "assemble");
+        fs::create_directories(outputPath);
 
-            // Create the original database with standard enveloping
-            std::cout << "\n--- Assembling ORIGINAL database ---" << std::endl;
-            AssembleFinalDatabase(targetPath, false);
+        // Create the original database with standard enveloping
+        log_ << "\n--- Assembling ORIGINAL database ---" << std::endl;
+        AssembleFinalDatabase(outputPath, false, store_);
 
-            // Create the new database with summed reinforcement for shells
-            std::cout << "\n--- Assembling SUMMED database (for shells) ---" << std::endl;
-            AssembleFinalDatabase(targetPath, true);
+        // Create the new database with summed reinforcement for shells
+        log_ << "\n--- Assembling SUMMED database (for shells) ---" << std::endl;
+        AssembleFinalDatabase(outputPath, true, store_);
 
-            std::cout << "\nBuild successful for both databases!" << std::endl;
-        }
-        catch (const std::exception& e)
+        for (size_t g = 0; g < groups_.size(); ++g)
         {
-            std::cerr << "\nCRITICAL ERROR: " << e.what() << std::endl;
+            const fs::path groupPath = outputPath / groups_[g].name;
+            fs::create_directories(groupPath);
+            log_ << "\n--- Assembling databases of group '" << groups_[g].name << "' ---" << std::endl;
+            AssembleFinalDatabase(groupPath, false, groupStores_[g]);
+            AssembleFinalDatabase(groupPath, true, groupStores_[g]);
         }
     }
 
-    bool EnvelopeBuilder::CollectAndVerifyElements(const fs::path& targetPath)
+    void EnvelopeBuilder::ClearStores()
     {
-        std::cout << "\nPASS 1: Verifying '" << config_.ELEMENTS_TABLE_NAME << "' tables..." << std::endl;
-        for (const auto& entry : fs::directory_iterator(targetPath))
+        store_.Clear();
+        for (auto& groupStore : groupStores_) groupStore.Clear();
+        envelopedTables_.clear();
+    }
+
+    int EnvelopeBuilder::AddLateElement(long long elemId)
+    {
+        for (auto& groupStore : groupStores_) groupStore.AddLateElement(elemId);
+        return store_.AddLateElement(elemId);
+    }
+
+    void EnvelopeBuilder::AssembleFinalDatabase(const fs::path& targetPath, bool createSummedVersion, const EnvelopeStore& store)
+    {
+        const std::string dbFilename = createSummedVersion ? config_.OUTPUT_DB_SUMMED_FILENAME : config_.OUTPUT_DB_FILENAME;
+        log_ << "\nPASS 3: Assembling final database '" << dbFilename << "'..." << std::endl;
+        
+        // The database is written under a temporary name and renamed over the old one,
+        // so readers never see a half-written file (important in watch mode)
+        fs::path finalDbPath = targetPath / dbFilename;
+        fs::path partialDbPath = targetPath / (dbFilename + ".partial");
+        if (fs::exists(partialDbPath)) fs::remove(partialDbPath);
+        RunStats::FileStats& fileStats = stats_.BeginFile("assemble", finalDbPath);
+        Stopwatch tableTimer;
+
+        sqlite3* finalDbHandle;
+        if (sqlite3_open_v2(partialDbPath.string().c_str(), &finalDbHandle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, nullptr) != SQLITE_OK)
+        {
+            sqlite3_close(finalDbHandle);
+            throw std::runtime_error("Could not create final database.");
+        }
+
+        char* errMsg = nullptr;
+        std::string error; // First write error: the database is then not published
+
+        // Step 1: Create the "Elements" table and copy it from the files in which the elements were first seen.
+        // ATTACH is not allowed inside a transaction, so this step runs before it.
+        try
+        {
+            WriteElementsTable(finalDbHandle);
+        }
+        catch (...)
         {
-            if (!entry.is_regular_file() || entry.path().extension() != ".db") continue;
+            sqlite3_close(finalDbHandle);
+            throw;
+        }
+        fileStats.AddTable(config_.ELEMENTS_TABLE_NAME, static_cast<long long>(elements_.Size()), tableTimer.Seconds());
+        tableTimer.Restart();
 
-            sqlite3* dbHandle;
-            if (sqlite3_open_v2(entry.path().string().c_str(), &dbHandle, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) continue;
+        sqlite3_exec(finalDbHandle, "BEGIN TRANSACTION;", 0, 0, &errMsg);
 
-            std::string query = "SELECT * FROM \"" + config_.ELEMENTS_TABLE_NAME + "\";";
-            sqlite3_stmt* stmt;
-            if (sqlite3_prepare_v2(dbHandle, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+        // Step 2: Create and populate the "Enveloped Reinforcement" table
+        std::set<std::string> allHeadersSet = CollectAllEnvelopedColumns(store);
+        if (allHeadersSet.empty())
+        {
+            log_ << "No enveloped data found to assemble." << std::endl;
+        }
+        else
+        {
+            std::vector<std::string> finalHeaders;
+            std::vector<int> headerSlots;
+            for (const auto& header : config_.OUTPUT_COLUMNS)
             {
-                sqlite3_close(dbHandle);
-                continue;
+                if (!allHeadersSet.count(header)) continue;
+                finalHeaders.push_back(header);
+                headerSlots.push_back(store.FindColumn(header));
             }
 
-            std::cout << "  - Checking file: " << entry.path().filename().string() << std::endl;
-
-            int colCount = sqlite3_column_count(stmt);
-            int elemIdIdx = -1;
-            std::vector<std::string> colNames;
-            for (int i = 0; i < colCount; ++i)
+            // In the summed version every element type gets its action per column: a rule slot, zero, or the plain envelope
+            const int kPlainValue = -1;
+            const int kZeroValue = -2;
+            std::vector<std::vector<int>> typeActions(store.TypeCount(), std::vector<int>(finalHeaders.size(), kPlainValue));
+            if (createSummedVersion)
             {
-                std::string colName = sqlite3_column_name(stmt, i);
-                if (colName == config_.ELEMENT_ID_COLUMN) elemIdIdx = i;
-                colNames.push_back(colName);
+                for (size_t typeCode = 0; typeCode < store.TypeCount(); ++typeCode)
+                {
+                    std::vector<int>& actions = typeActions[typeCode];
+                    for (int ruleIndex : store.RulesForType(static_cast<int>(typeCode)))
+                    {
+                        const EnvelopeRule& rule = store.Rules()[ruleIndex];
+                        for (size_t h = 0; h < finalHeaders.size(); ++h)
+                        {
+                            if (finalHeaders[h] == rule.target && actions[h] < 0) actions[h] = store.RuleSlot(ruleIndex);
+                        }
+                    }
+                    for (int ruleIndex : store.RulesForType(static_cast<int>(typeCode)))
+                    {
+                        const EnvelopeRule& rule = store.Rules()[ruleIndex];
+                        for (size_t h = 0; h < finalHeaders.size(); ++h)
+                        {
+                            if (actions[h] == kPlainValue && std::find(rule.zeroColumns.begin(), rule.zeroColumns.end(), finalHeaders[h]) != rule.zeroColumns.end())
+                            {
+                                actions[h] = kZeroValue;
+                            }
+                        }
+                    }
+                }
             }
 
-            if (elemIdIdx == -1)
+            std::stringstream createReinfTableSql;
+            // elemId INTEGER PRIMARY KEY: the rows are stored clustered by elemId in the table itself (no separate index)
+            createReinfTableSql << "CREATE TABLE \"" << config_.ENVELOPED_TABLE_NAME << "\" ("
+                << "\"" << config_.SET_N_COLUMN << "\" INT, "
+                << "\"" << config_.ELEMENT_ID_COLUMN << "\" INTEGER, "
+                << "\"" << config_.ELEM_TYPE_COLUMN << "\" INT";
+            // With bounds every column is followed by its pair: <column>_min and <column>_absmax
+            std::vector<std::string> boundSuffixes;
+            if (store.Bounds() != EnvelopeBounds::Max) boundSuffixes.push_back("_min");
+            if (store.Bounds() == EnvelopeBounds::MinMaxAbs) boundSuffixes.push_back("_absmax");
+            for (const auto& header : finalHeaders)
             {
-                sqlite3_finalize(stmt);
-                sqlite3_close(dbHandle);
-                continue;
+                createReinfTableSql << ", \"" << header << "\" REAL";
+                for (const auto& suffix : boundSuffixes) createReinfTableSql << ", \"" << header << suffix << "\" REAL";
             }
+            createReinfTableSql << ", PRIMARY KEY(\"" << config_.ELEMENT_ID_COLUMN << "\")"
+                << ", CONSTRAINT \"fk_elements\" FOREIGN KEY(\"" << config_.ELEMENT_ID_COLUMN << "\") REFERENCES \"" << config_.ELEMENTS_TABLE_NAME << "\"(elemId));";
+            sqlite3_exec(finalDbHandle, createReinfTableSql.str().c_str(), 0, 0, &errMsg);
 
-            while (sqlite3_step(stmt) == SQLITE_ROW)
+            std::stringstream insertReinfSql;
+            insertReinfSql << "INSERT INTO \"" << config_.ENVELOPED_TABLE_NAME << "\" (\"" << config_.SET_N_COLUMN << "\", \"" << config_.ELEMENT_ID_COLUMN << "\", \"" << config_.ELEM_TYPE_COLUMN << "\"";
+            for (const auto& header : finalHeaders)
             {
-                long long currentElemId = sqlite3_column_int64(stmt, elemIdIdx);
-                ElementProperties currentProps;
-                for (int i = 0; i < colCount; ++i)
-                {
-                    if (i == elemIdIdx) continue;
-                    const char* value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
-                    currentProps[colNames[i]] = value ? value : "";
-                }
+                insertReinfSql << ", \"" << header << "\"";
+                for (const auto& suffix : boundSuffixes) insertReinfSql << ", \"" << header << suffix << "\"";
+            }
+            insertReinfSql << ")";
 
-                if (verifiedElements_.count(currentElemId))
+            BatchInserter inserter(finalDbHandle, insertReinfSql.str(), static_cast<int>(finalHeaders.size() * (1 + boundSuffixes.size())) + 3);
+            // Bounds of a slot after its value; missing values are written like the value (0 or NULL)
+            auto bindBounds = [&](int slot, int element, bool hasValue, bool zeroIfMissing)
+            {
+                if (boundSuffixes.empty()) return;
+                if (!hasValue)
                 {
-                    if (currentProps != verifiedElements_.at(currentElemId))
+                    for (size_t b = 0; b < boundSuffixes.size(); ++b)
                     {
-                        throw std::runtime_error("Data mismatch for elemId " + std::to_string(currentElemId) + " in file '" + entry.path().filename().string() + "'.");
+                        if (zeroIfMissing) inserter.BindDouble(0.0); else inserter.BindNull();
                     }
+                    return;
                 }
+                inserter.BindDouble(store.MinValue(slot, element));
+                if (boundSuffixes.size() > 1) inserter.BindDouble(store.AbsMaxValue(slot, element));
+            };
+            long long insertedRows = 0;
+
+            // Provenance: one row per written value that came from a source row (zeroed columns have none)
+            std::unique_ptr<BatchInserter> sourceInserter;
+            if (options_.trackProvenance)
+            {
+                std::stringstream createSourceTableSql;
+                createSourceTableSql << "CREATE TABLE \"" << config_.PROVENANCE_TABLE_NAME << "\" (\"" << config_.ELEMENT_ID_COLUMN << "\" INT, \"column\" TEXT, "
+                    << "\"fileId\" INT, \"tableId\" INT, \"" << config_.SET_N_COLUMN << "\" INT, PRIMARY KEY(\"" << config_.ELEMENT_ID_COLUMN << "\", \"column\")) WITHOUT ROWID;";
+                sqlite3_exec(finalDbHandle, createSourceTableSql.str().c_str(), 0, 0, &errMsg);
+                sourceInserter.reset(new BatchInserter(finalDbHandle, "INSERT INTO \"" + config_.PROVENANCE_TABLE_NAME + "\"", 5));
+            }
+            auto insertSource = [&](long long elementId, size_t header, int slot, int element)
+            {
+                const ValueSource& source = store.Source(slot, element);
+                sourceInserter->BindInt64(elementId);
+                sourceInserter->BindText(finalHeaders[header]);
+                sourceInserter->BindInt64(source.file);
+                sourceInserter->BindInt64(source.table);
+                sourceInserter->BindInt64(source.setN);
+                sourceInserter->EndRow();
+            };
+
+            // Rows in ascending elemId order: every insert appends to the last page instead of splitting pages in the middle
+            const std::vector<int> elementOrder = RadixSortedOrder(store.ElementIds());
+            for (int element : elementOrder)
+            {
+                // Skipped: elements without values, and in watch mode results whose Elements row has not arrived yet
+                if (!store.HasData(element) || !store.IsVerified(element)) continue;
+                long long elementId = store.ElementId(element);
+
+                inserter.BindInt64(1);
+                inserter.BindInt64(elementId);
+
+                const std::string& elemType = store.TypeName(store.ElementType(element));
+                if (!elemType.empty())
+                    inserter.BindInt64(std::stoi(elemType));
                 else
+                    inserter.BindNull();
+
+                const std::vector<int>& actions = typeActions[store.ElementType(element)];
+                for (size_t h = 0; h < finalHeaders.size(); ++h)
                 {
-                    verifiedElements_[currentElemId] = currentProps;
+                    if (actions[h] == kZeroValue)
+                    {
+                        inserter.BindDouble(0.0);
+                        bindBounds(-1, element, false, true);
+                    }
+                    else if (actions[h] >= 0)
+                    {
+                        // Rule value; an element without one gets 0, as with the shell sum before
+                        const bool hasValue = store.HasValue(actions[h], element);
+                        inserter.BindDouble(hasValue ? store.Value(actions[h], element) : 0.0);
+                        bindBounds(actions[h], element, hasValue, true);
+                        if (hasValue && sourceInserter) insertSource(elementId, h, actions[h], element);
+                    }
+                    else if (store.HasValue(headerSlots[h], element))
+                    {
+                        inserter.BindDouble(store.Value(headerSlots[h], element));
+                        bindBounds(headerSlots[h], element, true, false);
+                        if (sourceInserter) insertSource(elementId, h, headerSlots[h], element);
+                    }
+                    else
+                    {
+                        inserter.BindNull();
+                        bindBounds(headerSlots[h], element, false, false);
+                    }
                 }
+                inserter.EndRow();
+                ++insertedRows;
+            }
+            inserter.Flush();
+            if (!inserter.Error().empty()) error = config_.ENVELOPED_TABLE_NAME + ": " + inserter.Error();
+            fileStats.AddTable(config_.ENVELOPED_TABLE_NAME, insertedRows, tableTimer.Seconds());
+
+            if (store.Sketching())
+            {
+                tableTimer.Restart();
+                long long quantileRows = WriteQuantileTable(finalDbHandle, store, elementOrder, finalHeaders, headerSlots, typeActions, error);
+                fileStats.AddTable(config_.QUANTILES_TABLE_NAME, quantileRows, tableTimer.Seconds());
+            }
+
+            if (sourceInserter)
+            {
+                sourceInserter->Flush();
+                if (error.empty() && !sourceInserter->Error().empty()) error = config_.PROVENANCE_TABLE_NAME + ": " + sourceInserter->Error();
+                std::string namesError = WriteNameTable(finalDbHandle, config_.PROVENANCE_FILES_TABLE_NAME, "fileId", store.SourceFiles());
+                if (namesError.empty()) namesError = WriteNameTable(finalDbHandle, config_.PROVENANCE_TABLES_TABLE_NAME, "tableId", store.SourceTables());
+                if (error.empty() && !namesError.empty()) error = namesError;
             }
-            sqlite3_finalize(stmt);
-            sqlite3_close(dbHandle);
         }
-        std::cout << "Verification successful. Found " << verifiedElements_.size() << " unique elements." << std::endl;
-        return true;
+
+        if (sqlite3_exec(finalDbHandle, "COMMIT;", 0, 0, &errMsg) != SQLITE_OK && error.empty()) error = errMsg ? errMsg : sqlite3_errmsg(finalDbHandle);
+        sqlite3_free(errMsg);
+        stats_.EndFile(fileStats, finalDbHandle);
+        sqlite3_close(finalDbHandle);
+        // An incomplete database must not replace the previous output (a watch refresh keeps the last good one);
+        // the .partial file is left for inspection
+        if (!error.empty()) throw std::runtime_error("Could not write " + dbFilename + " (" + error + "); the incomplete file is " + partialDbPath.string());
+        fs::rename(partialDbPath, finalDbPath);
+        std::error_code sizeError;
+        std::uintmax_t outputSize = fs::file_size(finalDbPath, sizeError);
+        fileStats.bytes = sizeError ? 0 : outputSize;
+        log_ << "OK: Database '" << dbFilename << "' created successfully." << std::endl;
     }
 
-    void EnvelopeBuilder::EnvelopeDataInMemory(const fs::path& targetPath)
+    std::map<std::string, std::string> EnvelopeBuilder::ShardSettings() const
     {
-        std::cout << "\nPASS 2: Enveloping data (In-Memory mode)..." << std::endl;
-        for (const auto& entry : fs::directory_iterator(targetPath))
+        std::map<std::string, std::string> settings;
+        settings["format"] = config_.SHARD_FORMAT;
+        std::string rules;
+        for (const auto& rule : store_.Rules()) rules += FormatEnvelopeRule(rule) + "\n";
+        settings["rules"] = rules;
+        settings["bounds"] = store_.Bounds() == EnvelopeBounds::Max ? "max" : (store_.Bounds() == EnvelopeBounds::MinMax ? "minmax" : "absmax");
+        // Full precision, so the percentiles read back are the same numbers (and give the same column names)
+        std::stringstream quantiles;
+        quantiles.precision(std::numeric_limits<double>::max_digits10);
+        for (size_t i = 0; i < options_.quantiles.size(); ++i) quantiles << (i ? "," : "") << options_.quantiles[i];
+        settings["quantiles"] = quantiles.str();
+        settings["provenance"] = options_.trackProvenance ? "1" : "0";
+        settings["sketch format"] = std::to_string(QuantileSketch::kFormatVersion);
+        if (store_.SinglePrecision()) settings["precision"] = "float32"; // Absent in double precision, as in shards written before the option
+        return settings;
+    }
+
+    std::map<std::string, std::string> EnvelopeBuilder::ReadShardSettings(const fs::path& shardPath)
+    {
+        const std::string shardName = shardPath.filename().string();
+        SqliteConnection* connection = connections_.OpenReadOnly(shardPath);
+        if (!connection) throw std::runtime_error("Could not open shard '" + shardName + "'.");
+        StatementLease statement = connection->Prepare("SELECT \"key\", \"value\" FROM \"" + config_.SHARD_INFO_TABLE_NAME + "\";");
+        if (!statement) throw std::runtime_error("'" + shardName + "' is not an envelope shard (no " + config_.SHARD_INFO_TABLE_NAME + " table).");
+        std::map<std::string, std::string> settings;
+        sqlite3_stmt* stmt = statement.Get();
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            const char* key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            const char* value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            settings[key ? key : ""] = value ? value : "";
+        }
+        if (settings["format"] != config_.SHARD_FORMAT)
+        {
+            throw std::runtime_error("'" + shardName + "' is a shard of another format ('" + settings["format"] + "', expected '" + config_.SHARD_FORMAT + "').");
+        }
+        return settings;
+    }
+
+    void EnvelopeBuilder::WriteShard(const fs::path& shardPath)
+    {
+        RunStats::ScopedTimer timer(stats_, "shard");
+        log_ << "\nWriting shard '" << shardPath.filename().string() << "'..." << std::endl;
+        if (shardPath.has_parent_path()) fs::create_directories(shardPath.parent_path());
+        fs::path partialPath = shardPath;
+        partialPath += ".partial";
+        if (fs::exists(partialPath)) fs::remove(partialPath);
+        RunStats::FileStats& fileStats = stats_.BeginFile("shard", shardPath);
+        Stopwatch tableTimer;
+
+        sqlite3* dbHandle;
+        if (sqlite3_open_v2(partialPath.string().c_str(), &dbHandle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, nullptr) != SQLITE_OK)
+        {
+            sqlite3_close(dbHandle);
+            throw std::runtime_error("Could not create shard file.");
+        }
+        try
+        {
+            WriteElementsTable(dbHandle);
+        }
+        catch (...)
         {
-            if (!entry.is_regular_file() || entry.path().extension() != ".db") continue;
-            std::cout << "  - Processing file: " << entry.path().filename().string() << std::endl;
-            sqlite3* dbHandle;
-            if (sqlite3_open_v2(entry.path().string().c_str(), &dbHandle, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) continue;
+            sqlite3_close(dbHandle);
+            throw;
+        }
+        fileStats.AddTable(config_.ELEMENTS_TABLE_NAME, static_cast<long long>(elements_.Size()), tableTimer.Seconds());
+        tableTimer.Restart();
+
+        char* errMsg = nullptr;
+        sqlite3_exec(dbHandle, "BEGIN TRANSACTION;", 0, 0, &errMsg);
 
-            for (const auto& tableName : GetTableNames(dbHandle))
+        std::string createInfoSql = "CREATE TABLE \"" + config_.SHARD_INFO_TABLE_NAME + "\" (\"key\" TEXT, \"value\" TEXT, PRIMARY KEY(\"key\")) WITHOUT ROWID;";
+        sqlite3_exec(dbHandle, createInfoSql.c_str(), 0, 0, nullptr);
+        {
+            BatchInserter infoInserter(dbHandle, "INSERT INTO \"" + config_.SHARD_INFO_TABLE_NAME + "\"", 2);
+            for (const auto& setting : ShardSettings())
             {
-                if (tableName == config_.ELEMENTS_TABLE_NAME) continue;
+                infoInserter.BindText(setting.first);
+                infoInserter.BindText(setting.second);
+                infoInserter.EndRow();
+            }
+        }
 
-                std::string query = "SELECT * FROM \"" + tableName + "\";";
-                sqlite3_stmt* stmt;
-                if (sqlite3_prepare_v2(dbHandle, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) continue;
+        // Column dictionary: slot -> name, the hidden rule slots included (their values are the envelopes of the rule sums)
+        std::vector<std::string> columnNames;
+        for (size_t slot = 0; slot < store_.ColumnCount(); ++slot) columnNames.push_back(store_.ColumnName(static_cast<int>(slot)));
+        std::string error = WriteNameTable(dbHandle, config_.SHARD_COLUMNS_TABLE_NAME, "slot", columnNames);
 
-                int colCount = sqlite3_column_count(stmt);
-                int elemIdIdx = -1;
-                std::vector<std::string> colNames;
-                for (int i = 0; i < colCount; ++i) 
+        // One row per element and slot with a value; bounds, source and sketch are NULL when not kept
+        std::string createValuesSql = "CREATE TABLE \"" + config_.SHARD_VALUES_TABLE_NAME + "\" (\"" + config_.ELEMENT_ID_COLUMN + "\" INT, \"slot\" INT, "
+            "\"value\" REAL, \"min\" REAL, \"absmax\" REAL, \"fileId\" INT, \"tableId\" INT, \"" + config_.SET_N_COLUMN + "\" INT, \"sketch\" BLOB, "
+            "PRIMARY KEY(\"" + config_.ELEMENT_ID_COLUMN + "\", \"slot\")) WITHOUT ROWID;";
+        sqlite3_exec(dbHandle, createValuesSql.c_str(), 0, 0, nullptr);
+        unsigned char sketchBytes[QuantileSketch::kMaxSerializedSize];
+        const bool withBounds = store_.Bounds() != EnvelopeBounds::Max;
+        long long valueRows = 0;
+        BatchInserter inserter(dbHandle, "INSERT INTO \"" + config_.SHARD_VALUES_TABLE_NAME + "\"", 9);
+        for (int element : RadixSortedOrder(store_.ElementIds()))
+        {
+            if (!store_.HasData(element) || !store_.IsVerified(element)) continue;
+            for (int slot = 0; slot < static_cast<int>(store_.ColumnCount()); ++slot)
+            {
+                if (!store_.HasValue(slot, element)) continue;
+                inserter.BindInt64(store_.ElementId(element));
+                inserter.BindInt64(slot);
+                inserter.BindDouble(store_.Value(slot, element));
+                if (withBounds)
                 {
-                    std::string colName = sqlite3_column_name(stmt, i);
-                    colNames.push_back(colName);
-                    if (colName == config_.ELEMENT_ID_COLUMN) elemIdIdx = i;
+                    inserter.BindDouble(store_.MinValue(slot, element));
+                    inserter.BindDouble(store_.AbsMaxValue(slot, element));
                 }
-
-                if (elemIdIdx == -1) 
+                else
                 {
-                    sqlite3_finalize(stmt);
-                    continue;
+                    inserter.BindNull();
+                    inserter.BindNull();
                 }
-                
-                while (sqlite3_step(stmt) == SQLITE_ROW)
+                if (options_.trackProvenance)
                 {
-                    long long elementId = sqlite3_column_int64(stmt, elemIdIdx);
-                    if (verifiedElements_.find(elementId) == verifiedElements_.end()) continue;
-
-                    std::unordered_map<std::string, double> currentRowNumerics;
-
-                    // Step 1: Perform standard enveloping for all numeric columns and collect current row values
-                    for (int i = 0; i < colCount; ++i)
-                    {
-                        const std::string& colName = colNames[i];
-                        if (colName == config_.ELEMENT_ID_COLUMN || colName == config_.SET_N_COLUMN || colName == config_.ELEM_TYPE_COLUMN) continue;
+                    const ValueSource& source = store_.Source(slot, element);
+                    inserter.BindInt64(source.file);
+                    inserter.BindInt64(source.table);
+                    inserter.BindInt64(source.setN);
+                }
+                else
+                {
+                    inserter.BindNull();
+                    inserter.BindNull();
+                    inserter.BindNull();
+                }
+                if (store_.HasSketch(slot, element)) inserter.BindBlob(sketchBytes, store_.Sketch(slot, element).Serialize(sketchBytes));
+                else inserter.BindNull();
+                inserter.EndRow();
+                ++valueRows;
+            }
+        }
+        inserter.Flush();
+        if (error.empty()) error = inserter.Error();
+        fileStats.AddTable(config_.SHARD_VALUES_TABLE_NAME, valueRows, tableTimer.Seconds());
 
-                        int colType = sqlite3_column_type(stmt, i);
-                        if (colType == SQLITE_INTEGER || colType == SQLITE_FLOAT)
-                        {
-                            double currentValue = sqlite3_column_double(stmt, i);
-                            currentRowNumerics[colName] = currentValue;
+        if (error.empty()) error = WriteNameTable(dbHandle, config_.SHARD_FILES_TABLE_NAME, "fileId", store_.SourceFiles());
+        if (error.empty()) error = WriteNameTable(dbHandle, config_.SHARD_TABLES_TABLE_NAME, "tableId", store_.SourceTables());
 
-                            if (envelopedData_[elementId].find(colName) == envelopedData_[elementId].end() || currentValue > envelopedData_[elementId][colName])
-                            {
-                                envelopedData_[elementId][colName] = currentValue;
-                            }
-                        }
-                    }
+        if (sqlite3_exec(dbHandle, "COMMIT;", 0, 0, &errMsg) != SQLITE_OK && error.empty()) error = errMsg ? errMsg : sqlite3_errmsg(dbHandle);
+        sqlite3_free(errMsg);
+        stats_.EndFile(fileStats, dbHandle);
+        sqlite3_close(dbHandle);
+        // A shard with missing rows must not reach --merge under its final name; the .partial file is left for inspection
+        if (!error.empty()) throw std::runtime_error("Could not write the shard (" + error + "); the incomplete file is " + partialPath.string());
+        fs::rename(partialPath, shardPath);
+        std::error_code sizeError;
+        std::uintmax_t shardSize = fs::file_size(shardPath, sizeError);
+        fileStats.bytes = sizeError ? 0 : shardSize;
+    }
 
-                    // Step 2: If it's a shell, additionally calculate and envelop the sums
-                    bool isShell = verifiedElements_.at(elementId).count(config_.ELEM_TYPE_COLUMN) &&
-                                   verifiedElements_.at(elementId).at(config_.ELEM_TYPE_COLUMN) == "2";
-                    
-                    if (isShell)
-                    {
-                        double asw1i = currentRowNumerics.count("Asw1i") ? currentRowNumerics.at("Asw1i") : 0.0;
-                        double asw2i = currentRowNumerics.count("Asw2i") ? currentRowNumerics.at("Asw2i") : 0.0;
-                        double asw1j = currentRowNumerics.count("Asw1j") ? currentRowNumerics.at("Asw1j") : 0.0;
-                        double asw2j = currentRowNumerics.count("Asw2j") ? currentRowNumerics.at("Asw2j") : 0.0;
+    void EnvelopeBuilder::MergeShard(const fs::path& shardPath)
+    {
+        const std::string shardName = shardPath.filename().string();
+        SqliteConnection* connection = connections_.OpenReadOnly(shardPath);
+        if (!connection) throw std::runtime_error("Could not open shard '" + shardName + "'.");
+        log_ << "  - Merging shard: " << shardName << "\n";
+        RunStats::FileStats& fileStats = stats_.BeginFile("merge", shardPath);
+        Stopwatch tableTimer;
 
-                        double sum_i = asw1i + asw2i;
-                        double sum_j = asw1j + asw2j;
+        // Slots and source ids of the shard become those of store_. Source names are added in the order of the shard,
+        // so shards of consecutive parts of a folder number the sources as one run over the whole folder would.
+        auto readNames = [&](const std::string& tableName, const std::string& idColumn)
+        {
+            std::vector<std::string> names;
+            StatementLease statement = connection->Prepare("SELECT \"name\" FROM \"" + tableName + "\" ORDER BY \"" + idColumn + "\";");
+            if (!statement) throw std::runtime_error("Shard '" + shardName + "' has no " + tableName + " table.");
+            while (sqlite3_step(statement.Get()) == SQLITE_ROW)
+            {
+                const char* name = reinterpret_cast<const char*>(sqlite3_column_text(statement.Get(), 0));
+                names.push_back(name ? name : "");
+            }
+            return names;
+        };
+        std::vector<int> slots;
+        for (const auto& name : readNames(config_.SHARD_COLUMNS_TABLE_NAME, "slot")) slots.push_back(store_.ColumnSlot(name));
+        std::vector<uint32_t> fileIds;
+        for (const auto& name : readNames(config_.SHARD_FILES_TABLE_NAME, "fileId")) fileIds.push_back(store_.SourceFileId(name));
+        std::vector<uint32_t> tableIds;
+        for (const auto& name : readNames(config_.SHARD_TABLES_TABLE_NAME, "tableId")) tableIds.push_back(store_.SourceTableId(name));
+        std::vector<EnvelopeMode> modes(store_.ColumnCount(), EnvelopeMode::Max);
+        for (size_t rule = 0; rule < store_.Rules().size(); ++rule) modes[store_.RuleSlot(rule)] = store_.Rules()[rule].mode;
 
-                        const std::string sum_i_key = "__Asw_sum_i";
-                        if (envelopedData_[elementId].find(sum_i_key) == envelopedData_[elementId].end() || sum_i > envelopedData_[elementId][sum_i_key])
-                        {
-                            envelopedData_[elementId][sum_i_key] = sum_i;
-                        }
-                        
-                        const std::string sum_j_key = "__Asw_sum_j";
-                        if (envelopedData_[elementId].find(sum_j_key) == envelopedData_[elementId].end() || sum_j > envelopedData_[elementId][sum_j_key])
-                        {
-                            envelopedData_[elementId][sum_j_key] = sum_j;
-                        }
-                    }
+        StatementLease statement = connection->Prepare("SELECT \"" + config_.ELEMENT_ID_COLUMN + "\", \"slot\", \"value\", \"min\", \"absmax\", \"fileId\", \"tableId\", \"" +
+                                                       config_.SET_N_COLUMN + "\", \"sketch\" FROM \"" + config_.SHARD_VALUES_TABLE_NAME + "\" ORDER BY \"" + config_.ELEMENT_ID_COLUMN + "\", \"slot\";");
+        if (!statement) throw std::runtime_error("Shard '" + shardName + "' has no " + config_.SHARD_VALUES_TABLE_NAME + " table.");
+        sqlite3_stmt* stmt = statement.Get();
+        const bool trackProvenance = options_.trackProvenance;
+        long long rowCount = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            ++rowCount;
+            int element = store_.FindElement(sqlite3_column_int64(stmt, 0));
+            if (element < 0) continue; // Outside the element filter of the merge
+            const long long shardSlot = sqlite3_column_int64(stmt, 1);
+            if (shardSlot < 0 || shardSlot >= static_cast<long long>(slots.size())) throw std::runtime_error("Shard '" + shardName + "' refers to an unknown column slot.");
+            const int slot = slots[static_cast<size_t>(shardSlot)];
+            const double value = sqlite3_column_double(stmt, 2);
+            const double minValue = sqlite3_column_type(stmt, 3) == SQLITE_NULL ? value : sqlite3_column_double(stmt, 3);
+            const double absMaxValue = sqlite3_column_type(stmt, 4) == SQLITE_NULL ? value : sqlite3_column_double(stmt, 4);
+            if (store_.FoldEnvelope(slot, element, value, minValue, absMaxValue, modes[slot]) && trackProvenance)
+            {
+                const long long fileId = sqlite3_column_int64(stmt, 5);
+                const long long tableId = sqlite3_column_int64(stmt, 6);
+                if (fileId < 0 || fileId >= static_cast<long long>(fileIds.size()) || tableId < 0 || tableId >= static_cast<long long>(tableIds.size()))
+                {
+                    throw std::runtime_error("Shard '" + shardName + "' refers to an unknown source file or table.");
                 }
-                sqlite3_finalize(stmt);
+                ValueSource source;
+                source.file = fileIds[static_cast<size_t>(fileId)];
+                source.table = tableIds[static_cast<size_t>(tableId)];
+                source.setN = sqlite3_column_int64(stmt, 7);
+                store_.SetSource(slot, element, source);
+            }
+            if (store_.Sketching() && sqlite3_column_type(stmt, 8) == SQLITE_BLOB)
+            {
+                QuantileSketch sketch;
+                if (!sketch.Deserialize(static_cast<const unsigned char*>(sqlite3_column_blob(stmt, 8)), static_cast<size_t>(sqlite3_column_bytes(stmt, 8))))
+                {
+                    throw std::runtime_error("Shard '" + shardName + "' holds a damaged sketch or one of another format.");
+                }
+                store_.MergeSketch(slot, element, sketch);
             }
-            sqlite3_close(dbHandle);
         }
+        fileStats.AddTable(config_.SHARD_VALUES_TABLE_NAME, rowCount, tableTimer.Seconds());
+        stats_.EndFile(fileStats, connection->Handle());
     }
 
-    void EnvelopeBuilder::AssembleFinalDatabase(const fs::path& targetPath, bool createSummedVersion)
+    void EnvelopeBuilder::WriteElementsTable(sqlite3* dbHandle)
     {
-        const std::string dbFilename = createSummedVersion ? config_.OUTPUT_DB_SUMMED_FILENAME : config_.OUTPUT_DB_FILENAME;
-        std::cout << "\nPASS 3: Assembling final database '" << dbFilename << "'..." << std::endl;
-        
-        fs::path finalDbPath = targetPath / dbFilename;
-        if (fs::exists(finalDbPath)) fs::remove(finalDbPath);
-
-        sqlite3* finalDbHandle;
-        if (sqlite3_open(finalDbPath.string().c_str(), &finalDbHandle) != SQLITE_OK) throw std::runtime_error("Could not create final database.");
-
-        char* errMsg = nullptr;
-        sqlite3_exec(finalDbHandle, "BEGIN TRANSACTION;", 0, 0, &errMsg);
-
-        // Step 1: Create and populate the "Elements" table (unchanged)
         const char* createElementsTableSql = R"(
         CREATE TABLE "Elements" (
-            "elemId"	INT, "elemType"	INT, "CGrade"	TEXT, "SLGrade"	TEXT, "STGrade"	TEXT,
+            "elemId"	INTEGER, "elemType"	INT, "CGrade"	TEXT, "SLGrade"	TEXT, "STGrade"	TEXT,
             "CSType"	INT, "b1"	REAL, "h1"	REAL, "a1"	REAL, "a2"	REAL, "t1"	REAL,
             "t2"	REAL, "reinfStep1"	REAL, "reinfStep2"	REAL, "a3"	REAL, "a4"	REAL,
             PRIMARY KEY("elemId")
         );)";
-        sqlite3_exec(finalDbHandle, createElementsTableSql, 0, 0, &errMsg);
-
-        const char* insertElementSql = R"(
-        INSERT INTO "Elements" ("elemId", "elemType", "CGrade", "SLGrade", "STGrade", "CSType", 
-        "b1", "h1", "a1", "a2", "t1", "t2", "reinfStep1", "reinfStep2", "a3", "a4") 
-        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);)";
-        sqlite3_stmt* insertElementStmt;
-        sqlite3_prepare_v2(finalDbHandle, insertElementSql, -1, &insertElementStmt, nullptr);
-        std::vector<std::string> propOrder = {
-            "elemType", "CGrade", "SLGrade", "STGrade", "CSType", "b1", "h1",
+        sqlite3_exec(dbHandle, createElementsTableSql, 0, 0, nullptr);
+
+        const std::vector<std::string> elementColumns = {
+            "elemId", "elemType", "CGrade", "SLGrade", "STGrade", "CSType", "b1", "h1",
             "a1", "a2", "t1", "t2", "reinfStep1", "reinfStep2", "a3", "a4"
         };
-        for (const auto& pair : verifiedElements_)
+        for (const auto& ownerFile : elements_.OwnerFiles())
         {
-            sqlite3_bind_int64(insertElementStmt, 1, pair.first);
-            for (size_t i = 0; i < propOrder.size(); ++i)
-            {
-                const std::string& propName = propOrder[i];
-                if (pair.second.count(propName))
-                    sqlite3_bind_text(insertElementStmt, i + 2, pair.second.at(propName).c_str(), -1, SQLITE_STATIC);
-                else
-                    sqlite3_bind_null(insertElementStmt, i + 2);
-            }
-            sqlite3_step(insertElementStmt);
-            sqlite3_reset(insertElementStmt);
+            if (HasExtension(ownerFile, ".csv")) CopyElementsFromCsv(dbHandle, ownerFile, elementColumns);
+            else CopyElementsFrom(dbHandle, ownerFile, elementColumns);
         }
-        sqlite3_finalize(insertElementStmt);
+    }
 
-        // Step 2: Create and populate the "Enveloped Reinforcement" table
-        std::set<std::string> allHeadersSet = CollectAllEnvelopedColumns();
-        if (allHeadersSet.empty())
+    std::string EnvelopeBuilder::WriteNameTable(sqlite3* dbHandle, const std::string& tableName, const std::string& idColumn, const std::vector<std::string>& names)
+    {
+        std::string createSql = "CREATE TABLE \"" + tableName + "\" (\"" + idColumn + "\" INTEGER, \"name\" TEXT, PRIMARY KEY(\"" + idColumn + "\"));";
+        sqlite3_exec(dbHandle, createSql.c_str(), 0, 0, nullptr);
+        BatchInserter inserter(dbHandle, "INSERT INTO \"" + tableName + "\"", 2);
+        for (size_t id = 0; id < names.size(); ++id)
         {
-            std::cout << "No enveloped data found to assemble." << std::endl;
+            inserter.BindInt64(static_cast<long long>(id));
+            inserter.BindText(names[id]);
+            inserter.EndRow();
         }
-        else
+        inserter.Flush();
+        return inserter.Error();
+    }
+
+    long long EnvelopeBuilder::WriteQuantileTable(sqlite3* dbHandle, const EnvelopeStore& store, const std::vector<int>& elementOrder, const std::vector<std::string>& headers,
+                                                  const std::vector<int>& headerSlots, const std::vector<std::vector<int>>& typeActions, std::string& error)
+    {
+        std::stringstream createSql;
+        createSql << "CREATE TABLE \"" << config_.QUANTILES_TABLE_NAME << "\" (\"" << config_.ELEMENT_ID_COLUMN << "\" INT, \"column\" TEXT, \"count\" INT";
+        for (double percent : options_.quantiles) createSql << ", \"p" << percent << "\" REAL";
+        createSql << ", PRIMARY KEY(\"" << config_.ELEMENT_ID_COLUMN << "\", \"column\")) WITHOUT ROWID;";
+        sqlite3_exec(dbHandle, createSql.str().c_str(), 0, 0, nullptr);
+
+        BatchInserter inserter(dbHandle, "INSERT INTO \"" + config_.QUANTILES_TABLE_NAME + "\"", static_cast<int>(options_.quantiles.size()) + 3);
+        long long insertedRows = 0;
+        for (int element : elementOrder)
         {
-            std::vector<std::string> orderedHeaders = {
-                "As1Ti", "As1Tj", "As1Bi", "As1Bj", "As2Ti", "As2Tj", "As2Bi", "As2Bj",
-                "Asw1i", "Asw1j", "Asw2i", "Asw2j", "Reinf1", "Reinf2", "Crack1i", "Crack1j",
-                "Crack2i", "Crack2j", "Sw1i", "Sw1j", "Sw2i", "Sw2j", "ls1i", "ls1j", "ls2i", "ls2j"
-            };
-            std::vector<std::string> finalHeaders;
-            for (const auto& header : orderedHeaders)
+            if (!store.HasData(element) || !store.IsVerified(element)) continue;
+            const std::vector<int>& actions = typeActions[store.ElementType(element)];
+            for (size_t h = 0; h < headers.size(); ++h)
             {
-                if (allHeadersSet.count(header)) finalHeaders.push_back(header);
+                const int slot = actions[h] >= 0 ? actions[h] : actions[h] == -1 ? headerSlots[h] : -1;
+                if (slot < 0 || !store.HasSketch(slot, element)) continue;
+                const QuantileSketch& sketch = store.Sketch(slot, element);
+                inserter.BindInt64(store.ElementId(element));
+                inserter.BindText(headers[h]);
+                inserter.BindInt64(static_cast<long long>(sketch.Count()));
+                for (double percent : options_.quantiles) inserter.BindDouble(sketch.Quantile(percent / 100.0));
+                inserter.EndRow();
+                ++insertedRows;
             }
+        }
+        inserter.Flush();
+        if (error.empty() && !inserter.Error().empty()) error = config_.QUANTILES_TABLE_NAME + ": " + inserter.Error();
+        return insertedRows;
+    }
 
-            std::stringstream createReinfTableSql;
-            createReinfTableSql << "CREATE TABLE \"" << config_.ENVELOPED_TABLE_NAME << "\" ("
-                << "\"" << config_.SET_N_COLUMN << "\" INT, "
-                << "\"" << config_.ELEMENT_ID_COLUMN << "\" INT, "
-                << "\"" << config_.ELEM_TYPE_COLUMN << "\" INT";
-            for (const auto& header : finalHeaders) createReinfTableSql << ", \"" << header << "\" REAL";
-            createReinfTableSql << ", PRIMARY KEY(\"" << config_.ELEMENT_ID_COLUMN << "\")"
-                << ", CONSTRAINT \"fk_elements\" FOREIGN KEY(\"" << config_.ELEMENT_ID_COLUMN << "\") REFERENCES \"" << config_.ELEMENTS_TABLE_NAME << "\"(elemId));";
-            sqlite3_exec(finalDbHandle, createReinfTableSql.str().c_str(), 0, 0, &errMsg);
+    void EnvelopeBuilder::CopyElementsFrom(sqlite3* dbHandle, const fs::path& sourcePath, const std::vector<std::string>& columns)
+    {
+        sqlite3_stmt* attachStmt;
+        sqlite3_prepare_v2(dbHandle, "ATTACH DATABASE ? AS source;", -1, &attachStmt, nullptr);
+        sqlite3_bind_text(attachStmt, 1, SourceUri(sourcePath, connections_.Profile()).c_str(), -1, SQLITE_TRANSIENT);
+        int rc = sqlite3_step(attachStmt);
+        sqlite3_finalize(attachStmt);
+        if (rc != SQLITE_DONE) throw std::runtime_error("Could not attach " + sourcePath.filename().string() + ": " + sqlite3_errmsg(dbHandle));
 
-            std::stringstream insertReinfSql;
-            insertReinfSql << "INSERT INTO \"" << config_.ENVELOPED_TABLE_NAME << "\" (\"" << config_.SET_N_COLUMN << "\", \"" << config_.ELEMENT_ID_COLUMN << "\", \"" << config_.ELEM_TYPE_COLUMN << "\"";
-            for (const auto& header : finalHeaders) insertReinfSql << ", \"" << header << "\"";
-            insertReinfSql << ") VALUES (?,?,?";
-            for (size_t i = 0; i < finalHeaders.size(); ++i) insertReinfSql << ",?";
-            insertReinfSql << ");";
+        std::set<std::string> sourceColumns;
+        sqlite3_stmt* columnsStmt;
+        std::string columnsSql = "SELECT * FROM source.\"" + config_.ELEMENTS_TABLE_NAME + "\";";
+        if (sqlite3_prepare_v2(dbHandle, columnsSql.c_str(), -1, &columnsStmt, nullptr) == SQLITE_OK)
+        {
+            for (int i = 0; i < sqlite3_column_count(columnsStmt); ++i) sourceColumns.insert(sqlite3_column_name(columnsStmt, i));
+        }
+        sqlite3_finalize(columnsStmt);
 
-            sqlite3_stmt* insertStmt;
-            sqlite3_prepare_v2(finalDbHandle, insertReinfSql.str().c_str(), -1, &insertStmt, nullptr);
+        // Elements taken from an earlier file are already there; OR IGNORE keeps them (and the first of duplicate rows)
+        std::stringstream copySql;
+        copySql << "INSERT OR IGNORE INTO main.\"" << config_.ELEMENTS_TABLE_NAME << "\" (";
+        for (size_t i = 0; i < columns.size(); ++i) copySql << (i ? ", " : "") << "\"" << columns[i] << "\"";
+        copySql << ") SELECT ";
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            copySql << (i ? ", " : "");
+            if (sourceColumns.count(columns[i])) copySql << "\"" << columns[i] << "\"";
+            else copySql << "NULL";
+        }
+        copySql << " FROM source.\"" << config_.ELEMENTS_TABLE_NAME << "\"";
+        if (elementFilter_.Active())
+        {
+            // Only the elements of the subset; the ranges let the PRIMARY KEY skip the rest
+            sqlite3_create_function(dbHandle, "element_in_subset", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, &elementFilter_, ElementInSubset, nullptr, nullptr);
+            copySql << " WHERE " << elementFilter_.SqlRanges(config_.ELEMENT_ID_COLUMN) << " AND element_in_subset(\"" << config_.ELEMENT_ID_COLUMN << "\")";
+        }
+        // In elemId order, so the rows are appended to the clustered table
+        copySql << " ORDER BY \"" << config_.ELEMENT_ID_COLUMN << "\";";
 
-            for (const auto& elemPair : envelopedData_)
-            {
-                long long elementId = elemPair.first;
-                const auto& elementData = elemPair.second;
+        char* errMsg = nullptr;
+        rc = sqlite3_exec(dbHandle, copySql.str().c_str(), nullptr, nullptr, &errMsg);
+        std::string error = errMsg ? errMsg : "";
+        sqlite3_free(errMsg);
+        sqlite3_exec(dbHandle, "DETACH DATABASE source;", nullptr, nullptr, nullptr);
+        if (rc != SQLITE_OK) throw std::runtime_error("Could not copy Elements from " + sourcePath.filename().string() + ": " + error);
+    }
 
-                sqlite3_bind_int64(insertStmt, 1, 1);
-                sqlite3_bind_int64(insertStmt, 2, elementId);
+    void EnvelopeBuilder::CopyElementsFromCsv(sqlite3* dbHandle, const fs::path& csvPath, const std::vector<std::string>& columns)
+    {
+        CsvRowReader rows;
+        if (!rows.Open(csvPath)) throw std::runtime_error("Could not read " + csvPath.filename().string() + ".");
 
-                if (verifiedElements_.count(elementId) && verifiedElements_.at(elementId).count(config_.ELEM_TYPE_COLUMN))
-                    sqlite3_bind_int(insertStmt, 3, std::stoi(verifiedElements_.at(elementId).at(config_.ELEM_TYPE_COLUMN)));
-                else
-                    sqlite3_bind_null(insertStmt, 3);
-                
-                bool isShellForSumming = createSummedVersion &&
-                                         verifiedElements_.count(elementId) &&
-                                         verifiedElements_.at(elementId).count(config_.ELEM_TYPE_COLUMN) &&
-                                         verifiedElements_.at(elementId).at(config_.ELEM_TYPE_COLUMN) == "2";
-
-                int colIdx = 4;
-                for (const auto& header : finalHeaders)
+        // Field of the CSV for every output column, -1 if the export has no such column (NULL, as for a .db)
+        const std::vector<std::string>& csvColumns = rows.ColumnNames();
+        std::vector<int> fields;
+        int elemIdField = -1;
+        for (const auto& column : columns)
+        {
+            const auto found = std::find(csvColumns.begin(), csvColumns.end(), column);
+            fields.push_back(found == csvColumns.end() ? -1 : static_cast<int>(found - csvColumns.begin()));
+            if (column == config_.ELEMENT_ID_COLUMN) elemIdField = fields.back();
+        }
+
+        sqlite3_exec(dbHandle, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr);
+        std::stringstream insertSql;
+        insertSql << "INSERT OR IGNORE INTO main.\"" << config_.ELEMENTS_TABLE_NAME << "\" (";
+        for (size_t i = 0; i < columns.size(); ++i) insertSql << (i ? ", " : "") << "\"" << columns[i] << "\"";
+        insertSql << ")";
+        std::string error;
+        {
+            // Elements taken from an earlier file are already there; OR IGNORE keeps them (and the first of duplicate rows).
+            // Fields are bound as text: the column affinity turns numbers into INTEGER and REAL, as in the CSV import.
+            BatchInserter inserter(dbHandle, insertSql.str(), static_cast<int>(columns.size()));
+            const bool filterElements = elementFilter_.Active();
+            while (rows.Next())
+            {
+                if (filterElements && !elementFilter_.Contains(rows.Int64(elemIdField))) continue;
+                for (int field : fields)
                 {
-                    // Logic for binding values with special handling for shells in the summed version
-                    if (isShellForSumming && header == "Asw1i") {
-                        double value = elementData.count("__Asw_sum_i") ? elementData.at("__Asw_sum_i") : 0.0;
-                        sqlite3_bind_double(insertStmt, colIdx, value);
-                    } else if (isShellForSumming && header == "Asw2i") {
-                        sqlite3_bind_double(insertStmt, colIdx, 0.0); // Zero out
-                    } else if (isShellForSumming && header == "Asw1j") {
-                        double value = elementData.count("__Asw_sum_j") ? elementData.at("__Asw_sum_j") : 0.0;
-                        sqlite3_bind_double(insertStmt, colIdx, value);
-                    } else if (isShellForSumming && header == "Asw2j") {
-                        sqlite3_bind_double(insertStmt, colIdx, 0.0); // Zero out
-                    } else {
-                        // Standard logic for all other cases
-                        if (elementData.count(header)) {
-                            sqlite3_bind_double(insertStmt, colIdx, elementData.at(header));
-                        } else {
-                            sqlite3_bind_null(insertStmt, colIdx);
-                        }
-                    }
-                    colIdx++;
+                    const std::string_view value = field >= 0 ? rows.Text(field) : std::string_view();
+                    if (value.empty()) inserter.BindNull();
+                    else inserter.BindText(std::string(value));
                 }
-                sqlite3_step(insertStmt);
-                sqlite3_reset(insertStmt);
+                inserter.EndRow();
             }
-            sqlite3_finalize(insertStmt);
+            inserter.Flush();
+            error = inserter.Error();
         }
-
-        sqlite3_exec(finalDbHandle, "COMMIT;", 0, 0, &errMsg);
-        if (errMsg)
+        char* errMsg = nullptr;
+        if (sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, &errMsg) != SQLITE_OK && error.empty()) error = errMsg ? errMsg : "COMMIT failed";
+        sqlite3_free(errMsg);
+        if (!error.empty())
         {
-            LogSqliteError("Error during final assembly", finalDbHandle);
-            sqlite3_free(errMsg);
+            sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw std::runtime_error("Could not copy Elements from " + csvPath.filename().string() + ": " + error);
         }
-        sqlite3_close(finalDbHandle);
-        std::cout << "OK: Database '" << dbFilename << "' created successfully." << std::endl;
     }
 
-    std::set<std::string> EnvelopeBuilder::CollectAllEnvelopedColumns()
+    std::set<std::string> EnvelopeBuilder::CollectAllEnvelopedColumns(const EnvelopeStore& store)
     {
         std::set<std::string> headers;
-        for (const auto& elemPair : envelopedData_)
+        for (size_t slot = 0; slot < store.ColumnCount(); ++slot)
         {
-            for (const auto& reinfPair : elemPair.second)
-            {
-                // Do not include internal helper fields in the final table columns
-                if (reinfPair.first.rfind("__", 0) != 0) {
-                    headers.insert(reinfPair.first);
-                }
-            }
+            // Do not include internal helper fields in the final table columns
+            const std::string& name = store.ColumnName(static_cast<int>(slot));
+            if (name.rfind("__", 0) != 0 && store.ColumnHasData(static_cast<int>(slot))) headers.insert(name);
         }
         return headers;
     }
@@ -365,7 +1846,7 @@ namespace Builder
         std::cout << "Enter path to directory with .db files (or '.' for current directory): ";
         std::string inputPathStr;
         std::getline(std::cin, inputPathStr);
-        fs::path targetPath = inputPathStr.empty() || inputPathStr == "." ? fs::current_path() : inputPathStr;
+        fs::path targetPath = inputPathStr.empty() || inputPathStr == "." ? fs::current_path() : fs::path(inputPathStr);
         if (!fs::exists(targetPath) || !fs::is_directory(targetPath))
         {
             std::cerr << "ERROR: Path does not exist or is not a directory: " << targetPath.string() << std::endl;
@@ -374,24 +1855,63 @@ namespace Builder
         return targetPath;
     }
 
-    void EnvelopeBuilder::LogSqliteError(const std::string& message, sqlite3* dbHandle)
+    bool EnvelopeBuilder::IsSourceDbFile(const fs::path& path) const
     {
-        std::cerr << "  ERROR: " << message << ": " << sqlite3_errmsg(dbHandle) << std::endl;
+        std::error_code ec;
+        if (path.extension() != ".db" || !fs::is_regular_file(path, ec)) return false;
+        return !IsToolOutputFile(path.filename().string());
     }
 
-    std::vector<std::string> EnvelopeBuilder::GetTableNames(sqlite3* dbHandle)
+    bool EnvelopeBuilder::IsSourceCsvFile(const fs::path& path, std::string* skipReason) const
     {
-        std::vector<std::string> tableNames;
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(dbHandle, "SELECT name FROM sqlite_master WHERE type='table';", -1, &stmt, nullptr) == SQLITE_OK)
+        std::error_code ec;
+        if (!HasExtension(path, ".csv") || !fs::is_regular_file(path, ec)) return false;
+        auto skip = [skipReason](const std::string& reason)
         {
-            while (sqlite3_step(stmt) == SQLITE_ROW)
-            {
-                tableNames.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
-            }
+            if (skipReason) *skipReason = reason;
+            return false;
+        };
+
+        // An export next to its database would count the same rows twice
+        const std::string prefix = CsvPrefix(path);
+        if (!prefix.empty() && IsSourceDbFile(path.parent_path() / (prefix + ".db"))) return skip("its data is read from " + prefix + ".db");
+
+        // Only the solver's tables: a --diff report or any other CSV in the folder has another header
+        const std::string layout = CsvTableName(path) == config_.ELEMENTS_TABLE_NAME
+            ? config_.ELEMENT_ID_COLUMN + ";" + config_.ELEM_TYPE_COLUMN
+            : config_.SET_N_COLUMN + ";" + config_.ELEMENT_ID_COLUMN + ";" + config_.ELEM_TYPE_COLUMN;
+        const std::string header = ReadHeaderLine(path);
+        if (header.compare(0, layout.size(), layout) != 0 || (header.size() > layout.size() && header[layout.size()] != ';'))
+        {
+            return skip("the header does not start with " + layout);
         }
-        sqlite3_finalize(stmt);
-        return tableNames;
+        return true;
+    }
+
+    bool EnvelopeBuilder::IsSourceDbReadable(const fs::path& dbPath) const
+    {
+        // A rollback journal or WAL next to the file means its writer has not committed yet
+        std::error_code ec;
+        if (fs::exists(dbPath.string() + "-journal", ec) || fs::exists(dbPath.string() + "-wal", ec)) return false;
+
+        sqlite3* dbHandle;
+        if (sqlite3_open_v2(dbPath.string().c_str(), &dbHandle, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+        {
+            sqlite3_close(dbHandle);
+            return false;
+        }
+        bool readable = sqlite3_exec(dbHandle, "SELECT count(*) FROM sqlite_master;", nullptr, nullptr, nullptr) == SQLITE_OK;
+        sqlite3_close(dbHandle);
+        return readable;
+    }
+
+    std::ostream& EnvelopeBuilder::ErrorLog()
+    {
+        return &log_ == &std::cout ? std::cerr : log_;
     }
-}
 
+    void EnvelopeBuilder::LogSqliteError(const std::string& message, sqlite3* dbHandle)
+    {
+        ErrorLog() << "  ERROR: " << message << ": " << sqlite3_errmsg(dbHandle) << std::endl;
+    }
+}
@@ -6,31 +6,121 @@
 #include <unordered_map>
 #include <set>
 #include <map>
+#include <ostream>
 
 #include "sqlite3.h"
+#include "RunStats.h"
+#include "EnvelopeStore.h"
+#include "EnvelopeGroups.h"
+#include "ElementCatalog.h"
+#include "ElementFilter.h"
+#include "SqliteAccess.h"
+#include "TableDigest.h"
 
 namespace fs = std::filesystem;
 
 namespace Builder
 {
+    /**
+     * @enum EnvelopeEngine
+     * @brief How pass 2 reads the source tables.
+     */
+    enum class EnvelopeEngine
+    {
+        Loop, // Row-by-row loop in C++ over SELECT * of every table
+        Sql,  // Source files are attached to SQLite in batches and enveloped by a generated GROUP BY query
+        Auto  // From 16 files on: the first file is read by the loop, the second by SQL, the faster one (bytes/s) reads the rest; otherwise the loop.
+              // Both engines give the same values (absmax ties keep the positive value in both), so the timing only changes the speed
+    };
+
+    /**
+     * @struct BuildOptions
+     * @brief Run settings of the builder that come from the command line or a job file.
+     */
+    struct BuildOptions
+    {
+        fs::path outputPath;          // Directory for Envelope.db / Envelope_Summed.db (empty = source directory)
+        fs::path reportPath;          // JSON timing report (empty = FEDOR_REPORT_JSON or none)
+        fs::path rulesPath;           // Rules of Envelope_Summed.db (empty = built-in shell sum rules)
+        fs::path groupsPath;          // Groups of files, tables or setN ranges with envelopes of their own (empty = none, see EnvelopeGroups.h)
+        bool trackProvenance = false; // Also write which file, table and setN produced every value ("Envelope Provenance")
+        EnvelopeBounds bounds = EnvelopeBounds::Max; // Bounds written next to every column (<column>_min, <column>_absmax)
+        std::vector<double> quantiles; // Percentiles of every column over all combinations, e.g. 50, 90, 95 ("Envelope Quantiles"; empty = none)
+        bool singlePrecision = false;  // Keep the in-memory values as float (half the memory); the output is still REAL
+        EnvelopeEngine engine = EnvelopeEngine::Auto; // Pass 2 engine; provenance, groups and quantiles always use the loop
+        bool immutableSources = false; // Source files are finalized: open them with immutable=1 (no locks, no change checks)
+        bool deduplicateTables = true; // Pass 2 (loop engine) skips tables whose rows are a verbatim copy of a table already enveloped in the run
+        int prefetchDepth = 1;        // Pass 2 loads this many files ahead of the current one into the OS file cache (0 = off)
+        int elementsMemoryMiB = 64;   // Memory for the pass-1 element records; past it they move to a temporary file
+        ElementFilter elementFilter;  // Envelope only these elements: ids and/or element types (inactive = all elements)
+        fs::path shardPath;           // Write a partial-envelope shard to this file instead of the output databases (empty = none, see Merge)
+        std::ostream* log = nullptr;  // Progress output (nullptr = std::cout)
+    };
+
+    /**
+     * @struct WatchOptions
+     * @brief Settings of the watch-folder mode, in which the builder follows a folder that is still being filled by the solver.
+     */
+    struct WatchOptions
+    {
+        double settleSeconds = 2.0;   // A new file must keep its size and time this long before it is read
+        double refreshSeconds = 10.0; // Minimum interval between refreshes of the output databases
+        double idleExitSeconds = 0.0; // Stop after this long without new files (0 = until interrupted)
+        int expectedFiles = 0;        // Stop once this many source files were enveloped (0 = no limit)
+    };
+
     /**
      * @class EnvelopeBuilder
      * @brief A utility to process a set of SQLite databases, verify their consistency,
      * and create a final "enveloped" database containing maximum values.
      * It can generate two types of output databases: one with standard enveloping
-     * and another with special handling for shell elements (elemType=2), where
-     * shear reinforcement values (Asw1, Asw2) are summed before enveloping.
+     * and another where envelope rules replace some columns. The built-in rules handle shell
+     * elements (elemType=2), where shear reinforcement values (Asw1, Asw2) are summed before enveloping;
+     * other rules can be loaded from a rules file (see EnvelopeRules.h).
      */
     class EnvelopeBuilder
     {
     public:
         EnvelopeBuilder();
+        /**
+         * @throws std::invalid_argument if the rules or groups file cannot be read or a rule writes a column that is not in the output table.
+         */
+        explicit EnvelopeBuilder(const BuildOptions& options);
         
         /**
-         * @brief Runs the main build process.
+         * @brief Runs the main build process, asking the user for the source directory.
          */
         void Run();
 
+        /**
+         * @brief Runs the main build process for the given directory without user interaction.
+         * @param targetPath The directory containing the source .db files.
+         * @return True if both output databases were built.
+         */
+        bool Run(const fs::path& targetPath);
+
+        /**
+         * @brief Watch-folder mode: envelopes the files already in the directory, then every new .db file
+         * as soon as it is closed by its writer and stable, and periodically replaces Envelope.db and
+         * Envelope_Summed.db with up-to-date versions. Stops on Ctrl+C or by the limits in watchOptions,
+         * writing the final databases before returning.
+         * @param targetPath The directory the solver writes its .db files to.
+         * @param watchOptions Stability, refresh and stop settings.
+         * @return True if the final databases were written and no file was rejected.
+         */
+        bool Watch(const fs::path& targetPath, const WatchOptions& watchOptions);
+
+        /**
+         * @brief Combines partial-envelope shards (written by Run with BuildOptions::shardPath, e.g. on several
+         * machines for parts of one source folder) into Envelope.db and Envelope_Summed.db without the sources.
+         * Rules, bounds, quantiles and provenance come from the shards and must be the same in all of them.
+         * The Elements tables of the shards are verified against each other as in pass 1. Ties keep the value
+         * of the earlier shard, so shards should be listed in the order of their source files.
+         * @param shardPaths The shard files.
+         * @return True if both output databases were built (into BuildOptions::outputPath, default: the folder of the first shard).
+         */
+        bool Merge(const std::vector<fs::path>& shardPaths);
+
     private:
         // Internal configuration constants
         struct Config
@@ -42,39 +132,223 @@ namespace Builder
             const std::string OUTPUT_DB_FILENAME = "Envelope.db";
             const std::string OUTPUT_DB_SUMMED_FILENAME = "Envelope_Summed.db";
             const std::string ENVELOPED_TABLE_NAME = "Enveloped Reinforcement";
+            const std::string PROVENANCE_TABLE_NAME = "Envelope Provenance";
+            const std::string PROVENANCE_FILES_TABLE_NAME = "Envelope Provenance Files";
+            const std::string PROVENANCE_TABLES_TABLE_NAME = "Envelope Provenance Tables";
+            const std::string QUANTILES_TABLE_NAME = "Envelope Quantiles";
+            // Tables of a shard file next to its Elements table (see WriteShard)
+            const std::string SHARD_FORMAT = "FEDOR envelope shard 2";
+            const std::string SHARD_INFO_TABLE_NAME = "Shard Info";
+            const std::string SHARD_COLUMNS_TABLE_NAME = "Shard Columns";
+            const std::string SHARD_VALUES_TABLE_NAME = "Shard Values";
+            const std::string SHARD_FILES_TABLE_NAME = "Shard Files";
+            const std::string SHARD_TABLES_TABLE_NAME = "Shard Tables";
+            // Columns of the output table, in output order; only columns with data are written
+            const std::vector<std::string> OUTPUT_COLUMNS = {
+                "As1Ti", "As1Tj", "As1Bi", "As1Bj", "As2Ti", "As2Tj", "As2Bi", "As2Bj",
+                "Asw1i", "Asw1j", "Asw2i", "Asw2j", "Reinf1", "Reinf2", "Crack1i", "Crack1j",
+                "Crack2i", "Crack2j", "Sw1i", "Sw1j", "Sw2i", "Sw2j", "ls1i", "ls1j", "ls2i", "ls2j"
+            };
         };
 
-        // Type aliases for clarity
-        using ElementProperties = std::unordered_map<std::string, std::string>;
-        using VerifiedElementsMap = std::unordered_map<long long, ElementProperties>;
-        using EnvelopedDataMap = std::unordered_map<long long, std::unordered_map<std::string, double>>;
-
         Config config_;
-        VerifiedElementsMap verifiedElements_; // Stores properties of unique elements
-        EnvelopedDataMap envelopedData_;       // Stores the enveloped (maximum) values
+        BuildOptions options_;
+        std::ostream& log_;                    // Progress output of this builder
+        RunStats stats_;                       // Timing and counters of the current run
+        ElementCatalog elements_;              // Verification records of unique elements (hash of properties, first file)
+        ElementFilter elementFilter_;          // Subset of the run; remembers the elements accepted by type in pass 1
+        EnvelopeStore store_;                  // Stores the enveloped values and the rules of the summed database
+        std::vector<EnvelopeGroup> groups_;    // Groups with envelopes of their own
+        std::vector<EnvelopeStore> groupStores_; // One store per group. Elements, columns and source names are added to all
+                                               // stores in the same order as to store_, so indices and slots are the same
+        bool allowLateElements_ = false;       // Watch mode: results may arrive before the Elements row of their element
+
+        /**
+         * @struct EnvelopedTable
+         * @brief A source table folded by the loop in this run, kept to recognize verbatim copies of it in later files.
+         */
+        struct EnvelopedTable
+        {
+            fs::path filePath;
+            std::string tableName;
+            std::vector<int> groups;    // Groups the rows were folded into (a copy must fold into the same ones)
+            TableDigest sample;         // SampleTableDigest: finds the candidates
+            TableDigest content;        // ContentTableDigest: confirms a copy; computed when first needed
+            bool hasContent = false;
+        };
+        std::vector<EnvelopedTable> envelopedTables_;
+        ConnectionCache connections_;          // Source files stay open between pass 1 and pass 2
 
         // --- Main Build Stages ---
 
         /**
-         * @brief PASS 1: Iterates through all .db files to collect and verify element properties.
-         * @param targetPath The directory containing the source .db files.
+         * @brief PASS 1: Iterates through all .db files and Elements exports (*_Elements.csv) to collect and verify
+         * element properties. CSV files that are not taken as sources are reported with the reason.
+         * @param targetPath The directory containing the source .db and .csv files.
          * @return True if verification is successful, false otherwise.
+         * @throws std::runtime_error if an element differs between files, or if no Elements source or no element was found.
          */
         bool CollectAndVerifyElements(const fs::path& targetPath);
 
         /**
-         * @brief PASS 2: Iterates through all .db files to find the maximum (enveloped) values for all numeric columns.
-         * For shell elements, it also calculates and envelops the sum of shear reinforcement.
-         * @param targetPath The directory containing the source .db files.
+         * @brief PASS 2: Iterates through all .db files and result exports (.csv) to find the maximum (enveloped) values for all numeric columns.
+         * It also envelops the values of the rules that apply to each element type.
+         * @param targetPath The directory containing the source .db and .csv files.
          */
         void EnvelopeDataInMemory(const fs::path& targetPath);
 
+        /**
+         * @brief Merges the Elements table of one file into the verified elements.
+         * @param dbPath The source database.
+         * @return False if the file could not be opened or has no Elements table with elemId.
+         * @throws std::runtime_error if an element differs from an already verified one; nothing from the file is merged then.
+         */
+        bool VerifyElementsFile(const fs::path& dbPath);
+
+        /**
+         * @brief Merges an Elements export (*_Elements.csv) into the verified elements, like VerifyElementsFile.
+         * @param csvPath The source CSV file.
+         * @return False if the file cannot be read or has no elemId column.
+         * @throws std::runtime_error if an element differs from an already verified one; nothing from the file is merged then.
+         */
+        bool VerifyElementsCsvFile(const fs::path& csvPath);
+
+        /**
+         * @brief The verification loop over the rows of one Elements table, shared by the SQLite and the CSV sources.
+         * Ends the file statistics.
+         * @param rows Row source with Next(), Int64(column) and Text(column).
+         * @param colNames The column names of the rows.
+         * @param sourcePath The source file (owner of the elements it adds first).
+         * @param fileStats The statistics of the file, begun by the caller.
+         * @param dbHandle The source database for the statistics, nullptr for a CSV file.
+         * @return False if the table has no elemId column.
+         * @throws std::runtime_error if an element differs from an already verified one; nothing from the file is merged then.
+         */
+        template <typename RowReader>
+        bool VerifyElementRows(RowReader& rows, const std::vector<std::string>& colNames, const fs::path& sourcePath, RunStats::FileStats& fileStats, sqlite3* dbHandle);
+
+        /**
+         * @brief Folds all result tables of one file into the enveloped values. A table whose rows are a verbatim
+         * copy of a table already folded in this run is skipped (BuildOptions::deduplicateTables): it cannot change
+         * a value or its first source.
+         * @param dbPath The source database.
+         */
+        void EnvelopeFile(const fs::path& dbPath);
+
+        /**
+         * @return The groups whose file and table patterns match a source table (setN ranges are checked per row).
+         */
+        std::vector<int> TableGroups(const std::string& fileName, const std::string& tableName) const;
+
+        /**
+         * @brief Looks for a table already enveloped in this run with the same rows as a source table. Only if the
+         * fingerprint and the groups of an enveloped table match, the records of both tables are hashed to confirm
+         * (ContentTableDigest reads the pages of the files, not the rows).
+         * @param connection The open source database.
+         * @param table The table with its fingerprint and groups.
+         * @return The enveloped original, or nullptr if the table has to be enveloped.
+         */
+        const EnvelopedTable* FindEnvelopedCopy(SqliteConnection& connection, const EnvelopedTable& table);
+
+        /**
+         * @brief Adds the file and table names to the provenance dictionaries of all stores, so the ids do not
+         * depend on whether the table was read.
+         */
+        void AddSourceNames(const std::string& fileName, const std::string& tableName);
+
+        /**
+         * @brief Folds a result export ("Prefix_Table.csv", the table is the part after the last '_') into the
+         * enveloped values, streaming it through the same row loop as EnvelopeFile. Elements exports are read in
+         * pass 1 and are not passed here.
+         * @param csvPath The source CSV file.
+         */
+        void EnvelopeCsvFile(const fs::path& csvPath);
+
+        /**
+         * @brief The envelope loop over the rows of one result table, shared by the SQLite and the CSV sources:
+         * folds every numeric column and the rules into store_ and the stores of the matching groups.
+         * @param rows Row source with Next(), Numeric(column), Double(column) and Int64(column).
+         * @param colNames The column names of the rows.
+         * @param fileName The source file name (provenance and group matching).
+         * @param tableName The table name (provenance and group matching).
+         * @return The number of rows read, or -1 if the table has no elemId column.
+         */
+        template <typename RowReader>
+        long long EnvelopeRows(RowReader& rows, const std::vector<std::string>& colNames, const std::string& fileName, const std::string& tableName);
+
+        /**
+         * @brief Folds the result tables of several files into the enveloped values inside SQLite: the files are
+         * attached in batches (up to the attach limit) and every batch is reduced by one
+         * SELECT elemId, MAX(col)..., MAX(rule expression)... FROM (... UNION ALL ...) GROUP BY elemId.
+         * Gives the same values as EnvelopeFile; cannot track provenance.
+         * @param files The source databases.
+         */
+        void EnvelopeFilesWithSql(const std::vector<fs::path>& files);
+
+        /**
+         * @brief Clears the global store and the stores of the groups.
+         */
+        void ClearStores();
+
+        /**
+         * @brief Adds an element that appeared in results before its Elements row to all stores.
+         * @return The element index.
+         */
+        int AddLateElement(long long elemId);
+
+        /**
+         * @brief Writes both output databases (standard and summed) into the output directory, and the databases
+         * of every group into its subfolder.
+         * @param outputPath The directory for the output databases.
+         */
+        void AssembleOutputs(const fs::path& outputPath);
+
+        /**
+         * @brief In single precision, logs the largest relative rounding error of the values folded so far.
+         */
+        void LogRoundingError();
+
+        /**
+         * @brief Writes the envelope as a partial-envelope shard: the verified Elements rows, the settings
+         * (Shard Info: format, rules, bounds, quantiles, provenance), the column dictionary including the hidden
+         * rule slots (Shard Columns), and per element and slot the value, its bounds, source and quantile sketch
+         * (Shard Values), with the source names of the provenance (Shard Files, Shard Tables).
+         * @param shardPath The shard file; written under a temporary name and renamed when complete.
+         */
+        void WriteShard(const fs::path& shardPath);
+
+        /**
+         * @brief Folds the values of one shard into store_ (after its Elements table was verified).
+         * @param shardPath The shard file.
+         */
+        void MergeShard(const fs::path& shardPath);
+
+        /**
+         * @return The settings a shard of this builder is written with (the rows of Shard Info).
+         */
+        std::map<std::string, std::string> ShardSettings() const;
+
+        /**
+         * @brief Reads the settings of a shard file.
+         * @throws std::runtime_error if the file cannot be read or is not a shard.
+         */
+        std::map<std::string, std::string> ReadShardSettings(const fs::path& shardPath);
+
+        /**
+         * @brief Creates the output Elements table and copies the rows of the verified elements into it from the
+         * files in which they were first seen. Must be called outside of a transaction.
+         * @param dbHandle The output database, opened with SQLITE_OPEN_URI.
+         * @throws std::runtime_error if a file cannot be attached or copied.
+         */
+        void WriteElementsTable(sqlite3* dbHandle);
+
         /**
          * @brief PASS 3: Assembles the final database from the in-memory data.
-         * @param targetPath The directory where the final database will be saved.
-         * @param createSummedVersion If true, creates the database with summed shear reinforcement for shells.
+         * @param targetPath The directory where the final database will be saved (already resolved from BuildOptions::outputPath).
+         * @param createSummedVersion If true, creates the database in which the rules replace their target and zero columns.
+         * @param store The envelope to write: store_ or the store of a group.
          */
-        void AssembleFinalDatabase(const fs::path& targetPath, bool createSummedVersion);
+        void AssembleFinalDatabase(const fs::path& targetPath, bool createSummedVersion, const EnvelopeStore& store);
 
         // --- Helper Methods ---
 
@@ -84,6 +358,34 @@ namespace Builder
          */
         fs::path GetTargetPathFromUser();
 
+        /**
+         * @brief Checks whether a path is a source .db file (not an output of the tools, see OutputFiles.h).
+         * @param path The file to check.
+         * @return True if the file should be read as a source database.
+         */
+        bool IsSourceDbFile(const fs::path& path) const;
+
+        /**
+         * @brief Checks whether a path is a result export (.csv, in any case) to be read with the .db sources: its header
+         * must start with setN;elemId;elemType (elemId;elemType for *_Elements.csv), and "Prefix_Table.csv" must
+         * not lie next to Prefix.db, whose tables are read already.
+         * @param path The file to check.
+         * @param skipReason Set to the reason if a .csv file is not taken (not set for other files); may be nullptr.
+         */
+        bool IsSourceCsvFile(const fs::path& path, std::string* skipReason = nullptr) const;
+
+        /**
+         * @brief Checks that a database is complete enough to be read: no rollback journal or WAL next to it
+         * and its schema can be read.
+         * @param dbPath The source database.
+         */
+        bool IsSourceDbReadable(const fs::path& dbPath) const;
+
+        /**
+         * @brief Stream for error messages: stderr for console runs, the job log when output is redirected.
+         */
+        std::ostream& ErrorLog();
+
         /**
          * @brief Logs a SQLite error message to stderr.
          * @param message A custom message to prepend to the error.
@@ -92,17 +394,57 @@ namespace Builder
         void LogSqliteError(const std::string& message, sqlite3* dbHandle);
 
         /**
-         * @brief Retrieves a list of all table names from a database.
-         * @param dbHandle The SQLite database handle.
-         * @return A vector of table names.
+         * @brief Writes an id -> name dictionary table (the ids used by the provenance table).
+         * @param dbHandle The output database.
+         * @param tableName The table to create.
+         * @param idColumn The name of the id column.
+         * @param names The names; the id of a name is its index.
+         * @return The SQLite error if the rows could not be written, empty on success.
+         */
+        std::string WriteNameTable(sqlite3* dbHandle, const std::string& tableName, const std::string& idColumn, const std::vector<std::string>& names);
+
+        /**
+         * @brief Writes the percentiles of the written columns (the "Envelope Quantiles" table): one row per element
+         * and column with the number of values and one column per requested percentile, e.g. p50, p90, p95.
+         * @param dbHandle The output database, inside the assembly transaction.
+         * @param store The envelope, with sketching on.
+         * @param headers The written columns.
+         * @param headerSlots The slot of every written column.
+         * @param typeActions Per element type and column: the rule slot that replaces the column (>= 0),
+         * -1 for the column itself or -2 for a zeroed column, which gets no row.
+         * @param elementOrder The element indices in ascending elemId order (the order of the rows).
+         * @param error Set to the SQLite error if the rows could not be written (kept if already set).
+         * @return The number of rows written.
+         */
+        long long WriteQuantileTable(sqlite3* dbHandle, const EnvelopeStore& store, const std::vector<int>& elementOrder, const std::vector<std::string>& headers,
+                                     const std::vector<int>& headerSlots, const std::vector<std::vector<int>>& typeActions, std::string& error);
+
+        /**
+         * @brief Copies the Elements rows of a source file that are not in the output yet (ATTACH + INSERT ... SELECT).
+         * Must be called outside of a transaction.
+         * @param dbHandle The output database, opened with SQLITE_OPEN_URI.
+         * @param sourcePath The source file.
+         * @param columns The columns of the output Elements table; columns missing in the source are NULL.
+         * @throws std::runtime_error if the file cannot be attached or copied.
+         */
+        void CopyElementsFrom(sqlite3* dbHandle, const fs::path& sourcePath, const std::vector<std::string>& columns);
+
+        /**
+         * @brief Copies the rows of an Elements export that are not in the output yet, in one transaction.
+         * Must be called outside of a transaction.
+         * @param dbHandle The output database.
+         * @param csvPath The source CSV file.
+         * @param columns The columns of the output Elements table; columns missing in the export and empty fields are NULL.
+         * @throws std::runtime_error if the file cannot be read or copied.
          */
-        std::vector<std::string> GetTableNames(sqlite3* dbHandle);
+        void CopyElementsFromCsv(sqlite3* dbHandle, const fs::path& csvPath, const std::vector<std::string>& columns);
 
         /**
          * @brief Collects all unique column headers from the enveloped data, excluding internal fields.
+         * @param store The envelope to look at.
          * @return A set of column names.
          */
-        std::set<std::string> CollectAllEnvelopedColumns();
+        std::set<std::string> CollectAllEnvelopedColumns(const EnvelopeStore& store);
     };
 }
 
@@ -1,7 +1,57 @@
 #include "EnvelopeAnalyzer.h" // Подключаем наш класс
+#include "CommandLine.h"
+#include "BatchJobs.h"
 #include <iostream>
 
-int main()
+// Опции командной строки анализатора
+static const std::set<std::string> kValueOptions = { "--mode", "--output", "--report", "--jobs", "--threads", "--top", "--prefetch", "--elements", "--elem-types" };
+static const std::set<std::string> kFlagOptions = { "--help", "--immutable", "--float32", "--wide" };
+
+static void PrintUsage()
+{
+    std::cout << "Usage: FEDOR_Analyzer [<folder>] [options]\n"
+              << "       FEDOR_Analyzer --jobs <job file> [options]\n"
+              << "  <folder>           Directory with source .db files (default: current directory)\n"
+              << "  --mode <mode>      memory | disk (default: " << (EnvelopeAnalyzer::DefaultMode() == EnvelopeAnalyzer::Mode::OnDisk ? "disk" : "memory") << ")\n"
+              << "  --output <dir>     Directory for the analysis results (default: <folder>)\n"
+              << "  --report <file>    Write a JSON timing report\n"
+              << "  --top N            Keep the N governing combinations per element and column (1..255, default: 1)\n"
+              << "  --float32          Keep the values in single precision (less memory); reports the largest rounding error\n"
+              << "  --wide             One row per element: value, source id and setN per column, plus a source dictionary\n"
+              << "  --immutable        Source files are final and not written by anyone: read them without locks\n"
+              << "  --elements <ids>   Only these elements: ids and ranges (e.g. 1-500,731) or a file of ids (.txt, or .csv: first column)\n"
+              << "  --elem-types <list> Only elements of these elemType values, e.g. 2 or 1,2 (with --elements: both must match)\n"
+              << "  --prefetch N       Load N files ahead of the one being analyzed into the OS file cache (default: 1, 0 = off)\n"
+              << "  --jobs <file>      Run one analysis per line of the job file (folder and options per line)\n"
+              << "  --threads N        Number of jobs run at the same time (default: 1)\n"
+              << "Without arguments the analyzer asks for the folder interactively.\n";
+}
+
+/// <summary>
+/// Переводит аргументы командной строки в настройки анализатора.
+/// </summary>
+static EnvelopeAnalyzer::Options OptionsFromArgs(const CommandLine& args)
+{
+    EnvelopeAnalyzer::Options options;
+    std::string mode = args.Get("--mode");
+    if (mode == "memory") options.mode = EnvelopeAnalyzer::Mode::InMemory;
+    else if (mode == "disk") options.mode = EnvelopeAnalyzer::Mode::OnDisk;
+    else if (!mode.empty()) throw std::invalid_argument("Unknown mode '" + mode + "' (expected memory or disk)");
+    options.outputPath = args.Get("--output");
+    options.reportPath = args.Get("--report");
+    options.topK = args.GetInt("--top", 1);
+    if (options.topK < 1 || options.topK > 255) throw std::invalid_argument("--top must be between 1 and 255");
+    options.wideOutput = args.Has("--wide");
+    options.immutableSources = args.Has("--immutable");
+    options.singlePrecision = args.Has("--float32");
+    options.prefetchDepth = args.GetInt("--prefetch", 1);
+    if (options.prefetchDepth < 0) throw std::invalid_argument("--prefetch must not be negative");
+    if (args.Has("--elements")) options.elementFilter.AddIds(args.Get("--elements"));
+    if (args.Has("--elem-types")) options.elementFilter.AddTypes(args.Get("--elem-types"));
+    return options;
+}
+
+int main(int argc, char* argv[])
 {
     // Устанавливаем кодировку консоли для корректного отображения вывода
 #ifdef _WIN32
@@ -11,10 +61,45 @@ int main()
 
     try
     {
-        // Создаем экземпляр нашего анализатора
-        EnvelopeAnalyzer analyzer;
-        // Запускаем его
-        analyzer.Run();
+        CommandLine args(argc, argv, kValueOptions, kFlagOptions);
+
+        // Без аргументов - прежний интерактивный режим
+        if (args.Empty())
+        {
+            EnvelopeAnalyzer analyzer;
+            analyzer.Run();
+            return 0;
+        }
+        if (args.Has("--help"))
+        {
+            PrintUsage();
+            return 0;
+        }
+
+        if (args.Has("--jobs"))
+        {
+            std::vector<CommandLine> jobs = ReadJobFile(args.Get("--jobs"), kValueOptions, kFlagOptions);
+            ThreadPool pool(static_cast<unsigned>(std::max(1, args.GetInt("--threads", 1))));
+            int failed = RunJobs(jobs, pool, [&](const CommandLine& job, size_t jobIndex, std::ostream& log)
+            {
+                CommandLine jobArgs = args.MergedWith(job);
+                EnvelopeAnalyzer::Options options = OptionsFromArgs(jobArgs);
+                if (!job.Has("--report")) options.reportPath = JobReportPath(options.reportPath, jobIndex);
+                options.log = &log;
+                EnvelopeAnalyzer analyzer(options);
+                return analyzer.Run(FolderArgument(jobArgs));
+            });
+            return failed == 0 ? 0 : 1;
+        }
+
+        EnvelopeAnalyzer analyzer(OptionsFromArgs(args));
+        return analyzer.Run(FolderArgument(args)) ? 0 : 1;
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        PrintUsage();
+        return 2;
     }
     catch (const std::exception& e)
     {
@@ -22,7 +107,4 @@ int main()
         std::cerr << "An unexpected critical error occurred: " << e.what() << std::endl;
         return 1;
     }
-    
-    return 0;
 }
-